@@ -18,10 +18,14 @@
 #include <mousepad/mousepad-settings.h>
 #include <mousepad/mousepad-application.h>
 #include <mousepad/mousepad-document.h>
+#include <mousepad/mousepad-journal.h>
+#include <mousepad/mousepad-cache.h>
 #include <mousepad/mousepad-prefs-dialog.h>
 #include <mousepad/mousepad-replace-dialog.h>
+#include <mousepad/mousepad-undo-manager.h>
 #include <mousepad/mousepad-window.h>
 #include <mousepad/mousepad-util.h>
+#include <mousepad/mousepad-watch.h>
 
 #include <xfconf/xfconf.h>
 
@@ -49,6 +53,9 @@ static void        mousepad_application_open                      (GApplication
                                                                    gint                      n_files,
                                                                    const gchar              *hint);
 static void        mousepad_application_shutdown                  (GApplication             *gapplication);
+static void        mousepad_application_open_ready                (GObject                  *object,
+                                                                   GAsyncResult             *result,
+                                                                   gpointer                  data);
 
 /* MousepadApplication own functions */
 static gboolean    mousepad_application_parse_encoding            (const gchar              *option_name,
@@ -68,6 +75,9 @@ static void        mousepad_application_set_shared_menu_parts     (MousepadAppli
                                                                    GMenuModel               *model);
 static void        mousepad_application_create_languages_menu     (MousepadApplication      *application);
 static void        mousepad_application_create_style_schemes_menu (MousepadApplication      *application);
+static void        mousepad_application_quit_ready                (GObject                  *object,
+                                                                   GAsyncResult             *result,
+                                                                   gpointer                  data);
 static void        mousepad_application_action_quit               (GSimpleAction            *action,
                                                                    GVariant                 *value,
                                                                    gpointer                  data);
@@ -83,6 +93,10 @@ static void        mousepad_application_action_update             (MousepadAppli
 static void        mousepad_application_action_whitespace         (GSimpleAction            *action,
                                                                    GVariant                 *state,
                                                                    gpointer                  data);
+static gchar      *mousepad_application_get_file_id               (GFile                    *file);
+static void        mousepad_application_location_changed          (MousepadFile             *file,
+                                                                   GFile                    *location,
+                                                                   MousepadDocument         *document);
 
 
 
@@ -102,6 +116,12 @@ struct _MousepadApplication
   /* command line options */
   gint             opening_mode;
   MousepadEncoding encoding;
+
+  /* opened files, by identity and uri */
+  GHashTable      *documents;
+
+  /* journals left by a previous session, to recover at the first command line */
+  gchar          **journals;
 };
 
 /* MousepadApplication properties */
@@ -314,11 +334,19 @@ mousepad_application_init (MousepadApplication *application)
   /* initialize mousepad settings */
   mousepad_settings_init ();
 
+  /* initialize the file watch service */
+  mousepad_watch_init ();
+
+  /* initialize the journals of unsaved changes */
+  mousepad_journal_init ();
+
   /* initialize application attributes */
   application->prefs_dialog = NULL;
   application->space_location_flags = GTK_SOURCE_SPACE_LOCATION_ALL;
   application->opening_mode = TAB;
   application->encoding = mousepad_encoding_get_default ();
+  application->documents = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  application->journals = NULL;
 
   /* default application name */
   g_set_application_name (_("Mousepad"));
@@ -626,6 +654,9 @@ mousepad_application_startup (GApplication *gapplication)
   /* chain up to parent */
   G_APPLICATION_CLASS (mousepad_application_parent_class)->startup (gapplication);
 
+  /* start persisting the undo histories, after cleaning up the old ones */
+  mousepad_undo_manager_history_init ();
+
   /* add application actions */
   g_action_map_add_action_entries (G_ACTION_MAP (application), stateless_actions,
                                    N_STATELESS, application);
@@ -681,6 +712,9 @@ mousepad_application_startup (GApplication *gapplication)
   /* do some actions when the active window changes */
   g_signal_connect (application, "notify::active-window",
                     G_CALLBACK (mousepad_application_active_window_changed), NULL);
+
+  /* look for unsaved changes left by a previous session, before this one records any */
+  application->journals = mousepad_journal_find_orphans ();
 }
 
 
@@ -690,6 +724,7 @@ mousepad_application_command_line (GApplication            *gapplication,
                                    GApplicationCommandLine *command_line)
 {
   MousepadApplication  *application = MOUSEPAD_APPLICATION (gapplication);
+  GtkWindow            *window;
   GVariantDict         *options;
   GError               *error = NULL;
   GPtrArray            *files;
@@ -761,6 +796,17 @@ mousepad_application_command_line (GApplication            *gapplication,
   else
     mousepad_application_activate (gapplication);
 
+  /* offer to recover the unsaved changes of a previous session which ended abnormally */
+  if (application->journals != NULL)
+    {
+      window = gtk_application_get_active_window (GTK_APPLICATION (application));
+      if (window != NULL && application->journals[0] != NULL)
+        mousepad_window_recover (MOUSEPAD_WINDOW (window), application->journals);
+
+      g_strfreev (application->journals);
+      application->journals = NULL;
+    }
+
   /* cleanup */
   g_free (filenames);
 
@@ -804,6 +850,24 @@ mousepad_application_activate (GApplication *gapplication)
 
 
 
+static void
+mousepad_application_open_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  GtkWidget *window = GTK_WIDGET (object);
+  gint       opened;
+
+  /* if at least one file was finally opened, show the window, unless it was closed */
+  opened = mousepad_window_open_files_finish (MOUSEPAD_WINDOW (window), result);
+  if (opened > 0)
+    gtk_widget_show (window);
+  else if (opened == 0)
+    gtk_widget_destroy (window);
+}
+
+
+
 static void
 mousepad_application_open (GApplication  *gapplication,
                            GFile        **files,
@@ -814,7 +878,7 @@ mousepad_application_open (GApplication  *gapplication,
   GtkWidget           *window;
   GFile               *valid_files[n_files];
   gchar               *uri;
-  gint                 n, valid = 0, opened = 0;
+  gint                 n, valid = 0;
 
   /* URIs may be invalid when entered by the user */
   for (n = 0; n < n_files; n++)
@@ -836,15 +900,10 @@ mousepad_application_open (GApplication  *gapplication,
           /* get the window to open the files */
           window = mousepad_application_get_window_for_files (application);
 
-          /* open the files */
-          opened = mousepad_window_open_files (MOUSEPAD_WINDOW (window), valid_files, valid,
-                                               application->encoding, FALSE);
-
-          /* if at least one file was finally opened, show the window */
-          if (opened > 0)
-            gtk_widget_show (window);
-          else if (GTK_IS_WIDGET (window))
-            gtk_widget_destroy (window);
+          /* open the files, the window is shown once they are */
+          mousepad_window_open_files (MOUSEPAD_WINDOW (window), valid_files, valid,
+                                      application->encoding, FALSE,
+                                      mousepad_application_open_ready, NULL);
         }
       /* open the files in windows */
       else
@@ -854,15 +913,10 @@ mousepad_application_open (GApplication  *gapplication,
               /* create a new window (signals added and already hooked up) */
               window = mousepad_application_create_window (application);
 
-              /* open the file */
-              opened = mousepad_window_open_files (MOUSEPAD_WINDOW (window), valid_files + n, 1,
-                                                   application->encoding, FALSE);
-
-              /* if the file was finally opened, show the window */
-              if (opened > 0)
-                gtk_widget_show (window);
-              else if (GTK_IS_WIDGET (window))
-                gtk_widget_destroy (window);
+              /* open the file, the window is shown once it is */
+              mousepad_window_open_files (MOUSEPAD_WINDOW (window), valid_files + n, 1,
+                                          application->encoding, FALSE,
+                                          mousepad_application_open_ready, NULL);
             }
         }
     }
@@ -901,6 +955,23 @@ mousepad_application_shutdown (GApplication *gapplication)
 
   g_list_free (windows);
 
+  /* all the documents should be unregistered at this point */
+  g_hash_table_destroy (application->documents);
+  application->documents = NULL;
+
+  /* finalize the file watch service */
+  mousepad_watch_finalize ();
+
+  /* wait for the journals to be updated */
+  mousepad_journal_finalize ();
+  g_strfreev (application->journals);
+
+  /* wait for the undo histories to be persisted */
+  mousepad_undo_manager_history_finalize ();
+
+  /* release the contents of the recently read files */
+  mousepad_cache_clear ();
+
   /* finalize mousepad settings */
   mousepad_settings_finalize ();
 
@@ -1065,6 +1136,156 @@ mousepad_application_show_preferences (MousepadApplication *application,
 
 
 
+/* the identity of a file which is shared by all its paths (symlinks, hard links, ...),
+ * or NULL if it doesn't exist or isn't local: querying a remote file would block */
+static gchar *
+mousepad_application_get_file_id (GFile *file)
+{
+  GFileInfo *info;
+  gchar     *id = NULL;
+
+  if (! g_file_is_native (file))
+    return NULL;
+
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_ID_FILE, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  if (info != NULL)
+    {
+      id = g_strdup (g_file_info_get_attribute_string (info, G_FILE_ATTRIBUTE_ID_FILE));
+      g_object_unref (info);
+    }
+
+  return id;
+}
+
+
+
+static void
+mousepad_application_location_changed (MousepadFile     *file,
+                                       GFile            *location,
+                                       MousepadDocument *document)
+{
+  MousepadApplication *application = MOUSEPAD_APPLICATION (g_application_get_default ());
+
+  /* index the document under its new location */
+  mousepad_application_add_document (application, document);
+}
+
+
+
+void
+mousepad_application_add_document (MousepadApplication *application,
+                                   MousepadDocument    *document)
+{
+  GFile  *location;
+  gchar **keys;
+
+  g_return_if_fail (MOUSEPAD_IS_APPLICATION (application));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* drop the previous keys, if any */
+  mousepad_application_remove_document (application, document);
+
+  /* keep the index up to date when the document is saved under another name */
+  g_signal_connect (document->file, "location-changed",
+                    G_CALLBACK (mousepad_application_location_changed), document);
+
+  /* nothing to index for an untitled document */
+  location = mousepad_file_get_location (document->file);
+  if (location == NULL || application->documents == NULL)
+    return;
+
+  /* index the document by its uri, and by its identity when there is one */
+  keys = g_new0 (gchar *, 3);
+  keys[0] = g_file_get_uri (location);
+  keys[1] = mousepad_application_get_file_id (location);
+
+  g_hash_table_replace (application->documents, g_strdup (keys[0]), document);
+  if (keys[1] != NULL)
+    g_hash_table_replace (application->documents, g_strdup (keys[1]), document);
+
+  mousepad_object_set_data_full (document, "application-keys", keys, g_strfreev);
+}
+
+
+
+void
+mousepad_application_remove_document (MousepadApplication *application,
+                                      MousepadDocument    *document)
+{
+  gchar **keys, **key;
+
+  g_return_if_fail (MOUSEPAD_IS_APPLICATION (application));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  mousepad_disconnect_by_func (document->file, mousepad_application_location_changed, document);
+
+  keys = mousepad_object_get_data (document, "application-keys");
+  if (keys == NULL)
+    return;
+
+  /* the keys may have been taken over by another document in the meantime */
+  for (key = keys; *key != NULL && application->documents != NULL; key++)
+    if (g_hash_table_lookup (application->documents, *key) == document)
+      g_hash_table_remove (application->documents, *key);
+
+  mousepad_object_set_data (document, "application-keys", NULL);
+}
+
+
+
+MousepadDocument *
+mousepad_application_lookup_document (MousepadApplication *application,
+                                      GFile               *file)
+{
+  MousepadDocument *document;
+  GFile            *location;
+  gchar            *key, *id;
+
+  g_return_val_if_fail (MOUSEPAD_IS_APPLICATION (application), NULL);
+  g_return_val_if_fail (G_IS_FILE (file), NULL);
+
+  if (application->documents == NULL || g_hash_table_size (application->documents) == 0)
+    return NULL;
+
+  /* look for the uri first, which doesn't require to query the file */
+  key = g_file_get_uri (file);
+  document = g_hash_table_lookup (application->documents, key);
+  g_free (key);
+
+  /* fall back on the file identity, to match the other paths of the same file */
+  if (document == NULL)
+    {
+      key = mousepad_application_get_file_id (file);
+      if (key != NULL)
+        {
+          document = g_hash_table_lookup (application->documents, key);
+
+          /* the identity may have been given to another file since the document was indexed,
+           * e.g. an inode number reused after its file was deleted */
+          if (document != NULL)
+            {
+              location = mousepad_file_get_location (document->file);
+              if (location == NULL)
+                document = NULL;
+              else if (! g_file_equal (location, file))
+                {
+                  id = mousepad_application_get_file_id (location);
+                  if (g_strcmp0 (id, key) != 0)
+                    document = NULL;
+
+                  g_free (id);
+                }
+            }
+
+          g_free (key);
+        }
+    }
+
+  return document;
+}
+
+
+
 static void
 mousepad_application_update_menu (GMenuModel *shared_menu,
                                   gint        position,
@@ -1305,29 +1526,51 @@ mousepad_application_create_style_schemes_menu (MousepadApplication *application
 
 
 static void
-mousepad_application_action_quit (GSimpleAction *action,
-                                  GVariant      *value,
-                                  gpointer       data)
+mousepad_application_quit_next (GList *windows)
 {
-  GList    *windows, *window;
-  GAction  *close_action;
-  GVariant *v_succeed;
-  gboolean  succeed;
+  GtkWindow *window;
 
-  /* try to close all windows, abort at the first failure */
-  windows = g_list_copy (gtk_application_get_windows (GTK_APPLICATION (data)));
-  for (window = windows; window != NULL; window = window->next)
+  /* skip the windows closed in the meantime */
+  while (windows != NULL && gtk_window_get_application (windows->data) == NULL)
     {
-      close_action = g_action_map_lookup_action (G_ACTION_MAP (window->data), "file.close-window");
-      g_action_activate (close_action, NULL);
-      v_succeed = g_action_get_state (close_action);
-      succeed = g_variant_get_int32 (v_succeed);
-      g_variant_unref (v_succeed);
-      if (! succeed)
-        break;
+      g_object_unref (windows->data);
+      windows = g_list_delete_link (windows, windows);
     }
 
-  g_list_free (windows);
+  if (windows == NULL)
+    return;
+
+  /* close the next window, the following ones being closed once it is */
+  window = windows->data;
+  windows = g_list_delete_link (windows, windows);
+  mousepad_window_close (MOUSEPAD_WINDOW (window), mousepad_application_quit_ready, windows);
+  g_object_unref (window);
+}
+
+
+
+static void
+mousepad_application_quit_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  /* abort at the first failure */
+  if (mousepad_window_close_finish (MOUSEPAD_WINDOW (object), result))
+    mousepad_application_quit_next (data);
+  else
+    g_list_free_full (data, g_object_unref);
+}
+
+
+
+static void
+mousepad_application_action_quit (GSimpleAction *action,
+                                  GVariant      *value,
+                                  gpointer       data)
+{
+  /* try to close all windows, one after the other */
+  mousepad_application_quit_next (g_list_copy_deep (gtk_application_get_windows (GTK_APPLICATION (data)),
+                                                    (GCopyFunc) g_object_ref, NULL));
 }
 
 
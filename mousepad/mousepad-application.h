@@ -17,7 +17,7 @@
 #ifndef __MOUSEPAD_APPLICATION_H__
 #define __MOUSEPAD_APPLICATION_H__
 
-#include <gtk/gtk.h>
+#include <mousepad/mousepad-document.h>
 
 G_BEGIN_DECLS
 
@@ -36,6 +36,15 @@ GType                mousepad_application_get_type                   (void) G_GN
 void                 mousepad_application_show_preferences           (MousepadApplication  *application,
                                                                       GtkWindow            *transient_for);
 
+void                 mousepad_application_add_document               (MousepadApplication  *application,
+                                                                      MousepadDocument     *document);
+
+void                 mousepad_application_remove_document            (MousepadApplication  *application,
+                                                                      MousepadDocument     *document);
+
+MousepadDocument    *mousepad_application_lookup_document            (MousepadApplication  *application,
+                                                                      GFile                *file);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_APPLICATION_H__ */
@@ -0,0 +1,282 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-cache.h>
+
+
+
+/*
+ * A small cache of the contents of the files recently read, raw (MOUSEPAD_ENCODING_NONE)
+ * or decoded to UTF-8, so that the encoding dialog and the retries after a failed loading
+ * do not read and convert the same file again and again. Entries are only valid for the
+ * etag and the size of the file they were read with, the etag alone possibly being made
+ * of a modification time with a coarse granularity, and are evicted in least recently used
+ * order, or when they have not been used for some time. The contents must be owned by the
+ * cache, not mapped from the file, which could be modified in place or truncated.
+ */
+#define MOUSEPAD_CACHE_MAX_ENTRIES 8
+#define MOUSEPAD_CACHE_MAX_SIZE    (256 * 1024 * 1024)
+#define MOUSEPAD_CACHE_TIMEOUT     60
+
+
+
+typedef struct
+{
+  GFile            *location;
+  gchar            *etag;
+  goffset           size;
+  MousepadEncoding  encoding;
+  GBytes           *bytes;
+  gint64            last_used;
+}
+MousepadCacheEntry;
+
+
+
+/* the entries, the most recently used first, the cache being used from the loading threads */
+static GQueue cache_entries = G_QUEUE_INIT;
+static gsize  cache_size = 0;
+static guint  cache_timer = 0;
+static GMutex cache_mutex;
+
+
+
+static void
+mousepad_cache_drop (GList *link)
+{
+  MousepadCacheEntry *entry = link->data;
+
+  g_queue_delete_link (&cache_entries, link);
+  cache_size -= g_bytes_get_size (entry->bytes);
+
+  g_bytes_unref (entry->bytes);
+  g_object_unref (entry->location);
+  g_free (entry->etag);
+  g_slice_free (MousepadCacheEntry, entry);
+}
+
+
+
+static GList *
+mousepad_cache_find (GFile            *location,
+                     const gchar      *etag,
+                     goffset           size,
+                     MousepadEncoding  encoding)
+{
+  MousepadCacheEntry *entry;
+  GList              *link;
+
+  for (link = cache_entries.head; link != NULL; link = link->next)
+    {
+      entry = link->data;
+      if (entry->encoding == encoding && entry->size == size && g_strcmp0 (entry->etag, etag) == 0
+          && g_file_equal (entry->location, location))
+        return link;
+    }
+
+  return NULL;
+}
+
+
+
+static gboolean
+mousepad_cache_expire (gpointer data)
+{
+  gint64   limit;
+  gboolean empty;
+
+  g_mutex_lock (&cache_mutex);
+
+  /* drop the entries not used for a while, the least recently used being last */
+  limit = g_get_monotonic_time () - MOUSEPAD_CACHE_TIMEOUT * G_USEC_PER_SEC;
+  while (cache_entries.tail != NULL
+         && ((MousepadCacheEntry *) cache_entries.tail->data)->last_used <= limit)
+    mousepad_cache_drop (cache_entries.tail);
+
+  /* stop checking until something is inserted again */
+  empty = g_queue_is_empty (&cache_entries);
+  if (empty)
+    cache_timer = 0;
+
+  g_mutex_unlock (&cache_mutex);
+
+  return ! empty;
+}
+
+
+
+/**
+ * mousepad_cache_lookup:
+ * @location : the location of the file.
+ * @etag     : the current etag of the file.
+ * @size     : the current size of the file, or -1 if it is unknown.
+ * @encoding : the encoding of the contents, %MOUSEPAD_ENCODING_NONE for the raw contents.
+ *
+ * Looks for the contents of @location read while it had @etag and @size, raw or decoded
+ * from @encoding to UTF-8. This is thread-safe.
+ *
+ * Return value: a new reference to the contents, or %NULL if they are not in the cache.
+ **/
+GBytes *
+mousepad_cache_lookup (GFile            *location,
+                       const gchar      *etag,
+                       goffset           size,
+                       MousepadEncoding  encoding)
+{
+  MousepadCacheEntry *entry;
+  GList              *link;
+  GBytes             *bytes = NULL;
+
+  g_return_val_if_fail (G_IS_FILE (location), NULL);
+
+  /* the contents can't be validated without an etag and a size */
+  if (etag == NULL || size < 0)
+    return NULL;
+
+  g_mutex_lock (&cache_mutex);
+
+  link = mousepad_cache_find (location, etag, size, encoding);
+  if (link != NULL)
+    {
+      /* this is now the most recently used entry */
+      entry = link->data;
+      entry->last_used = g_get_monotonic_time ();
+      g_queue_unlink (&cache_entries, link);
+      g_queue_push_head_link (&cache_entries, link);
+
+      bytes = g_bytes_ref (entry->bytes);
+    }
+
+  g_mutex_unlock (&cache_mutex);
+
+  return bytes;
+}
+
+
+
+/**
+ * mousepad_cache_insert:
+ * @location : the location of the file.
+ * @etag     : the etag of the file when @bytes were read.
+ * @size     : the size of the file when @bytes were read, or -1 if it is unknown.
+ * @encoding : the encoding of the contents, %MOUSEPAD_ENCODING_NONE for the raw contents.
+ * @bytes    : the contents, raw or decoded from @encoding to UTF-8, in memory owned by
+ *             @bytes and not mapped from the file.
+ *
+ * Stores the contents of @location, evicting the least recently used entries if the cache
+ * is full. Nothing is stored without an etag and a size, if the raw contents do not have
+ * that size, or if the contents are too large. This is thread-safe.
+ **/
+void
+mousepad_cache_insert (GFile            *location,
+                       const gchar      *etag,
+                       goffset           size,
+                       MousepadEncoding  encoding,
+                       GBytes           *bytes)
+{
+  MousepadCacheEntry *entry;
+  GList              *link;
+
+  g_return_if_fail (G_IS_FILE (location));
+  g_return_if_fail (bytes != NULL);
+
+  /* the file may have changed while it was read */
+  if (etag == NULL || size < 0 || g_bytes_get_size (bytes) > MOUSEPAD_CACHE_MAX_SIZE
+      || (encoding == MOUSEPAD_ENCODING_NONE && g_bytes_get_size (bytes) != (gsize) size))
+    return;
+
+  g_mutex_lock (&cache_mutex);
+
+  /* replace a previous entry for the same contents */
+  link = mousepad_cache_find (location, etag, size, encoding);
+  if (link != NULL)
+    mousepad_cache_drop (link);
+
+  entry = g_slice_new (MousepadCacheEntry);
+  entry->location = g_object_ref (location);
+  entry->etag = g_strdup (etag);
+  entry->size = size;
+  entry->encoding = encoding;
+  entry->bytes = g_bytes_ref (bytes);
+  entry->last_used = g_get_monotonic_time ();
+  g_queue_push_head (&cache_entries, entry);
+  cache_size += g_bytes_get_size (bytes);
+
+  /* evict the least recently used entries */
+  while (cache_entries.length > MOUSEPAD_CACHE_MAX_ENTRIES || cache_size > MOUSEPAD_CACHE_MAX_SIZE)
+    mousepad_cache_drop (cache_entries.tail);
+
+  /* expire the entries from the main loop */
+  if (cache_timer == 0)
+    cache_timer = g_timeout_add_seconds (MOUSEPAD_CACHE_TIMEOUT, mousepad_cache_expire, NULL);
+
+  g_mutex_unlock (&cache_mutex);
+}
+
+
+
+/**
+ * mousepad_cache_remove:
+ * @location : the location of a file.
+ *
+ * Drops all the contents of @location from the cache, e.g. because the file was saved
+ * and they are now outdated. This is thread-safe.
+ **/
+void
+mousepad_cache_remove (GFile *location)
+{
+  MousepadCacheEntry *entry;
+  GList              *link, *next;
+
+  g_return_if_fail (G_IS_FILE (location));
+
+  g_mutex_lock (&cache_mutex);
+
+  for (link = cache_entries.head; link != NULL; link = next)
+    {
+      next = link->next;
+      entry = link->data;
+      if (g_file_equal (entry->location, location))
+        mousepad_cache_drop (link);
+    }
+
+  g_mutex_unlock (&cache_mutex);
+}
+
+
+
+/**
+ * mousepad_cache_clear:
+ *
+ * Drops all the contents from the cache, to be called from the main thread.
+ **/
+void
+mousepad_cache_clear (void)
+{
+  g_mutex_lock (&cache_mutex);
+
+  while (cache_entries.head != NULL)
+    mousepad_cache_drop (cache_entries.head);
+
+  if (cache_timer != 0)
+    {
+      g_source_remove (cache_timer);
+      cache_timer = 0;
+    }
+
+  g_mutex_unlock (&cache_mutex);
+}
@@ -0,0 +1,43 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_CACHE_H__
+#define __MOUSEPAD_CACHE_H__
+
+#include <mousepad/mousepad-encoding.h>
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+GBytes *mousepad_cache_lookup (GFile            *location,
+                               const gchar      *etag,
+                               goffset           size,
+                               MousepadEncoding  encoding);
+
+void    mousepad_cache_insert (GFile            *location,
+                               const gchar      *etag,
+                               goffset           size,
+                               MousepadEncoding  encoding,
+                               GBytes           *bytes);
+
+void    mousepad_cache_remove (GFile            *location);
+
+void    mousepad_cache_clear  (void);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_CACHE_H__ */
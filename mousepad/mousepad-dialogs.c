@@ -105,6 +105,31 @@ mousepad_dialogs_show_error (GtkWindow    *parent,
 
 
 
+/* one dialog for the files which could not be opened at once, @details listing them
+ * with their error */
+void
+mousepad_dialogs_show_errors (GtkWindow   *parent,
+                              const gchar *details,
+                              gint         n_files)
+{
+  GtkWidget *dialog;
+
+  /* create the warning dialog */
+  dialog = gtk_message_dialog_new (parent, GTK_DIALOG_MODAL, GTK_MESSAGE_ERROR, GTK_BUTTONS_CLOSE,
+                                   ngettext ("%d file could not be opened",
+                                             "%d files could not be opened", n_files), n_files);
+  mousepad_dialogs_destroy_with_parent (dialog, parent);
+  gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", details);
+
+  /* display the dialog */
+  gtk_dialog_run (GTK_DIALOG (dialog));
+
+  /* cleanup */
+  gtk_widget_destroy (dialog);
+}
+
+
+
 void
 mousepad_dialogs_show_help (GtkWindow   *parent,
                             const gchar *page,
@@ -306,6 +331,70 @@ mousepad_dialogs_go_to (GtkWindow     *parent,
 
 
 
+/* a simpler version of mousepad_dialogs_go_to() for the files viewed page by page, which
+ * are not in a buffer: @line is the line of the cursor in the file, starting from 0, and
+ * @n_lines the number of lines of the file, or -1 if it is not yet known */
+gboolean
+mousepad_dialogs_go_to_line (GtkWindow *parent,
+                             guint64   *line,
+                             gint64     n_lines)
+{
+  GtkWidget *dialog;
+  GtkWidget *area, *hbox;
+  GtkWidget *button;
+  GtkWidget *label;
+  GtkWidget *line_spin;
+  gint       response;
+
+  /* build the dialog */
+  dialog = gtk_dialog_new_with_buttons (_("Go To"), parent, GTK_DIALOG_MODAL,
+                                        _("_Cancel"), MOUSEPAD_RESPONSE_CANCEL, NULL);
+  mousepad_dialogs_destroy_with_parent (dialog, parent);
+
+  /* add button */
+  button = mousepad_util_image_button ("go-jump", _("_Jump to"));
+  gtk_widget_set_can_default (button, TRUE);
+  gtk_dialog_add_action_widget (GTK_DIALOG (dialog), button, MOUSEPAD_RESPONSE_JUMP_TO);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_JUMP_TO);
+  gtk_window_set_resizable (GTK_WINDOW (dialog), FALSE);
+
+  /* line number box */
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 12);
+  area = gtk_dialog_get_content_area (GTK_DIALOG (dialog));
+  gtk_box_pack_start (GTK_BOX (area), hbox, TRUE, TRUE, 0);
+  gtk_container_set_border_width (GTK_CONTAINER (hbox), 6);
+  gtk_widget_show (hbox);
+
+  label = gtk_label_new_with_mnemonic (_("_Line number:"));
+  gtk_box_pack_start (GTK_BOX (hbox), label, TRUE, TRUE, 0);
+  gtk_label_set_xalign (GTK_LABEL (label), 0.0);
+  gtk_label_set_yalign (GTK_LABEL (label), 0.5);
+  gtk_widget_show (label);
+
+  /* the lines after the last one lead to the last one while it is unknown */
+  line_spin = gtk_spin_button_new_with_range (1, (n_lines > 0) ? n_lines : G_MAXINT64, 1);
+  gtk_entry_set_activates_default (GTK_ENTRY (line_spin), TRUE);
+  gtk_box_pack_start (GTK_BOX (hbox), line_spin, FALSE, FALSE, 0);
+  gtk_label_set_mnemonic_widget (GTK_LABEL (label), line_spin);
+  gtk_spin_button_set_snap_to_ticks (GTK_SPIN_BUTTON (line_spin), TRUE);
+  gtk_spin_button_set_digits (GTK_SPIN_BUTTON (line_spin), 0);
+  gtk_entry_set_width_chars (GTK_ENTRY (line_spin), 12);
+  gtk_spin_button_set_value (GTK_SPIN_BUTTON (line_spin), *line + 1);
+  gtk_widget_show (line_spin);
+
+  /* run the dialog */
+  response = gtk_dialog_run (GTK_DIALOG (dialog));
+  if (response == MOUSEPAD_RESPONSE_JUMP_TO)
+    *line = gtk_spin_button_get_value (GTK_SPIN_BUTTON (line_spin)) - 1;
+
+  /* destroy the dialog */
+  gtk_widget_destroy (dialog);
+
+  return (response == MOUSEPAD_RESPONSE_JUMP_TO);
+}
+
+
+
 gboolean
 mousepad_dialogs_clear_recent (GtkWindow *parent)
 {
@@ -555,6 +644,51 @@ mousepad_dialogs_revert (GtkWindow *parent)
 
 
 
+gint
+mousepad_dialogs_recover (GtkWindow *parent,
+                          guint      n_documents)
+{
+  GtkWidget *dialog;
+  GtkWidget *button;
+  gint       response;
+
+  /* setup the question dialog */
+  dialog = gtk_message_dialog_new (parent, GTK_DIALOG_MODAL,
+                                   GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
+                                   ngettext ("A document with unsaved changes was not closed properly. "
+                                             "Do you want to recover it?",
+                                             "%u documents with unsaved changes were not closed properly. "
+                                             "Do you want to recover them?", n_documents),
+                                   n_documents);
+  mousepad_dialogs_destroy_with_parent (dialog, parent);
+
+  /* set title and subtitle */
+  gtk_window_set_title (GTK_WINDOW (dialog), _("Recover Documents"));
+  gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog),
+                                   _("If you discard the changes, they will be lost. If you cancel, "
+                                     "you will be asked again the next time."));
+
+  /* add buttons */
+  gtk_dialog_add_buttons (GTK_DIALOG (dialog), _("_Cancel"), MOUSEPAD_RESPONSE_CANCEL, NULL);
+
+  button = mousepad_util_image_button ("edit-delete", _("_Discard"));
+  gtk_dialog_add_action_widget (GTK_DIALOG (dialog), button, MOUSEPAD_RESPONSE_CLEAR);
+
+  button = mousepad_util_image_button ("document-revert", _("_Recover"));
+  gtk_dialog_add_action_widget (GTK_DIALOG (dialog), button, MOUSEPAD_RESPONSE_RECOVER);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_RECOVER);
+
+  /* run the dialog */
+  response = gtk_dialog_run (GTK_DIALOG (dialog));
+
+  /* destroy the dialog */
+  gtk_widget_destroy (dialog);
+
+  return response;
+}
+
+
+
 gint
 mousepad_dialogs_confirm_encoding (const gchar *charset,
                                    const gchar *user_charset)
@@ -589,6 +723,42 @@ mousepad_dialogs_confirm_encoding (const gchar *charset,
 
 
 
+gint
+mousepad_dialogs_encoding_failures (GtkWindow   *parent,
+                                    const gchar *charset,
+                                    const gchar *filenames,
+                                    gint         n_files)
+{
+  GtkWidget *dialog;
+  gint       response;
+
+  /* setup the question dialog */
+  dialog = gtk_message_dialog_new (parent, GTK_DIALOG_MODAL,
+                                   GTK_MESSAGE_QUESTION, GTK_BUTTONS_NONE,
+                                   ngettext ("%d file could not be opened with the %s encoding",
+                                             "%d files could not be opened with the %s encoding",
+                                             n_files), n_files, charset);
+  mousepad_dialogs_destroy_with_parent (dialog, parent);
+
+  /* set subtitle */
+  gtk_message_dialog_format_secondary_text (GTK_MESSAGE_DIALOG (dialog), "%s", filenames);
+
+  /* add buttons */
+  gtk_dialog_add_buttons (GTK_DIALOG (dialog), _("_Skip"), MOUSEPAD_RESPONSE_CANCEL,
+                          _("Choose _Encoding"), MOUSEPAD_RESPONSE_OK, NULL);
+  gtk_dialog_set_default_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_OK);
+
+  /* run the dialog */
+  response = gtk_dialog_run (GTK_DIALOG (dialog));
+
+  /* destroy the dialog */
+  gtk_widget_destroy (dialog);
+
+  return response;
+}
+
+
+
 static gboolean
 mousepad_dialogs_combo_insert_separator (GtkTreeModel *model,
                                          GtkTreeIter  *iter,
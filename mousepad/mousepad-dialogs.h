@@ -40,6 +40,7 @@ enum {
   MOUSEPAD_RESPONSE_JUMP_TO,
   MOUSEPAD_RESPONSE_OK,
   MOUSEPAD_RESPONSE_OVERWRITE,
+  MOUSEPAD_RESPONSE_RECOVER,
   MOUSEPAD_RESPONSE_RELOAD,
   MOUSEPAD_RESPONSE_REPLACE,
   MOUSEPAD_RESPONSE_SAVE,
@@ -56,6 +57,10 @@ void       mousepad_dialogs_show_error          (GtkWindow         *parent,
                                                  const GError      *error,
                                                  const gchar       *message);
 
+void       mousepad_dialogs_show_errors         (GtkWindow         *parent,
+                                                 const gchar       *details,
+                                                 gint               n_files);
+
 void       mousepad_dialogs_show_help           (GtkWindow         *parent,
                                                  const gchar       *page,
                                                  const gchar       *offset);
@@ -66,6 +71,10 @@ gint       mousepad_dialogs_other_tab_size      (GtkWindow         *parent,
 gboolean   mousepad_dialogs_go_to               (GtkWindow         *parent,
                                                  GtkTextBuffer     *buffer);
 
+gboolean   mousepad_dialogs_go_to_line          (GtkWindow         *parent,
+                                                 guint64           *line,
+                                                 gint64             n_lines);
+
 gboolean   mousepad_dialogs_clear_recent        (GtkWindow         *parent);
 
 gint       mousepad_dialogs_save_changes        (GtkWindow         *parent,
@@ -77,9 +86,17 @@ gint       mousepad_dialogs_externally_modified (GtkWindow         *parent,
 
 gint       mousepad_dialogs_revert              (GtkWindow         *parent);
 
+gint       mousepad_dialogs_recover             (GtkWindow         *parent,
+                                                 guint              n_documents);
+
 gint       mousepad_dialogs_confirm_encoding    (const gchar       *charset,
                                                  const gchar       *user_charset);
 
+gint       mousepad_dialogs_encoding_failures   (GtkWindow         *parent,
+                                                 const gchar       *charset,
+                                                 const gchar       *filenames,
+                                                 gint               n_files);
+
 gint       mousepad_dialogs_save_as             (GtkWindow         *parent,
                                                  MousepadFile      *current_file,
                                                  GFile             *last_save_location,
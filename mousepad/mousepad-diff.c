@@ -0,0 +1,311 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-diff.h>
+
+
+
+/* beyond this number of line insertions and deletions, the part of the texts which differs
+ * is replaced as a whole, to bound the time and memory spent computing a minimal diff */
+#define MOUSEPAD_DIFF_MAX_EDITS 1024
+
+
+
+/* a line of text, including its line feed if any */
+typedef struct
+{
+  const gchar *start;
+  gsize        length;
+  guint        hash;
+}
+MousepadDiffLine;
+
+/* the insertion of the new line y, or the deletion of the old line x, at the position (x, y) */
+typedef struct
+{
+  guint    x;
+  guint    y;
+  gboolean insert;
+}
+MousepadDiffEdit;
+
+
+
+static GArray *
+mousepad_diff_split (const gchar *text,
+                     gsize        length)
+{
+  MousepadDiffLine  line;
+  GArray           *lines;
+  const gchar      *end = text + length, *eol, *p;
+
+  lines = g_array_new (FALSE, FALSE, sizeof (MousepadDiffLine));
+  while (text < end)
+    {
+      eol = memchr (text, '\n', end - text);
+      line.start = text;
+      line.length = (eol != NULL ? eol + 1 : end) - text;
+
+      /* hash the line so that most comparisons are integer comparisons */
+      line.hash = 5381;
+      for (p = text; p < text + line.length; p++)
+        line.hash = (line.hash << 5) + line.hash + (guchar) *p;
+
+      g_array_append_val (lines, line);
+      text += line.length;
+    }
+
+  return lines;
+}
+
+
+
+static inline gboolean
+mousepad_diff_line_equal (const MousepadDiffLine *a,
+                          const MousepadDiffLine *b)
+{
+  return a->hash == b->hash && a->length == b->length && memcmp (a->start, b->start, a->length) == 0;
+}
+
+
+
+/*
+ * Myers' O(ND) algorithm on the lines a[0..n) and b[0..m), storing the edits backwards in
+ * @edits. Returns FALSE if the number of edits exceeds @max_edits or if cancelled.
+ */
+static gboolean
+mousepad_diff_myers (const MousepadDiffLine *a,
+                     gint                    n,
+                     const MousepadDiffLine *b,
+                     gint                    m,
+                     gint                    max_edits,
+                     GArray                 *edits,
+                     GCancellable           *cancellable)
+{
+  MousepadDiffEdit   edit;
+  GPtrArray         *trace;
+  gint              *v, *saved;
+  gint               d, k, x, y, prev_k, prev_x, prev_y;
+  gboolean           found = FALSE;
+
+  /* v[k] is the furthest x reached on the diagonal k = x - y, with an offset for negative k */
+  v = g_new0 (gint, 2 * max_edits + 3) + max_edits + 1;
+  trace = g_ptr_array_new_with_free_func (g_free);
+
+  for (d = 0; d <= max_edits && ! found; d++)
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        break;
+
+      for (k = -d; k <= d; k += 2)
+        {
+          /* go down (insertion) or right (deletion), then follow the diagonal */
+          if (k == -d || (k != d && v[k - 1] < v[k + 1]))
+            x = v[k + 1];
+          else
+            x = v[k - 1] + 1;
+
+          y = x - k;
+          while (x < n && y < m && mousepad_diff_line_equal (a + x, b + y))
+            {
+              x++;
+              y++;
+            }
+
+          v[k] = x;
+          if (x >= n && y >= m)
+            {
+              found = TRUE;
+              break;
+            }
+        }
+
+      /* keep the state of this step for the backtracking */
+      saved = g_new (gint, 2 * d + 1);
+      memcpy (saved, v - d, (2 * d + 1) * sizeof (gint));
+      g_ptr_array_add (trace, saved);
+    }
+
+  /* walk the path back from the end */
+  if (found)
+    {
+      x = n;
+      y = m;
+      for (d = trace->len - 1; d > 0; d--)
+        {
+          saved = (gint *) g_ptr_array_index (trace, d - 1) + d - 1;
+          k = x - y;
+          if (k == -d || (k != d && saved[k - 1] < saved[k + 1]))
+            prev_k = k + 1;
+          else
+            prev_k = k - 1;
+
+          prev_x = saved[prev_k];
+          prev_y = prev_x - prev_k;
+
+          edit.x = prev_x;
+          edit.y = prev_y;
+          edit.insert = (prev_k == k + 1);
+          g_array_append_val (edits, edit);
+
+          x = prev_x;
+          y = prev_y;
+        }
+    }
+
+  g_free (v - max_edits - 1);
+  g_ptr_array_free (trace, TRUE);
+
+  return found;
+}
+
+
+
+static inline gsize
+mousepad_diff_offset (GArray      *lines,
+                      guint        index,
+                      const gchar *text,
+                      gsize        length)
+{
+  return (index < lines->len) ? (gsize) (g_array_index (lines, MousepadDiffLine, index).start - text)
+                              : length;
+}
+
+
+
+static void
+mousepad_diff_add_hunk (GArray      *hunks,
+                        GArray      *old_lines,
+                        guint        old_start,
+                        guint        old_count,
+                        const gchar *old_text,
+                        gsize        old_length,
+                        GArray      *new_lines,
+                        guint        new_start,
+                        guint        new_count,
+                        const gchar *new_text,
+                        gsize        new_length)
+{
+  MousepadDiffHunk hunk;
+
+  hunk.old_offset = mousepad_diff_offset (old_lines, old_start, old_text, old_length);
+  hunk.old_length = mousepad_diff_offset (old_lines, old_start + old_count,
+                                          old_text, old_length) - hunk.old_offset;
+  hunk.new_offset = mousepad_diff_offset (new_lines, new_start, new_text, new_length);
+  hunk.new_length = mousepad_diff_offset (new_lines, new_start + new_count,
+                                          new_text, new_length) - hunk.new_offset;
+  g_array_append_val (hunks, hunk);
+}
+
+
+
+/*
+ * Computes the line-level differences between two texts, as a list of hunks in increasing
+ * order, each replacing consecutive lines of the old text with a part of the new text, both
+ * given as byte ranges: lines only end with a line feed here, unlike in a text buffer.
+ * The common prefix and suffix are skipped first, and when the texts differ too much
+ * the remaining part is replaced as a whole. Returns NULL if cancelled.
+ */
+GArray *
+mousepad_diff_lines (const gchar  *old_text,
+                     gsize         old_length,
+                     const gchar  *new_text,
+                     gsize         new_length,
+                     GCancellable *cancellable)
+{
+  MousepadDiffEdit *edit;
+  MousepadDiffLine *a, *b;
+  GArray           *old_lines, *new_lines, *edits, *hunks = NULL;
+  guint             prefix = 0, n, m, i;
+  guint             old_start = 0, old_count = 0, new_start = 0, new_count = 0;
+  gboolean          open = FALSE;
+
+  old_lines = mousepad_diff_split (old_text, old_length);
+  new_lines = mousepad_diff_split (new_text, new_length);
+  a = (MousepadDiffLine *) (gpointer) old_lines->data;
+  b = (MousepadDiffLine *) (gpointer) new_lines->data;
+  n = old_lines->len;
+  m = new_lines->len;
+
+  /* skip the common prefix and suffix */
+  while (prefix < n && prefix < m && mousepad_diff_line_equal (a + prefix, b + prefix))
+    prefix++;
+
+  while (n > prefix && m > prefix && mousepad_diff_line_equal (a + n - 1, b + m - 1))
+    {
+      n--;
+      m--;
+    }
+
+  edits = g_array_new (FALSE, FALSE, sizeof (MousepadDiffEdit));
+  if (! mousepad_diff_myers (a + prefix, n - prefix, b + prefix, m - prefix,
+                             MIN (n - prefix + m - prefix, MOUSEPAD_DIFF_MAX_EDITS), edits, cancellable))
+    {
+      if (g_cancellable_is_cancelled (cancellable))
+        goto out;
+
+      /* too many differences: a single hunk for the whole middle part */
+      g_array_set_size (edits, 0);
+      for (i = m; i > prefix; i--)
+        {
+          MousepadDiffEdit insert = { n - prefix, i - 1 - prefix, TRUE };
+          g_array_append_val (edits, insert);
+        }
+      for (i = n; i > prefix; i--)
+        {
+          MousepadDiffEdit delete = { i - 1 - prefix, 0, FALSE };
+          g_array_append_val (edits, delete);
+        }
+    }
+
+  /* group the consecutive edits into hunks, the edits are stored backwards */
+  hunks = g_array_new (FALSE, FALSE, sizeof (MousepadDiffHunk));
+  for (i = edits->len; i > 0; i--)
+    {
+      edit = &g_array_index (edits, MousepadDiffEdit, i - 1);
+      if (! open || edit->x + prefix != old_start + old_count
+          || edit->y + prefix != new_start + new_count)
+        {
+          if (open)
+            mousepad_diff_add_hunk (hunks, old_lines, old_start, old_count, old_text, old_length,
+                                    new_lines, new_start, new_count, new_text, new_length);
+
+          open = TRUE;
+          old_start = edit->x + prefix;
+          old_count = 0;
+          new_start = edit->y + prefix;
+          new_count = 0;
+        }
+
+      if (edit->insert)
+        new_count++;
+      else
+        old_count++;
+    }
+
+  if (open)
+    mousepad_diff_add_hunk (hunks, old_lines, old_start, old_count, old_text, old_length,
+                            new_lines, new_start, new_count, new_text, new_length);
+
+  out:
+
+  g_array_free (edits, TRUE);
+  g_array_free (old_lines, TRUE);
+  g_array_free (new_lines, TRUE);
+
+  return hunks;
+}
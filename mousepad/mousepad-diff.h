@@ -0,0 +1,42 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_DIFF_H__
+#define __MOUSEPAD_DIFF_H__
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  /* the bytes to replace in the old text */
+  gsize old_offset;
+  gsize old_length;
+
+  /* the bytes replacing them in the new text */
+  gsize new_offset;
+  gsize new_length;
+}
+MousepadDiffHunk;
+
+GArray *mousepad_diff_lines (const gchar  *old_text,
+                             gsize         old_length,
+                             const gchar  *new_text,
+                             gsize         new_length,
+                             GCancellable *cancellable);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_DIFF_H__ */
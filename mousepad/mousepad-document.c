@@ -19,7 +19,10 @@
 #include <mousepad/mousepad-settings.h>
 #include <mousepad/mousepad-util.h>
 #include <mousepad/mousepad-document.h>
+#include <mousepad/mousepad-journal.h>
 #include <mousepad/mousepad-marshal.h>
+#include <mousepad/mousepad-pager.h>
+#include <mousepad/mousepad-undo-manager.h>
 #include <mousepad/mousepad-view.h>
 #include <mousepad/mousepad-window.h>
 
@@ -46,6 +49,7 @@ static void      mousepad_document_drag_data_received      (GtkWidget
                                                             MousepadDocument       *document);
 static void      mousepad_document_location_changed        (MousepadDocument       *document,
                                                             GFile                  *file);
+static void      mousepad_document_contents_appended       (MousepadDocument       *document);
 static void      mousepad_document_label_color             (MousepadDocument       *document);
 static void      mousepad_document_tab_button_clicked      (GtkWidget              *widget,
                                                             MousepadDocument       *document);
@@ -58,6 +62,8 @@ static void      mousepad_document_emit_search_signal      (MousepadDocument
 static void      mousepad_document_search_widget_visible   (MousepadDocument       *document,
                                                             GParamSpec             *pspec,
                                                             MousepadWindow         *window);
+static void      mousepad_document_pager_scrolled          (MousepadDocument       *document);
+static void      mousepad_document_pager_check             (MousepadDocument       *document);
 
 
 
@@ -68,6 +74,7 @@ enum
   ENCODING_CHANGED,
   LANGUAGE_CHANGED,
   OVERWRITE_CHANGED,
+  REDUCED_CHANGED,
   SEARCH_COMPLETED,
   LAST_SIGNAL
 };
@@ -93,6 +100,24 @@ struct _MousepadDocumentPrivate
   /* search contexts */
   GtkSourceSearchContext *search_context, *selection_context;
   GtkSourceBuffer        *selection_buffer;
+
+  /* journal of the unsaved changes */
+  MousepadJournal        *journal;
+
+  /* the pager of a large file viewed page by page, and the range of its lines which
+   * is in the buffer */
+  MousepadPager          *pager;
+  GCancellable           *pager_cancellable, *search_cancellable;
+  guint64                 first_line, n_lines;
+  guint                   pager_idle_id, remap_idle_id;
+
+  /* the selection to make once its lines are indexed */
+  gboolean                selection_pending;
+  guint64                 selection_start_line, selection_end_line;
+  gsize                   selection_start_column, selection_end_column;
+
+  /* whether the costly features are disabled because the document is large */
+  gboolean                reduced;
 };
 
 
@@ -143,6 +168,10 @@ mousepad_document_class_init (MousepadDocumentClass *klass)
     g_signal_new (I_("overwrite-changed"), G_TYPE_FROM_CLASS (gobject_class), G_SIGNAL_RUN_LAST,
                   0, NULL, NULL, g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
 
+  document_signals[REDUCED_CHANGED] =
+    g_signal_new (I_("reduced-changed"), G_TYPE_FROM_CLASS (gobject_class), G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, g_cclosure_marshal_VOID__BOOLEAN, G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
   document_signals[SEARCH_COMPLETED] =
     g_signal_new (I_("search-completed"), G_TYPE_FROM_CLASS (gobject_class), G_SIGNAL_RUN_LAST,
                   0, NULL, NULL, _mousepad_marshal_VOID__INT_STRING_FLAGS,
@@ -198,6 +227,7 @@ mousepad_document_init (MousepadDocument *document)
 {
   GtkTargetList           *target_list;
   GtkSourceSearchSettings *search_settings;
+  MousepadUndoManager     *undo_manager;
 
   /* we will complete initialization when the document is anchored */
   g_signal_connect (document, "hierarchy-changed", G_CALLBACK (mousepad_document_post_init), NULL);
@@ -212,6 +242,15 @@ mousepad_document_init (MousepadDocument *document)
   document->priv->css_provider = gtk_css_provider_new ();
   document->priv->selection_context = NULL;
   document->priv->selection_buffer = NULL;
+  document->priv->pager = NULL;
+  document->priv->pager_cancellable = NULL;
+  document->priv->search_cancellable = NULL;
+  document->priv->first_line = 0;
+  document->priv->n_lines = 0;
+  document->priv->pager_idle_id = 0;
+  document->priv->remap_idle_id = 0;
+  document->priv->selection_pending = FALSE;
+  document->priv->reduced = FALSE;
 
   /* setup the scrolled window */
   gtk_scrolled_window_set_policy (GTK_SCROLLED_WINDOW (document),
@@ -245,6 +284,16 @@ mousepad_document_init (MousepadDocument *document)
   g_signal_connect_swapped (document->file, "location-changed",
                             G_CALLBACK (mousepad_document_location_changed), document);
 
+  /* use our own undo manager, whose memory use is bounded and whose history persists
+   * across sessions */
+  undo_manager = mousepad_undo_manager_new (document->buffer, document->file);
+  gtk_source_buffer_set_undo_manager (GTK_SOURCE_BUFFER (document->buffer),
+                                      GTK_SOURCE_UNDO_MANAGER (undo_manager));
+  g_object_unref (undo_manager);
+
+  /* record the unsaved changes, to recover them after a crash */
+  document->priv->journal = mousepad_journal_new (document->file);
+
   /* setup the textview */
   document->textview = g_object_new (MOUSEPAD_TYPE_VIEW, "buffer", document->buffer, NULL);
   gtk_container_add (GTK_CONTAINER (document), GTK_WIDGET (document->textview));
@@ -263,6 +312,8 @@ mousepad_document_init (MousepadDocument *document)
                             G_CALLBACK (mousepad_document_label_color), document);
   g_signal_connect (document->textview, "drag-data-received",
                     G_CALLBACK (mousepad_document_drag_data_received), document);
+  g_signal_connect_swapped (document->file, "contents-appended",
+                            G_CALLBACK (mousepad_document_contents_appended), document);
 
   /* forward some document attribute signals more or less directly */
   g_signal_connect_swapped (document->buffer, "notify::cursor-position",
@@ -321,12 +372,38 @@ mousepad_document_finalize_search (MousepadDocument       *document,
 static void
 mousepad_document_finalize (GObject *object)
 {
-  MousepadDocument *document = MOUSEPAD_DOCUMENT (object);
+  MousepadDocument     *document = MOUSEPAD_DOCUMENT (object);
+  GtkSourceUndoManager *undo_manager;
 
   /* cleanup */
   g_free (document->priv->utf8_filename);
   g_free (document->priv->utf8_basename);
   g_object_unref (document->priv->css_provider);
+  mousepad_journal_free (document->priv->journal);
+
+  /* stop viewing the file page by page */
+  if (document->priv->pager != NULL)
+    {
+      if (document->priv->pager_idle_id != 0)
+        g_source_remove (document->priv->pager_idle_id);
+
+      if (document->priv->remap_idle_id != 0)
+        g_source_remove (document->priv->remap_idle_id);
+
+      g_cancellable_cancel (document->priv->pager_cancellable);
+      g_object_unref (document->priv->pager_cancellable);
+      mousepad_pager_unref (document->priv->pager);
+    }
+
+  if (document->priv->search_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->search_cancellable);
+      g_object_unref (document->priv->search_cancellable);
+    }
+
+  /* keep the undo history of a saved document for the next time it is opened */
+  undo_manager = gtk_source_buffer_get_undo_manager (GTK_SOURCE_BUFFER (document->buffer));
+  mousepad_undo_manager_persist (MOUSEPAD_UNDO_MANAGER (undo_manager));
 
   /* release the file */
   g_object_unref (document->file);
@@ -357,8 +434,10 @@ mousepad_document_notify_cursor_position (MousepadDocument *document)
   gtk_text_buffer_get_iter_at_mark (document->buffer, &iter,
                                     gtk_text_buffer_get_insert (document->buffer));
 
-  /* get the current line number */
+  /* get the current line number, in the file if it is viewed page by page */
   line = gtk_text_iter_get_line (&iter) + 1;
+  if (document->priv->pager != NULL)
+    line = MIN (document->priv->first_line + line, G_MAXINT);
 
   /* get the tab size */
   tab_size = MOUSEPAD_SETTING_GET_INT (TAB_WIDTH);
@@ -443,6 +522,106 @@ mousepad_document_send_signals (MousepadDocument *document)
 
   /* re-send the overwrite signal */
   mousepad_document_notify_overwrite (GTK_TEXT_VIEW (document->textview), NULL, document);
+
+  /* re-send the reduced signal */
+  g_signal_emit (document, document_signals[REDUCED_CHANGED], 0, document->priv->reduced);
+}
+
+
+
+/* suspend the handlers which are not needed while the buffer is filled at once,
+ * e.g. when a file is loaded */
+void
+mousepad_document_freeze (MousepadDocument *document)
+{
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* the cursor position notifications are sent at once when thawing */
+  g_object_freeze_notify (G_OBJECT (document->buffer));
+
+  /* the journal restarts from the buffer contents when thawing, if needed */
+  mousepad_journal_freeze (document->priv->journal);
+
+  /* block search context handlers */
+  g_signal_handlers_block_matched (document->buffer, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_ID,
+                                   g_signal_lookup ("insert-text", GTK_TYPE_TEXT_BUFFER),
+                                   0, NULL, NULL, document->priv->search_context);
+  g_signal_handlers_block_matched (document->buffer, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_ID,
+                                   g_signal_lookup ("delete-range", GTK_TYPE_TEXT_BUFFER),
+                                   0, NULL, NULL, document->priv->search_context);
+}
+
+
+
+/* disable the costly features if the file loaded in the buffer is large, the buffer of
+ * a file viewed page by page being small anyway */
+static void
+mousepad_document_update_reduced (MousepadDocument *document)
+{
+  GtkWidget *window;
+  gboolean   reduced, visible = FALSE;
+
+  reduced = document->priv->pager == NULL && mousepad_file_get_large (document->file);
+  if (reduced == document->priv->reduced)
+    return;
+
+  document->priv->reduced = reduced;
+  mousepad_view_set_reduced (document->textview, reduced);
+
+  /* search highlighting is bound to its setting while the search widget is visible */
+  window = gtk_widget_get_ancestor (GTK_WIDGET (document), MOUSEPAD_TYPE_WINDOW);
+  if (window != NULL)
+    g_object_get (window, "search-widget-visible", &visible, NULL);
+
+  if (reduced)
+    {
+      g_settings_unbind (document->priv->search_context, "highlight");
+      gtk_source_search_context_set_highlight (document->priv->search_context, FALSE);
+    }
+  else if (visible)
+    MOUSEPAD_SETTING_BIND (SEARCH_HIGHLIGHT_ALL, document->priv->search_context,
+                           "highlight", G_SETTINGS_BIND_GET);
+
+  g_signal_emit (document, document_signals[REDUCED_CHANGED], 0, reduced);
+}
+
+
+
+void
+mousepad_document_thaw (MousepadDocument *document)
+{
+  GtkSourceSearchSettings *search_settings;
+  GtkWidget               *window;
+  gboolean                 visible = FALSE;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* unblock search context handlers */
+  g_signal_handlers_unblock_matched (document->buffer, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_ID,
+                                     g_signal_lookup ("insert-text", GTK_TYPE_TEXT_BUFFER),
+                                     0, NULL, NULL, document->priv->search_context);
+  g_signal_handlers_unblock_matched (document->buffer, G_SIGNAL_MATCH_DATA | G_SIGNAL_MATCH_ID,
+                                     g_signal_lookup ("delete-range", GTK_TYPE_TEXT_BUFFER),
+                                     0, NULL, NULL, document->priv->search_context);
+
+  mousepad_journal_thaw (document->priv->journal);
+
+  /* the search context missed the buffer changes, make it rescan the whole buffer
+   * if it is active */
+  window = gtk_widget_get_ancestor (GTK_WIDGET (document), MOUSEPAD_TYPE_WINDOW);
+  if (window != NULL)
+    g_object_get (window, "search-widget-visible", &visible, NULL);
+
+  if (visible)
+    {
+      search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
+      g_object_notify (G_OBJECT (search_settings), "search-text");
+    }
+
+  /* the loaded contents may have crossed the large document thresholds */
+  mousepad_document_update_reduced (document);
+
+  g_object_thaw_notify (G_OBJECT (document->buffer));
 }
 
 
@@ -467,6 +646,22 @@ mousepad_document_drag_data_received (GtkWidget        *widget,
 
 
 
+static void
+mousepad_document_contents_appended (MousepadDocument *document)
+{
+  GtkTextIter end;
+
+  /* keep the end of a followed file in view */
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (FOLLOW_AUTOSCROLL))
+    {
+      gtk_text_buffer_get_end_iter (document->buffer, &end);
+      gtk_text_buffer_place_cursor (document->buffer, &end);
+      mousepad_view_scroll_to_cursor (document->textview);
+    }
+}
+
+
+
 static void
 mousepad_document_location_changed (MousepadDocument *document,
                                     GFile            *file)
@@ -565,6 +760,19 @@ mousepad_document_set_overwrite (MousepadDocument *document,
 
 
 
+/* enable the costly features disabled for a large document, or disable them again */
+void
+mousepad_document_set_reduced (MousepadDocument *document,
+                               gboolean          reduced)
+{
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  mousepad_file_set_large (document->file, reduced);
+  mousepad_document_update_reduced (document);
+}
+
+
+
 void
 mousepad_document_focus_textview (MousepadDocument *document)
 {
@@ -654,6 +862,495 @@ mousepad_document_get_filename (MousepadDocument *document)
 
 
 
+/* the number of lines of a file viewed page by page which are loaded in the buffer */
+#define MOUSEPAD_DOCUMENT_PAGER_LINES 3000
+
+
+
+/* whether @line exists in the file viewed page by page, the offset of a line after the
+ * last one being that of the last one */
+static gboolean
+mousepad_document_pager_has_line (MousepadDocument *document,
+                                  guint64           line)
+{
+  MousepadPager *pager = document->priv->pager;
+
+  return line == 0 || mousepad_pager_get_offset (pager, line, 0)
+                      != mousepad_pager_get_offset (pager, line - 1, 0);
+}
+
+
+
+/* get an iter at @column in @line of the buffer, or at the end of the line if it is
+ * shorter, which may happen when the file contains carriage returns or invalid bytes */
+static void
+mousepad_document_pager_get_iter (MousepadDocument *document,
+                                  GtkTextIter      *iter,
+                                  guint64           line,
+                                  gsize             column)
+{
+  gtk_text_buffer_get_iter_at_line (document->buffer, iter, MIN (line, G_MAXINT));
+  if (! gtk_text_iter_ends_line (iter))
+    gtk_text_iter_forward_to_line_end (iter);
+
+  if (column < (gsize) gtk_text_iter_get_line_offset (iter))
+    gtk_text_iter_set_line_offset (iter, column);
+}
+
+
+
+/* replace the contents of the buffer with the lines of the file from @first_line, which
+ * is neither an undoable action nor a modification of the document */
+static void
+mousepad_document_pager_load (MousepadDocument *document,
+                              guint64           first_line)
+{
+  GtkTextIter iter;
+  gchar      *text;
+  guint64     n_lines = MOUSEPAD_DOCUMENT_PAGER_LINES, cursor_line;
+  gsize       cursor_column;
+
+  /* the cursor position in the file */
+  gtk_text_buffer_get_iter_at_mark (document->buffer, &iter,
+                                    gtk_text_buffer_get_insert (document->buffer));
+  cursor_line = document->priv->first_line + gtk_text_iter_get_line (&iter);
+  cursor_column = gtk_text_iter_get_line_offset (&iter);
+
+  text = mousepad_pager_get_text (document->priv->pager, first_line, &n_lines);
+
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+  mousepad_document_freeze (document);
+
+  gtk_text_buffer_set_text (document->buffer, text, -1);
+  gtk_text_buffer_set_modified (document->buffer, FALSE);
+  document->priv->first_line = first_line;
+  document->priv->n_lines = n_lines;
+
+  mousepad_document_thaw (document);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+  g_free (text);
+
+  /* keep the cursor in place if it is still in the buffer */
+  if (cursor_line >= first_line && cursor_line < first_line + n_lines)
+    {
+      mousepad_document_pager_get_iter (document, &iter, cursor_line - first_line, cursor_column);
+      gtk_text_buffer_place_cursor (document->buffer, &iter);
+    }
+
+  mousepad_document_pager_check (document);
+}
+
+
+
+/* make sure @line is in the buffer, loading the lines around it if needed, and return
+ * its line in the buffer */
+static guint64
+mousepad_document_pager_show (MousepadDocument *document,
+                              guint64           line)
+{
+  MousepadPager *pager = document->priv->pager;
+  guint64        first_line, above;
+  gsize          column;
+
+  /* a line after the last one is the last one */
+  mousepad_pager_get_position (pager, mousepad_pager_get_offset (pager, line, 0), &line, &column);
+
+  /* load the lines around it, keeping a third of the buffer above */
+  if (line < document->priv->first_line
+      || line >= document->priv->first_line + document->priv->n_lines)
+    {
+      above = document->priv->n_lines / 3;
+      first_line = (line > above) ? line - above : 0;
+      mousepad_document_pager_load (document, first_line);
+    }
+
+  return line - document->priv->first_line;
+}
+
+
+
+/* slide the buffer over the file when the view gets close to its edges, keeping the first
+ * visible line in place */
+static gboolean
+mousepad_document_pager_slide (gpointer data)
+{
+  MousepadDocument *document = MOUSEPAD_DOCUMENT (data);
+  GtkTextView      *textview;
+  GtkTextMark      *mark;
+  GtkTextIter       iter;
+  GdkRectangle      rect;
+  guint64           top, bottom, margin, above, first_line;
+
+  document->priv->pager_idle_id = 0;
+
+  /* exit if the view was destroyed meanwhile */
+  if (! MOUSEPAD_IS_VIEW (document->textview))
+    return FALSE;
+
+  /* the lines at the edges of the view */
+  textview = GTK_TEXT_VIEW (document->textview);
+  gtk_text_view_get_visible_rect (textview, &rect);
+  gtk_text_view_get_line_at_y (textview, &iter, rect.y, NULL);
+  top = gtk_text_iter_get_line (&iter);
+  gtk_text_view_get_line_at_y (textview, &iter, rect.y + rect.height, NULL);
+  bottom = gtk_text_iter_get_line (&iter);
+
+  margin = document->priv->n_lines / 6;
+  if ((top < margin && document->priv->first_line > 0)
+      || (bottom + margin >= document->priv->n_lines
+          && mousepad_document_pager_has_line (document, document->priv->first_line
+                                                         + document->priv->n_lines)))
+    {
+      top += document->priv->first_line;
+      above = document->priv->n_lines / 3;
+      first_line = (top > above) ? top - above : 0;
+      if (first_line != document->priv->first_line)
+        {
+          mousepad_document_pager_load (document, first_line);
+
+          /* the scroll is done once the new lines are laid out */
+          gtk_text_buffer_get_iter_at_line (document->buffer, &iter, top - first_line);
+          mark = gtk_text_buffer_create_mark (document->buffer, NULL, &iter, TRUE);
+          gtk_text_view_scroll_to_mark (textview, mark, 0.0, TRUE, 0.0, 0.0);
+          gtk_text_buffer_delete_mark (document->buffer, mark);
+        }
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_document_pager_scrolled (MousepadDocument *document)
+{
+  /* wait for the view to be laid out and scrolled, which happens at a higher priority */
+  if (document->priv->pager != NULL && document->priv->pager_idle_id == 0)
+    document->priv->pager_idle_id = g_idle_add_full (G_PRIORITY_LOW, mousepad_document_pager_slide,
+                                                     document, NULL);
+}
+
+
+
+/* select a range of the file viewed page by page, after loading it in the buffer, or
+ * once its lines are indexed if they are not yet, so that they are not searched for on
+ * the main thread */
+static void
+mousepad_document_pager_select (MousepadDocument *document,
+                                guint64           start_line,
+                                gsize             start_column,
+                                guint64           end_line,
+                                gsize             end_column)
+{
+  GtkTextIter start, end;
+  guint64     line;
+
+  document->priv->selection_pending = ! mousepad_pager_is_indexed (document->priv->pager, end_line);
+  if (document->priv->selection_pending)
+    {
+      document->priv->selection_start_line = start_line;
+      document->priv->selection_start_column = start_column;
+      document->priv->selection_end_line = end_line;
+      document->priv->selection_end_column = end_column;
+
+      return;
+    }
+
+  line = mousepad_document_pager_show (document, start_line);
+  mousepad_document_pager_get_iter (document, &start, line, start_column);
+  mousepad_document_pager_get_iter (document, &end, line + end_line - start_line, end_column);
+  gtk_text_buffer_select_range (document->buffer, &start, &end);
+}
+
+
+
+static gboolean
+mousepad_document_pager_remap (gpointer data)
+{
+  MousepadDocument *document = MOUSEPAD_DOCUMENT (data);
+  MousepadPager    *pager;
+  GError           *error = NULL;
+
+  document->priv->remap_idle_id = 0;
+
+  /* the lines which could not be read are left empty until the file is reloaded */
+  pager = mousepad_pager_new (mousepad_file_get_location (document->file),
+                              mousepad_file_get_encoding (document->file), &error);
+  if (pager == NULL)
+    {
+      g_warning ("Failed to view the truncated file page by page: %s", error->message);
+      g_error_free (error);
+
+      return FALSE;
+    }
+
+  mousepad_document_set_pager (document, pager);
+  mousepad_pager_unref (pager);
+
+  return FALSE;
+}
+
+
+
+/* map the file again if it was truncated while being viewed page by page, the pages
+ * beyond its new end being no longer readable */
+static void
+mousepad_document_pager_check (MousepadDocument *document)
+{
+  if (mousepad_pager_is_truncated (document->priv->pager) && document->priv->remap_idle_id == 0)
+    document->priv->remap_idle_id = g_idle_add (mousepad_document_pager_remap, document);
+}
+
+
+
+static void
+mousepad_document_pager_indexed (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  MousepadDocument *document = MOUSEPAD_DOCUMENT (data);
+
+  /* exit if the pager was replaced or the document destroyed meanwhile */
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+    return;
+
+  mousepad_pager_index_finish (document->priv->pager, result, NULL);
+  mousepad_document_pager_check (document);
+
+  /* make the selection which was waiting for the index */
+  if (document->priv->selection_pending)
+    {
+      mousepad_document_pager_select (document, document->priv->selection_start_line,
+                                      document->priv->selection_start_column,
+                                      document->priv->selection_end_line,
+                                      document->priv->selection_end_column);
+      if (MOUSEPAD_IS_VIEW (document->textview))
+        mousepad_view_scroll_to_cursor (document->textview);
+    }
+}
+
+
+
+/**
+ * mousepad_document_set_pager:
+ * @document : a #MousepadDocument.
+ * @pager    : the #MousepadPager of the document file.
+ *
+ * Views the document file page by page through @pager, rather than loading it in the
+ * buffer, which becomes read-only: only the lines around the view are loaded in the
+ * buffer, as it is scrolled. Setting a new pager reloads the file, keeping the view at
+ * the same lines if possible.
+ **/
+void
+mousepad_document_set_pager (MousepadDocument *document,
+                             MousepadPager    *pager)
+{
+  GtkAdjustment *vadjustment;
+  guint64        first_line;
+  gsize          column;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (pager != NULL);
+
+  if (document->priv->pager != NULL)
+    {
+      g_cancellable_cancel (document->priv->pager_cancellable);
+      g_object_unref (document->priv->pager_cancellable);
+      mousepad_pager_unref (document->priv->pager);
+
+      /* a search in the previous contents is irrelevant */
+      if (document->priv->search_cancellable != NULL)
+        g_cancellable_cancel (document->priv->search_cancellable);
+    }
+  else
+    {
+      vadjustment = gtk_scrolled_window_get_vadjustment (GTK_SCROLLED_WINDOW (document));
+      g_signal_connect_swapped (vadjustment, "value-changed",
+                                G_CALLBACK (mousepad_document_pager_scrolled), document);
+      gtk_text_view_set_editable (GTK_TEXT_VIEW (document->textview), FALSE);
+    }
+
+  document->priv->pager = mousepad_pager_ref (pager);
+  document->priv->pager_cancellable = g_cancellable_new ();
+  document->priv->selection_pending = FALSE;
+
+  /* index the lines in the background, they can be accessed meanwhile */
+  mousepad_pager_index_async (pager, document->priv->pager_cancellable,
+                              mousepad_document_pager_indexed, document);
+
+  /* load the lines in view, the file may have shrunk since it was last loaded */
+  mousepad_pager_get_position (pager, mousepad_pager_get_offset (pager, document->priv->first_line, 0),
+                               &first_line, &column);
+  mousepad_document_pager_load (document, first_line);
+}
+
+
+
+MousepadPager *
+mousepad_document_get_pager (MousepadDocument *document)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), NULL);
+
+  return document->priv->pager;
+}
+
+
+
+/**
+ * mousepad_document_get_line:
+ * @document : a #MousepadDocument.
+ *
+ * Return value: the line of the cursor in the document file, starting from 0, even if
+ *               the file is viewed page by page.
+ **/
+guint64
+mousepad_document_get_line (MousepadDocument *document)
+{
+  GtkTextIter iter;
+
+  g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), 0);
+
+  gtk_text_buffer_get_iter_at_mark (document->buffer, &iter,
+                                    gtk_text_buffer_get_insert (document->buffer));
+
+  return document->priv->first_line + gtk_text_iter_get_line (&iter);
+}
+
+
+
+/**
+ * mousepad_document_go_to_line:
+ * @document : a #MousepadDocument.
+ * @line     : a line of the document file, starting from 0.
+ *
+ * Places the cursor at the start of @line, or of the last line if there are less lines,
+ * loading it in the buffer first if the file is viewed page by page, which is done once
+ * the lines are indexed up to @line.
+ **/
+void
+mousepad_document_go_to_line (MousepadDocument *document,
+                              guint64           line)
+{
+  GtkTextIter iter;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  if (document->priv->pager != NULL)
+    {
+      mousepad_document_pager_select (document, line, 0, line, 0);
+      return;
+    }
+
+  gtk_text_buffer_get_iter_at_line (document->buffer, &iter, MIN (line, G_MAXINT));
+  gtk_text_buffer_place_cursor (document->buffer, &iter);
+}
+
+
+
+static void
+mousepad_document_pager_search_completed (GObject      *object,
+                                          GAsyncResult *result,
+                                          gpointer      data)
+{
+  MousepadDocument        *document = MOUSEPAD_DOCUMENT (data);
+  GtkSourceSearchSettings *search_settings;
+  MousepadSearchFlags      flags;
+  GError                  *error = NULL;
+  const gchar             *string;
+  guint64                  start_line, end_line;
+  gsize                    start_column, end_column;
+  gboolean                 found;
+
+  found = mousepad_pager_search_finish (document->priv->pager, result, &start_line, &start_column,
+                                        &end_line, &end_column, &error);
+
+  /* exit if the search was replaced by another one, or the view was destroyed meanwhile */
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)
+      || ! MOUSEPAD_IS_VIEW (document->textview))
+    {
+      g_clear_error (&error);
+      g_object_unref (document);
+      return;
+    }
+
+  g_clear_error (&error);
+  mousepad_document_pager_check (document);
+
+  /* retrieve the search data */
+  flags = GPOINTER_TO_INT (mousepad_object_get_data (document->priv->search_context, "flags"));
+  search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
+  string = gtk_source_search_settings_get_search_text (search_settings);
+
+  /* select the match, after loading it in the buffer */
+  if (found && (flags & MOUSEPAD_SEARCH_FLAGS_ACTION_SELECT))
+    {
+      mousepad_document_pager_select (document, start_line, start_column, end_line, end_column);
+      if (! document->priv->selection_pending)
+        mousepad_view_scroll_to_cursor (document->textview);
+    }
+
+  /* the matches are not counted, only whether there is one */
+  g_signal_emit (document, document_signals[SEARCH_COMPLETED], 0, found ? -1 : 0, string, flags);
+
+  g_object_unref (document);
+}
+
+
+
+/* search the file viewed page by page from the cursor, the matches in the buffer being
+ * only highlighted */
+static void
+mousepad_document_pager_search (MousepadDocument    *document,
+                                const gchar         *string,
+                                MousepadSearchFlags  flags)
+{
+  GtkSourceSearchSettings *search_settings;
+  GtkTextIter              iter;
+  gsize                    offset;
+
+  /* highlight the matches in the buffer, and attach the flags for the second stage */
+  search_settings = gtk_source_search_context_get_settings (document->priv->search_context);
+  gtk_source_search_settings_set_search_text (search_settings, string);
+  mousepad_object_set_data (document->priv->search_context, "flags", GINT_TO_POINTER (flags));
+
+  /* cancel the previous search */
+  if (document->priv->search_cancellable != NULL)
+    {
+      g_cancellable_cancel (document->priv->search_cancellable);
+      g_clear_object (&document->priv->search_cancellable);
+    }
+
+  /* the document can't be modified, so there is nothing to replace */
+  if (string == NULL || *string == '\0'
+      || (flags & (MOUSEPAD_SEARCH_FLAGS_ACTION_REPLACE | MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS)))
+    {
+      g_signal_emit (document, document_signals[SEARCH_COMPLETED], 0, 0, string, flags);
+      return;
+    }
+
+  /* get the search offset in the file */
+  if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START)
+    gtk_text_buffer_get_selection_bounds (document->buffer, &iter, NULL);
+  else
+    gtk_text_buffer_get_selection_bounds (document->buffer, NULL, &iter);
+
+  offset = mousepad_pager_get_offset (document->priv->pager,
+                                      document->priv->first_line + gtk_text_iter_get_line (&iter),
+                                      gtk_text_iter_get_line_offset (&iter));
+
+  /* search the contents in a worker thread */
+  document->priv->search_cancellable = g_cancellable_new ();
+  mousepad_pager_search_async (document->priv->pager, string, offset,
+                               (flags & MOUSEPAD_SEARCH_FLAGS_DIR_BACKWARD) != 0,
+                               MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_MATCH_CASE),
+                               (flags & MOUSEPAD_SEARCH_FLAGS_WRAP_AROUND)
+                               || MOUSEPAD_SETTING_GET_BOOLEAN (SEARCH_WRAP_AROUND),
+                               document->priv->search_cancellable,
+                               mousepad_document_pager_search_completed, g_object_ref (document));
+}
+
+
+
 static void
 mousepad_document_search_completed (GObject      *object,
                                     GAsyncResult *result,
@@ -759,6 +1456,13 @@ mousepad_document_search (MousepadDocument    *document,
   const gchar             *reference = "";
   gboolean                 has_references;
 
+  /* a file viewed page by page is searched through its pager, except in the selection */
+  if (document->priv->pager != NULL && ! (flags & MOUSEPAD_SEARCH_FLAGS_AREA_SELECTION))
+    {
+      mousepad_document_pager_search (document, string, flags);
+      return;
+    }
+
   /* get the search iter */
   if (flags & MOUSEPAD_SEARCH_FLAGS_ITER_SEL_START)
     gtk_text_buffer_get_selection_bounds (document->buffer, &iter, NULL);
@@ -862,6 +1566,10 @@ mousepad_document_emit_search_signal (MousepadDocument       *document,
   gint                     n_matches;
   const gchar             *string;
 
+  /* the matches of a file viewed page by page are not counted */
+  if (document->priv->pager != NULL && search_context == document->priv->search_context)
+    return;
+
   /* retrieve data */
   flags = GPOINTER_TO_INT (mousepad_object_get_data (search_context, "flags"));
   n_matches = gtk_source_search_context_get_occurrences_count (search_context);
@@ -885,7 +1593,8 @@ mousepad_document_scanning_started (MousepadDocument *document)
 static void
 mousepad_document_scanning_completed (MousepadDocument *document)
 {
-  gtk_source_search_context_set_highlight (document->priv->search_context, TRUE);
+  if (! document->priv->reduced)
+    gtk_source_search_context_set_highlight (document->priv->search_context, TRUE);
 }
 
 
@@ -953,9 +1662,11 @@ mousepad_document_search_widget_visible (MousepadDocument *document,
                                        G_CALLBACK (mousepad_document_prevent_endless_scanning),
                                        document, G_CONNECT_SWAPPED);
 
-      /* bind "highlight" and "regex-enabled" search settings to Mousepad settings */
-      MOUSEPAD_SETTING_BIND (SEARCH_HIGHLIGHT_ALL, document->priv->search_context,
-                             "highlight", G_SETTINGS_BIND_GET);
+      /* bind "highlight" and "regex-enabled" search settings to Mousepad settings, search
+       * highlighting staying disabled for a large document */
+      if (! document->priv->reduced)
+        MOUSEPAD_SETTING_BIND (SEARCH_HIGHLIGHT_ALL, document->priv->search_context,
+                               "highlight", G_SETTINGS_BIND_GET);
       MOUSEPAD_SETTING_BIND (SEARCH_ENABLE_REGEX, search_settings,
                              "regex-enabled", G_SETTINGS_BIND_GET);
     }
@@ -18,6 +18,7 @@
 #define __MOUSEPAD_DOCUMENT_H__
 
 #include <mousepad/mousepad-file.h>
+#include <mousepad/mousepad-pager.h>
 #include <mousepad/mousepad-view.h>
 
 G_BEGIN_DECLS
@@ -85,10 +86,17 @@ MousepadDocument *mousepad_document_new            (void);
 void              mousepad_document_set_overwrite  (MousepadDocument    *document,
                                                     gboolean             overwrite);
 
+void              mousepad_document_set_reduced    (MousepadDocument    *document,
+                                                    gboolean             reduced);
+
 void              mousepad_document_focus_textview (MousepadDocument    *document);
 
 void              mousepad_document_send_signals   (MousepadDocument    *document);
 
+void              mousepad_document_freeze         (MousepadDocument    *document);
+
+void              mousepad_document_thaw           (MousepadDocument    *document);
+
 GtkWidget        *mousepad_document_get_tab_label  (MousepadDocument    *document);
 
 const gchar      *mousepad_document_get_basename   (MousepadDocument    *document);
@@ -97,6 +105,16 @@ const gchar      *mousepad_document_get_filename   (MousepadDocument    *documen
 
 gboolean          mousepad_document_get_word_wrap  (MousepadDocument    *document);
 
+void              mousepad_document_set_pager      (MousepadDocument    *document,
+                                                    MousepadPager       *pager);
+
+MousepadPager    *mousepad_document_get_pager      (MousepadDocument    *document);
+
+guint64           mousepad_document_get_line       (MousepadDocument    *document);
+
+void              mousepad_document_go_to_line     (MousepadDocument    *document,
+                                                    guint64              line);
+
 void              mousepad_document_search         (MousepadDocument    *document,
                                                     const gchar         *string,
                                                     const gchar         *replace,
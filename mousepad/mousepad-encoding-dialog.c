@@ -15,19 +15,35 @@
  */
 
 #include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-cache.h>
 #include <mousepad/mousepad-document.h>
 #include <mousepad/mousepad-encoding.h>
 #include <mousepad/mousepad-encoding-dialog.h>
 #include <mousepad/mousepad-util.h>
 #include <mousepad/mousepad-dialogs.h>
 
+#include <errno.h>
 
 
+
+/* the encodings are first tested on a sample of the file contents, to reject most of
+ * them quickly, and only then on the whole contents */
+#define MOUSEPAD_ENCODING_DIALOG_SAMPLE_SIZE  (64 * 1024)
+
+/* the preview only shows the beginning of the file */
+#define MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE (256 * 1024)
+
+/* size of the conversion output buffer, between which cancellation is checked */
+#define MOUSEPAD_ENCODING_DIALOG_CHUNK_SIZE   (64 * 1024)
+
+
+
+typedef struct _MousepadEncodingProbe MousepadEncodingProbe;
+
 static void     mousepad_encoding_dialog_finalize               (GObject                     *object);
 static void     mousepad_encoding_dialog_response               (GtkDialog                   *dialog,
                                                                  gint                         response_id);
-static gboolean mousepad_encoding_dialog_test_encodings_idle    (gpointer                     user_data);
-static void     mousepad_encoding_dialog_test_encodings_destroy (gpointer                     user_data);
+static void     mousepad_encoding_dialog_probe_cancel           (MousepadEncodingDialog      *dialog);
 static void     mousepad_encoding_dialog_test_encodings         (MousepadEncodingDialog      *dialog);
 static void     mousepad_encoding_dialog_cancel_encoding_test   (GtkWidget                   *button,
                                                                  MousepadEncodingDialog      *dialog);
@@ -47,6 +63,49 @@ enum
   N_COLUMNS
 };
 
+/* encoding test results */
+enum
+{
+  PROBE_UNKNOWN = -1,
+  PROBE_FAILED,
+  PROBE_PARTIAL,
+  PROBE_VALID
+};
+
+/* the encoding tests of a dialog, shared with the worker threads */
+struct _MousepadEncodingProbe
+{
+  gint                    ref_count;
+
+  /* the dialog, NULL once it doesn't want the results anymore, only accessed from
+   * the main thread as well as the counters */
+  MousepadEncodingDialog *dialog;
+  guint                   n_jobs;
+  guint                   n_done;
+
+  GCancellable           *cancellable;
+  GThreadPool            *pool;
+  GBytes                 *contents;
+};
+
+/* the test of an encoding, run in two steps by the probe thread pool */
+typedef struct
+{
+  MousepadEncodingProbe  *probe;
+  MousepadEncoding        encoding;
+  const gchar            *charset;
+  gboolean                is_default;
+  gboolean                is_system;
+
+  /* the conversion state, between the sample and the whole contents */
+  GIConv                  conv;
+  gsize                   offset;
+  gboolean                sampled;
+
+  gint                    result;
+}
+MousepadEncodingProbeJob;
+
 struct _MousepadEncodingDialogClass
 {
   GtkDialogClass __parent__;
@@ -54,35 +113,35 @@ struct _MousepadEncodingDialogClass
 
 struct _MousepadEncodingDialog
 {
-  GtkDialog      __parent__;
+  GtkDialog              __parent__;
 
   /* the file */
-  MousepadDocument *document;
+  MousepadDocument      *document;
 
   /* dialog title */
-  gchar            *title;
-
-  /* encoding test idle id */
-  guint             timer_id;
+  gchar                 *title;
 
-  /* boolean to cancel the testing loop */
-  guint             cancel_testing : 1;
+  /* the running encoding tests, the file contents and the test results, indexed by
+   * encoding (the unsupported system charset being tested as MOUSEPAD_ENCODING_NONE) */
+  MousepadEncodingProbe *probe;
+  GBytes                *contents;
+  gint                   results[MOUSEPAD_N_ENCODINGS];
 
   /* dialog widgets */
-  GtkWidget        *button_ok;
-  GtkWidget        *button_cancel;
-  GtkWidget        *error_box;
-  GtkWidget        *error_label;
-  GtkWidget        *progress_bar;
+  GtkWidget             *button_ok;
+  GtkWidget             *button_cancel;
+  GtkWidget             *error_box;
+  GtkWidget             *error_label;
+  GtkWidget             *progress_bar;
 
   /* radio buttons */
-  GtkWidget        *radio_default;
-  GtkWidget        *radio_system;
-  GtkWidget        *radio_other;
+  GtkWidget             *radio_default;
+  GtkWidget             *radio_system;
+  GtkWidget             *radio_other;
 
   /* other encodings combo box */
-  GtkListStore     *store, *fallback_store;
-  GtkWidget        *combo;
+  GtkListStore          *store, *fallback_store;
+  GtkWidget             *combo;
 };
 
 
@@ -112,6 +171,13 @@ mousepad_encoding_dialog_init (MousepadEncodingDialog *dialog)
   const gchar     *system_charset, *default_charset;
   GtkWidget       *area, *vbox, *hbox, *icon;
   GtkCellRenderer *cell;
+  guint            n;
+
+  /* no encoding tested yet */
+  dialog->probe = NULL;
+  dialog->contents = NULL;
+  for (n = 0; n < MOUSEPAD_N_ENCODINGS; n++)
+    dialog->results[n] = PROBE_UNKNOWN;
 
   /* set some dialog properties */
   gtk_window_set_default_size (GTK_WINDOW (dialog), 550, 350);
@@ -227,9 +293,10 @@ mousepad_encoding_dialog_finalize (GObject *object)
 {
   MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (object);
 
-  /* stop running timeout */
-  if (G_UNLIKELY (dialog->timer_id))
-    g_source_remove (dialog->timer_id);
+  /* stop the running encoding tests */
+  mousepad_encoding_dialog_probe_cancel (dialog);
+  if (dialog->contents != NULL)
+    g_bytes_unref (dialog->contents);
 
   /* clear and release stores */
   g_free (dialog->title);
@@ -248,122 +315,158 @@ mousepad_encoding_dialog_response (GtkDialog *dialog,
                                    gint       response_id)
 {
   /* make sure we cancel encoding testing asap */
-  MOUSEPAD_ENCODING_DIALOG (dialog)->cancel_testing = TRUE;
+  mousepad_encoding_dialog_probe_cancel (MOUSEPAD_ENCODING_DIALOG (dialog));
 }
 
 
 
-static gboolean
-mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
+static MousepadEncodingProbe *
+mousepad_encoding_probe_ref (MousepadEncodingProbe *probe)
 {
-  MousepadEncodingDialog *dialog = MOUSEPAD_ENCODING_DIALOG (user_data);
-  MousepadEncoding        default_encoding, system_encoding;
-  GError                 *error = NULL;
-  const gchar            *charset, *subtitle;
-  gchar                  *contents, *label, *encoded;
-  gsize                   length, written;
-  guint                   i, n;
-  gint                    result = 0;
-  gboolean                default_valid, system_valid = FALSE;
+  g_atomic_int_inc (&probe->ref_count);
 
-  /* exit with a popup dialog in case of problem */
-  if (! g_file_load_contents (mousepad_file_get_location (dialog->document->file),
-                              NULL, &contents, &length, NULL, &error))
-    {
-      /* show the warning */
-      mousepad_dialogs_show_error (GTK_WINDOW (dialog), error, MOUSEPAD_MESSAGE_IO_ERROR);
+  return probe;
+}
 
-      /* cleanup */
-      g_error_free (error);
 
-      /* cancel encoding test */
-      gtk_dialog_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_CANCEL);
 
-      return FALSE;
+static void
+mousepad_encoding_probe_unref (gpointer data)
+{
+  MousepadEncodingProbe *probe = data;
+
+  if (g_atomic_int_dec_and_test (&probe->ref_count))
+    {
+      g_object_unref (probe->cancellable);
+      if (probe->contents != NULL)
+        g_bytes_unref (probe->contents);
+
+      g_slice_free (MousepadEncodingProbe, probe);
     }
+}
 
-  /* see if default and system encodings are valid and set their button labels */
-  default_valid = g_utf8_validate (contents, length, NULL);
-  default_encoding = mousepad_encoding_get_default ();
-  charset = mousepad_encoding_get_charset (default_encoding);
-  label = default_valid ? g_strdup_printf ("%s (%s)", _("Default"), charset)
-                        : g_strdup_printf (_("%s (%s, partial)"), _("Default"), charset);
-  gtk_button_set_label (GTK_BUTTON (dialog->radio_default), label);
-  g_free (label);
 
-  /* get the system charset */
-  g_get_charset (&charset);
-  system_encoding = mousepad_encoding_find (charset);
 
-  if (dialog->radio_system != NULL)
+static void
+mousepad_encoding_probe_job_free (gpointer data)
+{
+  MousepadEncodingProbeJob *job = data;
+
+  if (job->conv != (GIConv) -1)
+    g_iconv_close (job->conv);
+
+  mousepad_encoding_probe_unref (job->probe);
+  g_slice_free (MousepadEncodingProbeJob, job);
+}
+
+
+
+/* convert the contents from the job offset up to @limit, the rest of the contents
+ * being available if @limit is less than @length */
+static void
+mousepad_encoding_dialog_probe_convert (MousepadEncodingProbeJob *job,
+                                        const gchar              *contents,
+                                        gsize                     limit,
+                                        gsize                     length)
+{
+  gchar *buffer, *in, *out;
+  gsize  in_left, out_left, retval;
+  gint   errsv;
+
+  buffer = g_malloc (MOUSEPAD_ENCODING_DIALOG_CHUNK_SIZE);
+  in = (gchar *) contents + job->offset;
+  in_left = limit - job->offset;
+
+  while (in_left > 0)
     {
-      /* try to convert the contents in the system encoding */
-      encoded = g_convert (contents, length, "UTF-8", charset, NULL, &written, NULL);
-
-      /* set the button label accordingly */
-      if (encoded == NULL)
-        label = g_strdup_printf (_("%s (%s, failed)"), _("System"), charset);
-      else if (! g_utf8_validate (encoded, written, NULL))
-        label = g_strdup_printf (_("%s (%s, partial)"), _("System"), charset);
-      else
+      if (g_cancellable_is_cancelled (job->probe->cancellable))
         {
-          system_valid = TRUE;
-          label = g_strdup_printf ("%s (%s)", _("System"), charset);
+          job->result = PROBE_UNKNOWN;
+          break;
         }
 
-      gtk_button_set_label (GTK_BUTTON (dialog->radio_system), label);
+      out = buffer;
+      out_left = MOUSEPAD_ENCODING_DIALOG_CHUNK_SIZE;
+      retval = g_iconv (job->conv, &in, &in_left, &out, &out_left);
+      errsv = errno;
 
-      /* cleanup */
-      g_free (label);
-      g_free (encoded);
+      /* iconv only outputs whole characters, so that each chunk can be validated
+       * separately, null bytes making it invalid as well */
+      if (job->result == PROBE_VALID && ! g_utf8_validate (buffer, out - buffer, NULL))
+        job->result = PROBE_PARTIAL;
+
+      if (retval == (gsize) -1 && errsv != E2BIG)
+        {
+          /* an incomplete character at the end of the sample is completed by the rest
+           * of the contents, otherwise the conversion failed */
+          if (errsv != EINVAL || limit == length)
+            job->result = PROBE_FAILED;
+
+          break;
+        }
     }
 
-  /* test all other encodings */
-  for (i = 1, n = 0; i < MOUSEPAD_N_ENCODINGS && ! dialog->cancel_testing; i++)
+  job->offset = in - contents;
+  g_free (buffer);
+}
+
+
+
+static void
+mousepad_encoding_dialog_store_insert (GtkListStore     *store,
+                                       MousepadEncoding  encoding,
+                                       const gchar      *charset)
+{
+  GtkTreeModel *model = GTK_TREE_MODEL (store);
+  GtkTreeIter   iter;
+  gboolean      valid;
+  gint          id, position = 0;
+
+  /* keep the encodings sorted, whatever the order in which the results arrive */
+  for (valid = gtk_tree_model_get_iter_first (model, &iter); valid;
+       valid = gtk_tree_model_iter_next (model, &iter), position++)
     {
-      /* skip default and system encodings */
-      if (i == default_encoding || i == system_encoding)
-        continue;
+      gtk_tree_model_get (model, &iter, COLUMN_ID, &id, -1);
+      if (id > (gint) encoding)
+        break;
+    }
 
-      /* set progress bar fraction */
-      gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar),
-                                     (i + 1.00) / MOUSEPAD_N_ENCODINGS);
+  gtk_list_store_insert_with_values (store, NULL, position,
+                                     COLUMN_LABEL, charset, COLUMN_ID, encoding, -1);
+}
 
-      /* try to convert the content */
-      charset = mousepad_encoding_get_charset (i);
-      encoded = g_convert (contents, length, "UTF-8", charset, NULL, &written, NULL);
 
-      if (encoded != NULL)
-        {
-          /* insert in the store */
-          if (g_utf8_validate (encoded, written, NULL))
-            gtk_list_store_insert_with_values (dialog->store, NULL, n++,
-                                               COLUMN_LABEL, charset, COLUMN_ID, i, -1);
-          else
-            gtk_list_store_insert_with_values (dialog->fallback_store, NULL, n++,
-                                               COLUMN_LABEL, charset, COLUMN_ID, i, -1);
-
-          /* cleanup */
-          g_free (encoded);
-        }
 
-      /* iterate the main loop to update the gui */
-      while (gtk_events_pending ())
-        gtk_main_iteration ();
-    }
+static void
+mousepad_encoding_dialog_probe_finish (MousepadEncodingDialog *dialog)
+{
+  MousepadEncoding  system_encoding;
+  const gchar      *charset, *subtitle;
+  gboolean          default_valid, system_valid = FALSE;
+  gint              result = 0, n;
 
-  /* cleanup */
-  g_free (contents);
+  /* the tests are complete */
+  mousepad_encoding_dialog_probe_cancel (dialog);
+
+  default_valid = dialog->results[mousepad_encoding_get_default ()] == PROBE_VALID;
+  if (dialog->radio_system != NULL)
+    {
+      g_get_charset (&charset);
+      system_encoding = mousepad_encoding_find (charset);
+      system_valid = dialog->results[system_encoding] == PROBE_VALID;
+    }
 
   /* hide progress bar and cancel button */
   gtk_widget_hide (dialog->progress_bar);
   gtk_widget_hide (dialog->button_cancel);
 
   /* check if we have something to propose to the user apart from the default encoding */
-  if (! gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->store), NULL))
+  n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->store), NULL);
+  if (n == 0)
     {
       /* fall back to partially valid conversions if possible */
-      if (G_LIKELY (gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->fallback_store), NULL)))
+      n = gtk_tree_model_iter_n_children (GTK_TREE_MODEL (dialog->fallback_store), NULL);
+      if (G_LIKELY (n > 0))
         {
           result = 1 - (default_valid || system_valid);
           gtk_combo_box_set_model (GTK_COMBO_BOX (dialog->combo),
@@ -416,6 +519,9 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
                                           _("No other valid encoding was found."),
                                           "text-x-generic");
 
+      /* the combo box may have been shown while testing */
+      gtk_widget_hide (dialog->combo);
+
       /* the system charset won't be recognized here, this is just to inform the user
        * that it is different from default */
       if (dialog->radio_system)
@@ -427,6 +533,81 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
       /* activate the radio button (maybe hidden) */
       gtk_toggle_button_toggled (GTK_TOGGLE_BUTTON (dialog->radio_default));
     }
+}
+
+
+
+static void
+mousepad_encoding_dialog_probe_add (MousepadEncodingDialog   *dialog,
+                                    MousepadEncodingProbeJob *job)
+{
+  gchar *label;
+
+  /* update the progress bar */
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (dialog->progress_bar),
+                                 (gdouble) dialog->probe->n_done / dialog->probe->n_jobs);
+
+  dialog->results[job->encoding] = job->result;
+
+  if (job->is_default)
+    {
+      /* set the default button label, the test may have been cancelled */
+      if (job->result == PROBE_PARTIAL || job->result == PROBE_FAILED)
+        label = g_strdup_printf (_("%s (%s, partial)"), _("Default"), job->charset);
+      else
+        label = g_strdup_printf ("%s (%s)", _("Default"), job->charset);
+
+      gtk_button_set_label (GTK_BUTTON (dialog->radio_default), label);
+      g_free (label);
+    }
+  else if (job->is_system)
+    {
+      /* set the system button label */
+      if (job->result == PROBE_FAILED)
+        label = g_strdup_printf (_("%s (%s, failed)"), _("System"), job->charset);
+      else if (job->result == PROBE_PARTIAL)
+        label = g_strdup_printf (_("%s (%s, partial)"), _("System"), job->charset);
+      else
+        label = g_strdup_printf ("%s (%s)", _("System"), job->charset);
+
+      gtk_button_set_label (GTK_BUTTON (dialog->radio_system), label);
+      g_free (label);
+    }
+  else if (job->result == PROBE_VALID)
+    {
+      /* show valid encodings as soon as they are found, the combo box being made
+       * sensitive when the tests are complete */
+      mousepad_encoding_dialog_store_insert (dialog->store, job->encoding, job->charset);
+      if (! gtk_widget_get_visible (dialog->combo))
+        {
+          gtk_widget_set_sensitive (dialog->combo, FALSE);
+          gtk_widget_show (dialog->combo);
+        }
+    }
+  else if (job->result == PROBE_PARTIAL)
+    mousepad_encoding_dialog_store_insert (dialog->fallback_store, job->encoding, job->charset);
+
+  if (dialog->probe->n_done == dialog->probe->n_jobs)
+    mousepad_encoding_dialog_probe_finish (dialog);
+}
+
+
+
+static gboolean
+mousepad_encoding_dialog_probe_report (gpointer data)
+{
+  MousepadEncodingProbeJob *job = data;
+  MousepadEncodingProbe    *probe = job->probe;
+
+  /* all jobs have run, the pool can be released */
+  if (++probe->n_done == probe->n_jobs)
+    {
+      g_thread_pool_free (probe->pool, FALSE, FALSE);
+      probe->pool = NULL;
+    }
+
+  if (probe->dialog != NULL)
+    mousepad_encoding_dialog_probe_add (probe->dialog, job);
 
   return FALSE;
 }
@@ -434,24 +615,217 @@ mousepad_encoding_dialog_test_encodings_idle (gpointer user_data)
 
 
 static void
-mousepad_encoding_dialog_test_encodings_destroy (gpointer user_data)
+mousepad_encoding_dialog_probe_run (gpointer data,
+                                    gpointer user_data)
+{
+  MousepadEncodingProbeJob *job = data;
+  const gchar              *contents;
+  gsize                     length;
+
+  contents = g_bytes_get_data (job->probe->contents, &length);
+
+  if (g_cancellable_is_cancelled (job->probe->cancellable))
+    job->result = PROBE_UNKNOWN;
+  else if (! job->sampled)
+    {
+      job->sampled = TRUE;
+      job->conv = g_iconv_open ("UTF-8", job->charset);
+      if (job->conv == (GIConv) -1)
+        job->result = PROBE_FAILED;
+      else
+        {
+          job->result = PROBE_VALID;
+          mousepad_encoding_dialog_probe_convert (job, contents,
+                                                  MIN (length, MOUSEPAD_ENCODING_DIALOG_SAMPLE_SIZE),
+                                                  length);
+
+          /* confirm on the whole contents, once the samples of the other encodings
+           * queued before have been tested */
+          if (job->result > PROBE_FAILED && job->offset < length)
+            {
+              g_thread_pool_push (job->probe->pool, job, NULL);
+              return;
+            }
+        }
+    }
+  else
+    mousepad_encoding_dialog_probe_convert (job, contents, length, length);
+
+  /* report the result in the main thread */
+  g_idle_add_full (G_PRIORITY_DEFAULT, mousepad_encoding_dialog_probe_report,
+                   job, mousepad_encoding_probe_job_free);
+}
+
+
+
+static void
+mousepad_encoding_dialog_probe_push (MousepadEncodingProbe *probe,
+                                     MousepadEncoding       encoding,
+                                     const gchar           *charset,
+                                     gboolean               is_default,
+                                     gboolean               is_system)
 {
-  MOUSEPAD_ENCODING_DIALOG (user_data)->timer_id = 0;
+  MousepadEncodingProbeJob *job;
+
+  job = g_slice_new0 (MousepadEncodingProbeJob);
+  job->probe = mousepad_encoding_probe_ref (probe);
+  job->encoding = encoding;
+  job->charset = charset;
+  job->is_default = is_default;
+  job->is_system = is_system;
+  job->conv = (GIConv) -1;
+  job->result = PROBE_UNKNOWN;
+
+  probe->n_jobs++;
+  g_thread_pool_push (probe->pool, job, NULL);
 }
 
 
 
 static void
-mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog)
+mousepad_encoding_dialog_probe_load (GTask        *task,
+                                     gpointer      source_object,
+                                     gpointer      task_data,
+                                     GCancellable *cancellable)
 {
-  if (G_LIKELY (dialog->timer_id == 0))
+  GFileInfo   *fileinfo;
+  GBytes      *bytes = NULL;
+  GError      *error = NULL;
+  gchar       *contents, *etag = NULL;
+  goffset      size = -1;
+  gsize        length;
+
+  /* reuse the contents read when opening the file, if it did not change in the meantime */
+  fileinfo = g_file_query_info (task_data, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                G_FILE_ATTRIBUTE_ETAG_VALUE, G_FILE_QUERY_INFO_NONE,
+                                cancellable, NULL);
+  if (fileinfo != NULL)
     {
-      /* reset boolean */
-      dialog->cancel_testing = FALSE;
+      etag = g_strdup (g_file_info_get_etag (fileinfo));
+      size = g_file_info_get_size (fileinfo);
+      bytes = mousepad_cache_lookup (task_data, etag, size, MOUSEPAD_ENCODING_NONE);
+      g_object_unref (fileinfo);
+    }
+
+  /* read the contents in memory of their own, a mapping could be changed under our feet */
+  if (bytes == NULL && g_file_load_contents (task_data, cancellable, &contents, &length, NULL, &error))
+    bytes = g_bytes_new_take (contents, length);
+
+  if (bytes != NULL)
+    {
+      mousepad_cache_insert (task_data, etag, size, MOUSEPAD_ENCODING_NONE, bytes);
+      g_task_return_pointer (task, bytes, (GDestroyNotify) g_bytes_unref);
+    }
+  else
+    g_task_return_error (task, error);
+
+  g_free (etag);
+}
+
+
+
+static void
+mousepad_encoding_dialog_probe_loaded (GObject      *object,
+                                       GAsyncResult *result,
+                                       gpointer      data)
+{
+  MousepadEncodingProbe  *probe = data;
+  MousepadEncodingDialog *dialog = probe->dialog;
+  MousepadEncoding        default_encoding, system_encoding, encoding;
+  GError                 *error = NULL;
+  const gchar            *charset;
+
+  probe->contents = g_task_propagate_pointer (G_TASK (result), &error);
+
+  /* the dialog was closed in the meantime */
+  if (dialog == NULL)
+    {
+      g_clear_error (&error);
+      mousepad_encoding_probe_unref (probe);
+
+      return;
+    }
+
+  /* exit with a popup dialog in case of problem */
+  if (probe->contents == NULL)
+    {
+      /* show the warning */
+      mousepad_dialogs_show_error (GTK_WINDOW (dialog), error, MOUSEPAD_MESSAGE_IO_ERROR);
+
+      /* cleanup */
+      g_error_free (error);
+      mousepad_encoding_probe_unref (probe);
+
+      /* cancel encoding test */
+      gtk_dialog_response (GTK_DIALOG (dialog), MOUSEPAD_RESPONSE_CANCEL);
+
+      return;
+    }
 
-      /* start a new idle function */
-      dialog->timer_id = g_idle_add_full (G_PRIORITY_LOW, mousepad_encoding_dialog_test_encodings_idle,
-                                          dialog, mousepad_encoding_dialog_test_encodings_destroy);
+  /* keep the contents for the preview */
+  dialog->contents = g_bytes_ref (probe->contents);
+
+  /* test all encodings in parallel, the default and system ones first */
+  probe->pool = g_thread_pool_new (mousepad_encoding_dialog_probe_run, NULL,
+                                   MAX (g_get_num_processors (), 1), FALSE, NULL);
+
+  default_encoding = mousepad_encoding_get_default ();
+  mousepad_encoding_dialog_probe_push (probe, default_encoding,
+                                       mousepad_encoding_get_charset (default_encoding),
+                                       TRUE, FALSE);
+
+  g_get_charset (&charset);
+  system_encoding = mousepad_encoding_find (charset);
+  if (dialog->radio_system != NULL)
+    mousepad_encoding_dialog_probe_push (probe, system_encoding, charset, FALSE, TRUE);
+
+  for (encoding = 1; encoding < MOUSEPAD_N_ENCODINGS; encoding++)
+    if (encoding != default_encoding && encoding != system_encoding)
+      mousepad_encoding_dialog_probe_push (probe, encoding,
+                                           mousepad_encoding_get_charset (encoding),
+                                           FALSE, FALSE);
+
+  mousepad_encoding_probe_unref (probe);
+}
+
+
+
+static void
+mousepad_encoding_dialog_probe_cancel (MousepadEncodingDialog *dialog)
+{
+  if (dialog->probe == NULL)
+    return;
+
+  /* the jobs will finish as soon as possible, without reporting to the dialog */
+  dialog->probe->dialog = NULL;
+  g_cancellable_cancel (dialog->probe->cancellable);
+  mousepad_encoding_probe_unref (dialog->probe);
+  dialog->probe = NULL;
+}
+
+
+
+static void
+mousepad_encoding_dialog_test_encodings (MousepadEncodingDialog *dialog)
+{
+  MousepadEncodingProbe *probe;
+  GTask                 *task;
+
+  if (G_LIKELY (dialog->probe == NULL))
+    {
+      probe = g_slice_new0 (MousepadEncodingProbe);
+      probe->ref_count = 1;
+      probe->dialog = dialog;
+      probe->cancellable = g_cancellable_new ();
+      dialog->probe = probe;
+
+      /* read the file in a worker thread, then test the encodings in a thread pool */
+      task = g_task_new (NULL, probe->cancellable, mousepad_encoding_dialog_probe_loaded,
+                         mousepad_encoding_probe_ref (probe));
+      g_task_set_task_data (task, g_object_ref (mousepad_file_get_location (dialog->document->file)),
+                            g_object_unref);
+      g_task_run_in_thread (task, mousepad_encoding_dialog_probe_load);
+      g_object_unref (task);
     }
 }
 
@@ -461,8 +835,80 @@ static void
 mousepad_encoding_dialog_cancel_encoding_test (GtkWidget              *button,
                                                MousepadEncodingDialog *dialog)
 {
-  /* cancel the testing loop */
-  dialog->cancel_testing = TRUE;
+  /* cancel the tests, the results found so far are still reported */
+  if (dialog->probe != NULL)
+    g_cancellable_cancel (dialog->probe->cancellable);
+}
+
+
+
+/* convert the beginning of the contents for the preview, making them valid as when
+ * loading a document, returns whether it was already valid */
+static gboolean
+mousepad_encoding_dialog_convert_preview (const gchar  *contents,
+                                          gsize         length,
+                                          const gchar  *charset,
+                                          gchar       **text)
+{
+  GString  *string;
+  GIConv    conv;
+  gchar    *buffer, *in, *out;
+  gsize     in_left, out_left, retval;
+  gboolean  valid = TRUE;
+  gint      errsv;
+
+  conv = g_iconv_open ("UTF-8", charset);
+  if (conv == (GIConv) -1)
+    {
+      *text = g_strdup ("");
+      return FALSE;
+    }
+
+  buffer = g_malloc (MOUSEPAD_ENCODING_DIALOG_CHUNK_SIZE);
+  string = g_string_new (NULL);
+  in = (gchar *) contents;
+  in_left = MIN (length, MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE);
+
+  while (in_left > 0)
+    {
+      out = buffer;
+      out_left = MOUSEPAD_ENCODING_DIALOG_CHUNK_SIZE;
+      retval = g_iconv (conv, &in, &in_left, &out, &out_left);
+      errsv = errno;
+      g_string_append_len (string, buffer, out - buffer);
+
+      if (retval == (gsize) -1 && errsv != E2BIG)
+        {
+          /* the last character may be truncated by the preview size */
+          if (errsv != EILSEQ)
+            {
+              valid = valid && length > MOUSEPAD_ENCODING_DIALOG_PREVIEW_SIZE;
+              break;
+            }
+
+          /* replace an invalid byte and go on */
+          g_string_append (string, "\357\277\275");
+          in++;
+          in_left--;
+          valid = FALSE;
+        }
+    }
+
+  g_iconv_close (conv);
+  g_free (buffer);
+
+  /* null bytes and invalid output are replaced as well */
+  if (! g_utf8_validate (string->str, string->len, NULL))
+    {
+      *text = g_utf8_make_valid (string->str, string->len);
+      valid = FALSE;
+    }
+  else
+    *text = g_strdup (string->str);
+
+  g_string_free (string, TRUE);
+
+  return valid;
 }
 
 
@@ -471,44 +917,48 @@ static void
 mousepad_encoding_dialog_read_file (MousepadEncodingDialog *dialog,
                                     MousepadEncoding        encoding)
 {
-  GtkTextIter  start, end;
-  GError      *error = NULL;
-  gchar       *message;
+  const gchar *contents, *charset;
+  gchar       *message, *text = NULL;
+  gsize        length;
+  gboolean     valid;
   gint         result;
 
-  /* clear buffer */
-  gtk_text_buffer_get_bounds (dialog->document->buffer, &start, &end);
-  gtk_text_buffer_delete (dialog->document->buffer, &start, &end);
-
   if (G_LIKELY (encoding))
     {
       /* set encoding */
       mousepad_file_set_encoding (dialog->document->file, encoding);
 
-      /* try to open the file */
-      result = mousepad_file_open (dialog->document->file, TRUE, TRUE, TRUE, &error);
+      /* preview the beginning of the file */
+      contents = g_bytes_get_data (dialog->contents, &length);
+      charset = mousepad_encoding_get_charset (encoding);
+      valid = mousepad_encoding_dialog_convert_preview (contents, length, charset, &text);
+
+      /* rely on the test of the whole contents, or on the preview if it was cancelled */
+      result = dialog->results[encoding];
+      if (result == PROBE_UNKNOWN)
+        result = valid ? PROBE_VALID : PROBE_PARTIAL;
     }
   /* unsupported system charset */
   else
-    result = 1;
+    result = PROBE_UNKNOWN;
+
+  /* replace the buffer contents, this is not an undoable user action */
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (dialog->document->buffer));
+  gtk_text_buffer_set_text (dialog->document->buffer, text != NULL ? text : "", -1);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (dialog->document->buffer));
+  g_free (text);
 
   /* set sensitivity of the ok button */
-  gtk_widget_set_sensitive (dialog->button_ok, result == 0);
+  gtk_widget_set_sensitive (dialog->button_ok, result == PROBE_VALID);
 
   /* no error, hide the box */
-  if (result == 0)
+  if (result == PROBE_VALID)
     gtk_widget_hide (dialog->error_box);
   else
     {
       /* conversion error */
-      if (error)
-        {
-          /* format message */
-          message = g_strdup_printf ("<b>%s.</b>", error->message);
-
-          /* clear the error */
-          g_error_free (error);
-        }
+      if (result != PROBE_UNKNOWN)
+        message = g_strdup_printf ("<b>%s.</b>", _("Invalid byte sequence in conversion input"));
       /* conversion skipped */
       else
         message = g_strdup_printf ("<b>%s.</b>", MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING);
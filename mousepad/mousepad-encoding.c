@@ -18,6 +18,28 @@
 #include <mousepad/mousepad-encoding.h>
 #include <mousepad/mousepad-settings.h>
 
+#include <errno.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+
+/* the number of bytes examined to detect the encoding of a file */
+#define MOUSEPAD_ENCODING_DETECT_SAMPLE_SIZE   (16 * 1024)
+
+/* the average score per character of a decoded text which looks like natural language */
+#define MOUSEPAD_ENCODING_DETECT_GOOD_SCORE    2.0
+
+/* the bonus of the characters whose encoded form is among the most frequent ones */
+#define MOUSEPAD_ENCODING_DETECT_BONUS         2.0
+
+/* how fast the confidence grows with the score difference between candidates, and
+ * the number of characters beyond which more evidence doesn't make it grow faster */
+#define MOUSEPAD_ENCODING_DETECT_TEMPERATURE   2.0
+#define MOUSEPAD_ENCODING_DETECT_MAX_EVIDENCE  1024
+
 
 
 struct MousepadEncodingInfo
@@ -111,6 +133,160 @@ static const struct MousepadEncodingInfo encoding_infos[MOUSEPAD_N_ENCODINGS] =
 
 
 
+/* what the detection knows about some encodings: a preference between encodings which
+ * decode a text identically, and for multibyte encodings, two ranges of lead bytes of
+ * their most frequent characters (the kana and the first level of ideographs or syllables) */
+struct MousepadEncodingModel
+{
+  MousepadEncoding  encoding;
+  guint8            prior;
+  guint8            frequent[4];
+};
+
+static const struct MousepadEncodingModel encoding_models[] =
+{
+  /* unicode */
+  { MOUSEPAD_ENCODING_UTF_8,        10, { 0xc2, 0xf4, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_UTF_16LE,      9, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_UTF_16BE,      9, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_UTF_32LE,      8, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_UTF_32BE,      8, { 0x00, 0x00, 0x00, 0x00 } },
+
+  /* single byte */
+  { MOUSEPAD_ENCODING_WINDOWS_1250,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1251,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1252,  8, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1253,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1254,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1255,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1256,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1257,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_WINDOWS_1258,  7, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_1,    6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_2,    6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_7,    6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_8_I,  6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_9,    6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_15,   5, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_ISO_8859_5,    5, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_KOI8_R,        6, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_KOI8_U,        5, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_CP_866,        5, { 0x00, 0x00, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_TIS_620,       6, { 0x00, 0x00, 0x00, 0x00 } },
+
+  /* multibyte */
+  { MOUSEPAD_ENCODING_GB18030,       7, { 0xb0, 0xd7, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_GBK,           6, { 0xb0, 0xd7, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_GB2312,        5, { 0xb0, 0xd7, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_BIG5,          7, { 0xa4, 0xc6, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_BIG5_HKSCS,    6, { 0xa4, 0xc6, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_EUC_TW,        5, { 0xc4, 0xfd, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_EUC_JP,        7, { 0xa4, 0xa5, 0xb0, 0xcf } },
+  { MOUSEPAD_ENCODING_SHIFT_JIS,     7, { 0x82, 0x83, 0x88, 0x98 } },
+  { MOUSEPAD_ENCODING_EUC_KR,        7, { 0xb0, 0xc8, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_UHC,           6, { 0xb0, 0xc8, 0x00, 0x00 } },
+  { MOUSEPAD_ENCODING_JOHAB,         4, { 0x88, 0xd3, 0x00, 0x00 } }
+};
+
+/* the most frequent lowercase or uncased letters of the scripts covered by the
+ * encodings above, apart from the ascii ones */
+static const gchar *frequent_letters =
+  /* latin */
+  "àáâãäåæçèéêëíîïñóôõöøúùûüßœąćčęěłńřśšůźżžăşţșțğıāēīūėđơư"
+  /* greek */
+  "αοιετνσςρπκμυηάέίόύή"
+  /* cyrillic */
+  "оеаинтсрвлкмдпуяыьіїє"
+  /* armenian and georgian */
+  "աեոնրիտսկմլვაიესრმოლნდ"
+  /* hebrew and arabic */
+  "יוהלרמאבנתשעכדالينمورهتبعدفكة"
+  /* thai */
+  "านรอกเมงยลวดทสิ่้";
+
+/* the non-ascii letters of some languages written with the latin script, a decoded text
+ * mixing the letters of several of them being unlikely */
+static const gchar *latin_alphabets[] =
+{
+  "àâæçéèêëîïôœùûüÿ",   /* french */
+  "äöüß",               /* german */
+  "áéíñóúü",            /* spanish */
+  "áâãàçéêíóôõú",       /* portuguese */
+  "àèéìíîòóùú",         /* italian */
+  "àçèéíïòóúü",         /* catalan */
+  "éëïöü",              /* dutch */
+  "æøåé",               /* danish and norwegian */
+  "åäöé",               /* swedish and finnish */
+  "áðéíóúýþæö",         /* icelandic */
+  "áčďéěíňóřšťúůýž",    /* czech */
+  "áäčďéíĺľňóôŕšťúýž",  /* slovak */
+  "ąćęłńóśźż",          /* polish */
+  "áéíóöőúüű",          /* hungarian */
+  "ăâîșțşţ",            /* romanian */
+  "čćđšž",              /* croatian and slovenian */
+  "çğıöşüâî",           /* turkish */
+  "āčēģīķļņšūž",        /* latvian */
+  "ąčęėįšųūž",          /* lithuanian */
+  "äöõüšž",             /* estonian */
+  "çë"                  /* albanian */
+};
+
+/* the tables built from the letters above, the detection runs in worker threads */
+static GHashTable *frequent_table = NULL;
+static GHashTable *alphabet_table = NULL;
+
+/* character classes of the detection model */
+enum
+{
+  DETECT_CLASS_OTHER,
+  DETECT_CLASS_SPACE,
+  DETECT_CLASS_LOWER,
+  DETECT_CLASS_UPPER,
+  DETECT_CLASS_LETTER,
+  DETECT_CLASS_PUNCTUATION,
+  DETECT_CLASS_SYMBOL,
+  DETECT_CLASS_CONTROL
+};
+
+/* an encoding being evaluated by the detection */
+typedef struct
+{
+  MousepadEncoding  encoding;
+  gchar            *decoded;
+  gsize             length;
+  gdouble           score;
+  gdouble           likelihood;
+  guint             n_chars;
+  guint             prior;
+}
+MousepadEncodingScore;
+
+/* the table of a single byte encoding compatible with ascii: the utf-8 form of each byte,
+ * of length 0 if the byte is not valid, and the byte of each character by pages of 256
+ * characters of the basic multilingual plane, 0 if there is none */
+typedef struct
+{
+  gchar   utf8[256][4];
+  guint8  utf8_length[256];
+  guchar *pages[256];
+}
+MousepadEncodingTable;
+
+/* the format of the utf-16 and utf-32 encodings */
+typedef struct
+{
+  guint    unit;
+  gboolean big_endian;
+  gboolean surrogates;
+}
+MousepadEncodingWide;
+
+/* the tables of the single byte encodings, built on first use from any thread */
+static MousepadEncodingTable *encoding_tables[MOUSEPAD_N_ENCODINGS];
+static gsize                  encoding_tables_initialized[MOUSEPAD_N_ENCODINGS];
+
+
+
 const gchar *
 mousepad_encoding_get_charset (MousepadEncoding encoding)
 {
@@ -259,13 +435,15 @@ mousepad_encoding_read_bom (const gchar *contents,
 
 
 
-void
-mousepad_encoding_write_bom (MousepadEncoding  *encoding,
-                             gint              *length,
-                             gchar            **contents)
+const guchar *
+mousepad_encoding_get_bom (MousepadEncoding *encoding,
+                           gsize            *bom_length)
 {
-  guchar bom[4];
-  gsize  bytes = 0, n;
+  static const guchar utf8_bom[] = { 0xef, 0xbb, 0xbf };
+  static const guchar utf16be_bom[] = { 0xfe, 0xff };
+  static const guchar utf16le_bom[] = { 0xff, 0xfe };
+  static const guchar utf32be_bom[] = { 0x00, 0x00, 0xfe, 0xff };
+  static const guchar utf32le_bom[] = { 0xff, 0xfe, 0x00, 0x00 };
 
   switch (*encoding)
     {
@@ -273,60 +451,1708 @@ mousepad_encoding_write_bom (MousepadEncoding  *encoding,
       case MOUSEPAD_ENCODING_UTF_7:
       case MOUSEPAD_ENCODING_UTF_8:
         *encoding = MOUSEPAD_ENCODING_UTF_8;
-        bom[0] = 0xef;
-        bom[1] = 0xbb;
-        bom[2] = 0xbf;
-        bytes = 3;
-        break;
+        *bom_length = sizeof (utf8_bom);
+        return utf8_bom;
 
       case MOUSEPAD_ENCODING_UTF_16BE:
-        bom[0] = 0xfe;
-        bom[1] = 0xff;
-        bytes = 2;
-        break;
+        *bom_length = sizeof (utf16be_bom);
+        return utf16be_bom;
 
       case MOUSEPAD_ENCODING_UTF_16LE:
-        bom[0] = 0xff;
-        bom[1] = 0xfe;
-        bom[2] = 0x00;
-        bom[2] = 0x00;
-        bytes = 4;
-        break;
+        *bom_length = sizeof (utf16le_bom);
+        return utf16le_bom;
 
       case MOUSEPAD_ENCODING_UTF_32BE:
-        bom[0] = 0x00;
-        bom[1] = 0x00;
-        bom[2] = 0xfe;
-        bom[2] = 0xff;
-        bytes = 4;
-        break;
+        *bom_length = sizeof (utf32be_bom);
+        return utf32be_bom;
 
       case MOUSEPAD_ENCODING_UTF_32LE:
-        bom[0] = 0xff;
-        bom[1] = 0xfe;
-        bom[2] = 0x00;
-        bom[2] = 0x00;
-        bytes = 4;
-        break;
+        *bom_length = sizeof (utf32le_bom);
+        return utf32le_bom;
+
+      default:
+        *bom_length = 0;
+        return NULL;
+    }
+}
+
+
+
+static const struct MousepadEncodingModel *
+mousepad_encoding_detect_get_model (MousepadEncoding encoding)
+{
+  static const struct MousepadEncodingModel none = { MOUSEPAD_ENCODING_NONE, 0, { 0, 0, 0, 0 } };
+  guint                                     i;
+
+  for (i = 0; i < G_N_ELEMENTS (encoding_models); i++)
+    if (encoding_models[i].encoding == encoding)
+      return encoding_models + i;
+
+  return &none;
+}
+
+
+
+static void
+mousepad_encoding_detect_init (void)
+{
+  static gsize  initialized = 0;
+  const gchar  *p;
+  gpointer      key;
+  guint         i, mask;
+
+  if (g_once_init_enter (&initialized))
+    {
+      frequent_table = g_hash_table_new (NULL, NULL);
+      for (p = frequent_letters; *p != '\0'; p = g_utf8_next_char (p))
+        g_hash_table_add (frequent_table, GUINT_TO_POINTER (g_utf8_get_char (p)));
+
+      /* map each letter to the set of alphabets it belongs to */
+      alphabet_table = g_hash_table_new (NULL, NULL);
+      for (i = 0; i < G_N_ELEMENTS (latin_alphabets); i++)
+        for (p = latin_alphabets[i]; *p != '\0'; p = g_utf8_next_char (p))
+          {
+            key = GUINT_TO_POINTER (g_utf8_get_char (p));
+            mask = GPOINTER_TO_UINT (g_hash_table_lookup (alphabet_table, key));
+            g_hash_table_insert (alphabet_table, key, GUINT_TO_POINTER (mask | (1u << i)));
+          }
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+
+
+static gboolean
+mousepad_encoding_is_wide (MousepadEncoding encoding)
+{
+  switch (encoding)
+    {
+      case MOUSEPAD_ENCODING_UTF_16LE:
+      case MOUSEPAD_ENCODING_UTF_16BE:
+      case MOUSEPAD_ENCODING_UCS_2LE:
+      case MOUSEPAD_ENCODING_UCS_2BE:
+      case MOUSEPAD_ENCODING_UTF_32LE:
+      case MOUSEPAD_ENCODING_UTF_32BE:
+        return TRUE;
+
+      default:
+        return FALSE;
+    }
+}
+
+
+
+static gboolean
+mousepad_encoding_is_7bit (MousepadEncoding encoding)
+{
+  switch (encoding)
+    {
+      case MOUSEPAD_ENCODING_UTF_7:
+      case MOUSEPAD_ENCODING_HZ:
+      case MOUSEPAD_ENCODING_ISO_2022_JP:
+      case MOUSEPAD_ENCODING_ISO_2022_KR:
+        return TRUE;
+
+      default:
+        return FALSE;
+    }
+}
+
+
+
+/* decode @sample with iconv, an incomplete character at its end being allowed only if
+ * the sample is @truncated, returns NULL if the sample is not valid in @charset */
+static gchar *
+mousepad_encoding_detect_decode (const gchar *charset,
+                                 const gchar *sample,
+                                 gsize        length,
+                                 gboolean     truncated,
+                                 gsize       *written)
+{
+  GIConv  conv;
+  gchar  *decoded, *in, *out;
+  gsize   in_left, out_left;
+  gint    errsv;
+
+  conv = g_iconv_open ("UTF-8", charset);
+  if (conv == (GIConv) -1)
+    return NULL;
+
+  /* no character takes more than four times its encoded size in UTF-8 */
+  decoded = out = g_malloc (4 * length + 1);
+  out_left = 4 * length;
+  in = (gchar *) sample;
+  in_left = length;
+
+  if (g_iconv (conv, &in, &in_left, &out, &out_left) == (gsize) -1)
+    {
+      errsv = errno;
+      if (errsv != EINVAL || ! truncated)
+        {
+          g_iconv_close (conv);
+          g_free (decoded);
+
+          return NULL;
+        }
+    }
+
+  /* reset the state of stateful encodings */
+  g_iconv (conv, NULL, NULL, &out, &out_left);
+  g_iconv_close (conv);
+
+  *out = '\0';
+  *written = out - decoded;
+
+  return decoded;
+}
+
+
+
+/* the class of @c in the detection model, and its weight: frequent letters and common
+ * punctuation, then syllables and other letters make a text look right, symbols and
+ * controls wrong */
+static gint
+mousepad_encoding_detect_classify (gunichar  c,
+                                   gdouble  *weight)
+{
+  GUnicodeScript script;
+
+  switch (g_unichar_type (c))
+    {
+      case G_UNICODE_LOWERCASE_LETTER:
+        *weight = g_hash_table_contains (frequent_table, GUINT_TO_POINTER (c)) ? 3.0 : 1.0;
+        return DETECT_CLASS_LOWER;
+
+      case G_UNICODE_UPPERCASE_LETTER:
+      case G_UNICODE_TITLECASE_LETTER:
+        *weight = 0.5;
+        return DETECT_CLASS_UPPER;
+
+      case G_UNICODE_OTHER_LETTER:
+      case G_UNICODE_MODIFIER_LETTER:
+      case G_UNICODE_NON_SPACING_MARK:
+      case G_UNICODE_SPACING_MARK:
+      case G_UNICODE_ENCLOSING_MARK:
+        if (g_hash_table_contains (frequent_table, GUINT_TO_POINTER (c)))
+          *weight = 3.0;
+        else
+          {
+            script = g_unichar_get_script (c);
+            *weight = (script == G_UNICODE_SCRIPT_HANGUL || script == G_UNICODE_SCRIPT_HIRAGANA
+                       || script == G_UNICODE_SCRIPT_KATAKANA) ? 2.0 : 1.0;
+          }
+
+        return DETECT_CLASS_LETTER;
+
+      case G_UNICODE_DECIMAL_NUMBER:
+        *weight = 0.5;
+        return DETECT_CLASS_OTHER;
+
+      case G_UNICODE_LETTER_NUMBER:
+      case G_UNICODE_OTHER_NUMBER:
+      case G_UNICODE_FORMAT:
+        *weight = 0.0;
+        return DETECT_CLASS_OTHER;
+
+      case G_UNICODE_SPACE_SEPARATOR:
+      case G_UNICODE_LINE_SEPARATOR:
+      case G_UNICODE_PARAGRAPH_SEPARATOR:
+        *weight = 0.5;
+        return DETECT_CLASS_SPACE;
+
+      case G_UNICODE_CONNECT_PUNCTUATION:
+      case G_UNICODE_DASH_PUNCTUATION:
+      case G_UNICODE_OPEN_PUNCTUATION:
+      case G_UNICODE_CLOSE_PUNCTUATION:
+      case G_UNICODE_INITIAL_PUNCTUATION:
+      case G_UNICODE_FINAL_PUNCTUATION:
+      case G_UNICODE_OTHER_PUNCTUATION:
+        /* quotes, dashes and ellipsis, guillemets, inverted marks, cjk and fullwidth punctuation */
+        if ((c >= 0x2010 && c <= 0x2027) || (c >= 0x3000 && c <= 0x303f)
+            || (c >= 0xff01 && c <= 0xff65) || c == 0xab || c == 0xbb || c == 0xa1 || c == 0xbf)
+          {
+            *weight = 3.0;
+            return DETECT_CLASS_PUNCTUATION;
+          }
+
+        *weight = 0.0;
+        return DETECT_CLASS_OTHER;
+
+      case G_UNICODE_MATH_SYMBOL:
+      case G_UNICODE_CURRENCY_SYMBOL:
+      case G_UNICODE_MODIFIER_SYMBOL:
+      case G_UNICODE_OTHER_SYMBOL:
+        /* euro, pound, degree, copyright, registered and trademark signs */
+        *weight = (c == 0x20ac || c == 0xa3 || c == 0xb0 || c == 0xa9
+                   || c == 0xae || c == 0x2122) ? 0.0 : -2.0;
+        return DETECT_CLASS_SYMBOL;
+
+      case G_UNICODE_CONTROL:
+        if (c == '\t' || c == '\n' || c == '\r' || c == '\f')
+          {
+            *weight = 0.5;
+            return DETECT_CLASS_SPACE;
+          }
+
+        /* fall through */
+
+      default:
+        *weight = -10.0;
+        return DETECT_CLASS_CONTROL;
+    }
+}
+
+
+
+static GUnicodeScript
+mousepad_encoding_detect_script (gunichar c)
+{
+  GUnicodeScript script = g_unichar_get_script (c);
+
+  switch (script)
+    {
+      /* the chinese and japanese scripts are mixed in the same texts */
+      case G_UNICODE_SCRIPT_HIRAGANA:
+      case G_UNICODE_SCRIPT_KATAKANA:
+      case G_UNICODE_SCRIPT_BOPOMOFO:
+        return G_UNICODE_SCRIPT_HAN;
+
+      case G_UNICODE_SCRIPT_INHERITED:
+      case G_UNICODE_SCRIPT_UNKNOWN:
+        return G_UNICODE_SCRIPT_COMMON;
+
+      default:
+        return script;
+    }
+}
+
+
+
+#define DETECT_IS_LETTER(klass) ((klass) == DETECT_CLASS_LOWER || (klass) == DETECT_CLASS_UPPER \
+                                 || (klass) == DETECT_CLASS_LETTER)
+
+/* the weight of the character bigram @a @b: letters of different scripts or with a wrong
+ * case in a word, or next to symbols or digits, are unlikely, non-ascii latin letters are
+ * rather surrounded with ascii ones, while the letters of other scripts follow each other,
+ * and punctuation comes next to letters and spaces */
+static gdouble
+mousepad_encoding_detect_bigram (gunichar       a,
+                                 gint           class_a,
+                                 GUnicodeScript script_a,
+                                 gunichar       b,
+                                 gint           class_b,
+                                 GUnicodeScript script_b)
+{
+  gboolean letter_a = DETECT_IS_LETTER (class_a), letter_b = DETECT_IS_LETTER (class_b);
+
+  if (letter_a && letter_b)
+    {
+      if (class_a == DETECT_CLASS_LOWER && class_b == DETECT_CLASS_UPPER)
+        return -4.0;
+
+      if (script_a == G_UNICODE_SCRIPT_COMMON || script_b == G_UNICODE_SCRIPT_COMMON)
+        return 0.0;
+
+      if (script_a != script_b)
+        return -6.0;
+
+      if (script_a == G_UNICODE_SCRIPT_LATIN)
+        return (a >= 0x80 && b >= 0x80) ? -1.0 : 1.0;
+
+      return 1.0;
+    }
+
+  if ((letter_a && class_b == DETECT_CLASS_SYMBOL) || (class_a == DETECT_CLASS_SYMBOL && letter_b))
+    return -3.0;
+
+  if ((class_a == DETECT_CLASS_PUNCTUATION && (letter_b || class_b == DETECT_CLASS_SPACE))
+      || (class_b == DETECT_CLASS_PUNCTUATION && (letter_a || class_a == DETECT_CLASS_SPACE)))
+    return 1.0;
+
+  if ((letter_a && a >= 0x80 && g_ascii_isdigit (b)) || (letter_b && b >= 0x80 && g_ascii_isdigit (a)))
+    return -2.0;
+
+  return 0.0;
+}
+
+
+
+/* the number of characters of @sample encoded in one of the most frequent ways for
+ * @encoding: a lead byte in one of the frequent ranges of multibyte encodings, or
+ * the zero high bytes of ascii and latin characters in wide encodings */
+static guint
+mousepad_encoding_detect_count_frequent (MousepadEncoding  encoding,
+                                         const guint8     *frequent,
+                                         const guchar     *sample,
+                                         gsize             length)
+{
+  gsize  i = 0;
+  guint  n = 0;
+  guchar c;
+
+  switch (encoding)
+    {
+      case MOUSEPAD_ENCODING_UTF_16LE:
+      case MOUSEPAD_ENCODING_UCS_2LE:
+        for (i = 1; i < length; i += 2)
+          n += (sample[i] == 0);
+
+        return n;
+
+      case MOUSEPAD_ENCODING_UTF_16BE:
+      case MOUSEPAD_ENCODING_UCS_2BE:
+        for (i = 0; i + 1 < length; i += 2)
+          n += (sample[i] == 0);
+
+        return n;
+
+      case MOUSEPAD_ENCODING_UTF_32LE:
+        for (i = 0; i + 3 < length; i += 4)
+          n += (sample[i + 2] == 0 && sample[i + 3] == 0);
+
+        return n;
+
+      case MOUSEPAD_ENCODING_UTF_32BE:
+        for (i = 0; i + 3 < length; i += 4)
+          n += (sample[i] == 0 && sample[i + 1] == 0);
+
+        return n;
 
       default:
-        return;
         break;
     }
 
-  if (G_LIKELY (bytes > 0))
+  if (frequent[0] == 0)
+    return 0;
+
+  while (i < length)
+    {
+      c = sample[i];
+      if (c < 0x80)
+        {
+          i++;
+          continue;
+        }
+
+      if ((c >= frequent[0] && c <= frequent[1]) || (c >= frequent[2] && c <= frequent[3]))
+        n++;
+
+      /* skip the trail bytes */
+      switch (encoding)
+        {
+          case MOUSEPAD_ENCODING_UTF_8:
+            i += (c >= 0xf0) ? 4 : (c >= 0xe0) ? 3 : 2;
+            break;
+
+          case MOUSEPAD_ENCODING_SHIFT_JIS:
+            i += (c >= 0xa1 && c <= 0xdf) ? 1 : 2;
+            break;
+
+          case MOUSEPAD_ENCODING_EUC_JP:
+            i += (c == 0x8f) ? 3 : 2;
+            break;
+
+          case MOUSEPAD_ENCODING_EUC_TW:
+            i += (c == 0x8e) ? 4 : 2;
+            break;
+
+          case MOUSEPAD_ENCODING_GB18030:
+            i += (i + 1 < length && sample[i + 1] >= 0x30 && sample[i + 1] <= 0x39) ? 4 : 2;
+            break;
+
+          default:
+            i += 2;
+            break;
+        }
+    }
+
+  return n;
+}
+
+
+
+/* score the decoded sample: the sum of the weights of its characters and bigrams, only
+ * non-ascii characters and their neighbours telling ascii compatible encodings apart,
+ * and the consistency of its non-ascii latin letters with one of the alphabets */
+static void
+mousepad_encoding_detect_evaluate (MousepadEncodingScore *score,
+                                   gboolean               wide)
+{
+  GUnicodeScript  script, prev_script = G_UNICODE_SCRIPT_COMMON;
+  const gchar    *p, *end = score->decoded + score->length;
+  gunichar        c, prev = 0;
+  gdouble         weight, total = 0.0;
+  gint            klass, prev_class = DETECT_CLASS_SPACE;
+  guint           n = 0, n_latin = 0, n_alphabets[G_N_ELEMENTS (latin_alphabets)] = { 0 };
+  guint           i, mask, best = 0;
+
+  for (p = score->decoded; p < end; p = g_utf8_next_char (p))
+    {
+      c = g_utf8_get_char (p);
+      klass = mousepad_encoding_detect_classify (c, &weight);
+      script = DETECT_IS_LETTER (klass) ? mousepad_encoding_detect_script (c) : G_UNICODE_SCRIPT_COMMON;
+
+      if (wide || c >= 0x80)
+        {
+          total += weight;
+          n++;
+
+          if (script == G_UNICODE_SCRIPT_LATIN && c >= 0x80)
+            {
+              n_latin++;
+              mask = GPOINTER_TO_UINT (g_hash_table_lookup (alphabet_table,
+                                                            GUINT_TO_POINTER (g_unichar_tolower (c))));
+              for (i = 0; mask != 0; i++, mask >>= 1)
+                n_alphabets[i] += (mask & 1);
+            }
+        }
+
+      if (wide || c >= 0x80 || prev >= 0x80)
+        total += mousepad_encoding_detect_bigram (prev, prev_class, prev_script, c, klass, script);
+
+      prev = c;
+      prev_class = klass;
+      prev_script = script;
+    }
+
+  /* the letters of the best matching alphabet count, the others count against */
+  for (i = 0; i < G_N_ELEMENTS (latin_alphabets); i++)
+    best = MAX (best, n_alphabets[i]);
+
+  score->score = total + 2.0 * best - 4.0 * (n_latin - best);
+  score->n_chars = n;
+}
+
+
+
+/* (1 + x / 8)^-8, an approximation of exp (-x) for the relative likelihood of candidates */
+static gdouble
+mousepad_encoding_detect_likelihood (gdouble x)
+{
+  gdouble y = 1.0 + x / 8.0;
+
+  y *= y;
+  y *= y;
+  y *= y;
+
+  return 1.0 / y;
+}
+
+
+
+static gint
+mousepad_encoding_detect_compare (gconstpointer a,
+                                  gconstpointer b)
+{
+  const MousepadEncodingScore *score_a = a, *score_b = b;
+
+  if (score_a->score != score_b->score)
+    return (score_a->score < score_b->score) ? 1 : -1;
+
+  return (gint) score_b->prior - (gint) score_a->prior;
+}
+
+
+
+/*
+ * Guess the encoding of @contents from a sample of it, trying all the encodings known
+ * to Mousepad except ascii. Each encoding able to decode the sample is scored with a
+ * model of unicode character classes and bigrams (frequent letters, case and script
+ * consistency in words, symbols and controls, latin alphabets), and for multibyte and
+ * wide encodings, the frequency of their most common byte patterns. Encodings which decode the sample
+ * identically are merged. Up to @n_candidates encodings are stored in @candidates, by
+ * decreasing confidence, and their number is returned.
+ */
+guint
+mousepad_encoding_detect (const gchar               *contents,
+                          gsize                      length,
+                          MousepadEncodingCandidate *candidates,
+                          guint                      n_candidates)
+{
+  const struct MousepadEncodingModel *model;
+  MousepadEncodingScore               score, *best, *other;
+  MousepadEncoding                    encoding;
+  const guchar                       *sample = (const guchar *) contents;
+  GArray                             *scores;
+  gdouble                             sum, evidence;
+  gboolean                            truncated, has_zero = FALSE, has_high = FALSE, duplicate;
+  gsize                               start = 0, n;
+  guint                               i, j, n_found;
+
+  g_return_val_if_fail (contents != NULL || length == 0, 0);
+  g_return_val_if_fail (candidates != NULL || n_candidates == 0, 0);
+
+  mousepad_encoding_detect_init ();
+
+  /* skip a long ascii prefix, all that matters is after it, and starting on an ascii byte
+   * is starting on a character boundary for ascii compatible encodings */
+  for (n = 0; n < length && sample[n] != 0 && sample[n] < 0x80; n++);
+  if (n < length && n > MOUSEPAD_ENCODING_DETECT_SAMPLE_SIZE / 2)
+    start = n - MOUSEPAD_ENCODING_DETECT_SAMPLE_SIZE / 16;
+
+  sample += start;
+  length -= start;
+  truncated = (length > MOUSEPAD_ENCODING_DETECT_SAMPLE_SIZE);
+  length = MIN (length, MOUSEPAD_ENCODING_DETECT_SAMPLE_SIZE);
+
+  for (n = 0; n < length; n++)
+    {
+      has_zero |= (sample[n] == 0);
+      has_high |= (sample[n] >= 0x80);
+    }
+
+  scores = g_array_new (FALSE, FALSE, sizeof (MousepadEncodingScore));
+  for (i = 0; i < MOUSEPAD_N_ENCODINGS; i++)
+    {
+      encoding = encoding_infos[i].encoding;
+      if (encoding == MOUSEPAD_ENCODING_NONE || encoding == MOUSEPAD_ENCODING_ASCII)
+        continue;
+
+      /* null bytes only occur in text encoded with wide encodings, which always contain some,
+       * and 7-bit encodings as well as ascii compatible ones without high bytes are identical
+       * to ascii */
+      if (has_zero != mousepad_encoding_is_wide (encoding)
+          || (! has_zero && has_high == mousepad_encoding_is_7bit (encoding)))
+        continue;
+
+      score.encoding = encoding;
+      score.decoded = mousepad_encoding_detect_decode (encoding_infos[i].charset,
+                                                       (const gchar *) sample, length,
+                                                       truncated, &score.length);
+      if (score.decoded == NULL)
+        continue;
+
+      mousepad_encoding_detect_evaluate (&score, has_zero);
+      if (score.n_chars == 0)
+        {
+          g_free (score.decoded);
+          continue;
+        }
+
+      /* the byte frequency model */
+      model = mousepad_encoding_detect_get_model (encoding);
+      score.score += MOUSEPAD_ENCODING_DETECT_BONUS
+                     * mousepad_encoding_detect_count_frequent (encoding, model->frequent,
+                                                                sample, length);
+      score.score /= score.n_chars;
+      score.prior = model->prior;
+      g_array_append_val (scores, score);
+    }
+
+  /* rank the candidates, keeping the preferred one among those which decode identically */
+  g_array_sort (scores, mousepad_encoding_detect_compare);
+  for (i = 0; i < scores->len; i++)
     {
-      /* realloc the contents string */
-      *contents = g_realloc (*contents, *length + bytes + 1);
+      other = &g_array_index (scores, MousepadEncodingScore, i);
+      for (j = 0, duplicate = FALSE; j < i && ! duplicate; j++)
+        {
+          best = &g_array_index (scores, MousepadEncodingScore, j);
+          duplicate = (best->length == other->length
+                       && memcmp (best->decoded, other->decoded, other->length) == 0);
+        }
 
-      /* move the existing contents */
-      memmove (*contents + bytes, *contents, *length + 1);
+      if (duplicate)
+        {
+          g_free (other->decoded);
+          g_array_remove_index (scores, i--);
+        }
+    }
 
-      /* write the bom at the start of the contents */
-      for (n = 0; n < bytes; n++)
-        (*contents)[n] = bom[n];
+  /* the confidence of each candidate is its share of the likelihood, sharper with more
+   * evidence, times how natural the text decoded with it looks */
+  n_found = MIN (scores->len, n_candidates);
+  if (n_found > 0)
+    {
+      best = &g_array_index (scores, MousepadEncodingScore, 0);
+      evidence = MIN (best->n_chars, MOUSEPAD_ENCODING_DETECT_MAX_EVIDENCE)
+                 / MOUSEPAD_ENCODING_DETECT_TEMPERATURE;
+      for (i = 0, sum = 0.0; i < scores->len; i++)
+        {
+          other = &g_array_index (scores, MousepadEncodingScore, i);
+          other->likelihood = mousepad_encoding_detect_likelihood ((best->score - other->score) * evidence);
+          sum += other->likelihood;
+        }
 
-      /* increase the length */
-      *length += bytes;
+      for (i = 0; i < n_found; i++)
+        {
+          other = &g_array_index (scores, MousepadEncodingScore, i);
+          candidates[i].encoding = other->encoding;
+          candidates[i].confidence = other->likelihood / sum
+            * CLAMP (other->score / MOUSEPAD_ENCODING_DETECT_GOOD_SCORE, 0.0, 1.0);
+        }
     }
+
+  for (i = 0; i < scores->len; i++)
+    g_free (g_array_index (scores, MousepadEncodingScore, i).decoded);
+
+  g_array_free (scores, TRUE);
+
+  return n_found;
+}
+
+
+
+static gboolean
+mousepad_encoding_get_wide (MousepadEncoding      encoding,
+                            MousepadEncodingWide *wide)
+{
+  switch (encoding)
+    {
+      case MOUSEPAD_ENCODING_UTF_16LE:
+      case MOUSEPAD_ENCODING_UTF_16BE:
+      case MOUSEPAD_ENCODING_UCS_2LE:
+      case MOUSEPAD_ENCODING_UCS_2BE:
+        wide->unit = 2;
+        break;
+
+      case MOUSEPAD_ENCODING_UTF_32LE:
+      case MOUSEPAD_ENCODING_UTF_32BE:
+        wide->unit = 4;
+        break;
+
+      default:
+        return FALSE;
+    }
+
+  wide->big_endian = (encoding == MOUSEPAD_ENCODING_UTF_16BE || encoding == MOUSEPAD_ENCODING_UCS_2BE
+                      || encoding == MOUSEPAD_ENCODING_UTF_32BE);
+
+  /* ucs-2 only covers the basic multilingual plane */
+  wide->surrogates = (encoding == MOUSEPAD_ENCODING_UTF_16LE || encoding == MOUSEPAD_ENCODING_UTF_16BE);
+
+  return TRUE;
+}
+
+
+
+/* build the table of @charset by decoding each byte with iconv, returns NULL if it is not
+ * a single byte encoding compatible with ascii, multibyte and stateful encodings being
+ * left to iconv */
+static MousepadEncodingTable *
+mousepad_encoding_table_new (const gchar *charset)
+{
+  MousepadEncodingTable *table;
+  GIConv                 conv;
+  gunichar               c;
+  guchar               **page;
+  gchar                  byte, *in, *out;
+  gsize                  in_left, out_left, length;
+  guint                  n;
+
+  conv = g_iconv_open ("UTF-8", charset);
+  if (conv == (GIConv) -1)
+    return NULL;
+
+  table = g_new0 (MousepadEncodingTable, 1);
+  for (n = 0; n < 256; n++)
+    {
+      byte = n;
+      in = &byte;
+      in_left = 1;
+      out = table->utf8[n];
+      out_left = sizeof (table->utf8[n]);
+
+      /* leave invalid bytes with a length of 0, but stop on the lead byte of a sequence */
+      g_iconv (conv, NULL, NULL, NULL, NULL);
+      if (g_iconv (conv, &in, &in_left, &out, &out_left) == (gsize) -1)
+        {
+          if (errno == EILSEQ)
+            continue;
+
+          break;
+        }
+
+      /* each byte must give a single character of the basic multilingual plane, and ascii
+       * bytes themselves */
+      length = out - table->utf8[n];
+      if (n < 0x80)
+        {
+          if (length != 1 || table->utf8[n][0] != (gchar) n)
+            break;
+        }
+      else
+        {
+          c = g_utf8_get_char_validated (table->utf8[n], length);
+          if (c >= 0x10000 || g_unichar_to_utf8 (c, NULL) != (gint) length)
+            break;
+
+          page = &table->pages[c >> 8];
+          if (*page == NULL)
+            *page = g_new0 (guchar, 256);
+
+          /* keep the first byte of a character encoded by several ones */
+          if ((*page)[c & 0xff] == 0)
+            (*page)[c & 0xff] = n;
+        }
+
+      table->utf8_length[n] = length;
+    }
+
+  g_iconv_close (conv);
+
+  if (n < 256)
+    {
+      for (n = 0; n < 256; n++)
+        g_free (table->pages[n]);
+
+      g_free (table);
+      return NULL;
+    }
+
+  return table;
+}
+
+
+
+static const MousepadEncodingTable *
+mousepad_encoding_get_table (MousepadEncoding encoding)
+{
+  MousepadEncodingWide wide;
+
+  if (encoding >= MOUSEPAD_N_ENCODINGS)
+    return NULL;
+
+  if (g_once_init_enter (&encoding_tables_initialized[encoding]))
+    {
+      if (encoding != MOUSEPAD_ENCODING_NONE && encoding != MOUSEPAD_ENCODING_UTF_8
+          && ! mousepad_encoding_get_wide (encoding, &wide))
+        encoding_tables[encoding] = mousepad_encoding_table_new (mousepad_encoding_get_charset (encoding));
+
+      g_once_init_leave (&encoding_tables_initialized[encoding], 1);
+    }
+
+  return encoding_tables[encoding];
+}
+
+
+
+/* returns the length of the run of ascii bytes at the start of @text */
+static inline gsize
+mousepad_encoding_ascii_run (const guchar *text,
+                             gsize         length)
+{
+  gsize   offset = 0;
+#ifdef __SSE2__
+  gint    mask;
+
+  for (; offset + 16 <= length; offset += 16)
+    {
+      mask = _mm_movemask_epi8 (_mm_loadu_si128 ((const __m128i *) (text + offset)));
+      if (mask != 0)
+        return offset + g_bit_nth_lsf (mask, -1);
+    }
+#else
+  guint64 word;
+
+  for (; offset + 8 <= length; offset += 8)
+    {
+      memcpy (&word, text + offset, sizeof (word));
+      if ((word & G_GUINT64_CONSTANT (0x8080808080808080)) != 0)
+        break;
+    }
+#endif
+
+  while (offset < length && text[offset] < 0x80)
+    offset++;
+
+  return offset;
+}
+
+
+
+static inline gunichar
+mousepad_encoding_read_unit (const guchar               *in,
+                             const MousepadEncodingWide *wide)
+{
+  if (wide->unit == 2)
+    return wide->big_endian ? (in[0] << 8 | in[1]) : (in[1] << 8 | in[0]);
+
+  return wide->big_endian ? ((gunichar) in[0] << 24 | in[1] << 16 | in[2] << 8 | in[3])
+                          : ((gunichar) in[3] << 24 | in[2] << 16 | in[1] << 8 | in[0]);
+}
+
+
+
+static inline void
+mousepad_encoding_write_unit (guchar                     *out,
+                              gunichar                    c,
+                              const MousepadEncodingWide *wide)
+{
+  if (wide->unit == 2 && wide->big_endian)
+    {
+      out[0] = c >> 8;
+      out[1] = c;
+    }
+  else if (wide->unit == 2)
+    {
+      out[0] = c;
+      out[1] = c >> 8;
+    }
+  else if (wide->big_endian)
+    {
+      out[0] = c >> 24;
+      out[1] = c >> 16;
+      out[2] = c >> 8;
+      out[3] = c;
+    }
+  else
+    {
+      out[0] = c;
+      out[1] = c >> 8;
+      out[2] = c >> 16;
+      out[3] = c >> 24;
+    }
+}
+
+
+
+/* returns the character at the start of @in like g_utf8_get_char_validated(), the two and
+ * three byte sequences of the alphabets being read inline */
+static inline gunichar
+mousepad_encoding_read_utf8 (const guchar *in,
+                             gsize         length)
+{
+  if (in[0] >= 0xc2 && in[0] <= 0xdf && length >= 2 && (in[1] & 0xc0) == 0x80)
+    return (in[0] & 0x1f) << 6 | (in[1] & 0x3f);
+
+  /* no overlong forms and no surrogates */
+  if (in[0] >= 0xe1 && in[0] <= 0xef && in[0] != 0xed && length >= 3
+      && (in[1] & 0xc0) == 0x80 && (in[2] & 0xc0) == 0x80)
+    return (in[0] & 0x0f) << 12 | (in[1] & 0x3f) << 6 | (in[2] & 0x3f);
+
+  return g_utf8_get_char_validated ((const gchar *) in, length);
+}
+
+
+
+/* writes the valid non-ascii character @c to @out, returns its length */
+static inline gsize
+mousepad_encoding_write_utf8 (gchar    *out,
+                              gunichar  c)
+{
+  if (c < 0x800)
+    {
+      out[0] = 0xc0 | (c >> 6);
+      out[1] = 0x80 | (c & 0x3f);
+      return 2;
+    }
+  else if (c < 0x10000)
+    {
+      out[0] = 0xe0 | (c >> 12);
+      out[1] = 0x80 | ((c >> 6) & 0x3f);
+      out[2] = 0x80 | (c & 0x3f);
+      return 3;
+    }
+
+  out[0] = 0xf0 | (c >> 18);
+  out[1] = 0x80 | ((c >> 12) & 0x3f);
+  out[2] = 0x80 | ((c >> 6) & 0x3f);
+  out[3] = 0x80 | (c & 0x3f);
+
+  return 4;
+}
+
+
+
+/* decode the leading ascii characters of @in, by blocks of 16 bytes when SSE2 is available,
+ * writing one byte per character to @out, returns the number of bytes consumed */
+static inline gsize
+mousepad_encoding_decode_wide_ascii (const guchar               *in,
+                                     gsize                       length,
+                                     guchar                     *out,
+                                     const MousepadEncodingWide *wide)
+{
+  gunichar c;
+  gsize    offset = 0;
+#ifdef __SSE2__
+  __m128i  block, mask;
+  gint     value, ascii;
+
+  /* the bits which must be unset in each unit for it to be an ascii character */
+  if (wide->unit == 2)
+    mask = _mm_set1_epi16 ((gshort) (wide->big_endian ? 0x80ff : 0xff80));
+  else
+    mask = _mm_set1_epi32 ((gint) (wide->big_endian ? 0x80ffffff : 0xffffff80));
+
+  for (; offset + 16 <= length; offset += 16)
+    {
+      block = _mm_loadu_si128 ((const __m128i *) (in + offset));
+      ascii = _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_and_si128 (block, mask),
+                                                 _mm_setzero_si128 ()));
+
+      /* move the characters to the low byte of the units, then narrow them to bytes, the
+       * whole block being written even if it is only partly ascii, there is room for it */
+      if (wide->unit == 2)
+        {
+          if (wide->big_endian)
+            block = _mm_srli_epi16 (block, 8);
+
+          _mm_storel_epi64 ((__m128i *) out, _mm_packus_epi16 (block, block));
+          out += 8;
+        }
+      else
+        {
+          if (wide->big_endian)
+            block = _mm_srli_epi32 (block, 24);
+
+          block = _mm_packs_epi32 (block, block);
+          value = _mm_cvtsi128_si32 (_mm_packus_epi16 (block, block));
+          memcpy (out, &value, 4);
+          out += 4;
+        }
+
+      /* stop before the first unit which is not an ascii character */
+      if (ascii != 0xffff)
+        return offset + g_bit_nth_lsf (~ascii, -1) / wide->unit * wide->unit;
+    }
+#endif
+
+  for (; offset + wide->unit <= length; offset += wide->unit)
+    {
+      c = mousepad_encoding_read_unit (in + offset, wide);
+      if (c >= 0x80)
+        break;
+
+      *out++ = c;
+    }
+
+  return offset;
+}
+
+
+
+#ifdef __SSE2__
+/* store the 8 characters of @units, 16-bit little endian units, as 32-bit units */
+static inline void
+mousepad_encoding_store_utf32 (guchar   *out,
+                               __m128i   units,
+                               gboolean  big_endian)
+{
+  __m128i zero = _mm_setzero_si128 (), low, high;
+
+  low = _mm_unpacklo_epi16 (units, zero);
+  high = _mm_unpackhi_epi16 (units, zero);
+  if (big_endian)
+    {
+      low = _mm_slli_epi32 (low, 24);
+      high = _mm_slli_epi32 (high, 24);
+    }
+
+  _mm_storeu_si128 ((__m128i *) out, low);
+  _mm_storeu_si128 ((__m128i *) (out + 16), high);
+}
+#endif
+
+
+
+/* encode the leading ascii characters of @in, by blocks of 16 bytes when SSE2 is available,
+ * returns the number of bytes consumed */
+static inline gsize
+mousepad_encoding_encode_wide_ascii (const guchar               *in,
+                                     gsize                       length,
+                                     guchar                     *out,
+                                     const MousepadEncodingWide *wide)
+{
+  gsize    offset = 0;
+#ifdef __SSE2__
+  __m128i  block, low, high, zero = _mm_setzero_si128 ();
+  gboolean big_endian = wide->big_endian;
+  gint     non_ascii;
+
+  for (; offset + 16 <= length; offset += 16)
+    {
+      block = _mm_loadu_si128 ((const __m128i *) (in + offset));
+      non_ascii = _mm_movemask_epi8 (block);
+
+      /* widen the bytes to little endian units, the whole block being written even if it
+       * is only partly ascii, there is room for it */
+      low = _mm_unpacklo_epi8 (block, zero);
+      high = _mm_unpackhi_epi8 (block, zero);
+      if (wide->unit == 2)
+        {
+          if (big_endian)
+            {
+              low = _mm_slli_epi16 (low, 8);
+              high = _mm_slli_epi16 (high, 8);
+            }
+
+          _mm_storeu_si128 ((__m128i *) out, low);
+          _mm_storeu_si128 ((__m128i *) (out + 16), high);
+          out += 32;
+        }
+      else
+        {
+          mousepad_encoding_store_utf32 (out, low, big_endian);
+          mousepad_encoding_store_utf32 (out + 32, high, big_endian);
+          out += 64;
+        }
+
+      /* stop before the first byte which is not an ascii character */
+      if (non_ascii != 0)
+        return offset + g_bit_nth_lsf (non_ascii, -1);
+    }
+#endif
+
+  for (; offset < length && in[offset] < 0x80; offset++, out += wide->unit)
+    mousepad_encoding_write_unit (out, in[offset], wide);
+
+  return offset;
+}
+
+
+
+/* terminate the output of a conversion like g_convert() does, an incomplete character at
+ * the end of the input being an error unless the caller wants to know where it stopped */
+static gchar *
+mousepad_encoding_convert_finish (gchar   *out,
+                                  gsize    written,
+                                  gsize    consumed,
+                                  gsize    length,
+                                  gsize   *bytes_read,
+                                  gsize   *bytes_written,
+                                  GError **error)
+{
+  /* enough nul bytes to terminate a string in any encoding */
+  memset (out + written, 0, 4);
+
+  if (consumed < length && bytes_read == NULL)
+    {
+      g_set_error_literal (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+                           _("Partial character sequence at end of input"));
+      g_free (out);
+      out = NULL;
+      written = 0;
+    }
+
+  if (bytes_read != NULL)
+    *bytes_read = consumed;
+
+  if (bytes_written != NULL)
+    *bytes_written = written;
+
+  return out;
+}
+
+
+
+static gchar *
+mousepad_encoding_convert_error (gchar   *out,
+                                 gsize    consumed,
+                                 gsize   *bytes_read,
+                                 gsize   *bytes_written,
+                                 GError **error)
+{
+  g_set_error_literal (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                       _("Invalid byte sequence in conversion input"));
+  g_free (out);
+
+  if (bytes_read != NULL)
+    *bytes_read = consumed;
+
+  if (bytes_written != NULL)
+    *bytes_written = 0;
+
+  return NULL;
+}
+
+
+
+/* compute the length of the utf-8 output of @in, runs of ascii characters being skipped at
+ * once and other bytes looked up one by one, returns the offset of the first byte which
+ * can't be decoded, or @length */
+static gsize
+mousepad_encoding_measure_table (const MousepadEncodingTable *table,
+                                 const guchar                *in,
+                                 gsize                        length,
+                                 gsize                       *size)
+{
+  gsize offset, run;
+
+  for (offset = 0, *size = 0; offset < length; )
+    {
+      if (in[offset] < 0x80 && offset + 1 < length && in[offset + 1] < 0x80)
+        {
+          run = mousepad_encoding_ascii_run (in + offset, length - offset);
+          offset += run;
+          *size += run;
+        }
+      else if (G_LIKELY (table->utf8_length[in[offset]] > 0))
+        *size += table->utf8_length[in[offset++]];
+      else
+        break;
+    }
+
+  return offset;
+}
+
+
+
+/* decode the valid contents @in to @out, which ends at @limit: characters are copied with
+ * 4 bytes while there is room for it */
+static void
+mousepad_encoding_write_table (const MousepadEncodingTable *table,
+                               const guchar                *in,
+                               gsize                        length,
+                               gchar                       *out,
+                               const gchar                 *limit)
+{
+  gsize offset, run;
+
+  for (offset = 0; offset < length; )
+    {
+      if (in[offset] < 0x80 && offset + 1 < length && in[offset + 1] < 0x80)
+        {
+          run = mousepad_encoding_ascii_run (in + offset, length - offset);
+          memcpy (out, in + offset, run);
+          offset += run;
+          out += run;
+        }
+      else
+        {
+          if (G_LIKELY (out + 4 <= limit))
+            memcpy (out, table->utf8[in[offset]], 4);
+          else
+            memcpy (out, table->utf8[in[offset]], table->utf8_length[in[offset]]);
+
+          out += table->utf8_length[in[offset++]];
+        }
+    }
+}
+
+
+
+static gchar *
+mousepad_encoding_decode_table (const MousepadEncodingTable  *table,
+                                const guchar                 *in,
+                                gsize                         length,
+                                gsize                        *bytes_read,
+                                gsize                        *bytes_written,
+                                GError                      **error)
+{
+  gchar *out;
+  gsize  offset, size;
+
+  /* compute the length of the output first, to allocate it only once */
+  offset = mousepad_encoding_measure_table (table, in, length, &size);
+  if (G_UNLIKELY (offset < length))
+    return mousepad_encoding_convert_error (NULL, offset, bytes_read, bytes_written, error);
+
+  /* the nul bytes cover the overflow */
+  out = g_malloc (size + 4);
+  mousepad_encoding_write_table (table, in, length, out, out + size + 4);
+
+  return mousepad_encoding_convert_finish (out, size, length, length,
+                                           bytes_read, bytes_written, error);
+}
+
+
+
+static gchar *
+mousepad_encoding_encode_table (const MousepadEncodingTable  *table,
+                                const gchar                  *charset,
+                                const guchar                 *in,
+                                gsize                         length,
+                                gsize                        *bytes_read,
+                                gsize                        *bytes_written,
+                                GError                      **error)
+{
+  gunichar  c;
+  gchar    *out, *o;
+  gsize     offset, run;
+  guchar    byte;
+
+  out = o = g_malloc (length + 4);
+  for (offset = 0; offset < length; )
+    {
+      if (in[offset] < 0x80)
+        {
+          run = mousepad_encoding_ascii_run (in + offset, length - offset);
+          memcpy (o, in + offset, run);
+          offset += run;
+          o += run;
+          continue;
+        }
+
+      c = mousepad_encoding_read_utf8 (in + offset, length - offset);
+      if (c == (gunichar) -2)
+        break;
+      else if (G_UNLIKELY (c == (gunichar) -1))
+        return mousepad_encoding_convert_error (out, offset, bytes_read, bytes_written, error);
+
+      /* let iconv handle the characters not in the table, to report them or to
+       * approximate them exactly like it would */
+      byte = 0;
+      if (G_LIKELY (c < 0x10000 && table->pages[c >> 8] != NULL))
+        byte = table->pages[c >> 8][c & 0xff];
+
+      if (G_UNLIKELY (byte == 0))
+        {
+          g_free (out);
+          return g_convert ((const gchar *) in, length, charset, "UTF-8",
+                            bytes_read, bytes_written, error);
+        }
+
+      *o++ = byte;
+      offset += g_utf8_skip[in[offset]];
+    }
+
+  return mousepad_encoding_convert_finish (out, o - out, offset, length,
+                                           bytes_read, bytes_written, error);
+}
+
+
+
+/* compute the length of the utf-8 output of @in like mousepad_encoding_write_wide() would
+ * write it, returns the offset where it stopped, setting @invalid if it is on an error */
+static gsize
+mousepad_encoding_measure_wide (const MousepadEncodingWide *wide,
+                                const guchar               *in,
+                                gsize                       length,
+                                gsize                      *size,
+                                gboolean                   *invalid)
+{
+  gunichar c, low;
+  gsize    offset, n;
+
+  *size = 0;
+  *invalid = FALSE;
+  for (offset = 0; offset + wide->unit <= length; offset += n)
+    {
+      c = mousepad_encoding_read_unit (in + offset, wide);
+      n = wide->unit;
+
+      if (c >= 0xd800 && c <= 0xdbff && wide->surrogates)
+        {
+          if (offset + 2 * wide->unit > length)
+            break;
+
+          low = mousepad_encoding_read_unit (in + offset + wide->unit, wide);
+          if (G_UNLIKELY (low < 0xdc00 || low > 0xdfff))
+            {
+              *invalid = TRUE;
+              break;
+            }
+
+          n = 2 * wide->unit;
+          *size += 4;
+        }
+      else if (G_UNLIKELY ((c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff))
+        {
+          *invalid = TRUE;
+          break;
+        }
+      else
+        *size += (c < 0x80) ? 1 : (c < 0x800) ? 2 : (c < 0x10000) ? 3 : 4;
+    }
+
+  return offset;
+}
+
+
+
+/* decode @in to @out, returns the offset where it stopped, setting @invalid if it is on an
+ * error: the ascii blocks may be written past the characters they contain, but not past the
+ * output of the rest of the block, each unit giving at least one byte */
+static gsize
+mousepad_encoding_write_wide (const MousepadEncodingWide *wide,
+                              const guchar               *in,
+                              gsize                       length,
+                              gchar                      *out,
+                              gsize                      *written,
+                              gboolean                   *invalid)
+{
+  gunichar  c, low;
+  gchar    *o = out;
+  gsize     offset, n;
+
+  *invalid = FALSE;
+  for (offset = 0; offset + wide->unit <= length; offset += n)
+    {
+      c = mousepad_encoding_read_unit (in + offset, wide);
+      n = wide->unit;
+
+      if (c < 0x80)
+        {
+          n = mousepad_encoding_decode_wide_ascii (in + offset, length - offset,
+                                                   (guchar *) o, wide);
+          o += n / wide->unit;
+          continue;
+        }
+
+      if (c >= 0xd800 && c <= 0xdbff && wide->surrogates)
+        {
+          /* an incomplete surrogate pair at the end of the input */
+          if (offset + 2 * wide->unit > length)
+            break;
+
+          low = mousepad_encoding_read_unit (in + offset + wide->unit, wide);
+          if (G_UNLIKELY (low < 0xdc00 || low > 0xdfff))
+            {
+              *invalid = TRUE;
+              break;
+            }
+
+          c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+          n = 2 * wide->unit;
+        }
+      else if (G_UNLIKELY ((c >= 0xd800 && c <= 0xdfff) || c > 0x10ffff))
+        {
+          *invalid = TRUE;
+          break;
+        }
+
+      o += mousepad_encoding_write_utf8 (o, c);
+    }
+
+  *written = o - out;
+
+  return offset;
+}
+
+
+
+static gchar *
+mousepad_encoding_decode_wide (const MousepadEncodingWide  *wide,
+                               const guchar                *in,
+                               gsize                        length,
+                               gsize                       *bytes_read,
+                               gsize                       *bytes_written,
+                               GError                     **error)
+{
+  gboolean  invalid;
+  gchar    *out;
+  gsize     offset, written;
+
+  /* a utf-16 unit gives at most 3 bytes and a surrogate pair 4, a utf-32 unit 4 */
+  out = g_malloc ((wide->unit == 2 ? length / 2 * 3 : length) + 4);
+  offset = mousepad_encoding_write_wide (wide, in, length, out, &written, &invalid);
+  if (G_UNLIKELY (invalid))
+    return mousepad_encoding_convert_error (out, offset, bytes_read, bytes_written, error);
+
+  return mousepad_encoding_convert_finish (out, written, offset, length,
+                                           bytes_read, bytes_written, error);
+}
+
+
+
+static gchar *
+mousepad_encoding_encode_wide (const MousepadEncodingWide  *wide,
+                               const guchar                *in,
+                               gsize                        length,
+                               gsize                       *bytes_read,
+                               gsize                       *bytes_written,
+                               GError                     **error)
+{
+  gunichar  c;
+  guchar   *out, *o;
+  gsize     offset, n;
+
+  /* a utf-8 sequence gives at most 2 bytes of utf-16 per byte, 4 of utf-32 */
+  out = o = g_malloc (length * (wide->unit == 2 ? 2 : 4) + 4);
+  for (offset = 0; offset < length; offset += n)
+    {
+      if (in[offset] < 0x80)
+        {
+          n = mousepad_encoding_encode_wide_ascii (in + offset, length - offset, o, wide);
+          o += n * wide->unit;
+          continue;
+        }
+
+      c = mousepad_encoding_read_utf8 (in + offset, length - offset);
+      if (c == (gunichar) -2)
+        break;
+      else if (G_UNLIKELY (c == (gunichar) -1))
+        return mousepad_encoding_convert_error ((gchar *) out, offset,
+                                                bytes_read, bytes_written, error);
+
+      n = g_utf8_skip[in[offset]];
+
+      if (c >= 0x10000 && wide->unit == 2)
+        {
+          if (G_UNLIKELY (! wide->surrogates))
+            return mousepad_encoding_convert_error ((gchar *) out, offset,
+                                                    bytes_read, bytes_written, error);
+
+          mousepad_encoding_write_unit (o, 0xd800 + ((c - 0x10000) >> 10), wide);
+          mousepad_encoding_write_unit (o + 2, 0xdc00 + ((c - 0x10000) & 0x3ff), wide);
+          o += 4;
+        }
+      else
+        {
+          mousepad_encoding_write_unit (o, c, wide);
+          o += wide->unit;
+        }
+    }
+
+  return mousepad_encoding_convert_finish ((gchar *) out, o - out, offset, length,
+                                           bytes_read, bytes_written, error);
+}
+
+
+
+/**
+ * mousepad_encoding_has_transcoder:
+ * @encoding : a #MousepadEncoding.
+ *
+ * Returns whether @encoding is converted by a built-in transcoder rather than by iconv:
+ * this is the case for UTF-16, UCS-2, UTF-32 and the single byte encodings compatible
+ * with ASCII.
+ **/
+gboolean
+mousepad_encoding_has_transcoder (MousepadEncoding encoding)
+{
+  MousepadEncodingWide wide;
+
+  return mousepad_encoding_get_wide (encoding, &wide)
+         || mousepad_encoding_get_table (encoding) != NULL;
+}
+
+
+
+/**
+ * mousepad_encoding_is_ascii_compatible:
+ * @encoding : a #MousepadEncoding.
+ *
+ * Returns whether @encoding encodes ASCII characters as single bytes which can't be part
+ * of another character, so that e.g. lines can be found without decoding the contents:
+ * this is the case for UTF-8 and the single byte encodings with a built-in transcoder.
+ **/
+gboolean
+mousepad_encoding_is_ascii_compatible (MousepadEncoding encoding)
+{
+  return encoding == MOUSEPAD_ENCODING_UTF_8 || mousepad_encoding_get_table (encoding) != NULL;
+}
+
+
+
+/**
+ * mousepad_encoding_find_boundary:
+ * @encoding : the #MousepadEncoding of @contents.
+ * @contents : the contents to split.
+ * @length   : the length of @contents in bytes.
+ * @offset   : the offset from which to look for a boundary.
+ *
+ * Looks for the first character boundary at or after @offset, from which @contents can
+ * be converted independently of what precedes it. This is possible for UTF-8 and for the
+ * encodings with a built-in transcoder, but not for stateful encodings like ISO-2022 or
+ * UTF-7, nor for the multibyte encodings whose trailing bytes may look like lead bytes.
+ *
+ * Returns: the offset of the boundary, at most @length, or 0 if @encoding can't be split.
+ **/
+gsize
+mousepad_encoding_find_boundary (MousepadEncoding  encoding,
+                                 const gchar      *contents,
+                                 gsize             length,
+                                 gsize             offset)
+{
+  const guchar         *ucontents = (const guchar *) contents;
+  MousepadEncodingWide  wide;
+  gunichar              c;
+
+  g_return_val_if_fail (contents != NULL || length == 0, 0);
+
+  if (encoding == MOUSEPAD_ENCODING_UTF_8)
+    {
+      /* skip the continuation bytes */
+      while (offset < length && (ucontents[offset] & 0xc0) == 0x80)
+        offset++;
+    }
+  else if (mousepad_encoding_get_wide (encoding, &wide))
+    {
+      /* align the offset on a unit, and don't split a surrogate pair */
+      offset += (wide.unit - offset % wide.unit) % wide.unit;
+      if (wide.surrogates && offset >= wide.unit && offset < length)
+        {
+          c = mousepad_encoding_read_unit (ucontents + offset - wide.unit, &wide);
+          if (c >= 0xd800 && c <= 0xdbff)
+            offset += wide.unit;
+        }
+    }
+  else if (mousepad_encoding_get_table (encoding) == NULL)
+    return 0;
+
+  return MIN (offset, length);
+}
+
+
+
+/**
+ * mousepad_encoding_convert_to_utf8:
+ * @encoding      : the #MousepadEncoding of @contents.
+ * @contents      : the contents to convert.
+ * @length        : the length of @contents in bytes.
+ * @bytes_read    : return location for the number of bytes converted, or %NULL.
+ * @bytes_written : return location for the length of the result, or %NULL.
+ * @error         : return location for errors, or %NULL.
+ *
+ * Converts @contents to UTF-8, with the same semantics as g_convert(). Single byte
+ * encodings are decoded with lookup tables and UTF-16/UTF-32 directly, both with fast
+ * paths for runs of ASCII characters, iconv being used for the other encodings.
+ *
+ * Returns: the converted contents, to be freed with g_free(), or %NULL on error.
+ **/
+gchar *
+mousepad_encoding_convert_to_utf8 (MousepadEncoding   encoding,
+                                   const gchar       *contents,
+                                   gsize              length,
+                                   gsize             *bytes_read,
+                                   gsize             *bytes_written,
+                                   GError           **error)
+{
+  const MousepadEncodingTable *table;
+  MousepadEncodingWide         wide;
+
+  g_return_val_if_fail (contents != NULL || length == 0, NULL);
+
+  if (mousepad_encoding_get_wide (encoding, &wide))
+    return mousepad_encoding_decode_wide (&wide, (const guchar *) contents, length,
+                                          bytes_read, bytes_written, error);
+
+  if ((table = mousepad_encoding_get_table (encoding)) != NULL)
+    return mousepad_encoding_decode_table (table, (const guchar *) contents, length,
+                                           bytes_read, bytes_written, error);
+
+  return g_convert (contents, length, "UTF-8", mousepad_encoding_get_charset (encoding),
+                    bytes_read, bytes_written, error);
+}
+
+
+
+/**
+ * mousepad_encoding_measure_utf8:
+ * @encoding    : the #MousepadEncoding of @contents, which must have a built-in transcoder.
+ * @contents    : the contents to convert.
+ * @length      : the length of @contents in bytes.
+ * @utf8_length : return location for the length of the converted contents.
+ * @error       : return location for errors, or %NULL.
+ *
+ * Computes the length of @contents converted to UTF-8 without converting them, so that
+ * the result of mousepad_encoding_convert_into() can be allocated up front, e.g.
+ * to convert several parts of large contents into it in parallel.
+ *
+ * Returns: %FALSE if @contents can't be converted, with the error of
+ *          mousepad_encoding_convert_to_utf8().
+ **/
+gboolean
+mousepad_encoding_measure_utf8 (MousepadEncoding   encoding,
+                                const gchar       *contents,
+                                gsize              length,
+                                gsize             *utf8_length,
+                                GError           **error)
+{
+  const MousepadEncodingTable *table;
+  MousepadEncodingWide         wide;
+  gboolean                     invalid = FALSE;
+  gsize                        offset;
+
+  g_return_val_if_fail (contents != NULL || length == 0, FALSE);
+  g_return_val_if_fail (utf8_length != NULL, FALSE);
+
+  if (mousepad_encoding_get_wide (encoding, &wide))
+    offset = mousepad_encoding_measure_wide (&wide, (const guchar *) contents, length,
+                                             utf8_length, &invalid);
+  else if ((table = mousepad_encoding_get_table (encoding)) != NULL)
+    {
+      offset = mousepad_encoding_measure_table (table, (const guchar *) contents, length,
+                                                utf8_length);
+      invalid = (offset < length);
+    }
+  else
+    g_return_val_if_reached (FALSE);
+
+  if (invalid)
+    g_set_error_literal (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                         _("Invalid byte sequence in conversion input"));
+  else if (offset < length)
+    g_set_error_literal (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT,
+                         _("Partial character sequence at end of input"));
+  else
+    return TRUE;
+
+  return FALSE;
+}
+
+
+
+/**
+ * mousepad_encoding_convert_into:
+ * @encoding    : the #MousepadEncoding of @contents, which must have a built-in transcoder.
+ * @contents    : the contents to convert, for which mousepad_encoding_measure_utf8()
+ *                succeeded.
+ * @length      : the length of @contents in bytes.
+ * @utf8        : the location to write the converted contents to.
+ * @utf8_length : the length returned by mousepad_encoding_measure_utf8().
+ *
+ * Converts @contents to UTF-8 into @utf8, writing exactly @utf8_length bytes and nothing
+ * after them, so that other threads can write what follows meanwhile. The result is not
+ * nul-terminated.
+ **/
+void
+mousepad_encoding_convert_into (MousepadEncoding  encoding,
+                                const gchar      *contents,
+                                gsize             length,
+                                gchar            *utf8,
+                                gsize             utf8_length)
+{
+  const MousepadEncodingTable *table;
+  MousepadEncodingWide         wide;
+  gboolean                     invalid;
+  gsize                        written;
+
+  g_return_if_fail (contents != NULL || length == 0);
+  g_return_if_fail (utf8 != NULL || utf8_length == 0);
+
+  if (mousepad_encoding_get_wide (encoding, &wide))
+    {
+      mousepad_encoding_write_wide (&wide, (const guchar *) contents, length, utf8,
+                                    &written, &invalid);
+      g_warn_if_fail (! invalid && written == utf8_length);
+    }
+  else if ((table = mousepad_encoding_get_table (encoding)) != NULL)
+    mousepad_encoding_write_table (table, (const guchar *) contents, length, utf8,
+                                   utf8 + utf8_length);
+  else
+    g_return_if_reached ();
+}
+
+
+
+/**
+ * mousepad_encoding_convert_from_utf8:
+ * @encoding      : the #MousepadEncoding to convert @text to.
+ * @text          : the UTF-8 text to convert.
+ * @length        : the length of @text in bytes.
+ * @bytes_read    : return location for the number of bytes converted, or %NULL.
+ * @bytes_written : return location for the length of the result, or %NULL.
+ * @error         : return location for errors, or %NULL.
+ *
+ * Converts @text from UTF-8 to @encoding, the reverse of
+ * mousepad_encoding_convert_to_utf8().
+ *
+ * Returns: the converted text, to be freed with g_free(), or %NULL on error.
+ **/
+gchar *
+mousepad_encoding_convert_from_utf8 (MousepadEncoding   encoding,
+                                     const gchar       *text,
+                                     gsize              length,
+                                     gsize             *bytes_read,
+                                     gsize             *bytes_written,
+                                     GError           **error)
+{
+  const MousepadEncodingTable *table;
+  MousepadEncodingWide         wide;
+  const gchar                 *charset = mousepad_encoding_get_charset (encoding);
+
+  g_return_val_if_fail (text != NULL || length == 0, NULL);
+
+  if (mousepad_encoding_get_wide (encoding, &wide))
+    return mousepad_encoding_encode_wide (&wide, (const guchar *) text, length,
+                                          bytes_read, bytes_written, error);
+
+  if ((table = mousepad_encoding_get_table (encoding)) != NULL)
+    return mousepad_encoding_encode_table (table, charset, (const guchar *) text, length,
+                                           bytes_read, bytes_written, error);
+
+  return g_convert (text, length, charset, "UTF-8", bytes_read, bytes_written, error);
 }
@@ -99,23 +99,73 @@ typedef enum
 }
 MousepadEncoding;
 
+/* an encoding guessed from the contents of a file, with a confidence between 0 and 1 */
+typedef struct
+{
+  MousepadEncoding encoding;
+  gdouble          confidence;
+}
+MousepadEncodingCandidate;
+
+/* the confidence from which a guessed encoding is used without asking the user */
+#define MOUSEPAD_ENCODING_CONFIDENCE_HIGH 0.9
+
+
+
+const gchar      *mousepad_encoding_get_charset         (MousepadEncoding           encoding);
+
+const gchar      *mousepad_encoding_get_name            (MousepadEncoding           encoding);
+
+MousepadEncoding  mousepad_encoding_find                (const gchar               *charset);
+
+MousepadEncoding  mousepad_encoding_get_default         (void);
+
+MousepadEncoding  mousepad_encoding_read_bom            (const gchar               *contents,
+                                                         gsize                      length,
+                                                         gsize                     *bom_length);
+
+const guchar     *mousepad_encoding_get_bom             (MousepadEncoding          *encoding,
+                                                         gsize                     *bom_length);
+
+guint             mousepad_encoding_detect              (const gchar               *contents,
+                                                         gsize                      length,
+                                                         MousepadEncodingCandidate *candidates,
+                                                         guint                      n_candidates);
 
+gboolean          mousepad_encoding_has_transcoder      (MousepadEncoding           encoding);
 
-const gchar      *mousepad_encoding_get_charset (MousepadEncoding   encoding);
+gboolean          mousepad_encoding_is_ascii_compatible (MousepadEncoding           encoding);
 
-const gchar      *mousepad_encoding_get_name    (MousepadEncoding   encoding);
+gsize             mousepad_encoding_find_boundary       (MousepadEncoding           encoding,
+                                                         const gchar               *contents,
+                                                         gsize                      length,
+                                                         gsize                      offset);
 
-MousepadEncoding  mousepad_encoding_find        (const gchar       *charset);
+gchar            *mousepad_encoding_convert_to_utf8     (MousepadEncoding           encoding,
+                                                         const gchar               *contents,
+                                                         gsize                      length,
+                                                         gsize                     *bytes_read,
+                                                         gsize                     *bytes_written,
+                                                         GError                   **error);
 
-MousepadEncoding  mousepad_encoding_get_default (void);
+gboolean          mousepad_encoding_measure_utf8        (MousepadEncoding           encoding,
+                                                         const gchar               *contents,
+                                                         gsize                      length,
+                                                         gsize                     *utf8_length,
+                                                         GError                   **error);
 
-MousepadEncoding  mousepad_encoding_read_bom    (const gchar       *contents,
-                                                 gsize              length,
-                                                 gsize             *bom_length);
+void              mousepad_encoding_convert_into        (MousepadEncoding           encoding,
+                                                         const gchar               *contents,
+                                                         gsize                      length,
+                                                         gchar                     *utf8,
+                                                         gsize                      utf8_length);
 
-void              mousepad_encoding_write_bom   (MousepadEncoding  *encoding,
-                                                 gint              *length,
-                                                 gchar            **contents);
+gchar            *mousepad_encoding_convert_from_utf8   (MousepadEncoding           encoding,
+                                                         const gchar               *text,
+                                                         gsize                      length,
+                                                         gsize                     *bytes_read,
+                                                         gsize                     *bytes_written,
+                                                         GError                   **error);
 
 G_END_DECLS
 
@@ -19,11 +19,38 @@
 #include <mousepad/mousepad-util.h>
 #include <mousepad/mousepad-settings.h>
 #include <mousepad/mousepad-dialogs.h>
+#include <mousepad/mousepad-scanner.h>
+#include <mousepad/mousepad-diff.h>
+#include <mousepad/mousepad-hash.h>
+#include <mousepad/mousepad-watch.h>
+#include <mousepad/mousepad-cache.h>
+#include <mousepad/mousepad-undo-manager.h>
+
+
+
+/* size of the blocks read from the file, in bytes */
+#define MOUSEPAD_FILE_READ_CHUNK_SIZE   (64 * 1024)
+
+/* size of the blocks inserted in the buffer at once when loading asynchronously, in bytes */
+#define MOUSEPAD_FILE_INSERT_CHUNK_SIZE (1024 * 1024)
+
+/* number of characters written at once when saving */
+#define MOUSEPAD_FILE_WRITE_CHUNK_SIZE  (256 * 1024)
+
+/* interval between two progress reports when loading asynchronously, in milliseconds */
+#define MOUSEPAD_FILE_PROGRESS_INTERVAL 100
+
+/* minimal size of the chunks decoded in parallel when loading large files, in bytes */
+#define MOUSEPAD_FILE_DECODE_CHUNK_SIZE (8 * 1024 * 1024)
+
+/* granularity of the modification time on the coarsest filesystems (FAT), in microseconds */
+#define MOUSEPAD_FILE_MTIME_GRANULARITY (2 * G_USEC_PER_SEC)
 
 
 
 enum
 {
+  CONTENTS_APPENDED,
   ENCODING_CHANGED,
   EXTERNALLY_MODIFIED,
   LOCATION_CHANGED,
@@ -36,14 +63,23 @@ enum
 static void     mousepad_file_finalize        (GObject           *object);
 
 /* MousepadFile own functions */
-static gboolean mousepad_file_set_monitor     (gpointer           data);
-static void     mousepad_file_monitor_changed (GFileMonitor      *monitor,
-                                               GFile             *location,
-                                               GFile             *other_location,
-                                               GFileMonitorEvent  event_type,
-                                               MousepadFile      *file);
-static void     mousepad_file_set_read_only   (MousepadFile      *file,
-                                               gboolean           readonly);
+static gboolean mousepad_file_set_monitor     (gpointer            data);
+static void     mousepad_file_monitor_changed (GFile              *location,
+                                               MousepadWatchEvents events,
+                                               GFileInfo          *fileinfo,
+                                               gpointer            data);
+static void     mousepad_file_set_read_only   (MousepadFile       *file,
+                                               gboolean            readonly);
+static void     mousepad_file_buffer_changed  (MousepadFile       *file);
+static gboolean mousepad_file_follow_appended (MousepadFile       *file,
+                                               MousepadWatchEvents events,
+                                               GFileInfo          *fileinfo);
+static void     mousepad_file_verify          (MousepadFile       *file,
+                                               GFileInfo          *fileinfo);
+static gsize    mousepad_file_load_normalize  (const gchar        *contents,
+                                               gsize               length,
+                                               GArray             *cr_offsets,
+                                               gchar              *dest);
 
 
 
@@ -63,13 +99,17 @@ struct _MousepadFile
   GFile              *location;
   gboolean            temporary;
 
-  /* file monitoring */
-  GFileMonitor       *monitor;
+  /* file monitoring, through the watch service */
+  guint               watch_id;
   gboolean            readonly;
 
   /* encoding of the file */
   MousepadEncoding    encoding;
 
+  /* the encoding guessed from the contents when they could not be decoded */
+  MousepadEncoding    detected_encoding;
+  gdouble             detected_confidence;
+
   /* line ending of the file */
   MousepadLineEnding  line_ending;
 
@@ -81,10 +121,176 @@ struct _MousepadFile
 
   /* whether the filetype has been set by user or we should guess it */
   gboolean            user_set_language;
+
+  /* whether the last loaded contents were too large for the costly features to be enabled,
+   * and whether the user enabled them anyway */
+  gboolean            large;
+  gboolean            large_override;
+
+  /* number of buffer changes, to know if it was modified during an asynchronous save */
+  guint               change_count;
+  gboolean            saving;
+
+  /* the size of the file when it was last read or written (-1 if unknown), its modification
+   * time and the hash of its contents, to check if it was really modified externally */
+  goffset             size;
+  guint64             mtime;
+  MousepadHash        hash;
+  GCancellable       *verify_cancellable;
+
+  /* follow mode: the bytes of an incomplete character at the end of the file and
+   * whether it ended with a cr, the reading of the appended bytes in progress and the
+   * change notifications received meanwhile, handled once it ends */
+  gboolean            follow;
+  GByteArray         *follow_pending;
+  gboolean            follow_cr;
+  GCancellable       *follow_cancellable;
+  MousepadWatchEvents follow_events;
+  GFileInfo          *follow_info;
 };
 
 
 
+/* the state of a loading process, shared between its different stages */
+typedef struct
+{
+  /* the file being loaded and its location at the start of the process */
+  MousepadFile                 *file;
+  GFile                        *location;
+
+  /* loading options */
+  MousepadEncoding              encoding;
+  gboolean                      must_exist;
+  gboolean                      ignore_bom;
+  gboolean                      make_valid;
+
+  /* progress report, in thousandths, updated atomically */
+  MousepadFileProgressCallback  progress_callback;
+  gpointer                      progress_data;
+  guint                         progress_timer;
+  gint                          progress;
+  gint                          progress_reported;
+
+  /* raw contents of the file and their status */
+  GBytes                       *bytes;
+  gchar                        *etag;
+  goffset                       etag_size;
+  guint64                       mtime;
+  MousepadHash                  hash;
+  gsize                         bom_length;
+
+  /* decoded contents with lf line endings, possibly pointing into the raw contents or
+   * into the converted contents shared with the cache */
+  const gchar                  *contents;
+  gchar                        *decoded;
+  GBytes                       *converted;
+  gsize                         length;
+  MousepadLineEnding            line_ending;
+  gboolean                      has_eol;
+
+  /* the thresholds from which the decoded contents are large, and whether they are */
+  guint64                       size_threshold;
+  gsize                         line_threshold;
+  gboolean                      large;
+
+  /* insertion offset in the decoded contents */
+  gsize                         offset;
+
+  /* when reloading, the previous contents of the buffer and the changes to apply to it */
+  gboolean                      reload;
+  gchar                        *old_contents;
+  guint                         old_change_count;
+  GArray                       *hunks;
+
+  /* the return value, 0 or one of the error codes of mousepad-file.h */
+  gint                          retval;
+
+  /* the encoding guessed from the raw contents if they could not be decoded */
+  MousepadEncodingCandidate     detected;
+}
+MousepadFileLoad;
+
+/* a chunk of the raw contents of a large file, decoded and scanned in a worker thread */
+typedef struct
+{
+  MousepadEncoding              encoding;
+  GCancellable                 *cancellable;
+  const gchar                  *raw;
+  gsize                         raw_length;
+
+  /* the place of the chunk in the decoded contents, unless the file is in UTF-8,
+   * and the scan of the decoded chunk */
+  gchar                        *decoded;
+  gsize                         length;
+  MousepadScanResult            scan;
+  GError                       *error;
+}
+MousepadFileLoadChunk;
+
+
+
+/* the state of a saving process */
+typedef struct
+{
+  /* the file being saved and its location at the start of the process */
+  MousepadFile                 *file;
+  GFile                        *location;
+
+  /* the etag to check, and the one of the saved file */
+  gchar                        *etag;
+  gchar                        *new_etag;
+  gboolean                      make_backup;
+
+  /* conversions to apply, the charset being converted with iconv unless the encoding
+   * has a built-in transcoder */
+  const guchar                 *bom;
+  gsize                         bom_length;
+  const gchar                  *charset;
+  MousepadEncoding              encoding;
+  gboolean                      transcode;
+  MousepadLineEnding            line_ending;
+
+  /* the source of the contents, the buffer itself or a snapshot of it */
+  GtkTextIter                   iter;
+  GPtrArray                    *snapshot;
+  guint                         snapshot_index;
+
+  /* the buffer change count when the contents were read */
+  guint                         change_count;
+
+  /* the hash of the written contents */
+  MousepadHash                  hash;
+}
+MousepadFileSave;
+
+
+
+/* the state of a verification of the file contents after a change notification */
+typedef struct
+{
+  GFile                        *location;
+  MousepadHash                  hash;
+  gchar                        *etag;
+  guint64                       mtime;
+}
+MousepadFileVerify;
+
+/* the reading of the bytes appended to a followed file, from its size when last read */
+typedef struct
+{
+  GFile                        *location;
+  goffset                       offset;
+  GBytes                       *bytes;
+  GFileInfo                    *fileinfo;
+
+  /* the change notification, handled as usual if the file did not only grow */
+  MousepadWatchEvents           events;
+  GFileInfo                    *event_info;
+}
+MousepadFileFollow;
+
+
+
 static guint file_signals[LAST_SIGNAL];
 
 
@@ -101,6 +307,10 @@ mousepad_file_class_init (MousepadFileClass *klass)
   gobject_class = G_OBJECT_CLASS (klass);
   gobject_class->finalize = mousepad_file_finalize;
 
+  file_signals[CONTENTS_APPENDED] =
+    g_signal_new (I_("contents-appended"), G_TYPE_FROM_CLASS (gobject_class), G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL, g_cclosure_marshal_VOID__VOID, G_TYPE_NONE, 0);
+
   file_signals[ENCODING_CHANGED] =
     g_signal_new (I_("encoding-changed"), G_TYPE_FROM_CLASS (gobject_class), G_SIGNAL_RUN_LAST,
                   0, NULL, NULL, g_cclosure_marshal_VOID__ENUM, G_TYPE_NONE, 1, G_TYPE_INT);
@@ -126,7 +336,7 @@ mousepad_file_init (MousepadFile *file)
   /* initialize */
   file->location          = NULL;
   file->temporary         = FALSE;
-  file->monitor           = NULL;
+  file->watch_id          = 0;
   file->readonly          = FALSE;
   file->encoding          = MOUSEPAD_ENCODING_NONE;
 #ifdef G_OS_WIN32
@@ -137,6 +347,13 @@ mousepad_file_init (MousepadFile *file)
   file->etag              = NULL;
   file->write_bom         = FALSE;
   file->user_set_language = FALSE;
+  file->large             = FALSE;
+  file->large_override    = FALSE;
+  file->size              = -1;
+  file->mtime             = 0;
+  file->follow            = FALSE;
+  file->follow_pending    = g_byte_array_new ();
+  file->follow_cr         = FALSE;
 
   /* file monitoring */
   MOUSEPAD_SETTING_CONNECT_OBJECT (MONITOR_CHANGES, G_CALLBACK (mousepad_file_set_monitor),
@@ -152,21 +369,48 @@ mousepad_file_finalize (GObject *object)
 
   /* cleanup */
   g_free (file->etag);
+  g_byte_array_unref (file->follow_pending);
+
+  if (file->follow_info != NULL)
+    g_object_unref (file->follow_info);
+
+  if (file->follow_cancellable != NULL)
+    {
+      g_cancellable_cancel (file->follow_cancellable);
+      g_object_unref (file->follow_cancellable);
+    }
+
+  if (file->verify_cancellable != NULL)
+    {
+      g_cancellable_cancel (file->verify_cancellable);
+      g_object_unref (file->verify_cancellable);
+    }
 
   if (G_IS_FILE (file->location))
     g_object_unref (file->location);
 
-  if (G_IS_FILE_MONITOR (file->monitor))
-    g_object_unref (file->monitor);
+  if (file->watch_id != 0)
+    mousepad_watch_remove (file->watch_id);
 
   if (GTK_IS_TEXT_BUFFER (file->buffer))
-    g_object_unref (file->buffer);
+    {
+      mousepad_disconnect_by_func (file->buffer, mousepad_file_buffer_changed, file);
+      g_object_unref (file->buffer);
+    }
 
   (*G_OBJECT_CLASS (mousepad_file_parent_class)->finalize) (object);
 }
 
 
 
+static void
+mousepad_file_buffer_changed (MousepadFile *file)
+{
+  file->change_count++;
+}
+
+
+
 MousepadFile *
 mousepad_file_new (GtkTextBuffer *buffer)
 {
@@ -178,6 +422,7 @@ mousepad_file_new (GtkTextBuffer *buffer)
 
   /* set the buffer */
   file->buffer = GTK_TEXT_BUFFER (g_object_ref (buffer));
+  g_signal_connect_swapped (buffer, "changed", G_CALLBACK (mousepad_file_buffer_changed), file);
 
   return file;
 }
@@ -185,584 +430,2459 @@ mousepad_file_new (GtkTextBuffer *buffer)
 
 
 static void
-mousepad_file_monitor_changed (GFileMonitor      *monitor,
-                               GFile             *location,
-                               GFile             *other_location,
-                               GFileMonitorEvent  event_type,
-                               MousepadFile      *file)
+mousepad_file_monitor_changed (GFile               *location,
+                               MousepadWatchEvents  events,
+                               GFileInfo           *fileinfo,
+                               gpointer             data)
 {
-  GFileInfo *fileinfo;
+  MousepadFile *file = data;
 
   /* update readonly status */
-  if (event_type & G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED
-      && G_LIKELY (fileinfo = g_file_query_info (location, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
-                                                 G_FILE_QUERY_INFO_NONE, NULL, NULL)))
-    {
-      mousepad_file_set_read_only (file,
-        ! g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
-      g_object_unref (fileinfo);
-    }
-
-  /* the file has been externally modified */
-  if (event_type & (G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT | G_FILE_MONITOR_EVENT_MOVED_IN))
-    g_signal_emit (file, file_signals[EXTERNALLY_MODIFIED], 0);
+  if (events & MOUSEPAD_WATCH_EVENT_ATTRIBUTES && G_LIKELY (fileinfo != NULL))
+    mousepad_file_set_read_only (file,
+      ! g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
+
+  /* append what was added at the end of the file, which is checked in a thread, the
+   * change being handled below from there if the file did not only grow */
+  if (file->follow && events & (MOUSEPAD_WATCH_EVENT_CHANGED | MOUSEPAD_WATCH_EVENT_CHANGES_DONE)
+      && mousepad_file_follow_appended (file, events, fileinfo))
+    return;
+
+  /* the file may have been externally modified, provided it was read or written before: the
+   * contents of a tab opened lazily are not there yet, there is nothing to compare with */
+  if (events & MOUSEPAD_WATCH_EVENT_CHANGES_DONE && (file->size >= 0 || file->etag != NULL))
+    mousepad_file_verify (file, fileinfo);
 }
 
 
 
-static gboolean
-mousepad_file_set_monitor (gpointer data)
+static guint64
+mousepad_file_info_get_mtime (GFileInfo *fileinfo)
 {
-  MousepadFile *file;
-  GError       *error = NULL;
+  return g_file_info_get_attribute_uint64 (fileinfo, G_FILE_ATTRIBUTE_TIME_MODIFIED) * G_USEC_PER_SEC
+         + g_file_info_get_attribute_uint32 (fileinfo, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC);
+}
 
-  /* the file may have been released during the delay */
-  if (MOUSEPAD_IS_FILE (data))
-    {
-      file = MOUSEPAD_FILE (data);
-      if (G_IS_FILE_MONITOR (file->monitor))
-        g_object_unref (file->monitor);
 
-      if (MOUSEPAD_SETTING_GET_BOOLEAN (MONITOR_CHANGES))
-        {
-          file->monitor = g_file_monitor_file (file->location,
-                                               G_FILE_MONITOR_WATCH_MOVES
-                                               | G_FILE_MONITOR_WATCH_HARD_LINKS,
-                                               NULL, &error);
 
-          /* inform the user */
-          if (error != NULL)
-            {
-              g_message ("File monitoring is disabled for file '%s': %s",
-                         mousepad_file_get_path (file), error->message);
-              g_error_free (error);
-            }
-          /* watch file for changes */
-          else
-            g_signal_connect (file->monitor, "changed",
-                              G_CALLBACK (mousepad_file_monitor_changed), file);
-        }
-    }
+/* the modification time of a file whose status is being recorded, or 0 if it is too recent:
+ * the file could then be written again without its modification time changing */
+static guint64
+mousepad_file_info_get_status_mtime (GFileInfo *fileinfo)
+{
+  guint64 mtime;
 
-  return FALSE;
+  mtime = mousepad_file_info_get_mtime (fileinfo);
+  if ((guint64) g_get_real_time () < mtime + MOUSEPAD_FILE_MTIME_GRANULARITY)
+    return 0;
+
+  return mtime;
 }
 
 
 
-void
-mousepad_file_set_location (MousepadFile *file,
-                            GFile        *location,
-                            gboolean      real)
+/* hash the contents of @location by chunks, also getting its etag and modification time */
+static gboolean
+mousepad_file_hash_location (GFile         *location,
+                             MousepadHash  *hash,
+                             gchar        **etag,
+                             guint64       *mtime,
+                             GCancellable  *cancellable,
+                             GError       **error)
 {
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  GFileInputStream *stream;
+  GFileInfo        *fileinfo;
+  guchar           *buffer;
+  gssize            n_read;
 
-  /* set location */
-  if (file->location == NULL && location != NULL)
-    file->location = g_object_ref (location);
-  /* reset location */
-  else if (file->location != NULL && location == NULL)
-    {
-      g_object_unref (file->location);
-      file->location = NULL;
-    }
-  /* update location */
-  else if (file->location != NULL && location != NULL
-           && ! g_file_equal (file->location, location))
-    {
-      g_object_unref (file->location);
-      file->location = g_object_ref (location);
-    }
+  stream = g_file_read (location, cancellable, error);
+  if (G_UNLIKELY (stream == NULL))
+    return FALSE;
 
-  /* not a virtual change, such as when trying to save as */
-  if (real)
+  fileinfo = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_ETAG_VALUE ","
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, cancellable, NULL);
+  if (G_LIKELY (fileinfo != NULL))
     {
-      /* this is a definitve location */
-      file->temporary = FALSE;
+      if (etag != NULL)
+        *etag = g_strdup (g_file_info_get_etag (fileinfo));
 
-      /* activate file monitoring with a delay, to not consider our own saving as
-       * external modification after a save as */
-      g_timeout_add (MOUSEPAD_SETTING_GET_INT (MONITOR_DISABLING_TIMER),
-                     mousepad_file_set_monitor, file);
+      if (mtime != NULL)
+        *mtime = mousepad_file_info_get_status_mtime (fileinfo);
 
-      /* send a signal that the name has been changed */
-      g_signal_emit (file, file_signals[LOCATION_CHANGED], 0, file->location);
+      g_object_unref (fileinfo);
     }
-  /* toggle location state */
-  else
-    file->temporary = ! file->temporary;
-}
-
 
+  mousepad_hash_init (hash);
+  buffer = g_malloc (MOUSEPAD_FILE_READ_CHUNK_SIZE);
+  while ((n_read = g_input_stream_read (G_INPUT_STREAM (stream), buffer, MOUSEPAD_FILE_READ_CHUNK_SIZE,
+                                        cancellable, error)) > 0)
+    mousepad_hash_update (hash, buffer, n_read);
 
-GFile *
-mousepad_file_get_location (MousepadFile *file)
-{
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+  g_free (buffer);
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
 
-  return file->location;
+  return n_read == 0;
 }
 
 
 
-gboolean
-mousepad_file_location_is_set (MousepadFile *file)
+static void
+mousepad_file_verify_free (gpointer data)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  MousepadFileVerify *verify = data;
 
-  return G_IS_FILE (file->location);
+  g_object_unref (verify->location);
+  g_free (verify->etag);
+  g_slice_free (MousepadFileVerify, verify);
 }
 
 
 
-const gchar *
-mousepad_file_get_path (MousepadFile *file)
+static void
+mousepad_file_verify_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+  MousepadFileVerify *verify = task_data;
+  GError             *error = NULL;
 
-  return mousepad_util_get_path (file->location);
+  if (mousepad_file_hash_location (verify->location, &verify->hash, &verify->etag, &verify->mtime,
+                                   cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
 }
 
 
 
-gchar *
-mousepad_file_get_uri (MousepadFile *file)
+static void
+mousepad_file_verify_ready (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      data)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+  MousepadFile       *file = MOUSEPAD_FILE (object);
+  MousepadFileVerify *verify = g_task_get_task_data (G_TASK (result));
+  GError             *error = NULL;
 
-  return g_file_get_uri (file->location);
+  if (! g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      /* a newer verification is running, or the file was released */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        {
+          g_error_free (error);
+          return;
+        }
+
+      g_error_free (error);
+    }
+  /* same contents: only the file status changed, e.g. after a touch */
+  else if (verify->hash.total_length == (guint64) file->size
+           && mousepad_hash_digest (&verify->hash) == mousepad_hash_digest (&file->hash)
+           && g_file_equal (verify->location, file->location))
+    {
+      g_free (file->etag);
+      file->etag = verify->etag;
+      verify->etag = NULL;
+      file->mtime = verify->mtime;
+
+      return;
+    }
+
+  g_signal_emit (file, file_signals[EXTERNALLY_MODIFIED], 0);
 }
 
 
 
+/* emit "externally-modified" only if the contents of the file really changed since it was
+ * last read or written: a different size is enough to conclude, the same modification time
+ * also unless it was too recent then, else the contents are hashed in a thread and compared */
 static void
-mousepad_file_set_read_only (MousepadFile *file,
-                             gboolean      readonly)
+mousepad_file_verify (MousepadFile *file,
+                      GFileInfo    *fileinfo)
 {
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  MousepadFileVerify *verify;
+  GTask              *task;
+  gboolean            modified = TRUE;
 
-  if (G_LIKELY (file->readonly != readonly))
+  /* cancel a previous verification still running */
+  if (file->verify_cancellable != NULL)
     {
-      /* store new value */
-      file->readonly = readonly;
-
-      /* emit signal */
-      g_signal_emit (file, file_signals[READONLY_CHANGED], 0, readonly);
+      g_cancellable_cancel (file->verify_cancellable);
+      g_object_unref (file->verify_cancellable);
+      file->verify_cancellable = NULL;
     }
-}
 
+  if (file->size >= 0 && fileinfo != NULL)
+    {
+      if (g_file_info_get_size (fileinfo) == file->size)
+        {
+          if (file->mtime != 0 && mousepad_file_info_get_mtime (fileinfo) == file->mtime)
+            modified = FALSE;
+          else
+            {
+              verify = g_slice_new0 (MousepadFileVerify);
+              verify->location = g_object_ref (file->location);
+              file->verify_cancellable = g_cancellable_new ();
 
+              task = g_task_new (file, file->verify_cancellable, mousepad_file_verify_ready, NULL);
+              g_task_set_task_data (task, verify, mousepad_file_verify_free);
+              g_task_run_in_thread (task, mousepad_file_verify_thread);
+              g_object_unref (task);
 
-gboolean
-mousepad_file_get_read_only (MousepadFile *file)
-{
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+              modified = FALSE;
+            }
+        }
+    }
 
-  return file->readonly;
+  if (modified)
+    g_signal_emit (file, file_signals[EXTERNALLY_MODIFIED], 0);
 }
 
 
 
-gboolean
-mousepad_file_is_savable (MousepadFile *file)
+static gboolean
+mousepad_file_set_monitor (gpointer data)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  MousepadFile *file;
 
-  return file->location == NULL
-         || (! file->readonly && gtk_text_buffer_get_modified (file->buffer));
+  /* the file may have been released during the delay */
+  if (MOUSEPAD_IS_FILE (data))
+    {
+      file = MOUSEPAD_FILE (data);
+      if (file->watch_id != 0)
+        {
+          mousepad_watch_remove (file->watch_id);
+          file->watch_id = 0;
+        }
+
+      /* watch file for changes, by polling it if it can't be monitored */
+      if (MOUSEPAD_SETTING_GET_BOOLEAN (MONITOR_CHANGES))
+        file->watch_id = mousepad_watch_add (file->location, mousepad_file_monitor_changed, file);
+    }
+
+  return FALSE;
 }
 
 
 
-void
-mousepad_file_set_encoding (MousepadFile     *file,
-                            MousepadEncoding  encoding)
+static void
+mousepad_file_follow_reset (MousepadFile *file,
+                            goffset       size)
 {
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  file->size = size;
+  file->follow_cr = FALSE;
+  g_byte_array_set_size (file->follow_pending, 0);
 
-  /* set new encoding */
-  file->encoding = encoding;
+  /* a reading in progress would not apply to the new contents */
+  if (file->follow_cancellable != NULL)
+    {
+      g_cancellable_cancel (file->follow_cancellable);
+      g_object_unref (file->follow_cancellable);
+      file->follow_cancellable = NULL;
+    }
 
-  /* send a signal that the encoding has been changed */
-  g_signal_emit (file, file_signals[ENCODING_CHANGED], 0, file->encoding);
+  file->follow_events = 0;
+  if (file->follow_info != NULL)
+    {
+      g_object_unref (file->follow_info);
+      file->follow_info = NULL;
+    }
 }
 
 
 
-MousepadEncoding
-mousepad_file_get_encoding (MousepadFile *file)
+/* decode the bytes appended to the file, leaving an incomplete character at their end for
+ * the next time, returns the text with lf line endings or NULL if they could not be decoded */
+static gchar *
+mousepad_file_follow_decode (MousepadFile *file,
+                             gsize        *length)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), MOUSEPAD_ENCODING_NONE);
-
-  return file->encoding;
-}
+  MousepadScanResult  scan;
+  GByteArray         *raw = file->follow_pending;
+  const gchar        *contents = (const gchar *) raw->data;
+  gchar              *text;
+  gsize               consumed = raw->len, written;
+  GError             *error = NULL;
+
+  if (file->encoding == MOUSEPAD_ENCODING_UTF_8)
+    {
+      mousepad_scanner_scan (contents, raw->len, &scan);
+      mousepad_scanner_clear (&scan);
+      if (scan.valid_length == raw->len)
+        text = g_strndup (contents, raw->len);
+      else if (g_utf8_get_char_validated (contents + scan.valid_length,
+                                          raw->len - scan.valid_length) == (gunichar) -2)
+        {
+          consumed = scan.valid_length;
+          text = g_strndup (contents, consumed);
+        }
+      else
+        text = g_utf8_make_valid (contents, raw->len);
 
+      written = strlen (text);
+    }
+  else
+    {
+      text = mousepad_encoding_convert_to_utf8 (file->encoding, contents, raw->len,
+                                                &consumed, &written, &error);
+      if (text == NULL && g_error_matches (error, G_CONVERT_ERROR, G_CONVERT_ERROR_PARTIAL_INPUT))
+        text = mousepad_encoding_convert_to_utf8 (file->encoding, contents, consumed,
+                                                  &consumed, &written, NULL);
 
+      if (error != NULL)
+        g_error_free (error);
 
-void
-mousepad_file_set_write_bom (MousepadFile *file,
-                             gboolean      write_bom)
-{
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+      if (text == NULL)
+        return NULL;
+    }
 
-  /* set new value */
-  file->write_bom = write_bom;
+  g_byte_array_remove_range (raw, 0, consumed);
 
-  /* set the encoding to UTF-8 if not already compatible */
-  if (file->encoding != MOUSEPAD_ENCODING_UTF_7
-      && file->encoding != MOUSEPAD_ENCODING_UTF_8
-      && file->encoding != MOUSEPAD_ENCODING_UTF_16BE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_16LE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_32BE
-      && file->encoding != MOUSEPAD_ENCODING_UTF_32LE)
-    file->encoding = MOUSEPAD_ENCODING_UTF_8;
-}
+  /* the lf of a cr+lf split between two reads was already inserted with the cr */
+  if (file->follow_cr && written > 0 && text[0] == '\n')
+    {
+      memmove (text, text + 1, written);
+      written--;
+    }
 
+  if (written > 0)
+    file->follow_cr = (text[written - 1] == '\r');
 
+  /* convert the line endings to line feeds */
+  mousepad_scanner_scan (text, written, &scan);
+  if (scan.cr_offsets->len > 0)
+    written = mousepad_file_load_normalize (text, written, scan.cr_offsets, text);
 
-gboolean
-mousepad_file_get_write_bom (MousepadFile *file)
-{
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  mousepad_scanner_clear (&scan);
+  *length = written;
 
-  return file->write_bom;
+  return text;
 }
 
 
 
-GtkTextBuffer *
-mousepad_file_get_buffer (MousepadFile *file)
+static void
+mousepad_file_follow_free (gpointer data)
 {
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+  MousepadFileFollow *follow = data;
 
-  return file->buffer;
-}
+  g_object_unref (follow->location);
 
+  if (follow->bytes != NULL)
+    g_bytes_unref (follow->bytes);
 
+  if (follow->fileinfo != NULL)
+    g_object_unref (follow->fileinfo);
 
-void
-mousepad_file_set_line_ending (MousepadFile       *file,
-                               MousepadLineEnding  line_ending)
-{
-  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  if (follow->event_info != NULL)
+    g_object_unref (follow->event_info);
 
-  file->line_ending = line_ending;
+  g_slice_free (MousepadFileFollow, follow);
 }
 
 
 
-MousepadLineEnding
-mousepad_file_get_line_ending (MousepadFile *file)
+static void
+mousepad_file_follow_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
 {
-  return file->line_ending;
-}
-
+  MousepadFileFollow *follow = task_data;
+  GFileInputStream   *stream;
+  GError             *error = NULL;
+  guint8             *data;
+  goffset             size;
+  gsize               n_read = 0;
+
+  stream = g_file_read (follow->location, cancellable, &error);
+  if (G_UNLIKELY (stream == NULL))
+    {
+      g_task_return_error (task, error);
+      return;
+    }
 
+  follow->fileinfo = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                                     G_FILE_ATTRIBUTE_ETAG_VALUE ","
+                                                     G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                                     G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                                     cancellable, &error);
 
-static void
+  /* read only the new bytes, after those read the last time */
+  if (G_LIKELY (follow->fileinfo != NULL))
+    {
+      size = g_file_info_get_size (follow->fileinfo);
+      if (size <= follow->offset || ! g_seekable_can_seek (G_SEEKABLE (stream)))
+        g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_FAILED, "The file did not only grow");
+      else if (g_seekable_seek (G_SEEKABLE (stream), follow->offset, G_SEEK_SET, cancellable, &error))
+        {
+          data = g_malloc (size - follow->offset);
+          if (g_input_stream_read_all (G_INPUT_STREAM (stream), data, size - follow->offset,
+                                       &n_read, cancellable, &error))
+            follow->bytes = g_bytes_new_take (data, n_read);
+          else
+            g_free (data);
+        }
+    }
+
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  if (error != NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+
+
+/* append the bytes read to the buffer, returns FALSE if they could not be decoded */
+static gboolean
+mousepad_file_follow_insert (MousepadFile *file,
+                             GBytes       *bytes,
+                             GFileInfo    *fileinfo)
+{
+  GtkSourceUndoManager *undo_manager;
+  MousepadHash          hash;
+  const guint8         *data;
+  gsize                 old_length, n_read, length = 0;
+  gchar                *text;
+
+  data = g_bytes_get_data (bytes, &n_read);
+  old_length = file->follow_pending->len;
+  g_byte_array_append (file->follow_pending, data, n_read);
+  text = mousepad_file_follow_decode (file, &length);
+
+  /* leave things as they were on failure */
+  if (text == NULL)
+    {
+      g_byte_array_set_size (file->follow_pending, old_length);
+      return FALSE;
+    }
+
+  /* append the text, this is not an undoable user action but the history remains valid,
+   * all the changes it records preceding the appended text */
+  undo_manager = gtk_source_buffer_get_undo_manager (GTK_SOURCE_BUFFER (file->buffer));
+  mousepad_undo_manager_append (MOUSEPAD_UNDO_MANAGER (undo_manager), text, length);
+  gtk_text_buffer_set_modified (file->buffer, FALSE);
+  g_free (text);
+
+  /* the document is in sync with the file again */
+  hash = file->hash;
+  mousepad_hash_update (&hash, data, n_read);
+  file->size += n_read;
+  file->hash = hash;
+  file->mtime = mousepad_file_info_get_status_mtime (fileinfo);
+  g_free (file->etag);
+  file->etag = g_strdup (g_file_info_get_etag (fileinfo));
+
+  g_signal_emit (file, file_signals[CONTENTS_APPENDED], 0);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_follow_ready (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      data)
+{
+  MousepadFile        *file = MOUSEPAD_FILE (object);
+  MousepadFileFollow  *follow = g_task_get_task_data (G_TASK (result));
+  MousepadWatchEvents  events;
+  GFileInfo           *fileinfo;
+  GError              *error = NULL;
+
+  /* the contents were reloaded or saved meanwhile */
+  if (! g_task_propagate_boolean (G_TASK (result), &error)
+      && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+
+  g_clear_error (&error);
+  g_object_unref (file->follow_cancellable);
+  file->follow_cancellable = NULL;
+
+  /* the document may have been modified meanwhile, the change is then handled as usual */
+  if (follow->bytes == NULL || ! file->follow || file->saving
+      || gtk_text_buffer_get_modified (file->buffer)
+      || ! mousepad_file_follow_insert (file, follow->bytes, follow->fileinfo))
+    {
+      if (follow->events & MOUSEPAD_WATCH_EVENT_CHANGES_DONE && (file->size >= 0 || file->etag != NULL))
+        mousepad_file_verify (file, follow->fileinfo != NULL ? follow->fileinfo : follow->event_info);
+    }
+
+  /* handle the notifications received meanwhile */
+  if (file->follow_events != 0)
+    {
+      events = file->follow_events;
+      fileinfo = file->follow_info;
+      file->follow_events = 0;
+      file->follow_info = NULL;
+
+      mousepad_file_monitor_changed (file->location, events, fileinfo, file);
+
+      if (fileinfo != NULL)
+        g_object_unref (fileinfo);
+    }
+}
+
+
+
+/* start reading the contents which were added at the end of the file since it was last
+ * read, returns FALSE if they can't be appended and the change must be handled as usual */
+static gboolean
+mousepad_file_follow_appended (MousepadFile        *file,
+                               MousepadWatchEvents  events,
+                               GFileInfo           *fileinfo)
+{
+  MousepadFileFollow *follow;
+  GTask              *task;
+
+  /* a reading is in progress, the notification is handled once it ends */
+  if (file->follow_cancellable != NULL)
+    {
+      file->follow_events |= events;
+      if (fileinfo != NULL)
+        {
+          if (file->follow_info != NULL)
+            g_object_unref (file->follow_info);
+
+          file->follow_info = g_object_ref (fileinfo);
+        }
+
+      return TRUE;
+    }
+
+  /* only follow untouched documents, whose size on disk is known */
+  if (file->size < 0 || file->saving || file->location == NULL
+      || gtk_text_buffer_get_modified (file->buffer))
+    return FALSE;
+
+  follow = g_slice_new0 (MousepadFileFollow);
+  follow->location = g_object_ref (file->location);
+  follow->offset = file->size;
+  follow->events = events;
+  follow->event_info = fileinfo != NULL ? g_object_ref (fileinfo) : NULL;
+  file->follow_cancellable = g_cancellable_new ();
+
+  task = g_task_new (file, file->follow_cancellable, mousepad_file_follow_ready, NULL);
+  g_task_set_task_data (task, follow, mousepad_file_follow_free);
+  g_task_run_in_thread (task, mousepad_file_follow_thread);
+  g_object_unref (task);
+
+  return TRUE;
+}
+
+
+
+void
+mousepad_file_set_follow (MousepadFile *file,
+                          gboolean      follow)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  file->follow = follow;
+}
+
+
+
+gboolean
+mousepad_file_get_follow (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->follow;
+}
+
+
+
+/* get the hash of the file contents as they were last read or written, and their size,
+ * returns FALSE if they are unknown */
+gboolean
+mousepad_file_get_digest (MousepadFile *file,
+                          guint64      *digest,
+                          goffset      *size)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  if (file->size < 0 || file->hash.total_length != (guint64) file->size)
+    return FALSE;
+
+  *digest = mousepad_hash_digest (&file->hash);
+  *size = file->size;
+
+  return TRUE;
+}
+
+
+
+void
+mousepad_file_set_location (MousepadFile *file,
+                            GFile        *location,
+                            gboolean      real)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* set location */
+  if (file->location == NULL && location != NULL)
+    file->location = g_object_ref (location);
+  /* reset location */
+  else if (file->location != NULL && location == NULL)
+    {
+      g_object_unref (file->location);
+      file->location = NULL;
+    }
+  /* update location */
+  else if (file->location != NULL && location != NULL
+           && ! g_file_equal (file->location, location))
+    {
+      g_object_unref (file->location);
+      file->location = g_object_ref (location);
+    }
+
+  /* not a virtual change, such as when trying to save as */
+  if (real)
+    {
+      /* this is a definitve location */
+      file->temporary = FALSE;
+
+      /* nothing is known about its contents yet */
+      mousepad_file_follow_reset (file, -1);
+
+      /* activate file monitoring with a delay, to not consider our own saving as
+       * external modification after a save as */
+      g_timeout_add (MOUSEPAD_SETTING_GET_INT (MONITOR_DISABLING_TIMER),
+                     mousepad_file_set_monitor, file);
+
+      /* send a signal that the name has been changed */
+      g_signal_emit (file, file_signals[LOCATION_CHANGED], 0, file->location);
+    }
+  /* toggle location state */
+  else
+    file->temporary = ! file->temporary;
+}
+
+
+
+GFile *
+mousepad_file_get_location (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  return file->location;
+}
+
+
+
+gboolean
+mousepad_file_location_is_set (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return G_IS_FILE (file->location);
+}
+
+
+
+const gchar *
+mousepad_file_get_path (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  return mousepad_util_get_path (file->location);
+}
+
+
+
+gchar *
+mousepad_file_get_uri (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  return g_file_get_uri (file->location);
+}
+
+
+
+static void
+mousepad_file_set_read_only (MousepadFile *file,
+                             gboolean      readonly)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  if (G_LIKELY (file->readonly != readonly))
+    {
+      /* store new value */
+      file->readonly = readonly;
+
+      /* emit signal */
+      g_signal_emit (file, file_signals[READONLY_CHANGED], 0, readonly);
+    }
+}
+
+
+
+gboolean
+mousepad_file_get_read_only (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->readonly;
+}
+
+
+
+gboolean
+mousepad_file_is_savable (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->location == NULL
+         || (! file->readonly && gtk_text_buffer_get_modified (file->buffer));
+}
+
+
+
+void
+mousepad_file_set_encoding (MousepadFile     *file,
+                            MousepadEncoding  encoding)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* set new encoding */
+  file->encoding = encoding;
+
+  /* send a signal that the encoding has been changed */
+  g_signal_emit (file, file_signals[ENCODING_CHANGED], 0, file->encoding);
+}
+
+
+
+MousepadEncoding
+mousepad_file_get_encoding (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), MOUSEPAD_ENCODING_NONE);
+
+  return file->encoding;
+}
+
+
+
+/* the encoding guessed from the contents if the last loading failed to decode them,
+ * or MOUSEPAD_ENCODING_NONE */
+MousepadEncoding
+mousepad_file_get_detected_encoding (MousepadFile *file,
+                                     gdouble      *confidence)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), MOUSEPAD_ENCODING_NONE);
+
+  if (confidence != NULL)
+    *confidence = file->detected_confidence;
+
+  return file->detected_encoding;
+}
+
+
+
+void
+mousepad_file_set_write_bom (MousepadFile *file,
+                             gboolean      write_bom)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* set new value */
+  file->write_bom = write_bom;
+
+  /* set the encoding to UTF-8 if not already compatible */
+  if (file->encoding != MOUSEPAD_ENCODING_UTF_7
+      && file->encoding != MOUSEPAD_ENCODING_UTF_8
+      && file->encoding != MOUSEPAD_ENCODING_UTF_16BE
+      && file->encoding != MOUSEPAD_ENCODING_UTF_16LE
+      && file->encoding != MOUSEPAD_ENCODING_UTF_32BE
+      && file->encoding != MOUSEPAD_ENCODING_UTF_32LE)
+    file->encoding = MOUSEPAD_ENCODING_UTF_8;
+}
+
+
+
+gboolean
+mousepad_file_get_write_bom (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->write_bom;
+}
+
+
+
+GtkTextBuffer *
+mousepad_file_get_buffer (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  return file->buffer;
+}
+
+
+
+void
+mousepad_file_set_line_ending (MousepadFile       *file,
+                               MousepadLineEnding  line_ending)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  file->line_ending = line_ending;
+}
+
+
+
+MousepadLineEnding
+mousepad_file_get_line_ending (MousepadFile *file)
+{
+  return file->line_ending;
+}
+
+
+
+static void
 mousepad_file_set_language (MousepadFile *file)
 {
-  GtkSourceLanguage *language;
-  GtkTextIter        start, end;
-  gchar             *data, *content_type, *basename;
-  gboolean           result_uncertain;
+  GtkSourceLanguage *language;
+  GtkTextIter        start, end;
+  gchar             *data, *content_type, *basename;
+  gboolean           result_uncertain;
+
+  g_return_if_fail (file->location != NULL);
+
+  gtk_text_buffer_get_start_iter (file->buffer, &start);
+  end = start;
+  gtk_text_iter_forward_chars (&end, 255);
+  data = gtk_text_buffer_get_text (file->buffer, &start, &end, TRUE);
+
+  content_type = g_content_type_guess (mousepad_file_get_path (file), (const guchar *) data,
+                                       strlen (data), &result_uncertain);
+  basename = g_file_get_basename (file->location);
+  language = gtk_source_language_manager_guess_language (gtk_source_language_manager_get_default (),
+                                                         basename,
+                                                         result_uncertain ? NULL : content_type);
+
+  gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (file->buffer), language);
+
+  g_free (data);
+  g_free (basename);
+  g_free (content_type);
+}
+
+
+
+void
+mousepad_file_set_user_set_language (MousepadFile *file,
+                                     gboolean      set_by_user)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  file->user_set_language = set_by_user;
+}
+
+
+
+/* whether the last loaded contents crossed the "large-file-threshold" or "long-line-threshold"
+ * settings, the costly features being disabled for them */
+gboolean
+mousepad_file_get_large (MousepadFile *file)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+
+  return file->large;
+}
+
+
+
+void
+mousepad_file_set_large (MousepadFile *file,
+                         gboolean      large)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+
+  /* the next loadings do not change the user choice */
+  file->large = large;
+  file->large_override = ! large;
+
+  /* guess the filetype/language which was deferred */
+  if (! large && ! file->user_set_language && file->location != NULL)
+    mousepad_file_set_language (file);
+}
+
+
+
+static MousepadFileLoad *
+mousepad_file_load_new (MousepadFile *file,
+                        gboolean      must_exist,
+                        gboolean      ignore_bom,
+                        gboolean      make_valid)
+{
+  MousepadFileLoad *load;
+
+  load = g_slice_new0 (MousepadFileLoad);
+  load->file = g_object_ref (file);
+  load->location = g_object_ref (file->location);
+  load->encoding = file->encoding;
+  load->must_exist = must_exist;
+  load->ignore_bom = ignore_bom;
+  load->make_valid = make_valid;
+  load->retval = ERROR_READING_FAILED;
+  load->etag_size = -1;
+  load->size_threshold = (guint64) MOUSEPAD_SETTING_GET_INT (LARGE_FILE_THRESHOLD) * 1024 * 1024;
+  load->line_threshold = MOUSEPAD_SETTING_GET_INT (LONG_LINE_THRESHOLD);
+
+  /* forget the encoding guessed by a previous loading */
+  file->detected_encoding = MOUSEPAD_ENCODING_NONE;
+  file->detected_confidence = 0.0;
+
+  return load;
+}
+
+
+
+static void
+mousepad_file_load_free (gpointer data)
+{
+  MousepadFileLoad *load = data;
+
+  /* stop reporting progress */
+  if (load->progress_timer != 0)
+    g_source_remove (load->progress_timer);
+
+  /* cleanup */
+  if (load->bytes != NULL)
+    g_bytes_unref (load->bytes);
+
+  if (load->converted != NULL)
+    g_bytes_unref (load->converted);
+
+  if (load->hunks != NULL)
+    g_array_free (load->hunks, TRUE);
+
+  g_free (load->old_contents);
+  g_free (load->decoded);
+  g_free (load->etag);
+  g_object_unref (load->location);
+  g_object_unref (load->file);
+
+  g_slice_free (MousepadFileLoad, load);
+}
+
+
+
+static void
+mousepad_file_load_report_progress (MousepadFileLoad *load)
+{
+  gint progress;
+
+  /* only report real changes */
+  progress = g_atomic_int_get (&load->progress);
+  if (load->progress_callback != NULL && progress != load->progress_reported)
+    {
+      load->progress_reported = progress;
+      load->progress_callback (load->file, progress / 1000.0, load->progress_data);
+    }
+}
+
+
+
+static gboolean
+mousepad_file_load_progress_timeout (gpointer data)
+{
+  mousepad_file_load_report_progress (data);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_load_read_stream (MousepadFileLoad  *load,
+                                GCancellable      *cancellable,
+                                GError           **error)
+{
+  GFileInputStream *stream;
+  GFileInfo        *fileinfo;
+  GByteArray       *array;
+  goffset           file_size = -1;
+  gssize            n_read;
+  gsize             length = 0, reserved, n_request;
+
+  /* open the file for reading */
+  stream = g_file_read (load->location, cancellable, error);
+  if (G_UNLIKELY (stream == NULL))
+    return FALSE;
+
+  /* get the expected size, the etag and the modification time of the file */
+  fileinfo = g_file_input_stream_query_info (stream, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                             G_FILE_ATTRIBUTE_ETAG_VALUE ","
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                             G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC, cancellable, NULL);
+  if (G_LIKELY (fileinfo != NULL))
+    {
+      file_size = load->etag_size = g_file_info_get_size (fileinfo);
+      load->etag = g_strdup (g_file_info_get_etag (fileinfo));
+      load->mtime = mousepad_file_info_get_status_mtime (fileinfo);
+      g_object_unref (fileinfo);
+    }
+
+  /* reuse the contents read previously if the file did not change in the meantime,
+   * unless the user asked to read it again */
+  if (! load->reload)
+    load->bytes = mousepad_cache_lookup (load->location, load->etag, load->etag_size,
+                                         MOUSEPAD_ENCODING_NONE);
+
+  if (load->bytes != NULL)
+    {
+      g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+      g_object_unref (stream);
+      g_atomic_int_set (&load->progress, 500);
+
+      return TRUE;
+    }
+
+  /* read the contents by chunks, the size of the file may have changed in the meantime:
+   * the reads stop at the expected size, the byte reserved after it for the nul byte being
+   * enough to see the end of the file, so that the array is only grown if the file grew */
+  reserved = MAX (file_size, 0) + 1;
+  array = g_byte_array_sized_new (reserved);
+  do
+    {
+      n_request = (length < reserved) ? MIN (reserved - length, MOUSEPAD_FILE_READ_CHUNK_SIZE)
+                                      : MOUSEPAD_FILE_READ_CHUNK_SIZE;
+      g_byte_array_set_size (array, length + n_request);
+      n_read = g_input_stream_read (G_INPUT_STREAM (stream), array->data + length,
+                                    n_request, cancellable, error);
+      if (G_UNLIKELY (n_read < 0))
+        break;
+
+      /* reading accounts for the first half of the progress */
+      length += n_read;
+      if (file_size > 0)
+        g_atomic_int_set (&load->progress, MIN (length, (gsize) file_size) * 500 / file_size);
+    }
+  while (n_read > 0);
+
+  /* cleanup */
+  g_input_stream_close (G_INPUT_STREAM (stream), NULL, NULL);
+  g_object_unref (stream);
+
+  if (G_UNLIKELY (n_read < 0))
+    {
+      g_byte_array_free (array, TRUE);
+      return FALSE;
+    }
+
+  /* keep a nul byte after the contents, without counting it */
+  g_byte_array_set_size (array, length + 1);
+  array->data[length] = '\0';
+  g_byte_array_set_size (array, length);
+  load->bytes = g_byte_array_free_to_bytes (array);
+
+  return TRUE;
+}
+
+
+
+static gboolean
+mousepad_file_load_read (MousepadFileLoad  *load,
+                         GCancellable      *cancellable,
+                         GError           **error)
+{
+  gconstpointer contents;
+  gsize         length;
+
+  if (! mousepad_file_load_read_stream (load, cancellable, error))
+    return FALSE;
+
+  /* hash the contents, to recognize them later */
+  contents = g_bytes_get_data (load->bytes, &length);
+  mousepad_hash_init (&load->hash);
+  mousepad_hash_update (&load->hash, contents, length);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_load_check_bom (MousepadFileLoad *load)
+{
+  MousepadEncoding  bom_encoding;
+  const gchar      *contents, *charset, *bom_charset;
+  gsize             length, bom_length;
+
+  /* detect if there is a bom with the encoding type */
+  contents = g_bytes_get_data (load->bytes, &length);
+  if (load->ignore_bom || length == 0)
+    return;
+
+  bom_encoding = mousepad_encoding_read_bom (contents, length, &bom_length);
+  if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
+    {
+      /* ask the user what to do if he has set an encoding different from default
+       * (including with respect to GSettings, i.e. UTF-8 only) */
+      charset = mousepad_encoding_get_charset (load->encoding);
+      bom_charset = mousepad_encoding_get_charset (bom_encoding);
+      if (load->encoding == MOUSEPAD_ENCODING_UTF_8 || load->encoding == bom_encoding
+          || mousepad_dialogs_confirm_encoding (bom_charset, charset) != GTK_RESPONSE_YES)
+        {
+          /* we've found a valid bom at the start of the contents */
+          load->file->write_bom = TRUE;
+
+          /* skip the bom when decoding */
+          load->bom_length = bom_length;
+
+          /* set the detected encoding */
+          load->encoding = load->file->encoding = bom_encoding;
+        }
+    }
+}
+
+
+
+/* copy @contents to @dest, converting cr and cr+lf line endings to lf, @dest may be
+ * @contents itself, returns the new length */
+static gsize
+mousepad_file_load_normalize (const gchar *contents,
+                              gsize        length,
+                              GArray      *cr_offsets,
+                              gchar       *dest)
+{
+  gsize cr, offset = 0, written = 0;
+  guint n;
+
+  for (n = 0; n < cr_offsets->len; n++)
+    {
+      /* copy the text up to the carriage return, then a line feed */
+      cr = g_array_index (cr_offsets, gsize, n);
+      memmove (dest + written, contents + offset, cr - offset);
+      written += cr - offset;
+      dest[written++] = '\n';
+
+      /* skip the line feed of a cr+lf */
+      offset = cr + 1;
+      if (offset < length && contents[offset] == '\n')
+        offset++;
+    }
+
+  /* copy the remaining part */
+  memmove (dest + written, contents + offset, length - offset);
+  written += length - offset;
+  dest[written] = '\0';
+
+  return written;
+}
+
+
+
+/* guess the encoding of contents which could not be decoded, so that the caller can
+ * retry with it rather than asking the user */
+static void
+mousepad_file_load_detect (MousepadFileLoad *load)
+{
+  MousepadEncodingCandidate  candidates[2];
+  const gchar               *contents;
+  gsize                      length;
+  guint                      n, n_candidates;
+
+  contents = g_bytes_get_data (load->bytes, &length);
+  n_candidates = mousepad_encoding_detect (contents + load->bom_length, length - load->bom_length,
+                                           candidates, G_N_ELEMENTS (candidates));
+
+  /* skip the encoding which just failed */
+  for (n = 0; n < n_candidates; n++)
+    if (candidates[n].encoding != load->encoding)
+      {
+        load->detected = candidates[n];
+        break;
+      }
+}
+
+
+
+/* share the contents of a file which could not be decoded with its next loadings, e.g.
+ * from the encoding dialog or a retry, so that it is neither read nor converted again */
+static void
+mousepad_file_load_cache (MousepadFileLoad *load)
+{
+  mousepad_cache_insert (load->location, load->etag, load->etag_size, MOUSEPAD_ENCODING_NONE,
+                         load->bytes);
+
+  if (load->converted != NULL)
+    mousepad_cache_insert (load->location, load->etag, load->etag_size, load->encoding,
+                           load->converted);
+}
+
+
+
+static void
+mousepad_file_load_measure_chunk (gpointer data,
+                                  gpointer user_data)
+{
+  MousepadFileLoadChunk *chunk = data;
+
+  if (g_cancellable_is_cancelled (chunk->cancellable))
+    return;
+
+  mousepad_encoding_measure_utf8 (chunk->encoding, chunk->raw, chunk->raw_length,
+                                  &chunk->length, &chunk->error);
+}
+
+
+
+static void
+mousepad_file_load_decode_chunk (gpointer data,
+                                 gpointer user_data)
+{
+  MousepadFileLoadChunk *chunk = data;
+  const gchar           *text = chunk->raw;
+
+  if (g_cancellable_is_cancelled (chunk->cancellable))
+    return;
+
+  if (chunk->encoding != MOUSEPAD_ENCODING_UTF_8)
+    {
+      mousepad_encoding_convert_into (chunk->encoding, chunk->raw, chunk->raw_length,
+                                      chunk->decoded, chunk->length);
+      text = chunk->decoded;
+    }
+  else
+    chunk->length = chunk->raw_length;
+
+  mousepad_scanner_scan (text, chunk->length, &chunk->scan);
+}
+
+
+
+/* run @func on all the chunks, the first one in this thread while the others are in a pool */
+static void
+mousepad_file_load_run_chunks (MousepadFileLoadChunk *chunks,
+                               guint                  n_chunks,
+                               GFunc                  func)
+{
+  GThreadPool *pool;
+  guint        n;
+
+  pool = g_thread_pool_new (func, NULL, n_chunks - 1, FALSE, NULL);
+  for (n = 1; n < n_chunks; n++)
+    g_thread_pool_push (pool, chunks + n, NULL);
+
+  func (chunks, NULL);
+  g_thread_pool_free (pool, FALSE, TRUE);
+}
+
+
+
+/* decode and scan large contents by chunks in a thread pool, the chunks ending on character
+ * boundaries so that they can be decoded independently: the length of each decoded chunk is
+ * computed first, so that they are all decoded in place in the whole decoded contents */
+static gboolean
+mousepad_file_load_decode_parallel (MousepadFileLoad    *load,
+                                    guint                n_chunks,
+                                    const gchar        **contents,
+                                    gsize               *length,
+                                    MousepadScanResult  *scan,
+                                    GCancellable        *cancellable,
+                                    GError             **error)
+{
+  MousepadFileLoadChunk *chunks, *chunk;
+  gsize                  start, end, offset, cr;
+  guint                  n, i;
+  gboolean               succeed = TRUE;
+
+  /* split the contents in chunks of about the same size */
+  chunks = g_new0 (MousepadFileLoadChunk, n_chunks);
+  for (n = 0, start = 0; n < n_chunks; n++, start = end)
+    {
+      end = *length;
+      if (n < n_chunks - 1)
+        end = MAX (start, mousepad_encoding_find_boundary (load->encoding, *contents, *length,
+                                                           *length / n_chunks * (n + 1)));
+
+      chunks[n].encoding = load->encoding;
+      chunks[n].cancellable = cancellable;
+      chunks[n].raw = *contents + start;
+      chunks[n].raw_length = end - start;
+    }
+
+  if (load->encoding != MOUSEPAD_ENCODING_UTF_8)
+    {
+      mousepad_file_load_run_chunks (chunks, n_chunks, mousepad_file_load_measure_chunk);
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        succeed = FALSE;
+
+      /* a chunk which could not be converted fails the whole conversion */
+      for (n = 0; n < n_chunks && succeed; n++)
+        if (chunks[n].error != NULL)
+          {
+            g_propagate_error (error, chunks[n].error);
+            chunks[n].error = NULL;
+            load->retval = ERROR_CONVERTING_FAILED;
+            mousepad_file_load_detect (load);
+            mousepad_file_load_cache (load);
+            succeed = FALSE;
+          }
+
+      /* allocate the decoded contents once, each chunk being decoded at its place */
+      if (succeed)
+        {
+          for (n = 0, *length = 0; n < n_chunks; n++)
+            *length += chunks[n].length;
+
+          load->decoded = g_malloc (*length + 1);
+          load->decoded[*length] = '\0';
+          *contents = load->decoded;
+
+          for (n = 0, offset = 0; n < n_chunks; offset += chunks[n++].length)
+            chunks[n].decoded = load->decoded + offset;
+        }
+    }
+
+  if (succeed)
+    {
+      mousepad_file_load_run_chunks (chunks, n_chunks, mousepad_file_load_decode_chunk);
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        succeed = FALSE;
+    }
+
+  if (succeed)
+    {
+      /* merge the scans, up to the first chunk which is not valid */
+      memset (scan, 0, sizeof (MousepadScanResult));
+      scan->cr_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+      for (n = 0, offset = 0; n < n_chunks; offset += chunks[n++].length)
+        {
+          chunk = chunks + n;
+          scan->n_lf += chunk->scan.n_lf;
+          scan->n_cr += chunk->scan.n_cr;
+          scan->n_crlf += chunk->scan.n_crlf;
+
+          /* a cr+lf split between two chunks was counted as a cr and a lf */
+          if (offset > 0 && chunk->length > 0
+              && (*contents)[offset - 1] == '\r' && (*contents)[offset] == '\n')
+            {
+              scan->n_cr--;
+              scan->n_lf--;
+              scan->n_crlf++;
+            }
+
+          for (i = 0; i < chunk->scan.cr_offsets->len; i++)
+            {
+              cr = offset + g_array_index (chunk->scan.cr_offsets, gsize, i);
+              g_array_append_val (scan->cr_offsets, cr);
+            }
+
+          scan->valid_length = offset + chunk->scan.valid_length;
+          if (chunk->scan.valid_length < chunk->length)
+            {
+              scan->binary = chunk->scan.binary;
+              break;
+            }
+        }
+    }
+
+  /* cleanup */
+  for (n = 0; n < n_chunks; n++)
+    {
+      mousepad_scanner_clear (&chunks[n].scan);
+      if (chunks[n].error != NULL)
+        g_error_free (chunks[n].error);
+    }
+
+  g_free (chunks);
+
+  return succeed;
+}
+
+
+
+/* whether the contents have a line of at least threshold bytes */
+static gboolean
+mousepad_file_load_has_long_line (const gchar *contents,
+                                  gsize        length,
+                                  gsize        threshold)
+{
+  const gchar *end = contents + length, *eol;
+
+  while ((gsize) (end - contents) >= threshold)
+    {
+      eol = memchr (contents, '\n', threshold);
+      if (eol == NULL)
+        return TRUE;
+
+      contents = eol + 1;
+    }
+
+  return FALSE;
+}
+
+
+
+static gboolean
+mousepad_file_load_decode (MousepadFileLoad  *load,
+                           GCancellable      *cancellable,
+                           GError           **error)
+{
+  MousepadScanResult  scan;
+  const gchar        *contents, *n;
+  gchar              *temp;
+  gsize               length, written, eol, n_chunks;
+
+  /* get the contents after the bom, if any */
+  contents = g_bytes_get_data (load->bytes, &length);
+  contents += load->bom_length;
+  length -= load->bom_length;
+
+  if (G_UNLIKELY (length == 0))
+    return TRUE;
+
+  /* reuse the contents converted by a previous loading of the same file, e.g. when the
+   * encoding dialog or a retry follows a failed loading, unless a bom was skipped or the
+   * user asked to read the file again */
+  if (load->encoding != MOUSEPAD_ENCODING_UTF_8 && load->bom_length == 0 && ! load->reload)
+    load->converted = mousepad_cache_lookup (load->location, load->etag, load->etag_size,
+                                             load->encoding);
+
+  /* split large contents to decode and scan them on all processors, if their encoding
+   * allows it, stateful and most multibyte encodings being decoded serially */
+  n_chunks = MIN ((gsize) g_get_num_processors (), length / MOUSEPAD_FILE_DECODE_CHUNK_SIZE);
+  if (load->converted != NULL)
+    {
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      contents = g_bytes_get_data (load->converted, &length);
+      mousepad_scanner_scan (contents, length, &scan);
+    }
+  else if (n_chunks > 1
+           && mousepad_encoding_find_boundary (load->encoding, contents, length, length / 2) > 0)
+    {
+      if (! mousepad_file_load_decode_parallel (load, n_chunks, &contents, &length, &scan,
+                                                cancellable, error))
+        return FALSE;
+    }
+  else
+    {
+      /* try to convert the contents if needed */
+      if (load->encoding != MOUSEPAD_ENCODING_UTF_8)
+        {
+          if (g_cancellable_set_error_if_cancelled (cancellable, error))
+            return FALSE;
+
+          temp = mousepad_encoding_convert_to_utf8 (load->encoding, contents, length,
+                                                    NULL, &written, error);
+
+          /* check if the conversion succeed at least partially */
+          if (temp == NULL)
+            {
+              load->retval = ERROR_CONVERTING_FAILED;
+              mousepad_file_load_detect (load);
+              mousepad_file_load_cache (load);
+
+              return FALSE;
+            }
+
+          /* set new values */
+          contents = load->decoded = temp;
+          length = written;
+        }
+
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        return FALSE;
+
+      /* validate the contents and look for line endings in a single pass */
+      mousepad_scanner_scan (contents, length, &scan);
+    }
+
+  if (scan.valid_length < length)
+    {
+      /* leave when the encoding is not valid... */
+      if (! load->make_valid)
+        {
+          load->retval = ERROR_ENCODING_NOT_VALID;
+          if (scan.binary)
+            g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                         _("The file contains null bytes, it may be a binary file"));
+          else
+            g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
+                         _("Invalid byte sequence in conversion input"));
+
+          mousepad_scanner_clear (&scan);
+          mousepad_file_load_detect (load);
+
+          /* the converted contents are kept too, unless a bom was skipped */
+          if (load->decoded != NULL && load->bom_length == 0)
+            {
+              load->converted = g_bytes_new_take (load->decoded, length);
+              load->decoded = NULL;
+            }
+
+          mousepad_file_load_cache (load);
+
+          return FALSE;
+        }
+      /* ... or make it valid and scan it again */
+      else
+        {
+          temp = g_utf8_make_valid (contents, length);
+          g_free (load->decoded);
+          contents = load->decoded = temp;
+          length = strlen (contents);
+
+          mousepad_scanner_clear (&scan);
+          mousepad_scanner_scan (contents, length, &scan);
+        }
+    }
+
+  /* use the most frequent line ending, or the first one found in case of a tie, mixed
+   * line endings being converted to it when saving */
+  if (scan.n_lf > 0 || scan.n_cr > 0 || scan.n_crlf > 0)
+    {
+      load->has_eol = TRUE;
+      if (scan.n_lf > MAX (scan.n_cr, scan.n_crlf))
+        load->line_ending = MOUSEPAD_EOL_UNIX;
+      else if (scan.n_crlf > MAX (scan.n_lf, scan.n_cr))
+        load->line_ending = MOUSEPAD_EOL_DOS;
+      else if (scan.n_cr > MAX (scan.n_lf, scan.n_crlf))
+        load->line_ending = MOUSEPAD_EOL_MAC;
+      else
+        {
+          n = memchr (contents, '\n', scan.valid_length);
+          if (scan.cr_offsets->len == 0
+              || (n != NULL && (gsize) (n - contents) < g_array_index (scan.cr_offsets, gsize, 0)))
+            load->line_ending = MOUSEPAD_EOL_UNIX;
+          else
+            {
+              eol = g_array_index (scan.cr_offsets, gsize, 0) + 1;
+              load->line_ending = (eol < length && contents[eol] == '\n') ? MOUSEPAD_EOL_DOS
+                                                                          : MOUSEPAD_EOL_MAC;
+            }
+        }
+    }
+
+  /* the decoded contents to insert in the buffer */
+  length = scan.valid_length;
+  if (scan.cr_offsets->len > 0)
+    {
+      if (g_cancellable_set_error_if_cancelled (cancellable, error))
+        {
+          mousepad_scanner_clear (&scan);
+          return FALSE;
+        }
+
+      /* convert the line endings to line feeds, in place if we own the contents */
+      temp = (load->decoded != NULL) ? load->decoded : g_malloc (length + 1);
+      length = mousepad_file_load_normalize (contents, length, scan.cr_offsets, temp);
+      contents = load->decoded = temp;
+    }
+
+  load->contents = contents;
+  load->length = length;
+
+  /* a long line is only looked for if the size did not already tell */
+  if (load->size_threshold > 0 && length >= load->size_threshold)
+    load->large = TRUE;
+  else if (load->line_threshold > 0)
+    load->large = mousepad_file_load_has_long_line (contents, length, load->line_threshold);
+
+  mousepad_scanner_clear (&scan);
+
+  /* the contents kept after a previous failure are not needed anymore */
+  mousepad_cache_remove (load->location);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_file_load_begin (MousepadFileLoad *load)
+{
+  GtkTextIter start, end;
+
+  /* make sure the buffer is empty, in particular for reloading */
+  gtk_text_buffer_get_bounds (load->file->buffer, &start, &end);
+  gtk_text_buffer_delete (load->file->buffer, &start, &end);
+
+  /* set the detected line ending */
+  if (load->has_eol)
+    load->file->line_ending = load->line_ending;
+}
+
+
+
+static gboolean
+mousepad_file_load_insert (MousepadFileLoad *load)
+{
+  GtkTextIter iter;
+  gsize       limit;
+
+  /* insert the next chunk of contents at the end of the buffer, without splitting a character */
+  limit = MIN (load->offset + MOUSEPAD_FILE_INSERT_CHUNK_SIZE, load->length);
+  while (limit < load->length && (load->contents[limit] & 0xc0) == 0x80)
+    limit++;
+
+  gtk_text_buffer_get_end_iter (load->file->buffer, &iter);
+  gtk_text_buffer_insert (load->file->buffer, &iter, load->contents + load->offset,
+                          limit - load->offset);
+
+  /* inserting accounts for the second half of the progress */
+  load->offset = limit;
+  g_atomic_int_set (&load->progress, 500 + load->offset * 500 / load->length);
+
+  return load->offset < load->length;
+}
+
+
+
+static void
+mousepad_file_load_update_etag (MousepadFileLoad *load)
+{
+  /* update etag, only once the contents are in the buffer: if the loading fails, the file
+   * must still look modified compared to the buffer */
+  g_free (load->file->etag);
+  load->file->etag = g_strdup (load->etag);
+
+  /* the status of the file as we read it */
+  load->file->mtime = load->mtime;
+  load->file->hash = load->hash;
+  mousepad_file_follow_reset (load->file, g_bytes_get_size (load->bytes));
+}
+
+
+
+static gint
+mousepad_file_load_complete (MousepadFileLoad  *load,
+                             gint               retval,
+                             GError           **error)
+{
+  MousepadFile *file = load->file;
+  GtkTextIter   start, end;
+  GFileInfo    *fileinfo;
+
+  /* make the guessed encoding available to the caller */
+  file->detected_encoding = load->detected.encoding;
+  file->detected_confidence = load->detected.confidence;
+
+  if (retval == 0)
+    {
+      mousepad_file_load_update_etag (load);
+
+      /* set the cursor to the beginning of the document, it was kept in place when reloading */
+      if (! load->reload)
+        {
+          gtk_text_buffer_get_start_iter (file->buffer, &start);
+          gtk_text_buffer_place_cursor (file->buffer, &start);
+        }
+
+      /* store the file status */
+      if (G_LIKELY (! file->temporary))
+        if (G_LIKELY (fileinfo = g_file_query_info (file->location, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
+                                                    G_FILE_QUERY_INFO_NONE, NULL, error)))
+          {
+            mousepad_file_set_read_only (file,
+              ! g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
+            g_object_unref (fileinfo);
+          }
+        /* set return value */
+        else
+          retval = ERROR_FILE_STATUS_FAILED;
+      /* this is a new document with content from a template */
+      else
+        {
+          g_free (file->etag);
+          file->etag = NULL;
+        }
+    }
+
+  /* make sure the buffer is empty if we did not succeed, it was left untouched when reloading */
+  if (G_UNLIKELY (retval != 0) && ! load->reload)
+    {
+      gtk_text_buffer_get_bounds (file->buffer, &start, &end);
+      gtk_text_buffer_delete (file->buffer, &start, &end);
+    }
+
+  /* the costly features stay enabled once the user asked for them */
+  if (retval == 0)
+    file->large = load->large && ! file->large_override;
+  else if (! load->reload)
+    file->large = FALSE;
+
+  /* guess and set the file's filetype/language, which is deferred for large contents */
+  if (! file->large)
+    mousepad_file_set_language (file);
+  else if (! file->user_set_language)
+    gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (file->buffer), NULL);
+
+  /* this does not count as a modified buffer, unless a reload failed */
+  if (retval == 0 || ! load->reload)
+    gtk_text_buffer_set_modified (file->buffer, FALSE);
+
+  return retval;
+}
+
+
+
+gint
+mousepad_file_open (MousepadFile  *file,
+                    gboolean       must_exist,
+                    gboolean       ignore_bom,
+                    gboolean       make_valid,
+                    GError       **error)
+{
+  MousepadFileLoad *load;
+  GError           *err = NULL;
+  gint              retval = 0;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
+  g_return_val_if_fail (file->location != NULL, FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  load = mousepad_file_load_new (file, must_exist, ignore_bom, make_valid);
+
+  /* if the file does not exist and this is allowed, no problem */
+  if (! mousepad_file_load_read (load, NULL, &err))
+    {
+      if (g_error_matches (err, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) && ! must_exist)
+        g_error_free (err);
+      else
+        {
+          g_propagate_error (error, err);
+          retval = ERROR_READING_FAILED;
+        }
+    }
+  /* the file was sucessfully loaded */
+  else
+    {
+      mousepad_file_load_check_bom (load);
+
+      /* decode the contents and insert them in the buffer */
+      if (mousepad_file_load_decode (load, NULL, error))
+        {
+          mousepad_file_load_begin (load);
+          while (load->offset < load->length && mousepad_file_load_insert (load));
+          retval = 0;
+        }
+      else
+        retval = load->retval;
+
+      retval = mousepad_file_load_complete (load, retval, error);
+    }
+
+  mousepad_file_load_free (load);
+
+  return retval;
+}
+
+
+
+static void
+mousepad_file_open_return (GTask  *task,
+                           gint    retval,
+                           GError *error)
+{
+  MousepadFileLoad *load = g_task_get_task_data (task);
+
+  /* stop reporting progress */
+  if (load->progress_timer != 0)
+    {
+      g_source_remove (load->progress_timer);
+      load->progress_timer = 0;
+    }
+
+  /* return the result */
+  load->retval = retval;
+  if (error != NULL)
+    g_task_return_error (task, error);
+  else
+    g_task_return_boolean (task, TRUE);
+
+  /* release our reference taken in mousepad_file_open_async() */
+  g_object_unref (task);
+}
+
+
+
+static gboolean
+mousepad_file_open_insert_idle (gpointer data)
+{
+  GTask            *task = data;
+  MousepadFileLoad *load = g_task_get_task_data (task);
+  GError           *error = NULL;
+  gint              retval;
+
+  /* insert a chunk of contents, leaving the main loop breathe between chunks */
+  if (load->offset < load->length && mousepad_file_load_insert (load))
+    return TRUE;
+
+  /* finish the loading process */
+  mousepad_file_load_report_progress (load);
+  retval = mousepad_file_load_complete (load, 0, &error);
+  mousepad_file_open_return (task, retval, error);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_file_open_decode_thread (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  GError *error = NULL;
+
+  if (mousepad_file_load_decode (task_data, cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+
+
+static void
+mousepad_file_reload_diff_thread (GTask        *task,
+                                  gpointer      source_object,
+                                  gpointer      task_data,
+                                  GCancellable *cancellable)
+{
+  MousepadFileLoad *load = task_data;
+  MousepadDiffHunk *hunk;
+  const gchar      *p;
+  glong             offset = 0;
+  guint             n;
+
+  load->hunks = mousepad_diff_lines (load->old_contents, strlen (load->old_contents),
+                                     load->contents, load->length, cancellable);
+  if (g_task_return_error_if_cancelled (task))
+    return;
+
+  /* the hunks are applied by character offsets in the buffer, which doesn't end its lines
+   * where the diff does (it also breaks them on cr and paragraph separators) */
+  for (n = 0, p = load->old_contents; n < load->hunks->len; n++)
+    {
+      hunk = &g_array_index (load->hunks, MousepadDiffHunk, n);
+      offset += g_utf8_strlen (p, load->old_contents + hunk->old_offset - p);
+      p = load->old_contents + hunk->old_offset;
+      hunk->old_offset = offset;
+
+      offset += g_utf8_strlen (p, hunk->old_length);
+      p += hunk->old_length;
+      hunk->old_length = offset - hunk->old_offset;
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+
+static void
+mousepad_file_reload_diff_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  GTask            *task = data;
+  MousepadFileLoad *load = g_task_get_task_data (task);
+  MousepadDiffHunk *hunk;
+  GtkTextBuffer    *buffer = load->file->buffer;
+  GtkTextIter       start, end;
+  GError           *error = NULL;
+  gint              retval;
+  guint             n;
+
+  if (! g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      retval = mousepad_file_load_complete (load, ERROR_READING_FAILED, NULL);
+      mousepad_file_open_return (task, retval, error);
+
+      return;
+    }
+
+  /* the buffer was edited in the meantime, the changes no longer apply to it: replace its
+   * contents as a whole, by chunks whenever idle */
+  if (load->file->change_count != load->old_change_count)
+    {
+      mousepad_file_load_begin (load);
+      g_idle_add (mousepad_file_open_insert_idle, task);
+
+      return;
+    }
+
+  /* apply the changes as a single user action, backwards so that the offsets of the next
+   * hunks remain valid */
+  gtk_text_buffer_begin_user_action (buffer);
+  for (n = load->hunks->len; n > 0; n--)
+    {
+      hunk = &g_array_index (load->hunks, MousepadDiffHunk, n - 1);
+      gtk_text_buffer_get_iter_at_offset (buffer, &start, hunk->old_offset);
+      gtk_text_buffer_get_iter_at_offset (buffer, &end, hunk->old_offset + hunk->old_length);
+      gtk_text_buffer_delete (buffer, &start, &end);
+      if (hunk->new_length > 0)
+        gtk_text_buffer_insert (buffer, &start, load->contents + hunk->new_offset, hunk->new_length);
+    }
+
+  gtk_text_buffer_end_user_action (buffer);
+
+  /* set the detected line ending */
+  if (load->has_eol)
+    load->file->line_ending = load->line_ending;
+
+  /* finish the loading process */
+  g_atomic_int_set (&load->progress, 1000);
+  mousepad_file_load_report_progress (load);
+  retval = mousepad_file_load_complete (load, 0, &error);
+  mousepad_file_open_return (task, retval, error);
+}
+
+
+
+static void
+mousepad_file_open_decode_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  GTask            *task = data, *subtask;
+  MousepadFileLoad *load = g_task_get_task_data (task);
+  GtkTextIter       start, end;
+  GError           *error = NULL;
+  gint              retval;
+
+  if (! g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      /* a cancelled decoding is a reading failure */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        load->retval = ERROR_READING_FAILED;
+
+      retval = mousepad_file_load_complete (load, load->retval, NULL);
+      mousepad_file_open_return (task, retval, error);
+
+      return;
+    }
+
+  /* compare the contents with those of the buffer in a thread, to only apply the changes */
+  if (load->reload)
+    {
+      gtk_text_buffer_get_bounds (load->file->buffer, &start, &end);
+      load->old_contents = gtk_text_buffer_get_text (load->file->buffer, &start, &end, TRUE);
+      load->old_change_count = load->file->change_count;
+
+      subtask = g_task_new (load->file, g_task_get_cancellable (task),
+                            mousepad_file_reload_diff_ready, task);
+      g_task_set_task_data (subtask, load, NULL);
+      g_task_run_in_thread (subtask, mousepad_file_reload_diff_thread);
+      g_object_unref (subtask);
+
+      return;
+    }
+
+  /* fill the buffer by chunks whenever idle */
+  mousepad_file_load_begin (load);
+  g_idle_add (mousepad_file_open_insert_idle, task);
+}
+
+
+
+static void
+mousepad_file_open_read_thread (GTask        *task,
+                                gpointer      source_object,
+                                gpointer      task_data,
+                                GCancellable *cancellable)
+{
+  GError *error = NULL;
+
+  if (mousepad_file_load_read (task_data, cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+
+
+static void
+mousepad_file_open_read_ready (GObject      *object,
+                               GAsyncResult *result,
+                               gpointer      data)
+{
+  GTask            *task = data, *subtask;
+  MousepadFileLoad *load = g_task_get_task_data (task);
+  GError           *error = NULL;
+
+  if (! g_task_propagate_boolean (G_TASK (result), &error))
+    {
+      /* if the file does not exist and this is allowed, no problem */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) && ! load->must_exist)
+        {
+          g_error_free (error);
+          mousepad_file_open_return (task, 0, NULL);
+        }
+      else
+        mousepad_file_open_return (task, ERROR_READING_FAILED, error);
+
+      return;
+    }
+
+  /* the file was sucessfully loaded, this may ask the user what to do with a bom */
+  mousepad_file_load_check_bom (load);
+
+  /* decode the contents in a thread */
+  subtask = g_task_new (load->file, g_task_get_cancellable (task),
+                        mousepad_file_open_decode_ready, task);
+  g_task_set_task_data (subtask, load, NULL);
+  g_task_run_in_thread (subtask, mousepad_file_open_decode_thread);
+  g_object_unref (subtask);
+}
+
+
+
+static void
+mousepad_file_load_start (MousepadFileLoad             *load,
+                          GCancellable                 *cancellable,
+                          MousepadFileProgressCallback  progress_callback,
+                          gpointer                      progress_data,
+                          GAsyncReadyCallback           callback,
+                          gpointer                      user_data)
+{
+  MousepadFile *file = load->file;
+  GTask        *task, *subtask;
 
-  g_return_if_fail (file->location != NULL);
+  /* the main task, kept alive until the end of the loading process */
+  task = g_task_new (file, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_file_open_async);
+  g_task_set_task_data (task, load, mousepad_file_load_free);
 
-  gtk_text_buffer_get_start_iter (file->buffer, &start);
-  end = start;
-  gtk_text_iter_forward_chars (&end, 255);
-  data = gtk_text_buffer_get_text (file->buffer, &start, &end, TRUE);
+  /* report progress periodically from the main loop */
+  if (progress_callback != NULL)
+    {
+      load->progress_callback = progress_callback;
+      load->progress_data = progress_data;
+      load->progress_timer = g_timeout_add (MOUSEPAD_FILE_PROGRESS_INTERVAL,
+                                            mousepad_file_load_progress_timeout, load);
+    }
 
-  content_type = g_content_type_guess (mousepad_file_get_path (file), (const guchar *) data,
-                                       strlen (data), &result_uncertain);
-  basename = g_file_get_basename (file->location);
-  language = gtk_source_language_manager_guess_language (gtk_source_language_manager_get_default (),
-                                                         basename,
-                                                         result_uncertain ? NULL : content_type);
+  /* read the file in a thread */
+  subtask = g_task_new (file, cancellable, mousepad_file_open_read_ready, task);
+  g_task_set_task_data (subtask, load, NULL);
+  g_task_run_in_thread (subtask, mousepad_file_open_read_thread);
+  g_object_unref (subtask);
+}
 
-  gtk_source_buffer_set_language (GTK_SOURCE_BUFFER (file->buffer), language);
 
-  g_free (data);
-  g_free (basename);
-  g_free (content_type);
+
+/*
+ * Asynchronous version of mousepad_file_open(): the contents are read and decoded in
+ * worker threads, then inserted in the buffer by chunks from the main loop.
+ * Cancellation is effective until the insertion of the contents begins.
+ */
+void
+mousepad_file_open_async (MousepadFile                 *file,
+                          gboolean                      must_exist,
+                          gboolean                      ignore_bom,
+                          gboolean                      make_valid,
+                          GCancellable                 *cancellable,
+                          MousepadFileProgressCallback  progress_callback,
+                          gpointer                      progress_data,
+                          GAsyncReadyCallback           callback,
+                          gpointer                      user_data)
+{
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  g_return_if_fail (GTK_IS_TEXT_BUFFER (file->buffer));
+  g_return_if_fail (file->location != NULL);
+
+  mousepad_file_load_start (mousepad_file_load_new (file, must_exist, ignore_bom, make_valid),
+                            cancellable, progress_callback, progress_data, callback, user_data);
 }
 
 
 
+/*
+ * Reloads the file into a buffer which already contains a version of it: the lines which
+ * differ are computed in a worker thread, and only those are replaced in the buffer, as a
+ * single user action, which preserves the cursor, the marks and the undo history.
+ * The result is retrieved with mousepad_file_open_finish().
+ */
 void
-mousepad_file_set_user_set_language (MousepadFile *file,
-                                     gboolean      set_by_user)
+mousepad_file_reload_async (MousepadFile                 *file,
+                            GCancellable                 *cancellable,
+                            MousepadFileProgressCallback  progress_callback,
+                            gpointer                      progress_data,
+                            GAsyncReadyCallback           callback,
+                            gpointer                      user_data)
 {
+  MousepadFileLoad *load;
+
   g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  g_return_if_fail (GTK_IS_TEXT_BUFFER (file->buffer));
+  g_return_if_fail (file->location != NULL);
 
-  file->user_set_language = set_by_user;
+  load = mousepad_file_load_new (file, TRUE, FALSE, FALSE);
+  load->reload = TRUE;
+  mousepad_file_load_start (load, cancellable, progress_callback, progress_data,
+                            callback, user_data);
 }
 
 
 
 gint
-mousepad_file_open (MousepadFile  *file,
-                    gboolean       must_exist,
-                    gboolean       ignore_bom,
-                    gboolean       make_valid,
-                    GError       **error)
+mousepad_file_open_finish (MousepadFile  *file,
+                           GAsyncResult  *result,
+                           GError       **error)
 {
-  MousepadEncoding  bom_encoding;
-  GtkTextIter       start, end;
-  GFileInfo        *fileinfo;
-  const gchar      *charset, *bom_charset, *endc, *n, *m;
-  gchar            *contents = NULL, *etag, *temp;
-  gsize             file_size, written, bom_length;
-  gint              retval = ERROR_READING_FAILED;
+  MousepadFileLoad *load;
 
-  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
-  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
-  g_return_val_if_fail (file->location != NULL, FALSE);
-  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), ERROR_READING_FAILED);
+  g_return_val_if_fail (g_task_is_valid (result, file), ERROR_READING_FAILED);
+  g_return_val_if_fail (error == NULL || *error == NULL, ERROR_READING_FAILED);
 
-  /* if the file does not exist and this is allowed, no problem */
-  if (! g_file_load_contents (file->location, NULL, &contents, &file_size, &etag, error)
-      && g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND) && ! must_exist)
-    {
-      g_clear_error (error);
-      return 0;
-    }
-  /* the file was sucessfully loaded */
-  else if (G_LIKELY (error == NULL || *error == NULL))
-    {
-      /* update etag */
-      g_free (file->etag);
-      file->etag = etag;
+  load = g_task_get_task_data (G_TASK (result));
+  g_task_propagate_boolean (G_TASK (result), error);
 
-      /* make sure the buffer is empty, in particular for reloading */
-      gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-      gtk_text_buffer_delete (file->buffer, &start, &end);
+  return load->retval;
+}
 
-      if (G_LIKELY (file_size > 0))
-        {
-          /* get the encoding charset */
-          charset = mousepad_encoding_get_charset (file->encoding);
 
-          /* detect if there is a bom with the encoding type */
-          if (! ignore_bom)
-            {
-              bom_encoding = mousepad_encoding_read_bom (contents, file_size, &bom_length);
-              if (G_UNLIKELY (bom_encoding != MOUSEPAD_ENCODING_NONE))
-                {
-                  /* ask the user what to do if he has set an encoding different from default
-                   * (including with respect to GSettings, i.e. UTF-8 only) */
-                  bom_charset = mousepad_encoding_get_charset (bom_encoding);
-                  if (file->encoding == MOUSEPAD_ENCODING_UTF_8 || file->encoding == bom_encoding
-                      || mousepad_dialogs_confirm_encoding (bom_charset, charset) != GTK_RESPONSE_YES)
-                    {
-                      /* we've found a valid bom at the start of the contents */
-                      file->write_bom = TRUE;
-
-                      /* advance the contents offset and decrease size */
-                      temp = g_strdup (contents + bom_length);
-                      g_free (contents);
-                      contents = temp;
-                      file_size -= bom_length;
-
-                      /* set the detected encoding */
-                      file->encoding = bom_encoding;
-                    }
-                }
-            }
 
-          /* try to convert the contents if needed */
-          if (file->encoding != MOUSEPAD_ENCODING_UTF_8)
-            {
-              temp = g_convert (contents, file_size, "UTF-8", charset, NULL, &written, error);
-
-              /* check if the conversion succeed at least partially */
-              if (temp == NULL)
-                {
-                  /* set return value */
-                  retval = ERROR_CONVERTING_FAILED;
-
-                  goto failed;
-                }
-              /* set new values */
-              else
-                {
-                  file_size = written;
-                  g_free (contents);
-                  contents = temp;
-                }
-            }
+static gboolean
+mousepad_file_monitor_unblock (gpointer data)
+{
+  MousepadFile *file;
 
-          if (! g_utf8_validate (contents, file_size, &endc))
-          {
-            /* leave when the encoding is not valid... */
-            if (! make_valid)
-              {
-                /* set return value */
-                retval = ERROR_ENCODING_NOT_VALID;
-
-                /* set an error */
-                g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_ILLEGAL_SEQUENCE,
-                             _("Invalid byte sequence in conversion input"));
-
-                goto failed;
-              }
-            /* ... or make it valid and update location for end of valid data */
-            else
-              {
-                temp = g_utf8_make_valid (contents, file_size);
-                g_free (contents);
-                contents = temp;
-                g_utf8_validate (contents, -1, &endc);
-              }
-          }
+  /* the file or its monitor may have been released during the delay */
+  if (MOUSEPAD_IS_FILE (data))
+    {
+      file = MOUSEPAD_FILE (data);
+      if (file->watch_id != 0)
+        mousepad_watch_unblock (file->watch_id);
+    }
 
-          /* detect the line ending, based on the first eol we match */
-          for (n = contents; n < endc; n = g_utf8_next_char (n))
-            {
-              if (G_LIKELY (*n == '\n'))
-                {
-                  /* set unix line ending */
-                  file->line_ending = MOUSEPAD_EOL_UNIX;
-
-                  break;
-                }
-              else if (*n == '\r')
-                {
-                  /* get next character */
-                  n = g_utf8_next_char (n);
-
-                  /* set dos or mac line ending */
-                  file->line_ending = (*n == '\n') ? MOUSEPAD_EOL_DOS : MOUSEPAD_EOL_MAC;
-
-                  break;
-                }
-            }
+  return FALSE;
+}
 
-          /* get the iter at the beginning of the document */
-          gtk_text_buffer_get_start_iter (file->buffer, &start);
 
-          /* insert the file contents in the buffer (for documents with cr line ending) */
-          for (n = m = contents; n < endc; n = g_utf8_next_char (n))
-            {
-              if (G_UNLIKELY (*n == '\r'))
-                {
-                  /* insert the text in the buffer */
-                  if (G_LIKELY (n - m > 0))
-                    gtk_text_buffer_insert (file->buffer, &start, m, n - m);
-
-                  /* advance the offset */
-                  m = g_utf8_next_char (n);
-
-                  /* insert a new line when the document is not cr+lf */
-                  if (*m != '\n')
-                    gtk_text_buffer_insert (file->buffer, &start, "\n", 1);
-                }
-            }
 
-          /* insert the remaining part, or everything for lf line ending */
-          if (G_LIKELY (n - m > 0))
-            gtk_text_buffer_insert (file->buffer, &start, m, n - m);
+static MousepadFileSave *
+mousepad_file_save_new (MousepadFile  *file,
+                        gboolean       forced,
+                        GError       **error)
+{
+  MousepadFileSave *save;
+  GtkTextIter       end, iter;
+  const gchar      *charset = NULL;
 
-          /* get the start iter */
-          gtk_text_buffer_get_start_iter (file->buffer, &start);
+  /* add line ending at end of last line if not present, it will be converted when writing */
+  gtk_text_buffer_get_end_iter (file->buffer, &end);
+  iter = end;
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (ADD_LAST_EOL)
+      && gtk_text_iter_backward_char (&iter) && ! gtk_text_iter_ends_line (&iter))
+    gtk_text_buffer_insert (file->buffer, &end, "\n", 1);
 
-          /* set the cursor to the beginning of the document */
-          gtk_text_buffer_place_cursor (file->buffer, &start);
-        }
+  save = g_slice_new0 (MousepadFileSave);
 
-      /* assume everything when file */
-      retval = 0;
+  /* get the bom to write, this may change the encoding */
+  if (file->write_bom)
+    save->bom = mousepad_encoding_get_bom (&(file->encoding), &save->bom_length);
 
-      /* store the file status */
-      if (G_LIKELY (! file->temporary))
-        if (G_LIKELY (fileinfo = g_file_query_info (file->location, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE,
-                                                    G_FILE_QUERY_INFO_NONE, NULL, error)))
-          {
-            mousepad_file_set_read_only (file,
-              ! g_file_info_get_attribute_boolean (fileinfo, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE));
-            g_object_unref (fileinfo);
-          }
-        /* set return value */
-        else
-          retval = ERROR_FILE_STATUS_FAILED;
-      /* this is a new document with content from a template */
-      else
+  /* get the charset */
+  if (G_UNLIKELY (file->encoding != MOUSEPAD_ENCODING_UTF_8))
+    {
+      charset = mousepad_encoding_get_charset (file->encoding);
+      if (G_UNLIKELY (charset == NULL))
         {
-          g_free (file->etag);
-          file->etag = NULL;
+          /* set an error */
+          g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
+                       MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING);
+          g_slice_free (MousepadFileSave, save);
+
+          return NULL;
         }
+    }
 
-      failed:
+  save->file = g_object_ref (file);
+  save->location = g_object_ref (file->location);
+  save->etag = (file->temporary || forced) ? NULL : g_strdup (file->etag);
+  save->make_backup = MOUSEPAD_SETTING_GET_BOOLEAN (MAKE_BACKUP);
+  save->charset = charset;
+  save->encoding = file->encoding;
+  save->transcode = (charset != NULL && mousepad_encoding_has_transcoder (file->encoding));
+  save->line_ending = file->line_ending;
+  save->change_count = file->change_count;
+  gtk_text_buffer_get_start_iter (file->buffer, &save->iter);
 
-      /* make sure the buffer is empty if we did not succeed */
-      if (G_UNLIKELY (retval != 0))
-        {
-          gtk_text_buffer_get_bounds (file->buffer, &start, &end);
-          gtk_text_buffer_delete (file->buffer, &start, &end);
-        }
+  /* suspend file monitoring */
+  if (file->watch_id != 0)
+    mousepad_watch_block (file->watch_id);
+
+  return save;
+}
 
-      /* cleanup */
-      g_free (contents);
 
-      /* guess and set the file's filetype/language */
-      mousepad_file_set_language (file);
 
-      /* this does not count as a modified buffer */
-      gtk_text_buffer_set_modified (file->buffer, FALSE);
-    }
+static void
+mousepad_file_save_free (gpointer data)
+{
+  MousepadFileSave *save = data;
 
-  return retval;
+  /* cleanup */
+  if (save->snapshot != NULL)
+    g_ptr_array_unref (save->snapshot);
+
+  g_free (save->etag);
+  g_free (save->new_etag);
+  g_object_unref (save->location);
+  g_object_unref (save->file);
+
+  g_slice_free (MousepadFileSave, save);
 }
 
 
 
-static gboolean
-mousepad_file_monitor_unblock (gpointer data)
+/* returns the next chunk of contents to write, read from the buffer or from its snapshot
+ * if any, in which case this is thread-safe */
+static GBytes *
+mousepad_file_save_next_chunk (MousepadFileSave *save)
 {
-  MousepadFile *file;
+  GtkTextIter  start;
+  gchar       *text;
 
-  /* the file or its monitor may have been released during the delay */
-  if (MOUSEPAD_IS_FILE (data))
+  /* read the snapshot */
+  if (save->snapshot != NULL)
     {
-      file = MOUSEPAD_FILE (data);
-      if (G_IS_FILE_MONITOR (file->monitor))
-        g_signal_handlers_unblock_by_func (file->monitor, mousepad_file_monitor_changed, data);
+      if (save->snapshot_index < save->snapshot->len)
+        return g_bytes_ref (g_ptr_array_index (save->snapshot, save->snapshot_index++));
+
+      return NULL;
     }
 
-  return FALSE;
+  /* read the buffer */
+  if (gtk_text_iter_is_end (&save->iter))
+    return NULL;
+
+  start = save->iter;
+  gtk_text_iter_forward_chars (&save->iter, MOUSEPAD_FILE_WRITE_CHUNK_SIZE);
+
+  text = gtk_text_buffer_get_slice (save->file->buffer, &start, &save->iter, TRUE);
+
+  return g_bytes_new_take (text, strlen (text));
+}
+
+
+
+static void
+mousepad_file_save_take_snapshot (MousepadFileSave *save)
+{
+  GPtrArray *snapshot;
+  GBytes    *chunk;
+
+  /* copy the buffer contents by chunks, so the buffer can be edited during the writing */
+  snapshot = g_ptr_array_new_with_free_func ((GDestroyNotify) g_bytes_unref);
+  while ((chunk = mousepad_file_save_next_chunk (save)) != NULL)
+    g_ptr_array_add (snapshot, chunk);
+
+  /* the contents are read from the snapshot from now on */
+  save->snapshot = snapshot;
 }
 
 
 
 static gboolean
-mousepad_file_replace_contents (MousepadFile      *m_file,
-                                GFile             *file,
-                                const char        *contents,
-                                gsize              length,
-                                const char        *etag,
-                                gboolean           make_backup,
-                                GFileCreateFlags   flags,
-                                char             **new_etag,
+mousepad_file_save_write_chunk (MousepadFileSave  *save,
+                                GOutputStream     *stream,
+                                GBytes            *chunk,
+                                GString           *scratch,
                                 GCancellable      *cancellable,
                                 GError           **error)
 {
-  gboolean succeed;
+  const gchar *text, *p, *n, *end;
+  gchar       *converted = NULL;
+  gsize        length;
+  gboolean     succeed;
+
+  /* the buffer text has unix line endings, replace them with mac or dos line endings */
+  text = g_bytes_get_data (chunk, &length);
+  if (save->line_ending != MOUSEPAD_EOL_UNIX)
+    {
+      end = text + length;
+      g_string_truncate (scratch, 0);
+      for (p = text; (n = memchr (p, '\n', end - p)) != NULL; p = n + 1)
+        {
+          g_string_append_len (scratch, p, n - p);
+          g_string_append (scratch, save->line_ending == MOUSEPAD_EOL_DOS ? "\r\n" : "\r");
+        }
 
-  /* suspend file monitoring */
-  if (G_IS_FILE_MONITOR (m_file->monitor))
-    g_signal_handlers_block_by_func (m_file->monitor, mousepad_file_monitor_changed, m_file);
+      g_string_append_len (scratch, p, end - p);
+      text = scratch->str;
+      length = scratch->len;
+    }
+
+  /* the chunks end on character boundaries, so they can be transcoded one by one */
+  if (save->transcode)
+    {
+      text = converted = mousepad_encoding_convert_from_utf8 (save->encoding, text, length,
+                                                              NULL, &length, error);
+      if (G_UNLIKELY (converted == NULL))
+        return FALSE;
+    }
+
+  /* these are the bytes of the file, unless they are converted to another charset by iconv */
+  if (save->charset == NULL || save->transcode)
+    mousepad_hash_update (&save->hash, text, length);
+
+  succeed = g_output_stream_write_all (stream, text, length, NULL, cancellable, error);
+  g_free (converted);
+
+  return succeed;
+}
 
-  /* replace contents */
-  succeed = g_file_replace_contents (file, contents, length, etag, make_backup,
-                                     flags, new_etag, cancellable, error);
+
+
+/* write the contents to the file, by chunks so that memory usage remains bounded:
+ * the line endings are converted first, then the charset */
+static gboolean
+mousepad_file_save_write (MousepadFileSave  *save,
+                          GCancellable      *cancellable,
+                          GError           **error)
+{
+  GFileOutputStream *file_stream;
+  GOutputStream     *stream;
+  GCharsetConverter *converter;
+  GCancellable      *cancel_close;
+  GString           *scratch;
+  GBytes            *chunk;
+  gboolean           succeed = TRUE;
+
+  /* open the file for writing, the original file is only replaced when the stream is closed */
+  file_stream = g_file_replace (save->location, save->etag, save->make_backup,
+                                G_FILE_CREATE_NONE, cancellable, error);
+  if (G_UNLIKELY (file_stream == NULL))
+    return FALSE;
+
+  stream = G_OUTPUT_STREAM (g_object_ref (file_stream));
+  mousepad_hash_init (&save->hash);
+
+  /* write the bom at the start of the file, in the target encoding */
+  if (save->bom_length > 0)
+    {
+      mousepad_hash_update (&save->hash, save->bom, save->bom_length);
+      succeed = g_output_stream_write_all (stream, save->bom, save->bom_length,
+                                           NULL, cancellable, error);
+    }
+
+  /* convert to the encoding if set and not transcoded chunk by chunk */
+  if (succeed && save->charset != NULL && ! save->transcode)
+    {
+      converter = g_charset_converter_new (save->charset, "UTF-8", error);
+      if (G_LIKELY (converter != NULL))
+        {
+          g_object_unref (stream);
+          stream = g_converter_output_stream_new (G_OUTPUT_STREAM (file_stream),
+                                                  G_CONVERTER (converter));
+          g_object_unref (converter);
+        }
+      else
+        succeed = FALSE;
+    }
+
+  /* write the contents by chunks */
+  scratch = g_string_new (NULL);
+  while (succeed && (chunk = mousepad_file_save_next_chunk (save)) != NULL)
+    {
+      succeed = mousepad_file_save_write_chunk (save, stream, chunk, scratch, cancellable, error);
+      g_bytes_unref (chunk);
+    }
+
+  g_string_free (scratch, TRUE);
+
+  /* replace the original file, or leave it untouched on failure by cancelling the close */
+  if (G_LIKELY (succeed))
+    succeed = g_output_stream_close (stream, cancellable, error);
+  else
+    {
+      cancel_close = g_cancellable_new ();
+      g_cancellable_cancel (cancel_close);
+      g_output_stream_close (G_OUTPUT_STREAM (file_stream), cancel_close, NULL);
+      g_object_unref (cancel_close);
+    }
+
+  if (G_LIKELY (succeed))
+    save->new_etag = g_strdup (g_file_output_stream_get_etag (file_stream));
+
+  /* hash what was really written after a charset conversion, it's in the page cache,
+   * on failure the hash length won't match any file size, so it won't match at all */
+  if (succeed && save->charset != NULL && ! save->transcode
+      && ! mousepad_file_hash_location (save->location, &save->hash, NULL, NULL, cancellable, NULL))
+    save->hash.total_length = G_MAXUINT64;
+
+  /* cleanup */
+  g_object_unref (stream);
+  g_object_unref (file_stream);
+
+  return succeed;
+}
+
+
+
+static void
+mousepad_file_save_complete (MousepadFileSave *save,
+                             gboolean          succeed)
+{
+  MousepadFile *file = save->file;
+  GFileInfo    *fileinfo;
 
   /* reactivate file monitoring with a delay, to not consider our own saving as
    * external modification */
-  if (G_IS_FILE_MONITOR (m_file->monitor))
+  if (file->watch_id != 0)
     g_timeout_add (MOUSEPAD_SETTING_GET_INT (MONITOR_DISABLING_TIMER),
-                   mousepad_file_monitor_unblock, m_file);
+                   mousepad_file_monitor_unblock, file);
 
-  return succeed;
+  if (! succeed)
+    return;
+
+  /* update etag */
+  g_free (file->etag);
+  file->etag = save->new_etag;
+  save->new_etag = NULL;
+
+  /* the contents read before are outdated */
+  mousepad_cache_remove (save->location);
+
+  /* the status of the file as we wrote it */
+  fileinfo = g_file_query_info (save->location, G_FILE_ATTRIBUTE_STANDARD_SIZE ","
+                                G_FILE_ATTRIBUTE_TIME_MODIFIED ","
+                                G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC,
+                                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  file->hash = save->hash;
+  if (fileinfo != NULL)
+    {
+      file->mtime = mousepad_file_info_get_status_mtime (fileinfo);
+      mousepad_file_follow_reset (file, g_file_info_get_size (fileinfo));
+      g_object_unref (fileinfo);
+    }
+  else
+    mousepad_file_follow_reset (file, -1);
+
+  /* everything has been saved, unless the buffer was modified in the meantime */
+  if (file->change_count == save->change_count)
+    gtk_text_buffer_set_modified (file->buffer, FALSE);
+
+  /* if the user hasn't set the filetype, try and re-guess it now
+   * that we have a new location to go by */
+  if (! file->user_set_language && ! file->large)
+    mousepad_file_set_language (file);
 }
 
 
@@ -772,157 +2892,142 @@ mousepad_file_save (MousepadFile  *file,
                     gboolean       forced,
                     GError       **error)
 {
-  GtkTextIter   start, end;
-  const gchar  *charset;
-  gchar        *contents, *p, *encoded, *etag = NULL;
-  gchar       **chunks;
-  gint          length;
-  gsize         written;
-  gboolean      succeed = FALSE;
+  MousepadFileSave *save;
+  gboolean          succeed;
 
   g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
   g_return_val_if_fail (GTK_IS_TEXT_BUFFER (file->buffer), FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
   g_return_val_if_fail (file->location != NULL, FALSE);
 
-  /* get the buffer bounds */
-  gtk_text_buffer_get_bounds (file->buffer, &start, &end);
+  /* do not write the same file twice at the same time */
+  if (G_UNLIKELY (file->saving))
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_PENDING, _("The document is already being saved"));
+      return FALSE;
+    }
 
-  /* get the buffer contents */
-  contents = gtk_text_buffer_get_slice (file->buffer, &start, &end, TRUE);
+  save = mousepad_file_save_new (file, forced, error);
+  if (G_UNLIKELY (save == NULL))
+    return FALSE;
 
-  if (G_LIKELY (contents))
-    {
-      /* get the content length */
-      length = strlen (contents);
+  /* write the buffer to the file */
+  succeed = mousepad_file_save_write (save, NULL, error);
+  mousepad_file_save_complete (save, succeed);
+  mousepad_file_save_free (save);
 
-      /* convert to the encoding if set */
-      if (G_UNLIKELY (file->encoding != MOUSEPAD_ENCODING_UTF_8))
-        {
-          /* get the charset */
-          charset = mousepad_encoding_get_charset (file->encoding);
-          if (G_UNLIKELY (charset == NULL))
-            {
-              /* set an error */
-              g_set_error (error, G_CONVERT_ERROR, G_CONVERT_ERROR_NO_CONVERSION,
-                           MOUSEPAD_MESSAGE_UNSUPPORTED_ENCODING);
+  return succeed;
+}
 
-              goto failed;
-            }
 
-          /* convert the content to the user encoding */
-          encoded = g_convert (contents, length, charset, "UTF-8", NULL, &written, error);
 
-          /* return if nothing was encoded */
-          if (G_UNLIKELY (encoded == NULL))
-            goto failed;
+static void
+mousepad_file_save_thread (GTask        *task,
+                           gpointer      source_object,
+                           gpointer      task_data,
+                           GCancellable *cancellable)
+{
+  GError *error = NULL;
 
-          /* cleanup */
-          g_free (contents);
+  if (mousepad_file_save_write (task_data, cancellable, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
 
-          /* set the new contents */
-          contents = encoded;
-          length = written;
-        }
 
-      /* handle line endings */
-      if (file->line_ending == MOUSEPAD_EOL_MAC)
-        {
-          /* replace the unix with a mac line ending */
-          for (p = contents; *p != '\0'; p++)
-            if (G_UNLIKELY (*p == '\n'))
-              *p = '\r';
-        }
-      else if (file->line_ending == MOUSEPAD_EOL_DOS)
-        {
-          /* split the contents into chunks */
-          chunks = g_strsplit (contents, "\n", -1);
 
-          /* cleanup */
-          g_free (contents);
+/* complete the saving whether or not the caller finishes it, then return */
+static void
+mousepad_file_save_ready (GObject      *object,
+                          GAsyncResult *result,
+                          gpointer      data)
+{
+  GTask        *task = data;
+  MousepadFile *file = MOUSEPAD_FILE (object);
+  GError       *error = NULL;
+  gboolean      succeed;
 
-          /* join the chunks with dos line endings in between */
-          contents = g_strjoinv ("\r\n", chunks);
+  succeed = g_task_propagate_boolean (G_TASK (result), &error);
 
-          /* cleanup */
-          g_strfreev (chunks);
+  file->saving = FALSE;
+  mousepad_file_save_complete (g_task_get_task_data (task), succeed);
 
-          /* new contents length */
-          length = strlen (contents);
-        }
+  if (succeed)
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
 
-      /* add line ending at end of last line if not present */
-      if (length > 0 && MOUSEPAD_SETTING_GET_BOOLEAN (ADD_LAST_EOL))
-        {
-          switch (file->line_ending)
-            {
-              case MOUSEPAD_EOL_UNIX:
-                if (contents[length - 1] != '\n')
-                  {
-                    contents = g_realloc (contents, length + 2);
-                    contents[length] = '\n';
-                    gtk_text_buffer_insert (file->buffer, &end, "\n", 1);
-                    length++;
-                  }
-                break;
-
-              case MOUSEPAD_EOL_MAC:
-                if (contents[length - 1] != '\r')
-                  {
-                    contents = g_realloc (contents, length + 2);
-                    contents[length] = '\r';
-                    gtk_text_buffer_insert (file->buffer, &end, "\r", 1);
-                    length++;
-                  }
-                break;
-
-              case MOUSEPAD_EOL_DOS:
-                if (contents[length - 1] != '\n' || (length > 1 && contents[length - 2] != '\r'))
-                  {
-                    contents = g_realloc (contents, length + 3);
-                    contents[length] = '\r';
-                    contents[length + 1] = '\n';
-                    gtk_text_buffer_insert (file->buffer, &end, "\r\n", 2);
-                    length += 2;
-                  }
-                break;
-            }
+  g_object_unref (task);
+}
 
-          contents[length] = '\0';
-        }
 
-      /* add a bom at the start of the contents if needed */
-      if (file->write_bom)
-        mousepad_encoding_write_bom (&(file->encoding), &length, &contents);
 
-      /* write the buffer to the file */
-      if (mousepad_file_replace_contents (file, file->location, contents, length,
-                                          (file->temporary || forced) ? NULL : file->etag,
-                                          MOUSEPAD_SETTING_GET_BOOLEAN (MAKE_BACKUP),
-                                          G_FILE_CREATE_NONE, &etag, NULL, error))
-        {
-          g_free (file->etag);
-          file->etag = etag;
-        }
-      else
-        goto failed;
+/*
+ * Asynchronous version of mousepad_file_save(): a snapshot of the buffer is taken,
+ * then written to the file in a worker thread, so the buffer can be edited meanwhile.
+ * The buffer is only considered unmodified after that if it was not edited in the
+ * meantime.
+ */
+void
+mousepad_file_save_async (MousepadFile        *file,
+                          gboolean             forced,
+                          GCancellable        *cancellable,
+                          GAsyncReadyCallback  callback,
+                          gpointer             user_data)
+{
+  MousepadFileSave *save;
+  GTask            *task, *subtask;
+  GError           *error = NULL;
+
+  g_return_if_fail (MOUSEPAD_IS_FILE (file));
+  g_return_if_fail (GTK_IS_TEXT_BUFFER (file->buffer));
+  g_return_if_fail (file->location != NULL);
 
-      /* everything has been saved */
-      gtk_text_buffer_set_modified (file->buffer, FALSE);
+  task = g_task_new (file, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_file_save_async);
 
-      /* if the user hasn't set the filetype, try and re-guess it now
-       * that we have a new location to go by */
-      if (! file->user_set_language)
-        mousepad_file_set_language (file);
+  /* do not write the same file twice at the same time */
+  if (G_UNLIKELY (file->saving))
+    {
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_PENDING,
+                               _("The document is already being saved"));
+      g_object_unref (task);
 
-      /* everything went file */
-      succeed = TRUE;
+      return;
+    }
 
-      failed:
+  save = mousepad_file_save_new (file, forced, &error);
+  if (G_UNLIKELY (save == NULL))
+    {
+      g_task_return_error (task, error);
+      g_object_unref (task);
 
-      /* cleanup */
-      g_free (contents);
+      return;
     }
 
-  return succeed;
+  /* write a consistent copy of the buffer in a thread, the main task being kept alive
+   * until the saving is completed */
+  file->saving = TRUE;
+  mousepad_file_save_take_snapshot (save);
+  g_task_set_task_data (task, save, mousepad_file_save_free);
+
+  subtask = g_task_new (file, cancellable, mousepad_file_save_ready, task);
+  g_task_set_task_data (subtask, save, NULL);
+  g_task_run_in_thread (subtask, mousepad_file_save_thread);
+  g_object_unref (subtask);
+}
+
+
+
+gboolean
+mousepad_file_save_finish (MousepadFile  *file,
+                           GAsyncResult  *result,
+                           GError       **error)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, file), FALSE);
+  g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
 }
@@ -52,6 +52,11 @@ typedef enum
 }
 MousepadLineEnding;
 
+/* progress report of asynchronous operations */
+typedef void (*MousepadFileProgressCallback) (MousepadFile *file,
+                                              gdouble       fraction,
+                                              gpointer      user_data);
+
 GType               mousepad_file_get_type                 (void) G_GNUC_CONST;
 
 MousepadFile       *mousepad_file_new                      (GtkTextBuffer       *buffer);
@@ -77,6 +82,9 @@ void                mousepad_file_set_encoding             (MousepadFile
 
 MousepadEncoding    mousepad_file_get_encoding             (MousepadFile        *file);
 
+MousepadEncoding    mousepad_file_get_detected_encoding    (MousepadFile        *file,
+                                                            gdouble             *confidence);
+
 void                mousepad_file_set_write_bom            (MousepadFile        *file,
                                                             gboolean             write_bom);
 
@@ -92,16 +100,61 @@ MousepadLineEnding  mousepad_file_get_line_ending          (MousepadFile
 void                mousepad_file_set_user_set_language    (MousepadFile        *file,
                                                             gboolean             set_by_user);
 
+gboolean            mousepad_file_get_large                (MousepadFile        *file);
+
+void                mousepad_file_set_large                (MousepadFile        *file,
+                                                            gboolean             large);
+
+void                mousepad_file_set_follow               (MousepadFile        *file,
+                                                            gboolean             follow);
+
+gboolean            mousepad_file_get_follow               (MousepadFile        *file);
+
+gboolean            mousepad_file_get_digest               (MousepadFile        *file,
+                                                            guint64             *digest,
+                                                            goffset             *size);
+
 gint                mousepad_file_open                     (MousepadFile        *file,
                                                             gboolean             must_exist,
                                                             gboolean             ignore_bom,
                                                             gboolean             make_valid,
                                                             GError             **error);
 
+void                mousepad_file_open_async               (MousepadFile                 *file,
+                                                            gboolean                      must_exist,
+                                                            gboolean                      ignore_bom,
+                                                            gboolean                      make_valid,
+                                                            GCancellable                 *cancellable,
+                                                            MousepadFileProgressCallback  progress_callback,
+                                                            gpointer                      progress_data,
+                                                            GAsyncReadyCallback           callback,
+                                                            gpointer                      user_data);
+
+void                mousepad_file_reload_async             (MousepadFile                 *file,
+                                                            GCancellable                 *cancellable,
+                                                            MousepadFileProgressCallback  progress_callback,
+                                                            gpointer                      progress_data,
+                                                            GAsyncReadyCallback           callback,
+                                                            gpointer                      user_data);
+
+gint                mousepad_file_open_finish              (MousepadFile                 *file,
+                                                            GAsyncResult                 *result,
+                                                            GError                      **error);
+
 gboolean            mousepad_file_save                     (MousepadFile        *file,
                                                             gboolean             forced,
                                                             GError             **error);
 
+void                mousepad_file_save_async               (MousepadFile        *file,
+                                                            gboolean             forced,
+                                                            GCancellable        *cancellable,
+                                                            GAsyncReadyCallback  callback,
+                                                            gpointer             user_data);
+
+gboolean            mousepad_file_save_finish              (MousepadFile        *file,
+                                                            GAsyncResult        *result,
+                                                            GError             **error);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_FILE_H__ */
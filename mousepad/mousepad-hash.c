@@ -0,0 +1,207 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-hash.h>
+
+
+
+/*
+ * A streaming implementation of the XXH64 non-cryptographic hash function (with a zero seed),
+ * which is fast enough to hash file contents at memory bandwidth.
+ * See https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+ */
+#define PRIME64_1 G_GUINT64_CONSTANT (11400714785074694791)
+#define PRIME64_2 G_GUINT64_CONSTANT (14029467366897019727)
+#define PRIME64_3 G_GUINT64_CONSTANT (1609587929392839161)
+#define PRIME64_4 G_GUINT64_CONSTANT (9650029242287828579)
+#define PRIME64_5 G_GUINT64_CONSTANT (2870177450012600261)
+
+
+
+static inline guint64
+mousepad_hash_rotl (guint64 value,
+                    guint   bits)
+{
+  return (value << bits) | (value >> (64 - bits));
+}
+
+
+
+static inline guint64
+mousepad_hash_read64 (const guchar *data)
+{
+  guint64 value;
+
+  memcpy (&value, data, sizeof (value));
+
+  return GUINT64_FROM_LE (value);
+}
+
+
+
+static inline guint32
+mousepad_hash_read32 (const guchar *data)
+{
+  guint32 value;
+
+  memcpy (&value, data, sizeof (value));
+
+  return GUINT32_FROM_LE (value);
+}
+
+
+
+static inline guint64
+mousepad_hash_round (guint64 acc,
+                     guint64 input)
+{
+  acc += input * PRIME64_2;
+  acc = mousepad_hash_rotl (acc, 31);
+
+  return acc * PRIME64_1;
+}
+
+
+
+static inline guint64
+mousepad_hash_merge_round (guint64 acc,
+                           guint64 value)
+{
+  acc ^= mousepad_hash_round (0, value);
+
+  return acc * PRIME64_1 + PRIME64_4;
+}
+
+
+
+/* process as many 32-byte stripes as possible, returns the number of bytes consumed */
+static inline gsize
+mousepad_hash_stripes (guint64      *acc,
+                       const guchar *data,
+                       gsize         length)
+{
+  const guchar *p = data;
+
+  for (; length - (p - data) >= 32; p += 32)
+    {
+      acc[0] = mousepad_hash_round (acc[0], mousepad_hash_read64 (p));
+      acc[1] = mousepad_hash_round (acc[1], mousepad_hash_read64 (p + 8));
+      acc[2] = mousepad_hash_round (acc[2], mousepad_hash_read64 (p + 16));
+      acc[3] = mousepad_hash_round (acc[3], mousepad_hash_read64 (p + 24));
+    }
+
+  return p - data;
+}
+
+
+
+void
+mousepad_hash_init (MousepadHash *hash)
+{
+  hash->total_length = 0;
+  hash->acc[0] = PRIME64_1 + PRIME64_2;
+  hash->acc[1] = PRIME64_2;
+  hash->acc[2] = 0;
+  hash->acc[3] = 0 - PRIME64_1;
+  hash->buffer_length = 0;
+}
+
+
+
+void
+mousepad_hash_update (MousepadHash  *hash,
+                      gconstpointer  data,
+                      gsize          length)
+{
+  const guchar *p = data;
+  gsize         n;
+
+  hash->total_length += length;
+
+  /* complete the pending stripe first */
+  if (hash->buffer_length > 0)
+    {
+      n = MIN (length, 32 - hash->buffer_length);
+      memcpy (hash->buffer + hash->buffer_length, p, n);
+      hash->buffer_length += n;
+      p += n;
+      length -= n;
+
+      if (hash->buffer_length < 32)
+        return;
+
+      mousepad_hash_stripes (hash->acc, hash->buffer, 32);
+      hash->buffer_length = 0;
+    }
+
+  /* then process the data directly, keeping the remainder for later */
+  n = mousepad_hash_stripes (hash->acc, p, length);
+  memcpy (hash->buffer, p + n, length - n);
+  hash->buffer_length = length - n;
+}
+
+
+
+guint64
+mousepad_hash_digest (const MousepadHash *hash)
+{
+  const guchar *p = hash->buffer, *end = hash->buffer + hash->buffer_length;
+  guint64       h;
+
+  if (hash->total_length >= 32)
+    {
+      h = mousepad_hash_rotl (hash->acc[0], 1) + mousepad_hash_rotl (hash->acc[1], 7)
+          + mousepad_hash_rotl (hash->acc[2], 12) + mousepad_hash_rotl (hash->acc[3], 18);
+      h = mousepad_hash_merge_round (h, hash->acc[0]);
+      h = mousepad_hash_merge_round (h, hash->acc[1]);
+      h = mousepad_hash_merge_round (h, hash->acc[2]);
+      h = mousepad_hash_merge_round (h, hash->acc[3]);
+    }
+  else
+    h = PRIME64_5;
+
+  h += hash->total_length;
+
+  /* consume the remaining input */
+  for (; end - p >= 8; p += 8)
+    {
+      h ^= mousepad_hash_round (0, mousepad_hash_read64 (p));
+      h = mousepad_hash_rotl (h, 27) * PRIME64_1 + PRIME64_4;
+    }
+
+  if (end - p >= 4)
+    {
+      h ^= (guint64) mousepad_hash_read32 (p) * PRIME64_1;
+      h = mousepad_hash_rotl (h, 23) * PRIME64_2 + PRIME64_3;
+      p += 4;
+    }
+
+  for (; p < end; p++)
+    {
+      h ^= *p * PRIME64_5;
+      h = mousepad_hash_rotl (h, 11) * PRIME64_1;
+    }
+
+  /* final mix */
+  h ^= h >> 33;
+  h *= PRIME64_2;
+  h ^= h >> 29;
+  h *= PRIME64_3;
+  h ^= h >> 32;
+
+  return h;
+}
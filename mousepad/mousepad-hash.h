@@ -0,0 +1,42 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_HASH_H__
+#define __MOUSEPAD_HASH_H__
+
+G_BEGIN_DECLS
+
+/* the state of a streaming XXH64 hash computation */
+typedef struct
+{
+  guint64 total_length;
+  guint64 acc[4];
+  guchar  buffer[32];
+  gsize   buffer_length;
+}
+MousepadHash;
+
+void    mousepad_hash_init   (MousepadHash       *hash);
+
+void    mousepad_hash_update (MousepadHash       *hash,
+                              gconstpointer       data,
+                              gsize               length);
+
+guint64 mousepad_hash_digest (const MousepadHash *hash);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_HASH_H__ */
@@ -0,0 +1,910 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-journal.h>
+#include <mousepad/mousepad-hash.h>
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_FILE_H
+#include <sys/file.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+
+
+/* a journal file starts with this magic, followed by records made of a type (8 bits),
+ * a payload length (32 bits), the payload, and a checksum of all that (32 bits),
+ * numbers being stored in little-endian order */
+#define MOUSEPAD_JOURNAL_MAGIC           "MPJ1"
+#define MOUSEPAD_JOURNAL_MAGIC_LEN       4
+#define MOUSEPAD_JOURNAL_RECORD_OVERHEAD 9
+
+/* the records are written and synced to disk by batches, after this delay in ms */
+#define MOUSEPAD_JOURNAL_SYNC_DELAY 1000
+
+/* the journal is compacted into a snapshot of the buffer when it exceeds this size,
+ * and twice the buffer size */
+#define MOUSEPAD_JOURNAL_COMPACT_SIZE (4 * 1024 * 1024)
+
+enum
+{
+  RECORD_LOCATION = 'L', /* uri of the document location, empty if it has none */
+  RECORD_ENCODING = 'E', /* charset of the file the buffer contents come from */
+  RECORD_BASE     = 'B', /* size and digest of the file the buffer contents come from, and its uri */
+  RECORD_SNAPSHOT = 'S', /* the buffer contents */
+  RECORD_INSERT   = 'I', /* char offset and inserted text */
+  RECORD_DELETE   = 'D', /* char offset and number of deleted chars */
+};
+
+
+
+struct _MousepadJournal
+{
+  MousepadFile  *file;
+  GtkTextBuffer *buffer;
+
+  /* the journal file, created at the first write */
+  gchar         *filename;
+  gint           fd;
+  gsize          length;
+
+  /* whether the buffer changes are recorded, the records not written yet
+   * and the timer to write them */
+  gboolean       active;
+  gboolean       failed;
+  GByteArray    *pending;
+  guint          sync_id;
+
+  /* the changes made while frozen are not recorded, which makes the journal stale */
+  guint          frozen;
+  gboolean       stale;
+};
+
+/* an I/O operation run by the journal thread: append some data to @fd and sync it, then
+ * rename @rename_from to @filename or remove @filename, then close @fd */
+typedef struct
+{
+  gint      fd;
+  GBytes   *data;
+  gchar    *rename_from;
+  gchar    *filename;
+  gboolean  remove_file;
+  gboolean  close_fd;
+}
+MousepadJournalJob;
+
+typedef struct
+{
+  guchar       type;
+  const gchar *payload;
+  gsize        length;
+}
+MousepadJournalRecord;
+
+
+
+/* the thread writing all the journals, one job at a time in order */
+static GThreadPool *journal_pool = NULL;
+
+
+
+static void
+mousepad_journal_job_run (gpointer data,
+                          gpointer user_data)
+{
+  MousepadJournalJob *job = data;
+  const gchar        *p;
+  gsize               length;
+  gssize              n;
+
+  if (job->data != NULL)
+    {
+      p = g_bytes_get_data (job->data, &length);
+      while (length > 0)
+        {
+          n = write (job->fd, p, length);
+          if (n < 0 && errno == EINTR)
+            continue;
+          else if (n < 0)
+            {
+              g_warning ("Failed to write journal file: %s", g_strerror (errno));
+              break;
+            }
+
+          p += n;
+          length -= n;
+        }
+
+      fsync (job->fd);
+      g_bytes_unref (job->data);
+    }
+
+  if (job->rename_from != NULL && g_rename (job->rename_from, job->filename) == -1)
+    g_warning ("Failed to rename journal file '%s': %s", job->rename_from, g_strerror (errno));
+
+  /* remove the file before releasing its lock, so that it's never seen as an orphan */
+  if (job->remove_file)
+    g_unlink (job->filename);
+
+  if (job->close_fd)
+    close (job->fd);
+
+  g_free (job->rename_from);
+  g_free (job->filename);
+  g_slice_free (MousepadJournalJob, job);
+}
+
+
+
+/* queue a job for the journal thread, taking ownership of @data, @rename_from and @filename */
+static void
+mousepad_journal_push (gint      fd,
+                       GBytes   *data,
+                       gchar    *rename_from,
+                       gchar    *filename,
+                       gboolean  remove_file,
+                       gboolean  close_fd)
+{
+  MousepadJournalJob *job;
+
+  job = g_slice_new0 (MousepadJournalJob);
+  job->fd = fd;
+  job->data = data;
+  job->rename_from = rename_from;
+  job->filename = filename;
+  job->remove_file = remove_file;
+  job->close_fd = close_fd;
+
+  if (journal_pool != NULL)
+    g_thread_pool_push (journal_pool, job, NULL);
+  else
+    mousepad_journal_job_run (job, NULL);
+}
+
+
+
+static gint
+mousepad_journal_open (const gchar *filename)
+{
+  gint fd;
+
+  fd = g_open (filename, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0600);
+
+#ifdef HAVE_SYS_FILE_H
+  /* tell the other instances this journal is in use */
+  if (fd != -1)
+    flock (fd, LOCK_EX | LOCK_NB);
+#endif
+
+  return fd;
+}
+
+
+
+static gchar *
+mousepad_journal_get_dirname (void)
+{
+  return g_build_filename (g_get_user_cache_dir (), MOUSEPAD_JOURNAL_RELPATH, NULL);
+}
+
+
+
+static void
+mousepad_journal_write_record (GByteArray    *array,
+                               guchar         type,
+                               const guint64 *numbers,
+                               guint          n_numbers,
+                               const gchar   *text,
+                               gsize          length)
+{
+  MousepadHash hash;
+  guint64      number;
+  guint32      value;
+  guint        start = array->len, n;
+
+  g_byte_array_append (array, &type, 1);
+  value = GUINT32_TO_LE (n_numbers * sizeof (guint64) + length);
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+
+  for (n = 0; n < n_numbers; n++)
+    {
+      number = GUINT64_TO_LE (numbers[n]);
+      g_byte_array_append (array, (const guint8 *) &number, sizeof (number));
+    }
+
+  if (length > 0)
+    g_byte_array_append (array, (const guint8 *) text, length);
+
+  mousepad_hash_init (&hash);
+  mousepad_hash_update (&hash, array->data + start, array->len - start);
+  value = GUINT32_TO_LE ((guint32) mousepad_hash_digest (&hash));
+  g_byte_array_append (array, (const guint8 *) &value, sizeof (value));
+}
+
+
+
+static void
+mousepad_journal_write_location (MousepadJournal *journal,
+                                 GByteArray      *array)
+{
+  gchar *uri = NULL;
+
+  if (mousepad_file_location_is_set (journal->file))
+    uri = mousepad_file_get_uri (journal->file);
+
+  mousepad_journal_write_record (array, RECORD_LOCATION, NULL, 0, uri, uri != NULL ? strlen (uri) : 0);
+  g_free (uri);
+}
+
+
+
+/* write what the next records apply to: the file the buffer was loaded from if it is
+ * unmodified and known, else a snapshot of its contents */
+static void
+mousepad_journal_write_origin (MousepadJournal *journal,
+                               GByteArray      *array,
+                               gboolean         snapshot)
+{
+  GtkTextIter  start, end;
+  const gchar *charset;
+  guint64      numbers[2];
+  goffset      size;
+  gchar       *text;
+
+  g_byte_array_append (array, (const guint8 *) MOUSEPAD_JOURNAL_MAGIC, MOUSEPAD_JOURNAL_MAGIC_LEN);
+  mousepad_journal_write_location (journal, array);
+
+  if (! snapshot && ! gtk_text_buffer_get_modified (journal->buffer)
+      && mousepad_file_location_is_set (journal->file)
+      && mousepad_file_get_digest (journal->file, &numbers[1], &size))
+    {
+      charset = mousepad_encoding_get_charset (mousepad_file_get_encoding (journal->file));
+      mousepad_journal_write_record (array, RECORD_ENCODING, NULL, 0, charset, strlen (charset));
+
+      numbers[0] = size;
+      text = mousepad_file_get_uri (journal->file);
+      mousepad_journal_write_record (array, RECORD_BASE, numbers, 2, text, strlen (text));
+    }
+  else
+    {
+      gtk_text_buffer_get_bounds (journal->buffer, &start, &end);
+      text = gtk_text_buffer_get_text (journal->buffer, &start, &end, TRUE);
+      mousepad_journal_write_record (array, RECORD_SNAPSHOT, NULL, 0, text, strlen (text));
+    }
+
+  g_free (text);
+}
+
+
+
+static gboolean
+mousepad_journal_sync (gpointer data)
+{
+  MousepadJournal *journal = data;
+  GByteArray      *array;
+  gchar           *dirname, *basename, *filename;
+  gint             fd;
+
+  journal->sync_id = 0;
+
+  /* create the journal file at the first write */
+  if (journal->fd == -1)
+    {
+      dirname = mousepad_journal_get_dirname ();
+      basename = g_strdup_printf ("%" G_GINT64_FORMAT "-%08x.journal",
+                                  g_get_real_time (), g_random_int ());
+      journal->filename = g_build_filename (dirname, basename, NULL);
+      if (g_mkdir_with_parents (dirname, 0700) == 0)
+        journal->fd = mousepad_journal_open (journal->filename);
+
+      g_free (dirname);
+      g_free (basename);
+
+      if (journal->fd == -1)
+        {
+          /* give up journaling this document */
+          g_warning ("Unable to create journal file '%s': %s", journal->filename, g_strerror (errno));
+          g_free (journal->filename);
+          journal->filename = NULL;
+          journal->active = FALSE;
+          journal->failed = TRUE;
+          g_byte_array_set_size (journal->pending, 0);
+
+          return FALSE;
+        }
+    }
+
+  /* append the pending records */
+  journal->length += journal->pending->len;
+  mousepad_journal_push (journal->fd, g_byte_array_free_to_bytes (journal->pending),
+                         NULL, NULL, FALSE, FALSE);
+  journal->pending = g_byte_array_new ();
+
+  /* compact the journal into a snapshot of the buffer when it becomes too big */
+  if (journal->length > MOUSEPAD_JOURNAL_COMPACT_SIZE
+      && journal->length / 2 > (gsize) gtk_text_buffer_get_char_count (journal->buffer))
+    {
+      filename = g_strconcat (journal->filename, ".new", NULL);
+      fd = mousepad_journal_open (filename);
+      if (fd != -1)
+        {
+          array = g_byte_array_new ();
+          mousepad_journal_write_origin (journal, array, TRUE);
+          journal->length = array->len;
+
+          /* the new journal replaces the old one only once it is complete on disk */
+          mousepad_journal_push (fd, g_byte_array_free_to_bytes (array),
+                                 filename, g_strdup (journal->filename), FALSE, FALSE);
+          mousepad_journal_push (journal->fd, NULL, NULL, NULL, FALSE, TRUE);
+          journal->fd = fd;
+        }
+      else
+        g_free (filename);
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_journal_record (MousepadJournal *journal,
+                         guchar           type,
+                         const guint64   *numbers,
+                         guint            n_numbers,
+                         const gchar     *text,
+                         gsize            length)
+{
+  mousepad_journal_write_record (journal->pending, type, numbers, n_numbers, text, length);
+
+  if (journal->sync_id == 0)
+    journal->sync_id = g_timeout_add (MOUSEPAD_JOURNAL_SYNC_DELAY, mousepad_journal_sync, journal);
+}
+
+
+
+static void
+mousepad_journal_activate (MousepadJournal *journal)
+{
+  journal->active = TRUE;
+  mousepad_journal_write_origin (journal, journal->pending, FALSE);
+
+  if (journal->sync_id == 0)
+    journal->sync_id = g_timeout_add (MOUSEPAD_JOURNAL_SYNC_DELAY, mousepad_journal_sync, journal);
+}
+
+
+
+/* stop recording the buffer changes, there is nothing to recover anymore */
+static void
+mousepad_journal_deactivate (MousepadJournal *journal)
+{
+  journal->active = FALSE;
+  g_byte_array_set_size (journal->pending, 0);
+
+  if (journal->sync_id != 0)
+    {
+      g_source_remove (journal->sync_id);
+      journal->sync_id = 0;
+    }
+
+  if (journal->fd != -1)
+    {
+      mousepad_journal_push (journal->fd, NULL, NULL, journal->filename, TRUE, TRUE);
+      journal->filename = NULL;
+      journal->fd = -1;
+      journal->length = 0;
+    }
+}
+
+
+
+/* whether a buffer change must be recorded, activating the journal at the first one */
+static gboolean
+mousepad_journal_prepare (MousepadJournal *journal)
+{
+  if (journal->frozen > 0)
+    {
+      journal->stale = TRUE;
+      return FALSE;
+    }
+
+  if (! journal->active && ! journal->failed)
+    mousepad_journal_activate (journal);
+
+  return journal->active;
+}
+
+
+
+static void
+mousepad_journal_insert_text (GtkTextBuffer   *buffer,
+                              GtkTextIter     *location,
+                              const gchar     *text,
+                              gint             length,
+                              MousepadJournal *journal)
+{
+  guint64 offset;
+
+  if (mousepad_journal_prepare (journal))
+    {
+      offset = gtk_text_iter_get_offset (location);
+      mousepad_journal_record (journal, RECORD_INSERT, &offset, 1, text, length);
+    }
+}
+
+
+
+static void
+mousepad_journal_delete_range (GtkTextBuffer   *buffer,
+                               GtkTextIter     *start,
+                               GtkTextIter     *end,
+                               MousepadJournal *journal)
+{
+  guint64 numbers[2];
+
+  if (mousepad_journal_prepare (journal))
+    {
+      numbers[0] = gtk_text_iter_get_offset (start);
+      numbers[1] = gtk_text_iter_get_offset (end) - numbers[0];
+      mousepad_journal_record (journal, RECORD_DELETE, numbers, 2, NULL, 0);
+    }
+}
+
+
+
+static void
+mousepad_journal_modified_changed (GtkTextBuffer   *buffer,
+                                   MousepadJournal *journal)
+{
+  if (! gtk_text_buffer_get_modified (buffer))
+    {
+      if (journal->active)
+        mousepad_journal_deactivate (journal);
+    }
+  /* the buffer may have been marked as modified without being changed */
+  else if (! journal->active && ! journal->failed && journal->frozen == 0)
+    mousepad_journal_activate (journal);
+}
+
+
+
+static void
+mousepad_journal_location_changed (MousepadFile    *file,
+                                   GFile           *location,
+                                   MousepadJournal *journal)
+{
+  if (journal->active)
+    {
+      mousepad_journal_write_location (journal, journal->pending);
+      if (journal->sync_id == 0)
+        journal->sync_id = g_timeout_add (MOUSEPAD_JOURNAL_SYNC_DELAY, mousepad_journal_sync, journal);
+    }
+}
+
+
+
+void
+mousepad_journal_init (void)
+{
+  if (journal_pool == NULL)
+    journal_pool = g_thread_pool_new (mousepad_journal_job_run, NULL, 1, FALSE, NULL);
+}
+
+
+
+void
+mousepad_journal_finalize (void)
+{
+  /* wait for the pending jobs, so that no journal is left behind */
+  if (journal_pool != NULL)
+    {
+      g_thread_pool_free (journal_pool, FALSE, TRUE);
+      journal_pool = NULL;
+    }
+}
+
+
+
+MousepadJournal *
+mousepad_journal_new (MousepadFile *file)
+{
+  MousepadJournal *journal;
+
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  journal = g_slice_new0 (MousepadJournal);
+  journal->file = g_object_ref (file);
+  journal->buffer = g_object_ref (mousepad_file_get_buffer (file));
+  journal->fd = -1;
+  journal->pending = g_byte_array_new ();
+
+  /* record the changes before they are applied, while the iters are still valid */
+  g_signal_connect (journal->buffer, "insert-text",
+                    G_CALLBACK (mousepad_journal_insert_text), journal);
+  g_signal_connect (journal->buffer, "delete-range",
+                    G_CALLBACK (mousepad_journal_delete_range), journal);
+  g_signal_connect (journal->buffer, "modified-changed",
+                    G_CALLBACK (mousepad_journal_modified_changed), journal);
+  g_signal_connect (journal->file, "location-changed",
+                    G_CALLBACK (mousepad_journal_location_changed), journal);
+
+  return journal;
+}
+
+
+
+void
+mousepad_journal_free (MousepadJournal *journal)
+{
+  g_signal_handlers_disconnect_by_data (journal->buffer, journal);
+  g_signal_handlers_disconnect_by_data (journal->file, journal);
+
+  /* the document is closed, its changes are saved or discarded */
+  mousepad_journal_deactivate (journal);
+
+  g_byte_array_unref (journal->pending);
+  g_object_unref (journal->buffer);
+  g_object_unref (journal->file);
+  g_slice_free (MousepadJournal, journal);
+}
+
+
+
+void
+mousepad_journal_freeze (MousepadJournal *journal)
+{
+  journal->frozen++;
+}
+
+
+
+void
+mousepad_journal_thaw (MousepadJournal *journal)
+{
+  g_return_if_fail (journal->frozen > 0);
+
+  if (--journal->frozen > 0 || ! journal->stale)
+    return;
+
+  /* the changes made meanwhile are missing, start again from the current contents */
+  journal->stale = FALSE;
+  if (journal->active)
+    mousepad_journal_deactivate (journal);
+
+  if (gtk_text_buffer_get_modified (journal->buffer) && ! journal->failed)
+    mousepad_journal_activate (journal);
+}
+
+
+
+/* a journal is an orphan if no running instance holds its lock */
+static gboolean
+mousepad_journal_is_orphan (const gchar *filename)
+{
+#ifdef HAVE_SYS_FILE_H
+  gboolean orphan;
+  gint     fd;
+
+  fd = g_open (filename, O_RDONLY, 0);
+  if (fd == -1)
+    return FALSE;
+
+  orphan = (flock (fd, LOCK_EX | LOCK_NB) == 0);
+  close (fd);
+
+  return orphan;
+#else
+  return TRUE;
+#endif
+}
+
+
+
+/* get the journals left by the instances which exited without closing their documents */
+gchar **
+mousepad_journal_find_orphans (void)
+{
+  GPtrArray   *filenames;
+  GDir        *dir;
+  const gchar *name;
+  gchar       *dirname, *filename;
+
+  filenames = g_ptr_array_new ();
+  dirname = mousepad_journal_get_dirname ();
+  dir = g_dir_open (dirname, 0, NULL);
+  if (dir != NULL)
+    {
+      while ((name = g_dir_read_name (dir)) != NULL)
+        {
+          filename = g_build_filename (dirname, name, NULL);
+          if (mousepad_journal_is_orphan (filename))
+            {
+              if (g_str_has_suffix (name, ".journal"))
+                {
+                  g_ptr_array_add (filenames, filename);
+                  continue;
+                }
+
+              /* an interrupted compaction, the journal it was to replace is still there */
+              if (g_str_has_suffix (name, ".journal.new"))
+                g_unlink (filename);
+            }
+
+          g_free (filename);
+        }
+
+      g_dir_close (dir);
+    }
+
+  g_free (dirname);
+  g_ptr_array_add (filenames, NULL);
+
+  return (gchar **) g_ptr_array_free (filenames, FALSE);
+}
+
+
+
+static GMappedFile *
+mousepad_journal_map (const gchar  *filename,
+                      const gchar **contents,
+                      const gchar **end,
+                      GError      **error)
+{
+  GMappedFile *mapped;
+  gsize        length;
+
+  mapped = g_mapped_file_new (filename, FALSE, error);
+  if (mapped == NULL)
+    return NULL;
+
+  *contents = g_mapped_file_get_contents (mapped);
+  length = g_mapped_file_get_length (mapped);
+  if (length < MOUSEPAD_JOURNAL_MAGIC_LEN
+      || memcmp (*contents, MOUSEPAD_JOURNAL_MAGIC, MOUSEPAD_JOURNAL_MAGIC_LEN) != 0)
+    {
+      g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("Invalid journal file"));
+      g_mapped_file_unref (mapped);
+
+      return NULL;
+    }
+
+  *end = *contents + length;
+  *contents += MOUSEPAD_JOURNAL_MAGIC_LEN;
+
+  return mapped;
+}
+
+
+
+/* read the record at @p, returns FALSE at the end of the journal, or at the first
+ * incomplete record if it was interrupted */
+static gboolean
+mousepad_journal_read_record (const gchar           **p,
+                              const gchar            *end,
+                              MousepadJournalRecord  *record)
+{
+  MousepadHash hash;
+  guint32      length, checksum;
+
+  if ((gsize) (end - *p) < MOUSEPAD_JOURNAL_RECORD_OVERHEAD)
+    return FALSE;
+
+  memcpy (&length, *p + 1, sizeof (length));
+  length = GUINT32_FROM_LE (length);
+  if ((gsize) (end - *p) - MOUSEPAD_JOURNAL_RECORD_OVERHEAD < length)
+    return FALSE;
+
+  memcpy (&checksum, *p + 5 + length, sizeof (checksum));
+  mousepad_hash_init (&hash);
+  mousepad_hash_update (&hash, *p, 5 + length);
+  if ((guint32) mousepad_hash_digest (&hash) != GUINT32_FROM_LE (checksum))
+    return FALSE;
+
+  record->type = **p;
+  record->payload = *p + 5;
+  record->length = length;
+  *p += MOUSEPAD_JOURNAL_RECORD_OVERHEAD + length;
+
+  return TRUE;
+}
+
+
+
+static guint64
+mousepad_journal_record_get_number (const MousepadJournalRecord *record,
+                                    guint                        index)
+{
+  guint64 number;
+
+  memcpy (&number, record->payload + index * sizeof (number), sizeof (number));
+
+  return GUINT64_FROM_LE (number);
+}
+
+
+
+/* get the location of the document a journal was recording, and the file its first
+ * records apply to with its encoding, @base_size being -1 if they start from a snapshot
+ * and @base_encoding MOUSEPAD_ENCODING_NONE if it is unknown */
+gboolean
+mousepad_journal_get_origin (const gchar       *filename,
+                             GFile            **location,
+                             GFile            **base_location,
+                             MousepadEncoding  *base_encoding,
+                             guint64           *base_digest,
+                             goffset           *base_size,
+                             GError           **error)
+{
+  MousepadJournalRecord  record;
+  GMappedFile           *mapped;
+  const gchar           *p, *end;
+  gchar                 *uri, *charset;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+
+  *location = NULL;
+  *base_location = NULL;
+  *base_encoding = MOUSEPAD_ENCODING_NONE;
+  *base_digest = 0;
+  *base_size = -1;
+
+  mapped = mousepad_journal_map (filename, &p, &end, error);
+  if (mapped == NULL)
+    return FALSE;
+
+  while (mousepad_journal_read_record (&p, end, &record))
+    {
+      if (record.type == RECORD_LOCATION)
+        {
+          g_clear_object (location);
+          if (record.length > 0)
+            {
+              uri = g_strndup (record.payload, record.length);
+              *location = g_file_new_for_uri (uri);
+              g_free (uri);
+            }
+        }
+      else if (record.type == RECORD_ENCODING)
+        {
+          charset = g_strndup (record.payload, record.length);
+          *base_encoding = mousepad_encoding_find (charset);
+          g_free (charset);
+        }
+      else if (record.type == RECORD_BASE && record.length > 2 * sizeof (guint64))
+        {
+          g_clear_object (base_location);
+          uri = g_strndup (record.payload + 2 * sizeof (guint64), record.length - 2 * sizeof (guint64));
+          *base_location = g_file_new_for_uri (uri);
+          *base_size = mousepad_journal_record_get_number (&record, 0);
+          *base_digest = mousepad_journal_record_get_number (&record, 1);
+          g_free (uri);
+        }
+      else if (record.type == RECORD_SNAPSHOT)
+        {
+          g_clear_object (base_location);
+          *base_encoding = MOUSEPAD_ENCODING_NONE;
+          *base_size = -1;
+        }
+    }
+
+  g_mapped_file_unref (mapped);
+
+  return TRUE;
+}
+
+
+
+/* apply the changes recorded in a journal to @buffer, which must hold the contents
+ * of its base file, if any */
+gboolean
+mousepad_journal_replay (const gchar    *filename,
+                         GtkTextBuffer  *buffer,
+                         GError        **error)
+{
+  MousepadJournalRecord  record;
+  GMappedFile           *mapped;
+  GtkTextIter            start, end_iter;
+  const gchar           *p, *end, *text;
+  guint64                offset, count, n_chars;
+  gsize                  length;
+  gboolean               succeed = TRUE;
+
+  g_return_val_if_fail (filename != NULL, FALSE);
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), FALSE);
+
+  mapped = mousepad_journal_map (filename, &p, &end, error);
+  if (mapped == NULL)
+    return FALSE;
+
+  while (succeed && mousepad_journal_read_record (&p, end, &record))
+    {
+      n_chars = gtk_text_buffer_get_char_count (buffer);
+      switch (record.type)
+        {
+        case RECORD_SNAPSHOT:
+          if ((succeed = g_utf8_validate (record.payload, record.length, NULL)))
+            gtk_text_buffer_set_text (buffer, record.payload, record.length);
+
+          break;
+
+        case RECORD_INSERT:
+          if (record.length < sizeof (guint64))
+            {
+              succeed = FALSE;
+              break;
+            }
+
+          offset = mousepad_journal_record_get_number (&record, 0);
+          text = record.payload + sizeof (guint64);
+          length = record.length - sizeof (guint64);
+          if ((succeed = (offset <= n_chars && g_utf8_validate (text, length, NULL))))
+            {
+              gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+              gtk_text_buffer_insert (buffer, &start, text, length);
+            }
+
+          break;
+
+        case RECORD_DELETE:
+          if (record.length < 2 * sizeof (guint64))
+            {
+              succeed = FALSE;
+              break;
+            }
+
+          offset = mousepad_journal_record_get_number (&record, 0);
+          count = mousepad_journal_record_get_number (&record, 1);
+          if ((succeed = (count <= n_chars && offset <= n_chars - count)))
+            {
+              gtk_text_buffer_get_iter_at_offset (buffer, &start, offset);
+              gtk_text_buffer_get_iter_at_offset (buffer, &end_iter, offset + count);
+              gtk_text_buffer_delete (buffer, &start, &end_iter);
+            }
+
+          break;
+
+        default:
+          break;
+        }
+    }
+
+  g_mapped_file_unref (mapped);
+
+  if (! succeed)
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
+                 _("The journal does not match the document contents"));
+
+  return succeed;
+}
+
+
+
+void
+mousepad_journal_discard (const gchar *filename)
+{
+  g_return_if_fail (filename != NULL);
+
+  g_unlink (filename);
+}
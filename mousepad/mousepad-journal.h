@@ -0,0 +1,56 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_JOURNAL_H__
+#define __MOUSEPAD_JOURNAL_H__
+
+#include <mousepad/mousepad-file.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadJournal MousepadJournal;
+
+void              mousepad_journal_init         (void);
+
+void              mousepad_journal_finalize     (void);
+
+MousepadJournal  *mousepad_journal_new          (MousepadFile     *file);
+
+void              mousepad_journal_free         (MousepadJournal  *journal);
+
+void              mousepad_journal_freeze       (MousepadJournal  *journal);
+
+void              mousepad_journal_thaw         (MousepadJournal  *journal);
+
+gchar           **mousepad_journal_find_orphans (void);
+
+gboolean          mousepad_journal_get_origin   (const gchar      *filename,
+                                                 GFile           **location,
+                                                 GFile           **base_location,
+                                                 MousepadEncoding *base_encoding,
+                                                 guint64          *base_digest,
+                                                 goffset          *base_size,
+                                                 GError          **error);
+
+gboolean          mousepad_journal_replay       (const gchar      *filename,
+                                                 GtkTextBuffer    *buffer,
+                                                 GError          **error);
+
+void              mousepad_journal_discard      (const gchar      *filename);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_JOURNAL_H__ */
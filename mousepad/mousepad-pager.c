@@ -0,0 +1,1067 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-pager.h>
+
+#include <setjmp.h>
+#include <signal.h>
+
+
+
+/*
+ * A pager gives access to the lines of a file too large to be loaded in a text buffer:
+ * the file is mapped in memory and a sparse index of its lines, which records the offset
+ * of one line every "step" lines, is built in a worker thread. When the index is full,
+ * every other entry is dropped and the step is doubled, so that its size is bounded
+ * whatever the size of the file. Lines are delimited by line feeds, so only the encodings
+ * where they can't be part of another character are supported, see
+ * mousepad_encoding_is_ascii_compatible(), which is checked on the head of the file.
+ *
+ * The file may be truncated while it is mapped, e.g. by a log rotation, which raises
+ * SIGBUS on any access to the pages past its new end: the accesses to the mapping are
+ * guarded, so that they fail instead, and the pager is then marked as truncated, for its
+ * owner to map the file again.
+ */
+#define MOUSEPAD_PAGER_INITIAL_STEP   256
+#define MOUSEPAD_PAGER_MAX_ENTRIES    (64 * 1024)
+
+/* the maximal size of the text returned at once, longer lines being truncated */
+#define MOUSEPAD_PAGER_MAX_TEXT_SIZE  (2 * 1024 * 1024)
+
+/* the amount of contents searched between which cancellation is checked */
+#define MOUSEPAD_PAGER_SEARCH_CHUNK   (16 * 1024 * 1024)
+
+/* the size of the head of the file whose encoding is checked */
+#define MOUSEPAD_PAGER_HEAD_SIZE      (64 * 1024)
+
+
+
+struct _MousepadPager
+{
+  gint              ref_count;
+
+  /* the mapped file, and the offset of its first line, after a bom */
+  GMappedFile      *mapped;
+  const gchar      *contents;
+  gsize             length;
+  gsize             start;
+  MousepadEncoding  encoding;
+
+  /* whether an access to the mapping failed because the file was truncated */
+  gint              truncated;
+
+  /* the sparse line index, entry n being the offset of line n * step, and the number
+   * of lines once the index is complete, all guarded by the mutex */
+  GMutex            mutex;
+  GArray           *offsets;
+  guint64           step;
+  gint64            n_lines;
+};
+
+typedef struct
+{
+  MousepadPager *pager;
+  gchar         *needle;
+  gsize          needle_length;
+  gsize          offset;
+  gboolean       backward;
+  gboolean       match_case;
+  gboolean       wrap_around;
+  gsize          match;
+
+  /* the position of the match, computed in the worker thread */
+  guint64        start_line, end_line;
+  gsize          start_column, end_column;
+}
+MousepadPagerSearch;
+
+
+
+/* the jump buffer of the guarded access to a mapping in progress in each thread, and the
+ * SIGBUS handler which was installed before ours */
+static GPrivate         pager_guard = G_PRIVATE_INIT (NULL);
+static struct sigaction pager_previous_action;
+
+
+
+static void
+mousepad_pager_fault_handler (gint       signum,
+                              siginfo_t *info,
+                              gpointer   context)
+{
+  sigjmp_buf *env = g_private_get (&pager_guard);
+
+  /* leave the guarded access, which fails */
+  if (env != NULL)
+    siglongjmp (*env, 1);
+
+  /* the fault is not ours: the access is done again with the previous handler */
+  sigaction (SIGBUS, &pager_previous_action, NULL);
+}
+
+
+
+static void
+mousepad_pager_fault_init (void)
+{
+  static gsize     initialized = 0;
+  struct sigaction action;
+
+  if (g_once_init_enter (&initialized))
+    {
+      memset (&action, 0, sizeof (action));
+      action.sa_sigaction = mousepad_pager_fault_handler;
+      action.sa_flags = SA_SIGINFO;
+      sigemptyset (&action.sa_mask);
+      sigaction (SIGBUS, &action, &pager_previous_action);
+
+      g_once_init_leave (&initialized, 1);
+    }
+}
+
+
+
+/* end a guarded access to the mapping which failed, @guard being the access in progress
+ * before it, if any */
+static void
+mousepad_pager_fault (MousepadPager *pager,
+                      gpointer       guard)
+{
+  g_private_set (&pager_guard, guard);
+  g_atomic_int_set (&pager->truncated, TRUE);
+}
+
+
+
+/* check that the lines of the file can be found without decoding it, from its head: a bom
+ * other than that of UTF-8, nul bytes and contents which can't be decoded or look like they
+ * are in another encoding are left to the normal loading, which deals with them */
+static gboolean
+mousepad_pager_check_encoding (MousepadPager  *pager,
+                               GError        **error)
+{
+  MousepadEncodingCandidate  candidate;
+  MousepadEncoding           bom_encoding;
+  const gchar               *head = pager->contents;
+  gpointer                   guard;
+  sigjmp_buf                 env;
+  gchar                     *text;
+  gsize                      length, bom_length, n_read, n;
+  gboolean                   supported;
+
+  length = MIN (pager->length, MOUSEPAD_PAGER_HEAD_SIZE);
+  if (length == 0)
+    return TRUE;
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                           _("The file was truncated while being read"));
+      return FALSE;
+    }
+
+  g_private_set (&pager_guard, &env);
+
+  bom_encoding = mousepad_encoding_read_bom (head, length, &bom_length);
+  if (bom_encoding == MOUSEPAD_ENCODING_UTF_8 && pager->encoding == MOUSEPAD_ENCODING_UTF_8)
+    {
+      pager->start = bom_length;
+      head += bom_length;
+      length -= bom_length;
+    }
+
+  /* an incomplete character at the end of the head is not an error */
+  supported = FALSE;
+  if (bom_encoding == MOUSEPAD_ENCODING_NONE || pager->start > 0)
+    {
+      text = mousepad_encoding_convert_to_utf8 (pager->encoding, head, length, &n_read, NULL, NULL);
+      supported = (text != NULL);
+      g_free (text);
+    }
+
+  /* nul bytes are only found in wide encodings and binary files, and the detection only
+   * matters if the head is not plain ascii, which all these encodings decode the same */
+  for (n = 0; supported && n < length && head[n] != '\0' && (guchar) head[n] < 0x80; n++);
+  if (supported && n < length)
+    supported = (head[n] != '\0'
+                 && (mousepad_encoding_detect (head, length, &candidate, 1) == 0
+                     || mousepad_encoding_is_ascii_compatible (candidate.encoding)));
+
+  g_private_set (&pager_guard, guard);
+
+  if (! supported)
+    g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                         _("The encoding of the file does not allow to view it page by page"));
+
+  return supported;
+}
+
+
+
+/**
+ * mousepad_pager_new:
+ * @location : the #GFile to view page by page.
+ * @encoding : the encoding of @location, which must be compatible with ASCII.
+ * @error    : return location for errors, or %NULL.
+ *
+ * Maps @location in memory to view it page by page. If the head of the file shows that
+ * it is not in @encoding or in an encoding compatible with ASCII, %G_IO_ERROR_NOT_SUPPORTED
+ * is returned, for the file to be loaded normally.
+ *
+ * Return value: the new #MousepadPager, or %NULL on error.
+ **/
+MousepadPager *
+mousepad_pager_new (GFile             *location,
+                    MousepadEncoding   encoding,
+                    GError           **error)
+{
+  MousepadPager *pager;
+  GMappedFile   *mapped;
+  gchar         *path;
+
+  g_return_val_if_fail (G_IS_FILE (location), NULL);
+  g_return_val_if_fail (mousepad_encoding_is_ascii_compatible (encoding), NULL);
+  g_return_val_if_fail (error == NULL || *error == NULL, NULL);
+
+  /* only local files can be mapped */
+  path = g_file_get_path (location);
+  if (path == NULL)
+    {
+      g_set_error_literal (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                           _("Only local files can be viewed page by page"));
+      return NULL;
+    }
+
+  mapped = g_mapped_file_new (path, FALSE, error);
+  g_free (path);
+  if (mapped == NULL)
+    return NULL;
+
+  mousepad_pager_fault_init ();
+
+  pager = g_slice_new0 (MousepadPager);
+  pager->ref_count = 1;
+  pager->mapped = mapped;
+  pager->length = g_mapped_file_get_length (mapped);
+  pager->contents = (pager->length > 0) ? g_mapped_file_get_contents (mapped) : "";
+  pager->encoding = encoding;
+
+  g_mutex_init (&pager->mutex);
+  pager->offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+  pager->step = MOUSEPAD_PAGER_INITIAL_STEP;
+  pager->n_lines = -1;
+
+  if (! mousepad_pager_check_encoding (pager, error))
+    {
+      mousepad_pager_unref (pager);
+      return NULL;
+    }
+
+  /* the first line is known, the others will be once indexed */
+  g_array_append_val (pager->offsets, pager->start);
+
+  return pager;
+}
+
+
+
+MousepadPager *
+mousepad_pager_ref (MousepadPager *pager)
+{
+  g_return_val_if_fail (pager != NULL, NULL);
+
+  g_atomic_int_inc (&pager->ref_count);
+
+  return pager;
+}
+
+
+
+void
+mousepad_pager_unref (MousepadPager *pager)
+{
+  g_return_if_fail (pager != NULL);
+
+  if (g_atomic_int_dec_and_test (&pager->ref_count))
+    {
+      g_array_free (pager->offsets, TRUE);
+      g_mutex_clear (&pager->mutex);
+      g_mapped_file_unref (pager->mapped);
+      g_slice_free (MousepadPager, pager);
+    }
+}
+
+
+
+MousepadEncoding
+mousepad_pager_get_encoding (MousepadPager *pager)
+{
+  g_return_val_if_fail (pager != NULL, MOUSEPAD_ENCODING_NONE);
+
+  return pager->encoding;
+}
+
+
+
+/* skip up to @n_lines line feeds from @offset, returns the offset following the last one
+ * and decrements @n_lines by the number of lines skipped */
+static gsize
+mousepad_pager_skip_lines (MousepadPager *pager,
+                           gsize          offset,
+                           guint64       *n_lines)
+{
+  const gchar *newline;
+
+  while (*n_lines > 0)
+    {
+      newline = memchr (pager->contents + offset, '\n', pager->length - offset);
+      if (newline == NULL)
+        break;
+
+      offset = newline - pager->contents + 1;
+      (*n_lines)--;
+    }
+
+  return offset;
+}
+
+
+
+static void
+mousepad_pager_index_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  MousepadPager *pager = task_data;
+  gpointer       guard;
+  sigjmp_buf     env;
+  guint64        n_lines, step = pager->step;
+  gsize          offset = pager->start, n, len;
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("The file was truncated while being read"));
+      return;
+    }
+
+  g_private_set (&pager_guard, &env);
+
+  while (TRUE)
+    {
+      if (g_task_return_error_if_cancelled (task))
+        {
+          g_private_set (&pager_guard, guard);
+          return;
+        }
+
+      /* look for the next line to index */
+      n_lines = step;
+      offset = mousepad_pager_skip_lines (pager, offset, &n_lines);
+      if (n_lines > 0)
+        break;
+
+      g_mutex_lock (&pager->mutex);
+      g_array_append_val (pager->offsets, offset);
+
+      /* keep one entry out of two when the index is full, at an odd length so that the
+       * last entry is kept, for the next one to be a whole step away */
+      len = pager->offsets->len;
+      if (len > MOUSEPAD_PAGER_MAX_ENTRIES && len % 2 == 1)
+        {
+          for (n = 0; 2 * n < len; n++)
+            g_array_index (pager->offsets, gsize, n) = g_array_index (pager->offsets, gsize, 2 * n);
+
+          g_array_set_size (pager->offsets, n);
+          step = pager->step *= 2;
+        }
+
+      g_mutex_unlock (&pager->mutex);
+    }
+
+  g_private_set (&pager_guard, guard);
+
+  /* the lines after the last entry, the last line being counted even if empty */
+  g_mutex_lock (&pager->mutex);
+  pager->n_lines = (gint64) ((pager->offsets->len - 1) * step + (step - n_lines) + 1);
+  g_mutex_unlock (&pager->mutex);
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+
+/**
+ * mousepad_pager_index_async:
+ * @pager       : a #MousepadPager.
+ * @cancellable : a #GCancellable, or %NULL.
+ * @callback    : the callback to call when the index is complete.
+ * @user_data   : the data to pass to @callback.
+ *
+ * Builds the index of the lines of @pager in a worker thread. The lines can be accessed
+ * while the index is incomplete, but those after the indexed part are slower to locate.
+ **/
+void
+mousepad_pager_index_async (MousepadPager       *pager,
+                            GCancellable        *cancellable,
+                            GAsyncReadyCallback  callback,
+                            gpointer             user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (pager != NULL);
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_pager_index_async);
+  g_task_set_task_data (task, mousepad_pager_ref (pager), (GDestroyNotify) mousepad_pager_unref);
+  g_task_run_in_thread (task, mousepad_pager_index_thread);
+  g_object_unref (task);
+}
+
+
+
+gboolean
+mousepad_pager_index_finish (MousepadPager  *pager,
+                             GAsyncResult   *result,
+                             GError        **error)
+{
+  g_return_val_if_fail (pager != NULL, FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+
+
+/**
+ * mousepad_pager_get_n_lines:
+ * @pager : a #MousepadPager.
+ *
+ * Return value: the number of lines of @pager, or -1 if the index is not yet complete.
+ **/
+gint64
+mousepad_pager_get_n_lines (MousepadPager *pager)
+{
+  gint64 n_lines;
+
+  g_return_val_if_fail (pager != NULL, -1);
+
+  g_mutex_lock (&pager->mutex);
+  n_lines = pager->n_lines;
+  g_mutex_unlock (&pager->mutex);
+
+  return n_lines;
+}
+
+
+
+/**
+ * mousepad_pager_is_indexed:
+ * @pager : a #MousepadPager.
+ * @line  : a line number, starting from 0.
+ *
+ * Return value: whether @line is in the indexed part of @pager, or after the last line if
+ *               the index is complete. The lines after the indexed part are not looked for
+ *               until they are indexed, see mousepad_pager_get_offset().
+ **/
+gboolean
+mousepad_pager_is_indexed (MousepadPager *pager,
+                           guint64        line)
+{
+  gboolean indexed;
+
+  g_return_val_if_fail (pager != NULL, FALSE);
+
+  g_mutex_lock (&pager->mutex);
+  indexed = (pager->n_lines >= 0 || line / pager->step < pager->offsets->len);
+  g_mutex_unlock (&pager->mutex);
+
+  return indexed;
+}
+
+
+
+/**
+ * mousepad_pager_is_truncated:
+ * @pager : a #MousepadPager.
+ *
+ * Return value: whether an access to @pager failed because the file was truncated, in
+ *               which case it must be mapped again with a new #MousepadPager.
+ **/
+gboolean
+mousepad_pager_is_truncated (MousepadPager *pager)
+{
+  g_return_val_if_fail (pager != NULL, FALSE);
+
+  return g_atomic_int_get (&pager->truncated);
+}
+
+
+
+/* the offset of @line, or of the last line if there are less lines: a line after the
+ * indexed part is not looked for while the index is incomplete, which would mean scanning
+ * an unbounded part of the file, the last indexed line is used instead */
+static gsize
+mousepad_pager_get_line_offset (MousepadPager *pager,
+                                guint64        line)
+{
+  guint64 entry, n_lines;
+  gsize   offset;
+
+  g_mutex_lock (&pager->mutex);
+  entry = MIN (line / pager->step, pager->offsets->len - 1);
+  offset = g_array_index (pager->offsets, gsize, entry);
+  n_lines = line - entry * pager->step;
+  if (n_lines >= pager->step && pager->n_lines < 0)
+    n_lines = 0;
+
+  g_mutex_unlock (&pager->mutex);
+
+  return mousepad_pager_skip_lines (pager, offset, &n_lines);
+}
+
+
+
+/**
+ * mousepad_pager_get_offset:
+ * @pager  : a #MousepadPager.
+ * @line   : a line number, starting from 0.
+ * @column : an offset in characters in @line.
+ *
+ * Return value: the offset in bytes of the given position in the file, in the last
+ *               indexed line if @line is not indexed yet, see mousepad_pager_is_indexed().
+ **/
+gsize
+mousepad_pager_get_offset (MousepadPager *pager,
+                           guint64        line,
+                           gsize          column)
+{
+  const gchar *end;
+  gpointer     guard;
+  sigjmp_buf   env;
+  gsize        offset;
+
+  g_return_val_if_fail (pager != NULL, 0);
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      return pager->start;
+    }
+
+  g_private_set (&pager_guard, &env);
+  offset = mousepad_pager_get_line_offset (pager, line);
+
+  /* single byte encodings */
+  if (pager->encoding != MOUSEPAD_ENCODING_UTF_8)
+    {
+      end = memchr (pager->contents + offset, '\n', pager->length - offset);
+      offset = MIN (offset + column, end != NULL ? (gsize) (end - pager->contents) : pager->length);
+    }
+  else
+    for (; column > 0 && offset < pager->length && pager->contents[offset] != '\n'; column--)
+      offset += g_utf8_skip[(guchar) pager->contents[offset]];
+
+  g_private_set (&pager_guard, guard);
+
+  return MIN (offset, pager->length);
+}
+
+
+
+/**
+ * mousepad_pager_get_position:
+ * @pager  : a #MousepadPager.
+ * @offset : an offset in bytes in the file.
+ * @line   : return location for the line number of @offset, starting from 0.
+ * @column : return location for the offset in characters of @offset in its line.
+ **/
+void
+mousepad_pager_get_position (MousepadPager *pager,
+                             gsize          offset,
+                             guint64       *line,
+                             gsize         *column)
+{
+  const gchar *newline;
+  gpointer     guard;
+  sigjmp_buf   env;
+  guint64      entry;
+  gsize        lower = 0, upper, middle, start, n;
+
+  g_return_if_fail (pager != NULL);
+  g_return_if_fail (line != NULL && column != NULL);
+
+  offset = CLAMP (offset, pager->start, pager->length);
+
+  /* find the last indexed line before the offset */
+  g_mutex_lock (&pager->mutex);
+  upper = pager->offsets->len;
+  while (upper - lower > 1)
+    {
+      middle = (lower + upper) / 2;
+      if (g_array_index (pager->offsets, gsize, middle) <= offset)
+        lower = middle;
+      else
+        upper = middle;
+    }
+
+  entry = lower;
+  start = g_array_index (pager->offsets, gsize, entry);
+  *line = entry * pager->step;
+  g_mutex_unlock (&pager->mutex);
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      *column = 0;
+      return;
+    }
+
+  g_private_set (&pager_guard, &env);
+
+  /* then count the lines up to the offset */
+  while ((newline = memchr (pager->contents + start, '\n', offset - start)) != NULL)
+    {
+      start = newline - pager->contents + 1;
+      (*line)++;
+    }
+
+  if (pager->encoding != MOUSEPAD_ENCODING_UTF_8)
+    *column = offset - start;
+  else
+    for (*column = 0, n = start; n < offset; n++)
+      if (((guchar) pager->contents[n] & 0xc0) != 0x80)
+        (*column)++;
+
+  g_private_set (&pager_guard, guard);
+}
+
+
+
+/* decode @length bytes of contents at @offset to valid UTF-8 for a text buffer: invalid
+ * sequences and nul bytes are replaced, and carriage returns are dropped so that the lines
+ * of the buffer match those of the file */
+static gchar *
+mousepad_pager_decode (MousepadPager *pager,
+                       gsize          offset,
+                       gsize          length)
+{
+  GString    *string;
+  GError     *error = NULL;
+  gpointer    guard;
+  sigjmp_buf  env;
+  gchar      *contents, *text;
+  gsize       n, i, n_read, n_written;
+
+  /* only the copy of the contents accesses the mapping */
+  contents = g_malloc (length + 1);
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      g_free (contents);
+      return g_strdup ("");
+    }
+
+  g_private_set (&pager_guard, &env);
+  memcpy (contents, pager->contents + offset, length);
+  g_private_set (&pager_guard, guard);
+
+  if (pager->encoding != MOUSEPAD_ENCODING_UTF_8)
+    {
+      string = g_string_sized_new (length);
+      for (n = 0; n < length; n += n_read + 1)
+        {
+          /* convert up to the next invalid byte, which is replaced */
+          text = mousepad_encoding_convert_to_utf8 (pager->encoding, contents + n, length - n,
+                                                    &n_read, &n_written, &error);
+          if (text == NULL)
+            {
+              g_clear_error (&error);
+              text = mousepad_encoding_convert_to_utf8 (pager->encoding, contents + n, n_read,
+                                                        NULL, &n_written, NULL);
+            }
+
+          if (text != NULL)
+            g_string_append_len (string, text, n_written);
+
+          if (n + n_read < length)
+            g_string_append (string, "\357\277\275");
+
+          g_free (text);
+        }
+
+      g_free (contents);
+      length = string->len;
+      contents = g_string_free (string, FALSE);
+    }
+
+  for (n = 0, i = 0; n < length; n++)
+    if (contents[n] != '\r')
+      contents[i++] = contents[n];
+
+  text = g_utf8_make_valid (contents, i);
+  g_free (contents);
+
+  return text;
+}
+
+
+
+/**
+ * mousepad_pager_get_text:
+ * @pager   : a #MousepadPager.
+ * @line    : the first line to get, starting from 0.
+ * @n_lines : the number of lines to get, and return location for the number of lines
+ *            actually got.
+ *
+ * Gets the text of some lines, without the line feed of the last one. Less lines are
+ * returned at the end of the file or if they are too long, a single line being truncated
+ * if needed.
+ *
+ * Return value: the UTF-8 text of the lines, to be freed with g_free().
+ **/
+gchar *
+mousepad_pager_get_text (MousepadPager *pager,
+                         guint64        line,
+                         guint64       *n_lines)
+{
+  const gchar *newline;
+  gpointer     guard;
+  sigjmp_buf   env;
+  guint64      count = 0;
+  gsize        start, end, limit, offset;
+
+  g_return_val_if_fail (pager != NULL, NULL);
+  g_return_val_if_fail (n_lines != NULL, NULL);
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (pager, guard);
+      *n_lines = 0;
+      return g_strdup ("");
+    }
+
+  g_private_set (&pager_guard, &env);
+
+  start = end = offset = mousepad_pager_get_line_offset (pager, line);
+  limit = MIN (pager->length, start + MOUSEPAD_PAGER_MAX_TEXT_SIZE);
+
+  while (count < *n_lines)
+    {
+      newline = memchr (pager->contents + offset, '\n', limit - offset);
+      if (newline == NULL)
+        {
+          /* the last line of the file */
+          if (limit == pager->length)
+            {
+              end = limit;
+              count++;
+            }
+          /* a line too long, truncated on a character boundary */
+          else if (count == 0)
+            {
+              end = mousepad_encoding_find_boundary (pager->encoding, pager->contents,
+                                                     pager->length, limit);
+              count++;
+            }
+
+          break;
+        }
+
+      end = newline - pager->contents;
+      offset = end + 1;
+      count++;
+    }
+
+  g_private_set (&pager_guard, guard);
+
+  *n_lines = count;
+
+  return mousepad_pager_decode (pager, start, end - start);
+}
+
+
+
+/* whether the needle is at @offset, ignoring the case of ASCII characters if needed */
+static inline gboolean
+mousepad_pager_search_match (MousepadPagerSearch *search,
+                             gsize                offset)
+{
+  const gchar *contents = search->pager->contents + offset;
+  gsize        n;
+
+  if (search->match_case)
+    return memcmp (contents, search->needle, search->needle_length) == 0;
+
+  for (n = 0; n < search->needle_length; n++)
+    if (g_ascii_tolower (contents[n]) != g_ascii_tolower (search->needle[n]))
+      return FALSE;
+
+  return TRUE;
+}
+
+
+
+/* look for the needle starting between @start and @end, the last one if searching
+ * backward, returns FALSE if it was not found or the search was cancelled */
+static gboolean
+mousepad_pager_search_range (MousepadPagerSearch *search,
+                             gsize                start,
+                             gsize                end,
+                             GCancellable        *cancellable)
+{
+  const gchar *contents = search->pager->contents, *found;
+  gsize        offset, chunk_end, chunk_start;
+  gchar        first, other;
+
+  end = MIN (end, search->pager->length - search->needle_length + 1);
+  first = search->needle[0];
+  other = search->match_case ? first : (g_ascii_islower (first) ? g_ascii_toupper (first)
+                                                                : g_ascii_tolower (first));
+
+  if (! search->backward)
+    {
+      for (offset = start; offset < end; offset = chunk_end)
+        {
+          if (g_cancellable_is_cancelled (cancellable))
+            return FALSE;
+
+          chunk_end = MIN (end, offset + MOUSEPAD_PAGER_SEARCH_CHUNK);
+          for (; offset < chunk_end; offset++)
+            {
+              /* jump to the next occurrence of the first byte when possible */
+              if (first == other)
+                {
+                  found = memchr (contents + offset, first, chunk_end - offset);
+                  if (found == NULL)
+                    break;
+
+                  offset = found - contents;
+                }
+              else if (contents[offset] != first && contents[offset] != other)
+                continue;
+
+              if (mousepad_pager_search_match (search, offset))
+                {
+                  search->match = offset;
+                  return TRUE;
+                }
+            }
+        }
+    }
+  else
+    {
+      for (offset = end; offset > start; offset = chunk_start)
+        {
+          if (g_cancellable_is_cancelled (cancellable))
+            return FALSE;
+
+          chunk_start = (offset - start > MOUSEPAD_PAGER_SEARCH_CHUNK)
+                        ? offset - MOUSEPAD_PAGER_SEARCH_CHUNK : start;
+          for (; offset > chunk_start; offset--)
+            if ((contents[offset - 1] == first || contents[offset - 1] == other)
+                && mousepad_pager_search_match (search, offset - 1))
+              {
+                search->match = offset - 1;
+                return TRUE;
+              }
+        }
+    }
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_pager_search_thread (GTask        *task,
+                              gpointer      source_object,
+                              gpointer      task_data,
+                              GCancellable *cancellable)
+{
+  MousepadPagerSearch *search = task_data;
+  gpointer             guard;
+  sigjmp_buf           env;
+  gsize                length = search->pager->length;
+  gboolean             found = FALSE;
+
+  guard = g_private_get (&pager_guard);
+  if (sigsetjmp (env, 1) != 0)
+    {
+      mousepad_pager_fault (search->pager, guard);
+      g_task_return_new_error (task, G_IO_ERROR, G_IO_ERROR_FAILED,
+                               _("The file was truncated while being read"));
+      return;
+    }
+
+  g_private_set (&pager_guard, &env);
+
+  if (search->needle != NULL && search->needle_length > 0 && search->needle_length <= length)
+    {
+      /* search up to the end of the file, or its start, then wrap around if needed */
+      if (! search->backward)
+        found = mousepad_pager_search_range (search, search->offset, length, cancellable)
+                || (search->wrap_around
+                    && mousepad_pager_search_range (search, 0, search->offset, cancellable));
+      else
+        found = (search->offset >= search->needle_length
+                 && mousepad_pager_search_range (search, 0, search->offset - search->needle_length + 1,
+                                                 cancellable))
+                || (search->wrap_around
+                    && mousepad_pager_search_range (search, search->offset, length, cancellable));
+    }
+
+  g_private_set (&pager_guard, guard);
+
+  /* the position of the match, which may be far from the indexed part of the file */
+  if (found)
+    {
+      mousepad_pager_get_position (search->pager, search->match,
+                                   &search->start_line, &search->start_column);
+      mousepad_pager_get_position (search->pager, search->match + search->needle_length,
+                                   &search->end_line, &search->end_column);
+    }
+
+  if (! g_task_return_error_if_cancelled (task))
+    g_task_return_boolean (task, found && ! mousepad_pager_is_truncated (search->pager));
+}
+
+
+
+static void
+mousepad_pager_search_free (gpointer data)
+{
+  MousepadPagerSearch *search = data;
+
+  mousepad_pager_unref (search->pager);
+  g_free (search->needle);
+  g_slice_free (MousepadPagerSearch, search);
+}
+
+
+
+/**
+ * mousepad_pager_search_async:
+ * @pager       : a #MousepadPager.
+ * @string      : the UTF-8 string to search for.
+ * @offset      : the offset in bytes from which to search.
+ * @backward    : whether to search for a match ending before @offset.
+ * @match_case  : whether the case is significant, it is only ignored for ASCII characters.
+ * @wrap_around : whether to search the rest of the file if no match is found.
+ * @cancellable : a #GCancellable, or %NULL.
+ * @callback    : the callback to call when the search is done.
+ * @user_data   : the data to pass to @callback.
+ *
+ * Searches the raw contents of the file for @string in a worker thread.
+ **/
+void
+mousepad_pager_search_async (MousepadPager       *pager,
+                             const gchar         *string,
+                             gsize                offset,
+                             gboolean             backward,
+                             gboolean             match_case,
+                             gboolean             wrap_around,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+  MousepadPagerSearch *search;
+  GTask               *task;
+
+  g_return_if_fail (pager != NULL);
+  g_return_if_fail (string != NULL);
+
+  search = g_slice_new0 (MousepadPagerSearch);
+  search->pager = mousepad_pager_ref (pager);
+  search->offset = MIN (offset, pager->length);
+  search->backward = backward;
+  search->match_case = match_case;
+  search->wrap_around = wrap_around;
+
+  /* search for the string as it is encoded in the file, a string which can't be encoded
+   * is not found */
+  if (pager->encoding == MOUSEPAD_ENCODING_UTF_8)
+    {
+      search->needle = g_strdup (string);
+      search->needle_length = strlen (string);
+    }
+  else
+    {
+      search->needle = mousepad_encoding_convert_from_utf8 (pager->encoding, string, strlen (string),
+                                                            NULL, &search->needle_length, NULL);
+
+      /* the length may be that of the part converted before the error */
+      if (search->needle == NULL)
+        search->needle_length = 0;
+    }
+
+  task = g_task_new (NULL, cancellable, callback, user_data);
+  g_task_set_source_tag (task, mousepad_pager_search_async);
+  g_task_set_task_data (task, search, mousepad_pager_search_free);
+  g_task_run_in_thread (task, mousepad_pager_search_thread);
+  g_object_unref (task);
+}
+
+
+
+/**
+ * mousepad_pager_search_finish:
+ * @pager        : a #MousepadPager.
+ * @result       : the #GAsyncResult passed to the callback.
+ * @start_line   : return location for the line of the match.
+ * @start_column : return location for the offset in characters of the match in its line.
+ * @end_line     : return location for the line of the end of the match.
+ * @end_column   : return location for the offset in characters of the end of the match.
+ * @error        : return location for errors, or %NULL.
+ *
+ * Return value: %TRUE if a match was found, %FALSE if not or if the search failed, in
+ *               which case @error is set.
+ **/
+gboolean
+mousepad_pager_search_finish (MousepadPager  *pager,
+                              GAsyncResult   *result,
+                              guint64        *start_line,
+                              gsize          *start_column,
+                              guint64        *end_line,
+                              gsize          *end_column,
+                              GError        **error)
+{
+  MousepadPagerSearch *search;
+
+  g_return_val_if_fail (pager != NULL, FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, NULL), FALSE);
+
+  if (! g_task_propagate_boolean (G_TASK (result), error))
+    return FALSE;
+
+  search = g_task_get_task_data (G_TASK (result));
+  *start_line = search->start_line;
+  *start_column = search->start_column;
+  *end_line = search->end_line;
+  *end_column = search->end_column;
+
+  return TRUE;
+}
@@ -0,0 +1,87 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_PAGER_H__
+#define __MOUSEPAD_PAGER_H__
+
+#include <mousepad/mousepad-encoding.h>
+
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef struct _MousepadPager MousepadPager;
+
+MousepadPager    *mousepad_pager_new           (GFile                *location,
+                                                MousepadEncoding      encoding,
+                                                GError              **error);
+
+MousepadPager    *mousepad_pager_ref           (MousepadPager        *pager);
+
+void              mousepad_pager_unref         (MousepadPager        *pager);
+
+MousepadEncoding  mousepad_pager_get_encoding  (MousepadPager        *pager);
+
+void              mousepad_pager_index_async   (MousepadPager        *pager,
+                                                GCancellable         *cancellable,
+                                                GAsyncReadyCallback   callback,
+                                                gpointer              user_data);
+
+gboolean          mousepad_pager_index_finish  (MousepadPager        *pager,
+                                                GAsyncResult         *result,
+                                                GError              **error);
+
+gint64            mousepad_pager_get_n_lines   (MousepadPager        *pager);
+
+gboolean          mousepad_pager_is_indexed    (MousepadPager        *pager,
+                                                guint64               line);
+
+gboolean          mousepad_pager_is_truncated  (MousepadPager        *pager);
+
+gsize             mousepad_pager_get_offset    (MousepadPager        *pager,
+                                                guint64               line,
+                                                gsize                 column);
+
+void              mousepad_pager_get_position  (MousepadPager        *pager,
+                                                gsize                 offset,
+                                                guint64              *line,
+                                                gsize                *column);
+
+gchar            *mousepad_pager_get_text      (MousepadPager        *pager,
+                                                guint64               line,
+                                                guint64              *n_lines);
+
+void              mousepad_pager_search_async  (MousepadPager        *pager,
+                                                const gchar          *string,
+                                                gsize                 offset,
+                                                gboolean              backward,
+                                                gboolean              match_case,
+                                                gboolean              wrap_around,
+                                                GCancellable         *cancellable,
+                                                GAsyncReadyCallback   callback,
+                                                gpointer              user_data);
+
+gboolean          mousepad_pager_search_finish (MousepadPager        *pager,
+                                                GAsyncResult         *result,
+                                                guint64              *start_line,
+                                                gsize                *start_column,
+                                                guint64              *end_line,
+                                                gsize                *end_column,
+                                                GError              **error);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_PAGER_H__ */
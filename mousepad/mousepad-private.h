@@ -57,6 +57,10 @@ G_BEGIN_DECLS
 #define MOUSEPAD_RC_RELPATH     ("Mousepad" G_DIR_SEPARATOR_S "mousepadrc")
 #define MOUSEPAD_ACCELS_RELPATH ("Mousepad" G_DIR_SEPARATOR_S "accels.scm")
 
+/* cache locations */
+#define MOUSEPAD_JOURNAL_RELPATH ("Mousepad" G_DIR_SEPARATOR_S "journal")
+#define MOUSEPAD_UNDO_RELPATH    ("Mousepad" G_DIR_SEPARATOR_S "undo")
+
 /* handling flags */
 #define MOUSEPAD_SET_FLAG(flags, flag)   G_STMT_START{ ((flags) |= (flag)); }G_STMT_END
 #define MOUSEPAD_UNSET_FLAG(flags, flag) G_STMT_START{ ((flags) &= ~(flag)); }G_STMT_END
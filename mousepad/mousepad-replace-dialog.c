@@ -595,11 +595,16 @@ mousepad_replace_dialog_search_completed (MousepadReplaceDialog *dialog,
       /* update entry color */
       mousepad_util_entry_error (dialog->search_entry, n_matches == 0);
 
-      /* update counter */
-      message = g_strdup_printf (ngettext ("%d occurrence", "%d occurrences", n_matches),
-                                 n_matches);
-      gtk_label_set_markup (GTK_LABEL (dialog->hits_label), message);
-      g_free (message);
+      /* update counter, unless the matches are not counted */
+      if (n_matches >= 0)
+        {
+          message = g_strdup_printf (ngettext ("%d occurrence", "%d occurrences", n_matches),
+                                     n_matches);
+          gtk_label_set_markup (GTK_LABEL (dialog->hits_label), message);
+          g_free (message);
+        }
+      else
+        gtk_label_set_text (GTK_LABEL (dialog->hits_label), NULL);
     }
 }
 
@@ -0,0 +1,229 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-scanner.h>
+
+#if defined (__AVX2__)
+#include <immintrin.h>
+#define MOUSEPAD_SCANNER_BLOCK_SIZE 32
+#elif defined (__SSE2__)
+#include <emmintrin.h>
+#define MOUSEPAD_SCANNER_BLOCK_SIZE 16
+#endif
+
+
+
+#ifdef MOUSEPAD_SCANNER_BLOCK_SIZE
+/* look for the non-ASCII bytes of the block at @text, and for its line endings or nul bytes */
+static inline void
+mousepad_scanner_classify_block (const guchar *text,
+                                 guint32      *non_ascii,
+                                 guint32      *mask)
+{
+#ifdef __AVX2__
+  __m256i block, special;
+
+  block = _mm256_loadu_si256 ((const __m256i *) text);
+  special = _mm256_or_si256 (_mm256_or_si256 (_mm256_cmpeq_epi8 (block, _mm256_set1_epi8 ('\n')),
+                                              _mm256_cmpeq_epi8 (block, _mm256_set1_epi8 ('\r'))),
+                             _mm256_cmpeq_epi8 (block, _mm256_setzero_si256 ()));
+  *non_ascii = _mm256_movemask_epi8 (block);
+  *mask = _mm256_movemask_epi8 (special);
+#else
+  __m128i block, special;
+
+  block = _mm_loadu_si128 ((const __m128i *) text);
+  special = _mm_or_si128 (_mm_or_si128 (_mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\n')),
+                                        _mm_cmpeq_epi8 (block, _mm_set1_epi8 ('\r'))),
+                          _mm_cmpeq_epi8 (block, _mm_setzero_si128 ()));
+  *non_ascii = _mm_movemask_epi8 (block);
+  *mask = _mm_movemask_epi8 (special);
+#endif
+}
+#endif
+
+
+
+/* returns the length of the valid UTF-8 sequence starting with a non-ASCII byte
+ * at @text, or 0 if it is not valid, with the same rules as g_utf8_validate() */
+static inline gsize
+mousepad_scanner_validate_sequence (const guchar *text,
+                                    gsize         length)
+{
+  guchar min = 0x80, max = 0xbf;
+  gsize  n, i;
+
+  if (text[0] >= 0xc2 && text[0] <= 0xdf)
+    n = 2;
+  else if (text[0] >= 0xe0 && text[0] <= 0xef)
+    {
+      n = 3;
+
+      /* no overlong forms and no surrogates */
+      if (text[0] == 0xe0)
+        min = 0xa0;
+      else if (text[0] == 0xed)
+        max = 0x9f;
+    }
+  else if (text[0] >= 0xf0 && text[0] <= 0xf4)
+    {
+      n = 4;
+
+      /* no overlong forms and nothing above U+10FFFF */
+      if (text[0] == 0xf0)
+        min = 0x90;
+      else if (text[0] == 0xf4)
+        max = 0x8f;
+    }
+  else
+    return 0;
+
+  if (G_UNLIKELY (length < n) || text[1] < min || text[1] > max)
+    return 0;
+
+  for (i = 2; i < n; i++)
+    if ((text[i] & 0xc0) != 0x80)
+      return 0;
+
+  return n;
+}
+
+
+
+/* scans the character at @offset, returns its length or 0 if it stops the scan */
+static inline gsize
+mousepad_scanner_step (const guchar       *text,
+                       gsize               offset,
+                       gsize               length,
+                       MousepadScanResult *result)
+{
+  switch (text[offset])
+    {
+      case '\n':
+        /* the crlf pairs are counted on the carriage return */
+        if (offset == 0 || text[offset - 1] != '\r')
+          result->n_lf++;
+        return 1;
+
+      case '\r':
+        g_array_append_val (result->cr_offsets, offset);
+        if (offset + 1 < length && text[offset + 1] == '\n')
+          result->n_crlf++;
+        else
+          result->n_cr++;
+        return 1;
+
+      case '\0':
+        result->binary = TRUE;
+        return 0;
+
+      default:
+        if (G_LIKELY (text[offset] < 0x80))
+          return 1;
+
+        return mousepad_scanner_validate_sequence (text + offset, length - offset);
+    }
+}
+
+
+
+/**
+ * mousepad_scanner_scan:
+ * @text   : the text to scan.
+ * @length : the length of @text in bytes.
+ * @result : return location for the result, to be cleared with mousepad_scanner_clear().
+ *
+ * Validates @text as UTF-8 and gathers its line endings in a single pass. Like
+ * g_utf8_validate(), the scan stops on the first invalid sequence or nul byte.
+ * Runs of ASCII characters are skipped by blocks of 32 bytes when AVX2 is available,
+ * of 16 bytes when SSE2 is.
+ **/
+void
+mousepad_scanner_scan (const gchar        *text,
+                       gsize               length,
+                       MousepadScanResult *result)
+{
+  const guchar *utext = (const guchar *) text;
+  gsize         offset = 0, n;
+#ifdef MOUSEPAD_SCANNER_BLOCK_SIZE
+  guint32       non_ascii, mask;
+  gint          bit, stop;
+#endif
+
+  g_return_if_fail (text != NULL || length == 0);
+  g_return_if_fail (result != NULL);
+
+  memset (result, 0, sizeof (MousepadScanResult));
+  result->cr_offsets = g_array_new (FALSE, FALSE, sizeof (gsize));
+
+#ifdef MOUSEPAD_SCANNER_BLOCK_SIZE
+  while (offset + MOUSEPAD_SCANNER_BLOCK_SIZE <= length)
+    {
+      mousepad_scanner_classify_block (utext + offset, &non_ascii, &mask);
+
+      /* plain ASCII text, the most common case */
+      if (G_LIKELY (non_ascii == 0 && mask == 0))
+        {
+          offset += MOUSEPAD_SCANNER_BLOCK_SIZE;
+          continue;
+        }
+
+      /* handle the special bytes located before the first non-ASCII byte */
+      stop = (non_ascii != 0) ? g_bit_nth_lsf (non_ascii, -1) : MOUSEPAD_SCANNER_BLOCK_SIZE;
+      for (bit = g_bit_nth_lsf (mask, -1); bit != -1 && bit < stop; bit = g_bit_nth_lsf (mask, bit))
+        if (mousepad_scanner_step (utext, offset + bit, length, result) == 0)
+          {
+            result->valid_length = offset + bit;
+            return;
+          }
+
+      offset += stop;
+
+      /* validate the multibyte sequence, then go on by blocks */
+      if (non_ascii != 0)
+        {
+          n = mousepad_scanner_step (utext, offset, length, result);
+          if (n == 0)
+            {
+              result->valid_length = offset;
+              return;
+            }
+
+          offset += n;
+        }
+    }
+#endif
+
+  /* scan what remains byte per byte */
+  while (offset < length && (n = mousepad_scanner_step (utext, offset, length, result)) != 0)
+    offset += n;
+
+  result->valid_length = offset;
+}
+
+
+
+void
+mousepad_scanner_clear (MousepadScanResult *result)
+{
+  g_return_if_fail (result != NULL);
+
+  if (result->cr_offsets != NULL)
+    g_array_free (result->cr_offsets, TRUE);
+
+  memset (result, 0, sizeof (MousepadScanResult));
+}
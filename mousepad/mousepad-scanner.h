@@ -0,0 +1,48 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_SCANNER_H__
+#define __MOUSEPAD_SCANNER_H__
+
+G_BEGIN_DECLS
+
+typedef struct
+{
+  /* length of the valid UTF-8 prefix of the text, the whole length if it is valid */
+  gsize   valid_length;
+
+  /* whether the scan stopped on a nul byte, i.e. the text looks like binary data */
+  gboolean binary;
+
+  /* line ending counts in the valid prefix */
+  gsize   n_lf;
+  gsize   n_cr;
+  gsize   n_crlf;
+
+  /* offsets of the carriage returns in the valid prefix, as gsize */
+  GArray *cr_offsets;
+}
+MousepadScanResult;
+
+void mousepad_scanner_scan  (const gchar        *text,
+                             gsize               length,
+                             MousepadScanResult *result);
+
+void mousepad_scanner_clear (MousepadScanResult *result);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_SCANNER_H__ */
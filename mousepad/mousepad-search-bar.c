@@ -396,11 +396,16 @@ mousepad_search_bar_search_completed (MousepadSearchBar   *bar,
       /* update entry color */
       mousepad_util_entry_error (bar->entry, n_matches == 0);
 
-      /* update counter */
-      message = g_strdup_printf (ngettext ("%d occurrence", "%d occurrences", n_matches),
-                                 n_matches);
-      gtk_label_set_markup (GTK_LABEL (bar->hits_label), message);
-      g_free (message);
+      /* update counter, unless the matches are not counted */
+      if (n_matches >= 0)
+        {
+          message = g_strdup_printf (ngettext ("%d occurrence", "%d occurrences", n_matches),
+                                     n_matches);
+          gtk_label_set_markup (GTK_LABEL (bar->hits_label), message);
+          g_free (message);
+        }
+      else
+        gtk_label_set_text (GTK_LABEL (bar->hits_label), NULL);
     }
 }
 
@@ -27,6 +27,16 @@ G_BEGIN_DECLS
 #define MOUSEPAD_SETTING_MAKE_BACKUP                  "preferences.file.make-backup"
 #define MOUSEPAD_SETTING_MONITOR_CHANGES              "preferences.file.monitor-changes"
 #define MOUSEPAD_SETTING_MONITOR_DISABLING_TIMER      "preferences.file.monitor-disabling-timer"
+#define MOUSEPAD_SETTING_LAZY_LOADING                 "preferences.file.lazy-loading"
+#define MOUSEPAD_SETTING_FOLLOW_AUTOSCROLL            "preferences.file.follow-autoscroll"
+#define MOUSEPAD_SETTING_UNDO_MEMORY_LIMIT            "preferences.file.undo-memory-limit"
+#define MOUSEPAD_SETTING_UNDO_GLOBAL_MEMORY_LIMIT     "preferences.file.undo-global-memory-limit"
+#define MOUSEPAD_SETTING_PERSIST_UNDO_HISTORY         "preferences.file.persist-undo-history"
+#define MOUSEPAD_SETTING_UNDO_HISTORY_MAX_AGE         "preferences.file.undo-history-max-age"
+#define MOUSEPAD_SETTING_UNDO_HISTORY_DISK_LIMIT      "preferences.file.undo-history-disk-limit"
+#define MOUSEPAD_SETTING_PAGED_VIEW_THRESHOLD         "preferences.file.paged-view-threshold"
+#define MOUSEPAD_SETTING_LARGE_FILE_THRESHOLD         "preferences.file.large-file-threshold"
+#define MOUSEPAD_SETTING_LONG_LINE_THRESHOLD          "preferences.file.long-line-threshold"
 #define MOUSEPAD_SETTING_AUTO_INDENT                  "preferences.view.auto-indent"
 #define MOUSEPAD_SETTING_FONT                         "preferences.view.font-name"
 #define MOUSEPAD_SETTING_USE_DEFAULT_FONT             "preferences.view.use-default-monospace-font"
@@ -21,6 +21,8 @@
 
 
 
+static void     mousepad_statusbar_dispose           (GObject           *object);
+
 static gboolean mousepad_statusbar_overwrite_clicked (GtkWidget         *widget,
                                                       GdkEventButton    *event,
                                                       MousepadStatusbar *statusbar);
@@ -29,11 +31,24 @@ static gboolean mousepad_statusbar_filetype_clicked  (GtkWidget         *widget,
                                                       GdkEventButton    *event,
                                                       MousepadStatusbar *statusbar);
 
+static gboolean mousepad_statusbar_reduced_clicked   (GtkWidget         *widget,
+                                                      GdkEventButton    *event,
+                                                      MousepadStatusbar *statusbar);
+
+static void     mousepad_statusbar_cancel_clicked    (GtkButton         *button,
+                                                      MousepadStatusbar *statusbar);
+
+
+
+/* delay before showing the progress of an operation, in milliseconds */
+#define MOUSEPAD_STATUSBAR_PROGRESS_DELAY 250
+
 
 
 enum
 {
   ENABLE_OVERWRITE,
+  ENABLE_FEATURES,
   LAST_SIGNAL,
 };
 
@@ -49,11 +64,20 @@ struct _MousepadStatusbar
   /* whether overwrite is enabled */
   guint               overwrite_enabled : 1;
 
-  /* extra labels in the statusbar */
+  /* extra labels in the statusbar, the large document indicator being shown with its
+   * separator only when needed */
+  GtkWidget          *reduced;
+  GtkWidget          *reduced_separator;
   GtkWidget          *language;
   GtkWidget          *encoding;
   GtkWidget          *position;
   GtkWidget          *overwrite;
+
+  /* progress of the running operations, the last one started being the first one */
+  GtkWidget          *progress_box;
+  GtkWidget          *progress;
+  GSList             *cancellables;
+  guint               progress_timer;
 };
 
 
@@ -80,6 +104,7 @@ mousepad_statusbar_class_init (MousepadStatusbarClass *klass)
   GObjectClass *gobject_class;
 
   gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->dispose = mousepad_statusbar_dispose;
 
   statusbar_signals[ENABLE_OVERWRITE] =
     g_signal_new (I_("enable-overwrite"),
@@ -88,6 +113,14 @@ mousepad_statusbar_class_init (MousepadStatusbarClass *klass)
                   0, NULL, NULL,
                   g_cclosure_marshal_VOID__BOOLEAN,
                   G_TYPE_NONE, 1, G_TYPE_BOOLEAN);
+
+  statusbar_signals[ENABLE_FEATURES] =
+    g_signal_new (I_("enable-features"),
+                  G_TYPE_FROM_CLASS (gobject_class),
+                  G_SIGNAL_RUN_LAST,
+                  0, NULL, NULL,
+                  g_cclosure_marshal_VOID__VOID,
+                  G_TYPE_NONE, 0);
 }
 
 
@@ -95,7 +128,7 @@ mousepad_statusbar_class_init (MousepadStatusbarClass *klass)
 static void
 mousepad_statusbar_init (MousepadStatusbar *statusbar)
 {
-  GtkWidget    *ebox, *box, *separator, *label;
+  GtkWidget    *ebox, *box, *separator, *label, *button;
   GtkStatusbar *bar = GTK_STATUSBAR (statusbar);
   GList *frame;
 
@@ -114,6 +147,40 @@ mousepad_statusbar_init (MousepadStatusbar *statusbar)
   g_object_unref (label);
   g_list_free (frame);
 
+  /* progress bar and cancel button, only shown while an operation is running */
+  statusbar->progress_box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 4);
+  gtk_box_pack_start (GTK_BOX (box), statusbar->progress_box, FALSE, FALSE, 0);
+
+  statusbar->progress = gtk_progress_bar_new ();
+  gtk_widget_set_valign (statusbar->progress, GTK_ALIGN_CENTER);
+  gtk_box_pack_start (GTK_BOX (statusbar->progress_box), statusbar->progress, FALSE, FALSE, 0);
+  gtk_widget_show (statusbar->progress);
+
+  button = gtk_button_new_from_icon_name ("process-stop", GTK_ICON_SIZE_MENU);
+  gtk_button_set_relief (GTK_BUTTON (button), GTK_RELIEF_NONE);
+  gtk_widget_set_tooltip_text (button, _("Cancel the operation"));
+  g_signal_connect (button, "clicked", G_CALLBACK (mousepad_statusbar_cancel_clicked), statusbar);
+  gtk_box_pack_start (GTK_BOX (statusbar->progress_box), button, FALSE, FALSE, 0);
+  gtk_widget_show (button);
+
+  /* large document event box */
+  statusbar->reduced_separator = gtk_separator_new (GTK_ORIENTATION_VERTICAL);
+  gtk_box_pack_start (GTK_BOX (box), statusbar->reduced_separator, FALSE, FALSE, 0);
+
+  statusbar->reduced = gtk_event_box_new ();
+  gtk_box_pack_start (GTK_BOX (box), statusbar->reduced, FALSE, TRUE, 0);
+  gtk_event_box_set_visible_window (GTK_EVENT_BOX (statusbar->reduced), FALSE);
+  gtk_widget_set_tooltip_text (statusbar->reduced,
+                               _("Highlighting and other costly features are disabled for this "
+                                 "large document, click to enable them"));
+  g_signal_connect (statusbar->reduced, "button-press-event",
+                    G_CALLBACK (mousepad_statusbar_reduced_clicked), statusbar);
+
+  /* large document label */
+  label = gtk_label_new (_("Large file"));
+  gtk_container_add (GTK_CONTAINER (statusbar->reduced), label);
+  gtk_widget_show (label);
+
   /* separator */
   separator = gtk_separator_new (GTK_ORIENTATION_VERTICAL);
   gtk_box_pack_start (GTK_BOX (box), separator, FALSE, FALSE, 0);
@@ -175,6 +242,27 @@ mousepad_statusbar_init (MousepadStatusbar *statusbar)
 
 
 
+static void
+mousepad_statusbar_dispose (GObject *object)
+{
+  MousepadStatusbar *statusbar = MOUSEPAD_STATUSBAR (object);
+
+  /* stop pending progress display */
+  if (statusbar->progress_timer != 0)
+    {
+      g_source_remove (statusbar->progress_timer);
+      statusbar->progress_timer = 0;
+    }
+
+  /* release the cancellables */
+  g_slist_free_full (statusbar->cancellables, g_object_unref);
+  statusbar->cancellables = NULL;
+
+  (*G_OBJECT_CLASS (mousepad_statusbar_parent_class)->dispose) (object);
+}
+
+
+
 static gboolean
 mousepad_statusbar_overwrite_clicked (GtkWidget         *widget,
                                       GdkEventButton    *event,
@@ -231,6 +319,52 @@ mousepad_statusbar_filetype_clicked (GtkWidget         *widget,
 
 
 
+static gboolean
+mousepad_statusbar_reduced_clicked (GtkWidget         *widget,
+                                    GdkEventButton    *event,
+                                    MousepadStatusbar *statusbar)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar), FALSE);
+
+  /* only respond on the left button click */
+  if (event->type != GDK_BUTTON_PRESS || event->button != 1)
+    return FALSE;
+
+  /* send the signal */
+  g_signal_emit (statusbar, statusbar_signals[ENABLE_FEATURES], 0);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_statusbar_cancel_clicked (GtkButton         *button,
+                                   MousepadStatusbar *statusbar)
+{
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  /* cancel the last operation */
+  if (statusbar->cancellables != NULL)
+    g_cancellable_cancel (statusbar->cancellables->data);
+}
+
+
+
+static gboolean
+mousepad_statusbar_show_progress (gpointer data)
+{
+  MousepadStatusbar *statusbar = MOUSEPAD_STATUSBAR (data);
+
+  /* the operation is taking some time, show its progress */
+  gtk_widget_show (statusbar->progress_box);
+  statusbar->progress_timer = 0;
+
+  return FALSE;
+}
+
+
+
 void
 mousepad_statusbar_set_cursor_position (MousepadStatusbar *statusbar,
                                         gint               line,
@@ -300,6 +434,18 @@ mousepad_statusbar_set_overwrite (MousepadStatusbar *statusbar,
 }
 
 
+
+void
+mousepad_statusbar_set_reduced (MousepadStatusbar *statusbar,
+                                gboolean           reduced)
+{
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  gtk_widget_set_visible (statusbar->reduced_separator, reduced);
+  gtk_widget_set_visible (statusbar->reduced, reduced);
+}
+
+
 void
 mousepad_statusbar_push_tooltip (MousepadStatusbar *statusbar,
                                  const gchar       *tooltip)
@@ -325,3 +471,82 @@ mousepad_statusbar_pop_tooltip (MousepadStatusbar *statusbar)
   id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "tooltip");
   gtk_statusbar_pop (GTK_STATUSBAR (statusbar), id);
 }
+
+
+
+void
+mousepad_statusbar_push_progress (MousepadStatusbar *statusbar,
+                                  const gchar       *text,
+                                  GCancellable      *cancellable)
+{
+  guint id, message_id;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+  g_return_if_fail (G_IS_CANCELLABLE (cancellable));
+
+  /* show the operation text, remembering it to remove it at the end of the operation */
+  id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "progress");
+  message_id = gtk_statusbar_push (GTK_STATUSBAR (statusbar), id, text != NULL ? text : "");
+  mousepad_object_set_data (cancellable, "statusbar-message", GUINT_TO_POINTER (message_id));
+
+  /* the cancel button acts on this operation from now on */
+  statusbar->cancellables = g_slist_prepend (statusbar->cancellables, g_object_ref (cancellable));
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (statusbar->progress), 0.0);
+
+  /* do not flash the progress bar for quick operations */
+  if (statusbar->progress_timer == 0 && ! gtk_widget_get_visible (statusbar->progress_box))
+    statusbar->progress_timer = g_timeout_add (MOUSEPAD_STATUSBAR_PROGRESS_DELAY,
+                                               mousepad_statusbar_show_progress, statusbar);
+}
+
+
+
+void
+mousepad_statusbar_set_progress (MousepadStatusbar *statusbar,
+                                 gdouble            fraction)
+{
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+
+  gtk_progress_bar_set_fraction (GTK_PROGRESS_BAR (statusbar->progress), CLAMP (fraction, 0.0, 1.0));
+}
+
+
+
+/* the operations run concurrently, they do not necessarily end in the reverse order they
+ * were started */
+void
+mousepad_statusbar_pop_progress (MousepadStatusbar *statusbar,
+                                 GCancellable      *cancellable)
+{
+  GSList *link;
+  guint   id;
+
+  g_return_if_fail (MOUSEPAD_IS_STATUSBAR (statusbar));
+  g_return_if_fail (G_IS_CANCELLABLE (cancellable));
+
+  /* nothing to do if the statusbar was disposed in the meantime */
+  link = g_slist_find (statusbar->cancellables, cancellable);
+  if (G_UNLIKELY (link == NULL))
+    return;
+
+  /* drop the operation text */
+  id = gtk_statusbar_get_context_id (GTK_STATUSBAR (statusbar), "progress");
+  gtk_statusbar_remove (GTK_STATUSBAR (statusbar), id,
+                        GPOINTER_TO_UINT (mousepad_object_get_data (cancellable, "statusbar-message")));
+
+  /* drop the operation cancellable */
+  statusbar->cancellables = g_slist_delete_link (statusbar->cancellables, link);
+  g_object_unref (cancellable);
+
+  /* hide the progress bar if there is no more running operation */
+  if (statusbar->cancellables == NULL)
+    {
+      if (statusbar->progress_timer != 0)
+        {
+          g_source_remove (statusbar->progress_timer);
+          statusbar->progress_timer = 0;
+        }
+
+      gtk_widget_hide (statusbar->progress_box);
+    }
+}
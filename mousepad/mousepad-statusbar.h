@@ -53,11 +53,24 @@ void        mousepad_statusbar_set_language         (MousepadStatusbar *statusba
 void        mousepad_statusbar_set_overwrite        (MousepadStatusbar *statusbar,
                                                      gboolean           overwrite);
 
+void        mousepad_statusbar_set_reduced          (MousepadStatusbar *statusbar,
+                                                     gboolean           reduced);
+
 void        mousepad_statusbar_push_tooltip         (MousepadStatusbar *statusbar,
                                                      const gchar       *tooltip);
 
 void        mousepad_statusbar_pop_tooltip          (MousepadStatusbar *statusbar);
 
+void        mousepad_statusbar_push_progress        (MousepadStatusbar *statusbar,
+                                                     const gchar       *text,
+                                                     GCancellable      *cancellable);
+
+void        mousepad_statusbar_set_progress         (MousepadStatusbar *statusbar,
+                                                     gdouble            fraction);
+
+void        mousepad_statusbar_pop_progress         (MousepadStatusbar *statusbar,
+                                                     GCancellable      *cancellable);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_STATUSBAR_H__ */
@@ -0,0 +1,1570 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-settings.h>
+#include <mousepad/mousepad-undo-manager.h>
+#include <mousepad/mousepad-hash.h>
+
+#include <glib/gstdio.h>
+
+#include <errno.h>
+
+
+
+/* texts of at least this size (in bytes) are stored compressed */
+#define MOUSEPAD_UNDO_COMPRESSION_THRESHOLD (16 * 1024)
+
+/* the memory limit settings are expressed in MiB */
+#define MOUSEPAD_UNDO_MIB                   (G_GUINT64_CONSTANT (1) << 20)
+
+/* a persisted history starts with this magic, followed by the digest, the size and the
+ * character count of the file it applies to and the number of actions (64 bits each),
+ * then the actions, made of their type and compression flag (8 bits), step, start and
+ * end (32 bits each), stored and actual text sizes (64 bits each) and stored text, and
+ * ends with a checksum of all that (64 bits), numbers being stored in little-endian order */
+#define MOUSEPAD_UNDO_MAGIC                 "MPU1"
+#define MOUSEPAD_UNDO_MAGIC_LEN             4
+#define MOUSEPAD_UNDO_HEADER_LEN            (MOUSEPAD_UNDO_MAGIC_LEN + 4 * 8)
+#define MOUSEPAD_UNDO_ACTION_LEN            (1 + 3 * 4 + 2 * 8)
+
+/* the persisted history expiration setting is expressed in days */
+#define MOUSEPAD_UNDO_DAY                   (G_GINT64_CONSTANT (24) * 3600 * G_USEC_PER_SEC)
+
+
+
+static void      mousepad_undo_manager_iface_init         (GtkSourceUndoManagerIface *iface);
+static void      mousepad_undo_manager_finalize           (GObject                   *object);
+static void      mousepad_undo_manager_get_property       (GObject                   *object,
+                                                           guint                      prop_id,
+                                                           GValue                    *value,
+                                                           GParamSpec                *pspec);
+static gboolean  mousepad_undo_manager_can_undo           (GtkSourceUndoManager      *undo_manager);
+static gboolean  mousepad_undo_manager_can_redo           (GtkSourceUndoManager      *undo_manager);
+static void      mousepad_undo_manager_undo               (GtkSourceUndoManager      *undo_manager);
+static void      mousepad_undo_manager_redo               (GtkSourceUndoManager      *undo_manager);
+static void      mousepad_undo_manager_begin_not_undoable (GtkSourceUndoManager      *undo_manager);
+static void      mousepad_undo_manager_end_not_undoable   (GtkSourceUndoManager      *undo_manager);
+static void      mousepad_undo_manager_insert_text        (GtkTextBuffer             *buffer,
+                                                           GtkTextIter               *location,
+                                                           gchar                     *text,
+                                                           gint                       length,
+                                                           MousepadUndoManager       *manager);
+static void      mousepad_undo_manager_delete_range       (GtkTextBuffer             *buffer,
+                                                           GtkTextIter               *start,
+                                                           GtkTextIter               *end,
+                                                           MousepadUndoManager       *manager);
+static void      mousepad_undo_manager_begin_user_action  (MousepadUndoManager       *manager);
+static void      mousepad_undo_manager_end_user_action    (MousepadUndoManager       *manager);
+static void      mousepad_undo_manager_modified_changed   (MousepadUndoManager       *manager);
+static void      mousepad_undo_manager_enforce_limits     (MousepadUndoManager       *manager);
+
+
+
+enum
+{
+  PROP_0,
+  PROP_MEMORY_USAGE,
+  N_PROPERTIES
+};
+
+typedef enum
+{
+  MOUSEPAD_UNDO_INSERT,
+  MOUSEPAD_UNDO_DELETE
+}
+MousepadUndoType;
+
+/* character classes: single character insertions of the same class are merged,
+ * except for line breaks */
+enum
+{
+  CLASS_NONE,
+  CLASS_NEWLINE,
+  CLASS_SPACE,
+  CLASS_WORD
+};
+
+typedef struct
+{
+  /* the serial number of the action, the lowest being the oldest of all managers */
+  guint64 serial;
+
+  /* the text offset in the arena, its stored size and its actual size, in bytes */
+  gsize   text_offset;
+  gsize   stored_length;
+  gsize   length;
+
+  /* the affected range, in characters */
+  gint    start;
+  gint    end;
+
+  /* actions of the same step are undone and redone together */
+  guint   step;
+
+  guint8  type;
+  guint8  compressed;
+}
+MousepadUndoAction;
+
+/* a job of the persistence thread: the writing of a history, or the cleanup of all the
+ * persisted histories if there is no filename */
+typedef struct
+{
+  gchar      *filename;
+
+  /* the persisted history the actions follow, if any, and the file contents it applies to */
+  gchar      *history_file;
+  guint64     history_digest;
+  goffset     history_size;
+  gint        history_chars;
+
+  /* the file contents the new history applies to, its done actions and their texts */
+  guint64     digest;
+  goffset     size;
+  gint        chars;
+  GArray     *actions;
+  GByteArray *arena;
+  guint64     limit;
+
+  /* the cleanup policy */
+  gboolean    remove_all;
+  gint64      max_age;
+  guint64     disk_limit;
+}
+MousepadUndoJob;
+
+/* a persisted history found during the cleanup */
+typedef struct
+{
+  gchar  *filename;
+  gint64  mtime;
+  goffset size;
+}
+MousepadUndoEntry;
+
+struct _MousepadUndoManagerClass
+{
+  GObjectClass __parent__;
+};
+
+struct _MousepadUndoManager
+{
+  GObject        __parent__;
+
+  /* the buffer we record, weak pointer, and its file */
+  GtkTextBuffer *buffer;
+  MousepadFile  *file;
+
+  /* the actions and their texts, stored contiguously in the arena from arena_start:
+   * evicting the oldest actions only moves arena_start, until the arena is compacted */
+  GArray        *actions;
+  GByteArray    *arena;
+  gsize          arena_start;
+
+  /* the number of done actions, the following ones being redoable */
+  guint          n_done;
+
+  /* the number of done actions when the buffer was saved, -1 if it can't be reached */
+  gint           saved;
+
+  /* the current step and the user action state */
+  guint          step;
+  gboolean       new_step;
+  gint           user_action;
+
+  /* not undoable action nesting level */
+  gint           not_undoable;
+
+  /* whether we are changing the buffer ourselves */
+  gboolean       applying;
+
+  /* whether the next single character insertion can be merged with the last action,
+   * if it is of the same class and contiguous */
+  gboolean       can_merge;
+  gint           merge_class;
+
+  /* the persisted history preceding the oldest action, which is only read when needed,
+   * and the loaded file contents it must apply to */
+  gchar         *history_file;
+  guint64        history_digest;
+  goffset        history_size;
+  gint           history_chars;
+
+  /* the last notified states */
+  gboolean       can_undo;
+  gboolean       can_redo;
+  guint64        memory_usage;
+};
+
+
+
+static GParamSpec  *undo_manager_props[N_PROPERTIES] = { NULL, };
+
+/* all the undo managers, to enforce the global memory limit */
+static GSList      *undo_managers = NULL;
+
+/* the serial number of the last recorded action */
+static guint64      undo_serial = 0;
+
+/* the thread writing the persisted histories, one job at a time in order */
+static GThreadPool *undo_pool = NULL;
+
+
+
+G_DEFINE_TYPE_WITH_CODE (MousepadUndoManager, mousepad_undo_manager, G_TYPE_OBJECT,
+                         G_IMPLEMENT_INTERFACE (GTK_SOURCE_TYPE_UNDO_MANAGER,
+                                                mousepad_undo_manager_iface_init))
+
+
+
+static void
+mousepad_undo_manager_class_init (MousepadUndoManagerClass *klass)
+{
+  GObjectClass *gobject_class;
+
+  gobject_class = G_OBJECT_CLASS (klass);
+  gobject_class->finalize = mousepad_undo_manager_finalize;
+  gobject_class->get_property = mousepad_undo_manager_get_property;
+
+  undo_manager_props[PROP_MEMORY_USAGE] =
+    g_param_spec_uint64 ("memory-usage", "MemoryUsage",
+                         "The memory used by the undo history, in bytes",
+                         0, G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS);
+
+  g_object_class_install_properties (gobject_class, N_PROPERTIES, undo_manager_props);
+}
+
+
+
+static void
+mousepad_undo_manager_iface_init (GtkSourceUndoManagerIface *iface)
+{
+  iface->can_undo = mousepad_undo_manager_can_undo;
+  iface->can_redo = mousepad_undo_manager_can_redo;
+  iface->undo = mousepad_undo_manager_undo;
+  iface->redo = mousepad_undo_manager_redo;
+  iface->begin_not_undoable_action = mousepad_undo_manager_begin_not_undoable;
+  iface->end_not_undoable_action = mousepad_undo_manager_end_not_undoable;
+}
+
+
+
+static void
+mousepad_undo_manager_init (MousepadUndoManager *manager)
+{
+  manager->buffer = NULL;
+  manager->file = NULL;
+  manager->actions = g_array_new (FALSE, FALSE, sizeof (MousepadUndoAction));
+  manager->arena = g_byte_array_new ();
+  manager->arena_start = 0;
+  manager->n_done = 0;
+  manager->saved = 0;
+  manager->step = 0;
+  manager->new_step = TRUE;
+  manager->user_action = 0;
+  manager->not_undoable = 0;
+  manager->applying = FALSE;
+  manager->can_merge = FALSE;
+  manager->merge_class = CLASS_NONE;
+  manager->history_file = NULL;
+  manager->can_undo = FALSE;
+  manager->can_redo = FALSE;
+  manager->memory_usage = 0;
+
+  undo_managers = g_slist_prepend (undo_managers, manager);
+
+  /* apply the new limits immediately */
+  MOUSEPAD_SETTING_CONNECT_OBJECT (UNDO_MEMORY_LIMIT,
+                                   G_CALLBACK (mousepad_undo_manager_enforce_limits),
+                                   manager, G_CONNECT_SWAPPED);
+  MOUSEPAD_SETTING_CONNECT_OBJECT (UNDO_GLOBAL_MEMORY_LIMIT,
+                                   G_CALLBACK (mousepad_undo_manager_enforce_limits),
+                                   manager, G_CONNECT_SWAPPED);
+}
+
+
+
+static void
+mousepad_undo_manager_finalize (GObject *object)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (object);
+
+  undo_managers = g_slist_remove (undo_managers, manager);
+
+  /* the buffer may survive us if another undo manager was set */
+  if (manager->buffer != NULL)
+    {
+      g_signal_handlers_disconnect_by_data (manager->buffer, manager);
+      g_object_remove_weak_pointer (G_OBJECT (manager->buffer), (gpointer *) &manager->buffer);
+    }
+
+  if (manager->file != NULL)
+    g_object_unref (manager->file);
+
+  g_array_free (manager->actions, TRUE);
+  g_byte_array_free (manager->arena, TRUE);
+  g_free (manager->history_file);
+
+  G_OBJECT_CLASS (mousepad_undo_manager_parent_class)->finalize (object);
+}
+
+
+
+static void
+mousepad_undo_manager_get_property (GObject    *object,
+                                    guint       prop_id,
+                                    GValue     *value,
+                                    GParamSpec *pspec)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (object);
+
+  switch (prop_id)
+    {
+    case PROP_MEMORY_USAGE:
+      g_value_set_uint64 (value, mousepad_undo_manager_get_memory_usage (manager));
+      break;
+
+    default:
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+}
+
+
+
+static gboolean
+mousepad_undo_manager_compress (GByteArray  *arena,
+                                const gchar *text,
+                                gsize        length)
+{
+  GConverter       *converter;
+  GConverterResult  result;
+  gsize             offset, size, n_read, n_written, total_read = 0, total_written = 0;
+
+  /* compressing is only worth it if it saves at least an eighth of the size */
+  offset = arena->len;
+  size = length - length / 8;
+  g_byte_array_set_size (arena, offset + size);
+
+  converter = G_CONVERTER (g_zlib_compressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW, 1));
+  do
+    {
+      result = g_converter_convert (converter, text + total_read, length - total_read,
+                                    arena->data + offset + total_written, size - total_written,
+                                    G_CONVERTER_INPUT_AT_END, &n_read, &n_written, NULL);
+      total_read += n_read;
+      total_written += n_written;
+    }
+  while (result == G_CONVERTER_CONVERTED);
+
+  g_object_unref (converter);
+
+  /* running out of space is reported as an error, the text is then stored as is */
+  if (result == G_CONVERTER_FINISHED)
+    {
+      g_byte_array_set_size (arena, offset + total_written);
+      return TRUE;
+    }
+
+  g_byte_array_set_size (arena, offset);
+
+  return FALSE;
+}
+
+
+
+static gchar *
+mousepad_undo_manager_decompress (MousepadUndoManager      *manager,
+                                  const MousepadUndoAction *action)
+{
+  GConverter       *converter;
+  GConverterResult  result;
+  gchar            *text;
+  gsize             n_read, n_written, total_read = 0, total_written = 0;
+
+  /* one byte more than needed, so that the end of stream can be reached with some
+   * space left in the output buffer */
+  text = g_malloc (action->length + 1);
+
+  converter = G_CONVERTER (g_zlib_decompressor_new (G_ZLIB_COMPRESSOR_FORMAT_RAW));
+  do
+    {
+      result = g_converter_convert (converter,
+                                    manager->arena->data + action->text_offset + total_read,
+                                    action->stored_length - total_read,
+                                    text + total_written, action->length + 1 - total_written,
+                                    G_CONVERTER_INPUT_AT_END, &n_read, &n_written, NULL);
+      total_read += n_read;
+      total_written += n_written;
+    }
+  while (result == G_CONVERTER_CONVERTED);
+
+  g_object_unref (converter);
+
+  if (result != G_CONVERTER_FINISHED || total_written != action->length)
+    {
+      g_free (text);
+      return NULL;
+    }
+
+  return text;
+}
+
+
+
+static guint64
+mousepad_undo_manager_usage (MousepadUndoManager *manager)
+{
+  return manager->arena->len - manager->arena_start
+         + (guint64) manager->actions->len * sizeof (MousepadUndoAction);
+}
+
+
+
+static void
+mousepad_undo_manager_update_state (MousepadUndoManager *manager)
+{
+  guint64  usage;
+  gboolean can_undo, can_redo;
+
+  /* nothing can be undone while recording is suspended */
+  can_undo = manager->not_undoable == 0 && (manager->n_done > 0 || manager->history_file != NULL);
+  can_redo = manager->not_undoable == 0 && manager->n_done < manager->actions->len;
+  usage = mousepad_undo_manager_usage (manager);
+
+  if (can_undo != manager->can_undo)
+    {
+      manager->can_undo = can_undo;
+      gtk_source_undo_manager_can_undo_changed (GTK_SOURCE_UNDO_MANAGER (manager));
+    }
+
+  if (can_redo != manager->can_redo)
+    {
+      manager->can_redo = can_redo;
+      gtk_source_undo_manager_can_redo_changed (GTK_SOURCE_UNDO_MANAGER (manager));
+    }
+
+  if (usage != manager->memory_usage)
+    {
+      manager->memory_usage = usage;
+      g_object_notify_by_pspec (G_OBJECT (manager), undo_manager_props[PROP_MEMORY_USAGE]);
+    }
+}
+
+
+
+static void
+mousepad_undo_manager_compact (MousepadUndoManager *manager)
+{
+  GByteArray *arena;
+  gsize       live;
+  guint       n;
+
+  /* release the space of the evicted texts once it exceeds the space still used */
+  live = manager->arena->len - manager->arena_start;
+  if (manager->arena_start <= live)
+    return;
+
+  arena = g_byte_array_sized_new (live);
+  g_byte_array_append (arena, manager->arena->data + manager->arena_start, live);
+  g_byte_array_free (manager->arena, TRUE);
+
+  for (n = 0; n < manager->actions->len; n++)
+    g_array_index (manager->actions, MousepadUndoAction, n).text_offset -= manager->arena_start;
+
+  manager->arena = arena;
+  manager->arena_start = 0;
+}
+
+
+
+static void
+mousepad_undo_manager_clear (MousepadUndoManager *manager)
+{
+  g_array_set_size (manager->actions, 0);
+  g_byte_array_free (manager->arena, TRUE);
+  manager->arena = g_byte_array_new ();
+  manager->arena_start = 0;
+  manager->n_done = 0;
+  manager->can_merge = FALSE;
+
+  g_free (manager->history_file);
+  manager->history_file = NULL;
+}
+
+
+
+static void
+mousepad_undo_manager_drop_redo (MousepadUndoManager *manager)
+{
+  if (manager->n_done == manager->actions->len)
+    return;
+
+  if (manager->saved > (gint) manager->n_done)
+    manager->saved = -1;
+
+  /* the texts are stored in the order of the actions */
+  g_byte_array_set_size (manager->arena,
+                         g_array_index (manager->actions, MousepadUndoAction,
+                                        manager->n_done).text_offset);
+  g_array_set_size (manager->actions, manager->n_done);
+  manager->can_merge = FALSE;
+
+  mousepad_undo_manager_compact (manager);
+}
+
+
+
+static gboolean
+mousepad_undo_manager_evict_step (MousepadUndoManager *manager)
+{
+  guint n, step;
+
+  /* only redoable actions remain, which are dropped at once */
+  if (manager->n_done == 0)
+    {
+      if (manager->actions->len == 0)
+        return FALSE;
+
+      mousepad_undo_manager_drop_redo (manager);
+
+      return TRUE;
+    }
+
+  /* evict the oldest step */
+  step = g_array_index (manager->actions, MousepadUndoAction, 0).step;
+  for (n = 1; n < manager->n_done; n++)
+    if (g_array_index (manager->actions, MousepadUndoAction, n).step != step)
+      break;
+
+  g_array_remove_range (manager->actions, 0, n);
+  manager->n_done -= n;
+
+  /* the persisted history doesn't precede the remaining actions anymore */
+  g_free (manager->history_file);
+  manager->history_file = NULL;
+  manager->saved = manager->saved >= (gint) n ? manager->saved - (gint) n : -1;
+
+  if (manager->actions->len > 0)
+    manager->arena_start = g_array_index (manager->actions, MousepadUndoAction, 0).text_offset;
+  else
+    {
+      manager->arena_start = manager->arena->len;
+      manager->can_merge = FALSE;
+    }
+
+  mousepad_undo_manager_compact (manager);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_undo_manager_enforce_limits (MousepadUndoManager *manager)
+{
+  MousepadUndoManager *victim, *other;
+  GSList              *lp;
+  guint64              limit, serial;
+
+  /* evict the oldest steps of this history beyond its own limit */
+  limit = (guint64) MOUSEPAD_SETTING_GET_INT (UNDO_MEMORY_LIMIT) * MOUSEPAD_UNDO_MIB;
+  while (mousepad_undo_manager_usage (manager) > limit)
+    if (! mousepad_undo_manager_evict_step (manager))
+      break;
+
+  mousepad_undo_manager_update_state (manager);
+
+  /* then the oldest steps of all histories beyond the global limit */
+  limit = (guint64) MOUSEPAD_SETTING_GET_INT (UNDO_GLOBAL_MEMORY_LIMIT) * MOUSEPAD_UNDO_MIB;
+  while (mousepad_undo_manager_get_total_memory_usage () > limit)
+    {
+      victim = NULL;
+      serial = G_MAXUINT64;
+      for (lp = undo_managers; lp != NULL; lp = lp->next)
+        {
+          other = lp->data;
+          if (other->actions->len > 0
+              && g_array_index (other->actions, MousepadUndoAction, 0).serial < serial)
+            {
+              victim = other;
+              serial = g_array_index (other->actions, MousepadUndoAction, 0).serial;
+            }
+        }
+
+      if (victim == NULL || ! mousepad_undo_manager_evict_step (victim))
+        break;
+
+      mousepad_undo_manager_update_state (victim);
+    }
+}
+
+
+
+static gint
+mousepad_undo_manager_char_class (const gchar *text)
+{
+  gunichar c;
+
+  c = g_utf8_get_char (text);
+  if (c == '\n' || c == '\r')
+    return CLASS_NEWLINE;
+  else if (g_unichar_isspace (c))
+    return CLASS_SPACE;
+
+  return CLASS_WORD;
+}
+
+
+
+static void
+mousepad_undo_manager_record (MousepadUndoManager *manager,
+                              MousepadUndoType     type,
+                              gint                 start,
+                              gint                 end,
+                              const gchar         *text,
+                              gsize                length)
+{
+  MousepadUndoAction  action, *last;
+  gboolean            new_step;
+  gint                char_class = CLASS_NONE;
+
+  /* a new change discards the redoable actions */
+  mousepad_undo_manager_drop_redo (manager);
+
+  /* changes outside of a user action are steps of their own */
+  new_step = manager->user_action == 0 || manager->new_step;
+  manager->new_step = FALSE;
+
+  /* merge contiguous single character insertions, e.g. when typing a word */
+  if (type == MOUSEPAD_UNDO_INSERT && end - start == 1)
+    char_class = mousepad_undo_manager_char_class (text);
+
+  if (new_step && manager->can_merge && char_class == manager->merge_class)
+    {
+      last = &g_array_index (manager->actions, MousepadUndoAction, manager->actions->len - 1);
+      if (last->end == start)
+        {
+          g_byte_array_append (manager->arena, (const guint8 *) text, length);
+          last->end = end;
+          last->length += length;
+          last->stored_length += length;
+
+          /* the following actions of this user action belong to the merged step */
+          manager->step = last->step;
+          mousepad_undo_manager_enforce_limits (manager);
+
+          return;
+        }
+    }
+
+  if (new_step)
+    manager->step++;
+
+  action.serial = ++undo_serial;
+  action.type = type;
+  action.start = start;
+  action.end = end;
+  action.step = manager->step;
+  action.length = length;
+  action.text_offset = manager->arena->len;
+  action.compressed = length >= MOUSEPAD_UNDO_COMPRESSION_THRESHOLD
+                      && mousepad_undo_manager_compress (manager->arena, text, length);
+  if (! action.compressed)
+    g_byte_array_append (manager->arena, (const guint8 *) text, length);
+
+  action.stored_length = manager->arena->len - action.text_offset;
+
+  g_array_append_val (manager->actions, action);
+  manager->n_done++;
+
+  /* only a step made of a single character insertion can be extended */
+  manager->can_merge = new_step && char_class != CLASS_NONE && char_class != CLASS_NEWLINE;
+  manager->merge_class = char_class;
+
+  mousepad_undo_manager_enforce_limits (manager);
+}
+
+
+
+static void
+mousepad_undo_manager_insert_text (GtkTextBuffer       *buffer,
+                                   GtkTextIter         *location,
+                                   gchar               *text,
+                                   gint                 length,
+                                   MousepadUndoManager *manager)
+{
+  gint start;
+
+  if (manager->applying || manager->not_undoable > 0 || length <= 0)
+    return;
+
+  start = gtk_text_iter_get_offset (location);
+  mousepad_undo_manager_record (manager, MOUSEPAD_UNDO_INSERT, start,
+                                start + g_utf8_strlen (text, length), text, length);
+}
+
+
+
+static void
+mousepad_undo_manager_delete_range (GtkTextBuffer       *buffer,
+                                    GtkTextIter         *start,
+                                    GtkTextIter         *end,
+                                    MousepadUndoManager *manager)
+{
+  gchar *text;
+
+  if (manager->applying || manager->not_undoable > 0 || gtk_text_iter_equal (start, end))
+    return;
+
+  text = gtk_text_iter_get_slice (start, end);
+  mousepad_undo_manager_record (manager, MOUSEPAD_UNDO_DELETE, gtk_text_iter_get_offset (start),
+                                gtk_text_iter_get_offset (end), text, strlen (text));
+  g_free (text);
+}
+
+
+
+static void
+mousepad_undo_manager_begin_user_action (MousepadUndoManager *manager)
+{
+  if (manager->applying)
+    return;
+
+  if (manager->user_action++ == 0)
+    manager->new_step = TRUE;
+}
+
+
+
+static void
+mousepad_undo_manager_end_user_action (MousepadUndoManager *manager)
+{
+  if (manager->applying)
+    return;
+
+  if (manager->user_action > 0)
+    manager->user_action--;
+}
+
+
+
+static void
+mousepad_undo_manager_modified_changed (MousepadUndoManager *manager)
+{
+  /* remember the saved state, which no merged insertion must cross */
+  if (! gtk_text_buffer_get_modified (manager->buffer))
+    {
+      manager->saved = manager->n_done;
+      manager->can_merge = FALSE;
+    }
+}
+
+
+
+static void
+mousepad_undo_manager_apply (MousepadUndoManager      *manager,
+                             const MousepadUndoAction *action,
+                             gboolean                  insert)
+{
+  GtkTextIter  start, end;
+  const gchar *text;
+  gchar       *data = NULL;
+
+  gtk_text_buffer_get_iter_at_offset (manager->buffer, &start, action->start);
+
+  if (insert)
+    {
+      if (action->compressed)
+        {
+          text = data = mousepad_undo_manager_decompress (manager, action);
+          if (G_UNLIKELY (data == NULL))
+            {
+              g_critical ("Failed to restore a compressed text from the undo history");
+              return;
+            }
+        }
+      else
+        text = (const gchar *) manager->arena->data + action->text_offset;
+
+      gtk_text_buffer_insert (manager->buffer, &start, text, action->length);
+      g_free (data);
+    }
+  else
+    {
+      gtk_text_buffer_get_iter_at_offset (manager->buffer, &end, action->end);
+      gtk_text_buffer_delete (manager->buffer, &start, &end);
+    }
+
+  gtk_text_buffer_place_cursor (manager->buffer, &start);
+}
+
+
+
+static void
+mousepad_undo_manager_applied (MousepadUndoManager *manager)
+{
+  /* the buffer is unmodified again when going back to the saved state */
+  manager->can_merge = FALSE;
+  gtk_text_buffer_set_modified (manager->buffer, manager->saved != (gint) manager->n_done);
+
+  mousepad_undo_manager_update_state (manager);
+}
+
+
+
+static gchar *
+mousepad_undo_manager_get_history_filename (MousepadUndoManager *manager)
+{
+  MousepadHash  hash;
+  gchar        *uri, *basename, *filename;
+
+  if (! mousepad_file_location_is_set (manager->file))
+    return NULL;
+
+  /* histories are named after a hash of the file uri */
+  uri = mousepad_file_get_uri (manager->file);
+  mousepad_hash_init (&hash);
+  mousepad_hash_update (&hash, uri, strlen (uri));
+  basename = g_strdup_printf ("%016" G_GINT64_MODIFIER "x", mousepad_hash_digest (&hash));
+  filename = g_build_filename (g_get_user_cache_dir (), MOUSEPAD_UNDO_RELPATH, basename, NULL);
+
+  g_free (uri);
+  g_free (basename);
+
+  return filename;
+}
+
+
+
+static void
+mousepad_undo_manager_lookup_history (MousepadUndoManager *manager)
+{
+  gchar *filename;
+
+  /* a persisted history applies to the file contents as they were just loaded */
+  if (! MOUSEPAD_SETTING_GET_BOOLEAN (PERSIST_UNDO_HISTORY)
+      || ! mousepad_file_get_digest (manager->file, &manager->history_digest, &manager->history_size)
+      || (filename = mousepad_undo_manager_get_history_filename (manager)) == NULL)
+    return;
+
+  /* it is only read and checked when needed */
+  if (g_file_test (filename, G_FILE_TEST_IS_REGULAR))
+    {
+      manager->history_file = filename;
+      manager->history_chars = gtk_text_buffer_get_char_count (manager->buffer);
+    }
+  else
+    g_free (filename);
+}
+
+
+
+static void
+mousepad_undo_manager_put (GByteArray *array,
+                           guint64     number,
+                           guint       size)
+{
+  guint8 bytes[8];
+  guint  n;
+
+  for (n = 0; n < size; n++)
+    bytes[n] = number >> (8 * n);
+
+  g_byte_array_append (array, bytes, size);
+}
+
+
+
+static guint64
+mousepad_undo_manager_get (const guint8 **p,
+                           guint          size)
+{
+  guint64 number = 0;
+  guint   n;
+
+  for (n = 0; n < size; n++)
+    number |= (guint64) (*p)[n] << (8 * n);
+
+  *p += size;
+
+  return number;
+}
+
+
+
+/* check the integrity of a persisted history and that it applies to the given file
+ * contents, returns the position of its first action or NULL if it is obsolete or
+ * corrupted, its number of actions and of steps, these being numbered from zero */
+static const guint8 *
+mousepad_undo_manager_check_history (const guint8 *p,
+                                     gsize         length,
+                                     guint64       digest,
+                                     goffset       size,
+                                     gint          chars,
+                                     guint64      *n_actions,
+                                     guint        *n_steps)
+{
+  MousepadHash  hash;
+  const guint8 *end, *checksum, *actions;
+  guint64       n, stored_length;
+  guint         step = 0;
+
+  if (length < MOUSEPAD_UNDO_HEADER_LEN + 8
+      || memcmp (p, MOUSEPAD_UNDO_MAGIC, MOUSEPAD_UNDO_MAGIC_LEN) != 0)
+    return NULL;
+
+  /* check the integrity of the whole history first */
+  checksum = end = p + length - 8;
+  mousepad_hash_init (&hash);
+  mousepad_hash_update (&hash, p, length - 8);
+  if (mousepad_undo_manager_get (&checksum, 8) != mousepad_hash_digest (&hash))
+    return NULL;
+
+  /* then that it applies to the file contents */
+  p += MOUSEPAD_UNDO_MAGIC_LEN;
+  if (mousepad_undo_manager_get (&p, 8) != digest
+      || mousepad_undo_manager_get (&p, 8) != (guint64) size
+      || mousepad_undo_manager_get (&p, 8) != (guint64) chars)
+    return NULL;
+
+  *n_actions = mousepad_undo_manager_get (&p, 8);
+  for (n = 0, actions = p; n < *n_actions; n++)
+    {
+      if ((gsize) (end - p) < MOUSEPAD_UNDO_ACTION_LEN)
+        return NULL;
+
+      p += 1;
+      step = mousepad_undo_manager_get (&p, 4);
+      p += 2 * 4;
+      stored_length = mousepad_undo_manager_get (&p, 8);
+      p += 8;
+
+      if ((guint64) (end - p) < stored_length)
+        return NULL;
+
+      p += stored_length;
+    }
+
+  *n_steps = *n_actions > 0 ? step + 1 : 0;
+
+  return p == end ? actions : NULL;
+}
+
+
+
+static gboolean
+mousepad_undo_manager_read_history (MousepadUndoManager *manager,
+                                    const guint8        *p,
+                                    gsize                length,
+                                    GArray              *actions,
+                                    GByteArray          *arena)
+{
+  MousepadUndoAction action;
+  guint64            n_actions, n;
+  guint8             flags;
+  guint              n_steps;
+
+  p = mousepad_undo_manager_check_history (p, length, manager->history_digest, manager->history_size,
+                                           manager->history_chars, &n_actions, &n_steps);
+  if (p == NULL)
+    return FALSE;
+
+  for (n = 0; n < n_actions; n++)
+    {
+      flags = mousepad_undo_manager_get (&p, 1);
+      action.type = flags & 1;
+      action.compressed = (flags >> 1) & 1;
+      action.step = mousepad_undo_manager_get (&p, 4);
+      action.start = mousepad_undo_manager_get (&p, 4);
+      action.end = mousepad_undo_manager_get (&p, 4);
+      action.stored_length = mousepad_undo_manager_get (&p, 8);
+      action.length = mousepad_undo_manager_get (&p, 8);
+
+      action.serial = ++undo_serial;
+      action.text_offset = arena->len;
+      g_byte_array_append (arena, p, action.stored_length);
+      p += action.stored_length;
+
+      g_array_append_val (actions, action);
+    }
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_undo_manager_restore (MousepadUndoManager *manager)
+{
+  MousepadUndoAction *action;
+  GMappedFile        *mapped;
+  GByteArray         *arena;
+  GArray             *actions;
+  GError             *error = NULL;
+  gchar              *filename;
+  gsize               live;
+  guint               n, n_restored, step;
+  gboolean            succeed = FALSE;
+
+  if (manager->history_file == NULL)
+    return;
+
+  filename = manager->history_file;
+  manager->history_file = NULL;
+
+  mapped = g_mapped_file_new (filename, FALSE, &error);
+  if (mapped == NULL)
+    {
+      g_warning ("Failed to read undo history '%s': %s", filename, error->message);
+      g_error_free (error);
+      g_free (filename);
+
+      return;
+    }
+
+  actions = g_array_new (FALSE, FALSE, sizeof (MousepadUndoAction));
+  arena = g_byte_array_new ();
+  succeed = mousepad_undo_manager_read_history (manager,
+                                                (const guint8 *) g_mapped_file_get_contents (mapped),
+                                                g_mapped_file_get_length (mapped), actions, arena);
+  g_mapped_file_unref (mapped);
+
+  /* the history is obsolete or corrupted */
+  if (! succeed)
+    {
+      g_unlink (filename);
+      g_free (filename);
+      g_array_free (actions, TRUE);
+      g_byte_array_free (arena, TRUE);
+
+      return;
+    }
+
+  g_free (filename);
+
+  /* renumber the restored steps after the current ones */
+  n_restored = actions->len;
+  for (n = 0, step = 0; n < n_restored; n++)
+    {
+      action = &g_array_index (actions, MousepadUndoAction, n);
+      step = MAX (step, action->step);
+      action->step += manager->step + 1;
+    }
+
+  manager->step += step + 2;
+
+  /* the restored actions precede the current ones */
+  live = manager->arena->len - manager->arena_start;
+  for (n = 0; n < manager->actions->len; n++)
+    {
+      action = &g_array_index (manager->actions, MousepadUndoAction, n);
+      action->text_offset = action->text_offset - manager->arena_start + arena->len;
+    }
+
+  g_byte_array_append (arena, manager->arena->data + manager->arena_start, live);
+  g_array_append_vals (actions, manager->actions->data, manager->actions->len);
+  g_byte_array_free (manager->arena, TRUE);
+  g_array_free (manager->actions, TRUE);
+
+  manager->arena = arena;
+  manager->arena_start = 0;
+  manager->actions = actions;
+  manager->n_done += n_restored;
+  if (manager->saved >= 0)
+    manager->saved += n_restored;
+
+  mousepad_undo_manager_enforce_limits (manager);
+}
+
+
+
+static gboolean
+mousepad_undo_manager_can_undo (GtkSourceUndoManager *undo_manager)
+{
+  return MOUSEPAD_UNDO_MANAGER (undo_manager)->can_undo;
+}
+
+
+
+static gboolean
+mousepad_undo_manager_can_redo (GtkSourceUndoManager *undo_manager)
+{
+  return MOUSEPAD_UNDO_MANAGER (undo_manager)->can_redo;
+}
+
+
+
+static void
+mousepad_undo_manager_undo (GtkSourceUndoManager *undo_manager)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (undo_manager);
+  MousepadUndoAction  *action;
+  guint                step;
+
+  g_return_if_fail (manager->buffer != NULL);
+  g_return_if_fail (manager->can_undo);
+
+  /* read the persisted history once the current one is exhausted */
+  if (manager->n_done == 0)
+    {
+      mousepad_undo_manager_restore (manager);
+      if (manager->n_done == 0)
+        {
+          mousepad_undo_manager_update_state (manager);
+          return;
+        }
+    }
+
+  manager->applying = TRUE;
+  gtk_text_buffer_begin_user_action (manager->buffer);
+
+  step = g_array_index (manager->actions, MousepadUndoAction, manager->n_done - 1).step;
+  do
+    {
+      action = &g_array_index (manager->actions, MousepadUndoAction, --manager->n_done);
+      mousepad_undo_manager_apply (manager, action, action->type == MOUSEPAD_UNDO_DELETE);
+    }
+  while (manager->n_done > 0
+         && g_array_index (manager->actions, MousepadUndoAction, manager->n_done - 1).step == step);
+
+  gtk_text_buffer_end_user_action (manager->buffer);
+  manager->applying = FALSE;
+
+  mousepad_undo_manager_applied (manager);
+}
+
+
+
+static void
+mousepad_undo_manager_redo (GtkSourceUndoManager *undo_manager)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (undo_manager);
+  MousepadUndoAction  *action;
+  guint                step;
+
+  g_return_if_fail (manager->buffer != NULL);
+  g_return_if_fail (manager->can_redo);
+
+  manager->applying = TRUE;
+  gtk_text_buffer_begin_user_action (manager->buffer);
+
+  step = g_array_index (manager->actions, MousepadUndoAction, manager->n_done).step;
+  do
+    {
+      action = &g_array_index (manager->actions, MousepadUndoAction, manager->n_done++);
+      mousepad_undo_manager_apply (manager, action, action->type == MOUSEPAD_UNDO_INSERT);
+    }
+  while (manager->n_done < manager->actions->len
+         && g_array_index (manager->actions, MousepadUndoAction, manager->n_done).step == step);
+
+  gtk_text_buffer_end_user_action (manager->buffer);
+  manager->applying = FALSE;
+
+  mousepad_undo_manager_applied (manager);
+}
+
+
+
+static void
+mousepad_undo_manager_begin_not_undoable (GtkSourceUndoManager *undo_manager)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (undo_manager);
+
+  manager->not_undoable++;
+  mousepad_undo_manager_update_state (manager);
+}
+
+
+
+static void
+mousepad_undo_manager_end_not_undoable (GtkSourceUndoManager *undo_manager)
+{
+  MousepadUndoManager *manager = MOUSEPAD_UNDO_MANAGER (undo_manager);
+
+  g_return_if_fail (manager->not_undoable > 0);
+
+  /* the history doesn't match the buffer contents anymore */
+  if (--manager->not_undoable == 0)
+    {
+      mousepad_undo_manager_clear (manager);
+      manager->saved = manager->buffer != NULL && gtk_text_buffer_get_modified (manager->buffer)
+                       ? -1 : 0;
+
+      /* the file may have been loaded, with a history from a previous session */
+      if (manager->saved == 0)
+        mousepad_undo_manager_lookup_history (manager);
+    }
+
+  mousepad_undo_manager_update_state (manager);
+}
+
+
+
+MousepadUndoManager *
+mousepad_undo_manager_new (GtkTextBuffer *buffer,
+                           MousepadFile  *file)
+{
+  MousepadUndoManager *manager;
+
+  g_return_val_if_fail (GTK_IS_TEXT_BUFFER (buffer), NULL);
+  g_return_val_if_fail (MOUSEPAD_IS_FILE (file), NULL);
+
+  manager = g_object_new (MOUSEPAD_TYPE_UNDO_MANAGER, NULL);
+  manager->file = g_object_ref (file);
+  manager->buffer = buffer;
+  g_object_add_weak_pointer (G_OBJECT (buffer), (gpointer *) &manager->buffer);
+
+  /* record the changes before they are made, to know the deleted texts */
+  g_signal_connect (buffer, "insert-text",
+                    G_CALLBACK (mousepad_undo_manager_insert_text), manager);
+  g_signal_connect (buffer, "delete-range",
+                    G_CALLBACK (mousepad_undo_manager_delete_range), manager);
+  g_signal_connect_swapped (buffer, "begin-user-action",
+                            G_CALLBACK (mousepad_undo_manager_begin_user_action), manager);
+  g_signal_connect_swapped (buffer, "end-user-action",
+                            G_CALLBACK (mousepad_undo_manager_end_user_action), manager);
+  g_signal_connect_swapped (buffer, "modified-changed",
+                            G_CALLBACK (mousepad_undo_manager_modified_changed), manager);
+
+  return manager;
+}
+
+
+
+/* append text at the end of the buffer without recording it: the history remains valid,
+ * all the changes it records preceding the appended text */
+void
+mousepad_undo_manager_append (MousepadUndoManager *manager,
+                              const gchar         *text,
+                              gsize                length)
+{
+  GtkTextIter iter;
+
+  g_return_if_fail (MOUSEPAD_IS_UNDO_MANAGER (manager));
+  g_return_if_fail (manager->buffer != NULL);
+
+  manager->applying = TRUE;
+  gtk_text_buffer_get_end_iter (manager->buffer, &iter);
+  gtk_text_buffer_insert (manager->buffer, &iter, text, length);
+  manager->applying = FALSE;
+
+  /* a character typed at the end must not be merged with a previous one */
+  manager->can_merge = FALSE;
+}
+
+
+
+static void
+mousepad_undo_manager_put_action (GByteArray               *array,
+                                  const MousepadUndoAction *action,
+                                  guint                     step,
+                                  const guint8             *text)
+{
+  mousepad_undo_manager_put (array, action->type | (action->compressed << 1), 1);
+  mousepad_undo_manager_put (array, step, 4);
+  mousepad_undo_manager_put (array, action->start, 4);
+  mousepad_undo_manager_put (array, action->end, 4);
+  mousepad_undo_manager_put (array, action->stored_length, 8);
+  mousepad_undo_manager_put (array, action->length, 8);
+  g_byte_array_append (array, text, action->stored_length);
+}
+
+
+
+static void
+mousepad_undo_manager_write (MousepadUndoJob *job)
+{
+  MousepadUndoAction *action;
+  MousepadHash        hash;
+  GByteArray         *array;
+  GError             *error = NULL;
+  const guint8       *old_actions = NULL, *old_end = NULL;
+  gchar              *contents = NULL, *dirname;
+  gsize               length, new_length = 0;
+  guint64             n_old = 0;
+  guint               n, step, n_steps = 0;
+
+  /* the persisted history precedes the new actions, unless it is obsolete */
+  if (job->history_file != NULL && g_file_get_contents (job->history_file, &contents, &length, NULL))
+    {
+      old_actions = mousepad_undo_manager_check_history ((const guint8 *) contents, length,
+                                                         job->history_digest, job->history_size,
+                                                         job->history_chars, &n_old, &n_steps);
+      old_end = (const guint8 *) contents + length - 8;
+    }
+
+  /* it is dropped if the whole would exceed the memory limit of a document */
+  for (n = 0; n < job->actions->len; n++)
+    new_length += g_array_index (job->actions, MousepadUndoAction, n).stored_length
+                  + MOUSEPAD_UNDO_ACTION_LEN;
+
+  if (old_actions == NULL || (guint64) (old_end - old_actions) + new_length > job->limit)
+    {
+      old_actions = NULL;
+      n_old = 0;
+      n_steps = 0;
+    }
+
+  array = g_byte_array_new ();
+  g_byte_array_append (array, (const guint8 *) MOUSEPAD_UNDO_MAGIC, MOUSEPAD_UNDO_MAGIC_LEN);
+  mousepad_undo_manager_put (array, job->digest, 8);
+  mousepad_undo_manager_put (array, job->size, 8);
+  mousepad_undo_manager_put (array, job->chars, 8);
+  mousepad_undo_manager_put (array, n_old + job->actions->len, 8);
+
+  if (old_actions != NULL)
+    g_byte_array_append (array, old_actions, old_end - old_actions);
+
+  g_free (contents);
+
+  /* then the done actions, their steps following the persisted ones */
+  for (n = 0, step = n_steps; n < job->actions->len; n++)
+    {
+      action = &g_array_index (job->actions, MousepadUndoAction, n);
+      if (n > 0 && action->step != (action - 1)->step)
+        step++;
+
+      mousepad_undo_manager_put_action (array, action, step, job->arena->data + action->text_offset);
+    }
+
+  mousepad_hash_init (&hash);
+  mousepad_hash_update (&hash, array->data, array->len);
+  mousepad_undo_manager_put (array, mousepad_hash_digest (&hash), 8);
+
+  dirname = g_path_get_dirname (job->filename);
+  if (g_mkdir_with_parents (dirname, 0700) == -1
+      || ! g_file_set_contents (job->filename, (const gchar *) array->data, array->len, &error))
+    {
+      g_warning ("Failed to write undo history '%s': %s", job->filename,
+                 error != NULL ? error->message : g_strerror (errno));
+      g_clear_error (&error);
+    }
+
+  g_free (dirname);
+  g_byte_array_free (array, TRUE);
+}
+
+
+
+static gint
+mousepad_undo_manager_compare_entries (gconstpointer a,
+                                       gconstpointer b)
+{
+  const MousepadUndoEntry *entry_a = a, *entry_b = b;
+
+  /* the most recently updated first */
+  return (entry_a->mtime < entry_b->mtime) - (entry_a->mtime > entry_b->mtime);
+}
+
+
+
+/* remove the persisted histories which expired, then the least recently updated ones
+ * beyond the disk limit, or all of them if they are not to be kept */
+static void
+mousepad_undo_manager_cleanup (MousepadUndoJob *job)
+{
+  MousepadUndoEntry  entry;
+  GStatBuf           statbuf;
+  GArray            *entries;
+  GDir              *dir;
+  const gchar       *name;
+  gchar             *dirname;
+  gint64             now;
+  guint64            total = 0;
+  guint              n;
+
+  dirname = g_build_filename (g_get_user_cache_dir (), MOUSEPAD_UNDO_RELPATH, NULL);
+  dir = g_dir_open (dirname, 0, NULL);
+  if (dir == NULL)
+    {
+      g_free (dirname);
+      return;
+    }
+
+  entries = g_array_new (FALSE, FALSE, sizeof (MousepadUndoEntry));
+  while ((name = g_dir_read_name (dir)) != NULL)
+    {
+      entry.filename = g_build_filename (dirname, name, NULL);
+      if (g_stat (entry.filename, &statbuf) == 0 && S_ISREG (statbuf.st_mode))
+        {
+          entry.mtime = (gint64) statbuf.st_mtime * G_USEC_PER_SEC;
+          entry.size = statbuf.st_size;
+          g_array_append_val (entries, entry);
+        }
+      else
+        g_free (entry.filename);
+    }
+
+  g_dir_close (dir);
+  g_free (dirname);
+
+  g_array_sort (entries, mousepad_undo_manager_compare_entries);
+  now = g_get_real_time ();
+  for (n = 0; n < entries->len; n++)
+    {
+      entry = g_array_index (entries, MousepadUndoEntry, n);
+      total += entry.size;
+      if (job->remove_all || now - entry.mtime > job->max_age || total > job->disk_limit)
+        g_unlink (entry.filename);
+
+      g_free (entry.filename);
+    }
+
+  g_array_free (entries, TRUE);
+}
+
+
+
+static void
+mousepad_undo_manager_job_run (gpointer data,
+                               gpointer user_data)
+{
+  MousepadUndoJob *job = data;
+
+  if (job->filename != NULL)
+    mousepad_undo_manager_write (job);
+  else
+    mousepad_undo_manager_cleanup (job);
+
+  if (job->actions != NULL)
+    g_array_free (job->actions, TRUE);
+
+  if (job->arena != NULL)
+    g_byte_array_free (job->arena, TRUE);
+
+  g_free (job->history_file);
+  g_free (job->filename);
+  g_slice_free (MousepadUndoJob, job);
+}
+
+
+
+/* queue a job for the persistence thread, taking ownership of it */
+static void
+mousepad_undo_manager_push (MousepadUndoJob *job)
+{
+  if (undo_pool != NULL)
+    g_thread_pool_push (undo_pool, job, NULL);
+  else
+    mousepad_undo_manager_job_run (job, NULL);
+}
+
+
+
+/* start the persistence thread, cleaning up the histories of the previous sessions */
+void
+mousepad_undo_manager_history_init (void)
+{
+  MousepadUndoJob *job;
+
+  if (undo_pool == NULL)
+    undo_pool = g_thread_pool_new (mousepad_undo_manager_job_run, NULL, 1, FALSE, NULL);
+
+  job = g_slice_new0 (MousepadUndoJob);
+  job->remove_all = ! MOUSEPAD_SETTING_GET_BOOLEAN (PERSIST_UNDO_HISTORY);
+  job->max_age = MOUSEPAD_SETTING_GET_INT (UNDO_HISTORY_MAX_AGE) * MOUSEPAD_UNDO_DAY;
+  job->disk_limit = (guint64) MOUSEPAD_SETTING_GET_INT (UNDO_HISTORY_DISK_LIMIT) * MOUSEPAD_UNDO_MIB;
+  mousepad_undo_manager_push (job);
+}
+
+
+
+void
+mousepad_undo_manager_history_finalize (void)
+{
+  /* wait for the pending jobs, so that no history is lost */
+  if (undo_pool != NULL)
+    {
+      g_thread_pool_free (undo_pool, FALSE, TRUE);
+      undo_pool = NULL;
+    }
+}
+
+
+
+/* persist the history of an unmodified buffer, to restore it when the file is reopened:
+ * it is written in a thread, and handed over to it, the manager starting a new one */
+void
+mousepad_undo_manager_persist (MousepadUndoManager *manager)
+{
+  MousepadUndoJob *job;
+  gchar           *filename;
+  guint64          digest;
+  goffset          size;
+
+  g_return_if_fail (MOUSEPAD_IS_UNDO_MANAGER (manager));
+
+  if (! MOUSEPAD_SETTING_GET_BOOLEAN (PERSIST_UNDO_HISTORY)
+      || manager->buffer == NULL || manager->not_undoable > 0 || manager->n_done == 0
+      || gtk_text_buffer_get_modified (manager->buffer)
+      || ! mousepad_file_get_digest (manager->file, &digest, &size)
+      || (filename = mousepad_undo_manager_get_history_filename (manager)) == NULL)
+    return;
+
+  job = g_slice_new0 (MousepadUndoJob);
+  job->filename = filename;
+  job->digest = digest;
+  job->size = size;
+  job->chars = gtk_text_buffer_get_char_count (manager->buffer);
+  job->limit = (guint64) MOUSEPAD_SETTING_GET_INT (UNDO_MEMORY_LIMIT) * MOUSEPAD_UNDO_MIB;
+
+  /* the persisted history must be part of the new one */
+  job->history_file = manager->history_file;
+  job->history_digest = manager->history_digest;
+  job->history_size = manager->history_size;
+  job->history_chars = manager->history_chars;
+  manager->history_file = NULL;
+
+  /* only the done actions are persisted */
+  mousepad_undo_manager_drop_redo (manager);
+  job->actions = manager->actions;
+  job->arena = manager->arena;
+  manager->actions = g_array_new (FALSE, FALSE, sizeof (MousepadUndoAction));
+  manager->arena = g_byte_array_new ();
+  manager->arena_start = 0;
+  manager->n_done = 0;
+  manager->saved = -1;
+  manager->can_merge = FALSE;
+
+  mousepad_undo_manager_update_state (manager);
+  mousepad_undo_manager_push (job);
+}
+
+
+
+guint64
+mousepad_undo_manager_get_memory_usage (MousepadUndoManager *manager)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_UNDO_MANAGER (manager), 0);
+
+  return mousepad_undo_manager_usage (manager);
+}
+
+
+
+guint64
+mousepad_undo_manager_get_total_memory_usage (void)
+{
+  GSList  *lp;
+  guint64  usage = 0;
+
+  for (lp = undo_managers; lp != NULL; lp = lp->next)
+    usage += mousepad_undo_manager_usage (lp->data);
+
+  return usage;
+}
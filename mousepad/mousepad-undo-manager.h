@@ -0,0 +1,55 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_UNDO_MANAGER_H__
+#define __MOUSEPAD_UNDO_MANAGER_H__
+
+G_BEGIN_DECLS
+
+#include <mousepad/mousepad-file.h>
+
+typedef struct _MousepadUndoManagerClass MousepadUndoManagerClass;
+typedef struct _MousepadUndoManager      MousepadUndoManager;
+
+#define MOUSEPAD_TYPE_UNDO_MANAGER            (mousepad_undo_manager_get_type ())
+#define MOUSEPAD_UNDO_MANAGER(obj)            (G_TYPE_CHECK_INSTANCE_CAST ((obj), MOUSEPAD_TYPE_UNDO_MANAGER, MousepadUndoManager))
+#define MOUSEPAD_UNDO_MANAGER_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST ((klass), MOUSEPAD_TYPE_UNDO_MANAGER, MousepadUndoManagerClass))
+#define MOUSEPAD_IS_UNDO_MANAGER(obj)         (G_TYPE_CHECK_INSTANCE_TYPE ((obj), MOUSEPAD_TYPE_UNDO_MANAGER))
+#define MOUSEPAD_IS_UNDO_MANAGER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE ((klass), MOUSEPAD_TYPE_UNDO_MANAGER))
+#define MOUSEPAD_UNDO_MANAGER_GET_CLASS(obj)  (G_TYPE_INSTANCE_GET_CLASS ((obj), MOUSEPAD_TYPE_UNDO_MANAGER, MousepadUndoManagerClass))
+
+GType                mousepad_undo_manager_get_type               (void) G_GNUC_CONST;
+
+MousepadUndoManager *mousepad_undo_manager_new                    (GtkTextBuffer       *buffer,
+                                                                   MousepadFile        *file);
+
+void                 mousepad_undo_manager_history_init           (void);
+
+void                 mousepad_undo_manager_history_finalize       (void);
+
+void                 mousepad_undo_manager_persist                (MousepadUndoManager *manager);
+
+void                 mousepad_undo_manager_append                 (MousepadUndoManager *manager,
+                                                                   const gchar         *text,
+                                                                   gsize                length);
+
+guint64              mousepad_undo_manager_get_memory_usage       (MousepadUndoManager *manager);
+
+guint64              mousepad_undo_manager_get_total_memory_usage (void);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_UNDO_MANAGER_H__ */
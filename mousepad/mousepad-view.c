@@ -47,6 +47,7 @@ static void      mousepad_view_transpose_lines               (GtkTextBuffer
                                                               GtkTextIter         *end_iter);
 static void      mousepad_view_transpose_words               (GtkTextBuffer       *buffer,
                                                               GtkTextIter         *iter);
+static void      mousepad_view_update_draw_spaces            (MousepadView        *view);
 static void      mousepad_view_set_font                      (MousepadView        *view,
                                                               const gchar         *font);
 static void      mousepad_view_set_show_whitespace           (MousepadView        *view,
@@ -79,6 +80,9 @@ struct _MousepadView
   gboolean                     show_line_endings;
   gchar                       *color_scheme;
   gboolean                     match_braces;
+
+  /* whether the costly features are disabled, whatever their settings */
+  gboolean                     reduced;
 };
 
 
@@ -178,8 +182,8 @@ mousepad_view_buffer_changed (MousepadView *view,
         }
 
       gtk_source_buffer_set_style_scheme (buffer, scheme);
-      gtk_source_buffer_set_highlight_syntax (buffer, enable_highlight);
-      gtk_source_buffer_set_highlight_matching_brackets (buffer, view->match_braces);
+      gtk_source_buffer_set_highlight_syntax (buffer, enable_highlight && ! view->reduced);
+      gtk_source_buffer_set_highlight_matching_brackets (buffer, view->match_braces && ! view->reduced);
     }
 }
 
@@ -216,6 +220,7 @@ mousepad_view_init (MousepadView *view)
   view->show_line_endings = FALSE;
   view->color_scheme = g_strdup ("none");
   view->match_braces = FALSE;
+  view->reduced = FALSE;
 
   /* make sure any buffers set on the view get the color scheme applied to them */
   g_signal_connect (view, "notify::buffer",
@@ -1479,6 +1484,26 @@ mousepad_view_get_selection_length (MousepadView *view)
 
 
 
+/* disable syntax highlighting, brace matching and whitespace drawing whatever their
+ * settings, e.g. for a large document, or restore them */
+void
+mousepad_view_set_reduced (MousepadView *view,
+                           gboolean      reduced)
+{
+  g_return_if_fail (MOUSEPAD_IS_VIEW (view));
+
+  if (view->reduced == reduced)
+    return;
+
+  view->reduced = reduced;
+
+  /* update the buffer if there is one, and the space drawer */
+  mousepad_view_buffer_changed (view, NULL, NULL);
+  mousepad_view_update_draw_spaces (view);
+}
+
+
+
 static void
 mousepad_view_set_font (MousepadView *view,
                         const gchar  *font)
@@ -1520,7 +1545,7 @@ mousepad_view_update_draw_spaces (MousepadView *view)
 
   drawer = gtk_source_view_get_space_drawer (GTK_SOURCE_VIEW (view));
 
-  if (view->show_whitespace)
+  if (view->show_whitespace && ! view->reduced)
     {
       type_flags |= GTK_SOURCE_SPACE_TYPE_SPACE | GTK_SOURCE_SPACE_TYPE_TAB
                     | GTK_SOURCE_SPACE_TYPE_NBSP;
@@ -1536,7 +1561,7 @@ mousepad_view_update_draw_spaces (MousepadView *view)
     gtk_source_space_drawer_set_types_for_locations (drawer, GTK_SOURCE_SPACE_LOCATION_ALL,
                                                      GTK_SOURCE_SPACE_TYPE_NONE);
 
-  if (view->show_line_endings)
+  if (view->show_line_endings && ! view->reduced)
     {
       enable_matrix = TRUE;
       if (view->space_location_flags & GTK_SOURCE_SPACE_LOCATION_TRAILING)
@@ -87,6 +87,9 @@ void            mousepad_view_indent                    (MousepadView      *view
 
 gint            mousepad_view_get_selection_length      (MousepadView      *view);
 
+void            mousepad_view_set_reduced               (MousepadView      *view,
+                                                         gboolean           reduced);
+
 G_END_DECLS
 
 #endif /* !__MOUSEPAD_VIEW_H__ */
@@ -0,0 +1,755 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <mousepad/mousepad-private.h>
+#include <mousepad/mousepad-watch.h>
+
+
+
+/* the delay during which the events received for a file are merged, in ms */
+#define MOUSEPAD_WATCH_DELAY 250
+
+/* files which can't be monitored are polled: at most BATCH files are queried every TICK,
+ * each file being polled again after an interval doubling from MIN to MAX while it doesn't
+ * change, which bounds the query rate whatever the number of files */
+#define MOUSEPAD_WATCH_POLL_TICK         500
+#define MOUSEPAD_WATCH_POLL_BATCH        16
+#define MOUSEPAD_WATCH_POLL_MIN_INTERVAL 1000
+#define MOUSEPAD_WATCH_POLL_MAX_INTERVAL 32000
+
+
+
+typedef struct
+{
+  GFile        *location;
+  GFileMonitor *monitor;
+
+  /* the watchers of the file and whether it is waiting to be queried */
+  GSList       *watchers;
+  gboolean      pending;
+
+  /* polling, if the file can't be monitored: the last known file info, the current
+   * interval and the time of the next poll, in ms */
+  gboolean      polled;
+  GFileInfo    *fileinfo;
+  guint         interval;
+  gint64        next_poll;
+}
+MousepadWatchEntry;
+
+typedef struct
+{
+  guint                id;
+  MousepadWatchEntry  *entry;
+  MousepadWatchFunc    func;
+  gpointer             user_data;
+
+  /* the events received since the last notification */
+  MousepadWatchEvents  events;
+  guint                blocked;
+}
+MousepadWatcher;
+
+typedef struct
+{
+  GFile     *location;
+  GFileInfo *fileinfo;
+}
+MousepadWatchQuery;
+
+
+
+static void     mousepad_watch_schedule (void);
+static void     mousepad_watch_dispatch (GFile     *location,
+                                         GFileInfo *fileinfo);
+
+
+
+/* the watched files, the watchers by id, the locations waiting to be queried
+ * and the batch of queries being run, if any */
+static GHashTable   *watch_entries = NULL;
+static GHashTable   *watch_watchers = NULL;
+static GSList       *watch_pending = NULL;
+static GCancellable *watch_cancellable = NULL;
+static guint         watch_timeout_id = 0;
+static guint         watch_next_id = 1;
+
+/* the number of polled files, the poll timer and the batch of polls being run, if any */
+static guint         watch_n_polled = 0;
+static guint         watch_poll_timeout_id = 0;
+static GCancellable *watch_poll_cancellable = NULL;
+
+/* the queries run to set up the monitoring of the new files */
+static GCancellable *watch_setup_cancellable = NULL;
+
+
+
+static void
+mousepad_watch_entry_free (gpointer data)
+{
+  MousepadWatchEntry *entry = data;
+
+  if (entry->monitor != NULL)
+    {
+      g_signal_handlers_disconnect_matched (entry->monitor, G_SIGNAL_MATCH_DATA,
+                                            0, 0, NULL, NULL, entry);
+      g_file_monitor_cancel (entry->monitor);
+      g_object_unref (entry->monitor);
+    }
+  else if (entry->polled)
+    watch_n_polled--;
+
+  if (entry->fileinfo != NULL)
+    g_object_unref (entry->fileinfo);
+
+  g_object_unref (entry->location);
+  g_slist_free (entry->watchers);
+  g_slice_free (MousepadWatchEntry, entry);
+}
+
+
+
+static void
+mousepad_watcher_free (gpointer data)
+{
+  g_slice_free (MousepadWatcher, data);
+}
+
+
+
+static void
+mousepad_watch_query_free (gpointer data)
+{
+  MousepadWatchQuery *query = data;
+
+  g_object_unref (query->location);
+  if (query->fileinfo != NULL)
+    g_object_unref (query->fileinfo);
+
+  g_slice_free (MousepadWatchQuery, query);
+}
+
+
+
+/* merge @events with those not yet notified to the watchers of @entry,
+ * returns whether a watcher is concerned */
+static gboolean
+mousepad_watch_merge (MousepadWatchEntry  *entry,
+                      MousepadWatchEvents  events)
+{
+  MousepadWatcher *watcher;
+  GSList          *lp;
+  gboolean         notify = FALSE;
+
+  for (lp = entry->watchers; lp != NULL; lp = lp->next)
+    {
+      watcher = lp->data;
+      if (watcher->blocked == 0)
+        {
+          watcher->events |= events;
+          notify = TRUE;
+        }
+    }
+
+  return notify;
+}
+
+
+
+static void
+mousepad_watch_monitor_changed (GFileMonitor       *monitor,
+                                GFile              *location,
+                                GFile              *other_location,
+                                GFileMonitorEvent   event_type,
+                                MousepadWatchEntry *entry)
+{
+  MousepadWatchEvents events;
+
+  switch (event_type)
+    {
+    case G_FILE_MONITOR_EVENT_CHANGED:
+      events = MOUSEPAD_WATCH_EVENT_CHANGED;
+      break;
+
+    case G_FILE_MONITOR_EVENT_CHANGES_DONE_HINT:
+    case G_FILE_MONITOR_EVENT_CREATED:
+    case G_FILE_MONITOR_EVENT_MOVED_IN:
+      events = MOUSEPAD_WATCH_EVENT_CHANGES_DONE;
+      break;
+
+    /* another file was renamed over this one, e.g. saved atomically by another editor */
+    case G_FILE_MONITOR_EVENT_RENAMED:
+      if (other_location == NULL || ! g_file_equal (other_location, entry->location))
+        return;
+
+      events = MOUSEPAD_WATCH_EVENT_CHANGES_DONE;
+      break;
+
+    case G_FILE_MONITOR_EVENT_ATTRIBUTE_CHANGED:
+      events = MOUSEPAD_WATCH_EVENT_ATTRIBUTES;
+      break;
+
+    default:
+      return;
+    }
+
+  /* queue the file only once */
+  if (mousepad_watch_merge (entry, events) && ! entry->pending)
+    {
+      entry->pending = TRUE;
+      watch_pending = g_slist_prepend (watch_pending, g_object_ref (entry->location));
+      mousepad_watch_schedule ();
+    }
+}
+
+
+
+static void
+mousepad_watch_flush_thread (GTask        *task,
+                             gpointer      source_object,
+                             gpointer      task_data,
+                             GCancellable *cancellable)
+{
+  GPtrArray          *queries = task_data;
+  MousepadWatchQuery *query;
+  guint               n;
+
+  for (n = 0; n < queries->len && ! g_cancellable_is_cancelled (cancellable); n++)
+    {
+      query = g_ptr_array_index (queries, n);
+      query->fileinfo = g_file_query_info (query->location, MOUSEPAD_WATCH_ATTRIBUTES,
+                                           G_FILE_QUERY_INFO_NONE, cancellable, NULL);
+    }
+
+  g_task_return_boolean (task, TRUE);
+}
+
+
+
+/* notify the watchers of @location of their merged events */
+static void
+mousepad_watch_dispatch (GFile     *location,
+                         GFileInfo *fileinfo)
+{
+  MousepadWatchEntry  *entry;
+  MousepadWatcher     *watcher;
+  MousepadWatchEvents  events;
+  GArray              *ids;
+  GSList              *lp;
+  guint                n;
+
+  entry = g_hash_table_lookup (watch_entries, location);
+  if (entry == NULL)
+    return;
+
+  /* notifying a watcher may add or remove others, so only keep their ids */
+  ids = g_array_new (FALSE, FALSE, sizeof (guint));
+  for (lp = entry->watchers; lp != NULL; lp = lp->next)
+    g_array_append_val (ids, ((MousepadWatcher *) lp->data)->id);
+
+  for (n = 0; n < ids->len; n++)
+    {
+      watcher = g_hash_table_lookup (watch_watchers, GUINT_TO_POINTER (g_array_index (ids, guint, n)));
+      if (watcher == NULL || watcher->events == 0)
+        continue;
+
+      /* drop the events received before the watcher was blocked */
+      events = watcher->events;
+      watcher->events = 0;
+      if (watcher->blocked == 0)
+        watcher->func (location, events, fileinfo, watcher->user_data);
+    }
+
+  g_array_free (ids, TRUE);
+}
+
+
+
+static void
+mousepad_watch_flush_ready (GObject      *object,
+                            GAsyncResult *result,
+                            gpointer      data)
+{
+  GPtrArray          *queries = g_task_get_task_data (G_TASK (result));
+  MousepadWatchQuery *query;
+  guint               n;
+
+  /* the service was finalized in the meantime */
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+    return;
+
+  g_clear_object (&watch_cancellable);
+
+  for (n = 0; n < queries->len; n++)
+    {
+      query = g_ptr_array_index (queries, n);
+      mousepad_watch_dispatch (query->location, query->fileinfo);
+    }
+
+  /* handle the events received meanwhile */
+  mousepad_watch_schedule ();
+}
+
+
+
+static gboolean
+mousepad_watch_flush (gpointer data)
+{
+  GPtrArray          *queries;
+  MousepadWatchQuery *query;
+  MousepadWatchEntry *entry;
+  GTask              *task;
+  GSList             *lp;
+
+  watch_timeout_id = 0;
+
+  /* query the pending files which are still watched, in a single batch */
+  queries = g_ptr_array_new_with_free_func (mousepad_watch_query_free);
+  for (lp = watch_pending; lp != NULL; lp = lp->next)
+    {
+      entry = g_hash_table_lookup (watch_entries, lp->data);
+      if (entry == NULL)
+        {
+          g_object_unref (lp->data);
+          continue;
+        }
+
+      entry->pending = FALSE;
+      query = g_slice_new0 (MousepadWatchQuery);
+      query->location = lp->data;
+      g_ptr_array_add (queries, query);
+    }
+
+  g_slist_free (watch_pending);
+  watch_pending = NULL;
+
+  if (queries->len == 0)
+    {
+      g_ptr_array_unref (queries);
+      return FALSE;
+    }
+
+  watch_cancellable = g_cancellable_new ();
+  task = g_task_new (NULL, watch_cancellable, mousepad_watch_flush_ready, NULL);
+  g_task_set_task_data (task, queries, (GDestroyNotify) g_ptr_array_unref);
+  g_task_run_in_thread (task, mousepad_watch_flush_thread);
+  g_object_unref (task);
+
+  return FALSE;
+}
+
+
+
+static void
+mousepad_watch_schedule (void)
+{
+  /* a single batch of queries at a time */
+  if (watch_pending != NULL && watch_timeout_id == 0 && watch_cancellable == NULL)
+    watch_timeout_id = g_timeout_add (MOUSEPAD_WATCH_DELAY, mousepad_watch_flush, NULL);
+}
+
+
+
+/* compare the status of a polled file with the last known one */
+static MousepadWatchEvents
+mousepad_watch_poll_compare (GFileInfo *old_info,
+                             GFileInfo *new_info)
+{
+  MousepadWatchEvents events = 0;
+
+  /* the file appeared or disappeared, it's not a change as long as it's not there */
+  if (old_info == NULL || new_info == NULL)
+    return new_info != NULL ? MOUSEPAD_WATCH_EVENT_CHANGES_DONE : 0;
+
+  if (g_file_info_get_size (old_info) != g_file_info_get_size (new_info)
+      || g_file_info_get_attribute_uint64 (old_info, G_FILE_ATTRIBUTE_TIME_MODIFIED)
+         != g_file_info_get_attribute_uint64 (new_info, G_FILE_ATTRIBUTE_TIME_MODIFIED)
+      || g_file_info_get_attribute_uint32 (old_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC)
+         != g_file_info_get_attribute_uint32 (new_info, G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC))
+    events |= MOUSEPAD_WATCH_EVENT_CHANGES_DONE;
+
+  if (g_file_info_get_attribute_boolean (old_info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE)
+      != g_file_info_get_attribute_boolean (new_info, G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE))
+    events |= MOUSEPAD_WATCH_EVENT_ATTRIBUTES;
+
+  return events;
+}
+
+
+
+static void
+mousepad_watch_poll_ready (GObject      *object,
+                           GAsyncResult *result,
+                           gpointer      data)
+{
+  GPtrArray           *queries = g_task_get_task_data (G_TASK (result));
+  MousepadWatchQuery  *query;
+  MousepadWatchEntry  *entry;
+  MousepadWatchEvents  events;
+  gint64               now;
+  guint                n;
+
+  /* the service was finalized in the meantime */
+  if (g_cancellable_is_cancelled (g_task_get_cancellable (G_TASK (result))))
+    return;
+
+  g_clear_object (&watch_poll_cancellable);
+
+  now = g_get_monotonic_time () / 1000;
+  for (n = 0; n < queries->len; n++)
+    {
+      query = g_ptr_array_index (queries, n);
+      entry = g_hash_table_lookup (watch_entries, query->location);
+      if (entry == NULL || ! entry->polled)
+        continue;
+
+      events = mousepad_watch_poll_compare (entry->fileinfo, query->fileinfo);
+      if (entry->fileinfo != NULL)
+        g_object_unref (entry->fileinfo);
+
+      entry->fileinfo = query->fileinfo != NULL ? g_object_ref (query->fileinfo) : NULL;
+
+      /* poll a changing file more often, a quiet one less and less */
+      if (events != 0)
+        entry->interval = MOUSEPAD_WATCH_POLL_MIN_INTERVAL;
+      else
+        entry->interval = MIN (2 * entry->interval, MOUSEPAD_WATCH_POLL_MAX_INTERVAL);
+
+      entry->next_poll = now + entry->interval;
+
+      if (events != 0 && mousepad_watch_merge (entry, events))
+        mousepad_watch_dispatch (query->location, query->fileinfo);
+    }
+}
+
+
+
+static gint
+mousepad_watch_poll_compare_entries (gconstpointer a,
+                                     gconstpointer b)
+{
+  const MousepadWatchEntry *entry_a = *((MousepadWatchEntry **) a);
+  const MousepadWatchEntry *entry_b = *((MousepadWatchEntry **) b);
+
+  return (entry_a->next_poll > entry_b->next_poll) - (entry_a->next_poll < entry_b->next_poll);
+}
+
+
+
+static gboolean
+mousepad_watch_poll (gpointer data)
+{
+  MousepadWatchEntry *entry;
+  MousepadWatchQuery *query;
+  GHashTableIter      iter;
+  GPtrArray          *due, *queries;
+  GTask              *task;
+  gint64              now;
+  guint               n;
+
+  /* no more files to poll */
+  if (watch_n_polled == 0)
+    {
+      watch_poll_timeout_id = 0;
+      return FALSE;
+    }
+
+  /* the previous batch is still running, e.g. on a slow network */
+  if (watch_poll_cancellable != NULL)
+    return TRUE;
+
+  /* collect the files to poll, the most overdue first */
+  now = g_get_monotonic_time () / 1000;
+  due = g_ptr_array_new ();
+  g_hash_table_iter_init (&iter, watch_entries);
+  while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &entry))
+    if (entry->polled && entry->next_poll <= now)
+      g_ptr_array_add (due, entry);
+
+  if (due->len == 0)
+    {
+      g_ptr_array_free (due, TRUE);
+      return TRUE;
+    }
+
+  g_ptr_array_sort (due, mousepad_watch_poll_compare_entries);
+
+  /* query a bounded batch of them in a thread, reusing the flush worker */
+  queries = g_ptr_array_new_with_free_func (mousepad_watch_query_free);
+  for (n = 0; n < MIN (due->len, MOUSEPAD_WATCH_POLL_BATCH); n++)
+    {
+      entry = g_ptr_array_index (due, n);
+      query = g_slice_new0 (MousepadWatchQuery);
+      query->location = g_object_ref (entry->location);
+      g_ptr_array_add (queries, query);
+    }
+
+  g_ptr_array_free (due, TRUE);
+
+  watch_poll_cancellable = g_cancellable_new ();
+  task = g_task_new (NULL, watch_poll_cancellable, mousepad_watch_poll_ready, NULL);
+  g_task_set_task_data (task, queries, (GDestroyNotify) g_ptr_array_unref);
+  g_task_run_in_thread (task, mousepad_watch_flush_thread);
+  g_object_unref (task);
+
+  return TRUE;
+}
+
+
+
+static void
+mousepad_watch_setup_poll (GObject      *object,
+                           GAsyncResult *result,
+                           gpointer      data)
+{
+  MousepadWatchEntry *entry;
+  GFileInfo          *fileinfo;
+  GError             *error = NULL;
+
+  fileinfo = g_file_query_info_finish (G_FILE (object), result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+  else if (error != NULL)
+    g_clear_error (&error);
+
+  /* the file may have been unwatched in the meantime */
+  entry = g_hash_table_lookup (watch_entries, object);
+  if (entry == NULL || entry->monitor != NULL || entry->polled)
+    {
+      if (fileinfo != NULL)
+        g_object_unref (fileinfo);
+
+      return;
+    }
+
+  /* start polling from the current file status */
+  entry->polled = TRUE;
+  entry->fileinfo = fileinfo;
+  entry->interval = MOUSEPAD_WATCH_POLL_MIN_INTERVAL;
+  entry->next_poll = g_get_monotonic_time () / 1000 + entry->interval;
+
+  watch_n_polled++;
+  if (watch_poll_timeout_id == 0)
+    watch_poll_timeout_id = g_timeout_add (MOUSEPAD_WATCH_POLL_TICK, mousepad_watch_poll, NULL);
+}
+
+
+
+static void
+mousepad_watch_setup (GObject      *object,
+                      GAsyncResult *result,
+                      gpointer      data)
+{
+  MousepadWatchEntry *entry;
+  GFile              *location = G_FILE (object);
+  GFileInfo          *fsinfo;
+  GError             *error = NULL;
+  gchar              *uri;
+  gboolean            remote = FALSE;
+
+  fsinfo = g_file_query_filesystem_info_finish (location, result, &error);
+  if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    {
+      g_error_free (error);
+      return;
+    }
+  else if (error != NULL)
+    g_clear_error (&error);
+  else
+    {
+      remote = g_file_info_get_attribute_boolean (fsinfo, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE);
+      g_object_unref (fsinfo);
+    }
+
+  /* the file may have been unwatched in the meantime */
+  entry = g_hash_table_lookup (watch_entries, location);
+  if (entry == NULL || entry->monitor != NULL || entry->polled)
+    return;
+
+  /* changes made from elsewhere to a file on a remote filesystem may not be notified,
+   * e.g. on NFS */
+  if (! remote)
+    {
+      entry->monitor = g_file_monitor_file (location, G_FILE_MONITOR_WATCH_MOVES
+                                            | G_FILE_MONITOR_WATCH_HARD_LINKS, NULL, &error);
+      if (entry->monitor != NULL)
+        {
+          g_signal_connect (entry->monitor, "changed",
+                            G_CALLBACK (mousepad_watch_monitor_changed), entry);
+          return;
+        }
+
+      uri = g_file_get_uri (location);
+      g_message ("Polling file '%s' which can't be monitored: %s", uri, error->message);
+      g_free (uri);
+      g_error_free (error);
+    }
+
+  /* fall back on polling, once the current file status is known */
+  g_file_query_info_async (location, MOUSEPAD_WATCH_ATTRIBUTES, G_FILE_QUERY_INFO_NONE,
+                           G_PRIORITY_DEFAULT, watch_setup_cancellable,
+                           mousepad_watch_setup_poll, NULL);
+}
+
+
+
+void
+mousepad_watch_init (void)
+{
+  if (watch_entries != NULL)
+    return;
+
+  watch_entries = g_hash_table_new_full (g_file_hash, (GEqualFunc) g_file_equal,
+                                         NULL, mousepad_watch_entry_free);
+  watch_watchers = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+                                          NULL, mousepad_watcher_free);
+  watch_setup_cancellable = g_cancellable_new ();
+}
+
+
+
+void
+mousepad_watch_finalize (void)
+{
+  if (watch_entries == NULL)
+    return;
+
+  if (watch_cancellable != NULL)
+    {
+      g_cancellable_cancel (watch_cancellable);
+      g_clear_object (&watch_cancellable);
+    }
+
+  if (watch_poll_cancellable != NULL)
+    {
+      g_cancellable_cancel (watch_poll_cancellable);
+      g_clear_object (&watch_poll_cancellable);
+    }
+
+  g_cancellable_cancel (watch_setup_cancellable);
+  g_clear_object (&watch_setup_cancellable);
+
+  if (watch_timeout_id != 0)
+    {
+      g_source_remove (watch_timeout_id);
+      watch_timeout_id = 0;
+    }
+
+  if (watch_poll_timeout_id != 0)
+    {
+      g_source_remove (watch_poll_timeout_id);
+      watch_poll_timeout_id = 0;
+    }
+
+  g_slist_free_full (watch_pending, g_object_unref);
+  watch_pending = NULL;
+
+  g_hash_table_destroy (watch_watchers);
+  g_hash_table_destroy (watch_entries);
+  watch_watchers = NULL;
+  watch_entries = NULL;
+}
+
+
+
+guint
+mousepad_watch_add (GFile             *location,
+                    MousepadWatchFunc  func,
+                    gpointer           user_data)
+{
+  MousepadWatchEntry *entry;
+  MousepadWatcher    *watcher;
+
+  g_return_val_if_fail (G_IS_FILE (location), 0);
+  g_return_val_if_fail (func != NULL, 0);
+  g_return_val_if_fail (watch_entries != NULL, 0);
+
+  /* share the monitor of the file with its other watchers */
+  entry = g_hash_table_lookup (watch_entries, location);
+  if (entry == NULL)
+    {
+      entry = g_slice_new0 (MousepadWatchEntry);
+      entry->location = g_object_ref (location);
+      g_hash_table_insert (watch_entries, entry->location, entry);
+
+      /* monitor or poll the file depending on its filesystem, which is queried
+       * asynchronously since it may be slow, e.g. for a remote file */
+      g_file_query_filesystem_info_async (location, G_FILE_ATTRIBUTE_FILESYSTEM_REMOTE,
+                                          G_PRIORITY_DEFAULT, watch_setup_cancellable,
+                                          mousepad_watch_setup, NULL);
+    }
+
+  watcher = g_slice_new0 (MousepadWatcher);
+  watcher->id = watch_next_id++;
+  watcher->entry = entry;
+  watcher->func = func;
+  watcher->user_data = user_data;
+
+  entry->watchers = g_slist_prepend (entry->watchers, watcher);
+  g_hash_table_insert (watch_watchers, GUINT_TO_POINTER (watcher->id), watcher);
+
+  return watcher->id;
+}
+
+
+
+void
+mousepad_watch_remove (guint watch_id)
+{
+  MousepadWatchEntry *entry;
+  MousepadWatcher    *watcher;
+
+  /* the service may have been finalized before the watchers */
+  if (watch_watchers == NULL
+      || (watcher = g_hash_table_lookup (watch_watchers, GUINT_TO_POINTER (watch_id))) == NULL)
+    return;
+
+  entry = watcher->entry;
+  entry->watchers = g_slist_remove (entry->watchers, watcher);
+  g_hash_table_remove (watch_watchers, GUINT_TO_POINTER (watch_id));
+
+  /* stop monitoring the file with its last watcher */
+  if (entry->watchers == NULL)
+    g_hash_table_remove (watch_entries, entry->location);
+}
+
+
+
+void
+mousepad_watch_block (guint watch_id)
+{
+  MousepadWatcher *watcher;
+
+  if (watch_watchers != NULL
+      && (watcher = g_hash_table_lookup (watch_watchers, GUINT_TO_POINTER (watch_id))) != NULL)
+    watcher->blocked++;
+}
+
+
+
+void
+mousepad_watch_unblock (guint watch_id)
+{
+  MousepadWatcher *watcher;
+
+  if (watch_watchers != NULL
+      && (watcher = g_hash_table_lookup (watch_watchers, GUINT_TO_POINTER (watch_id))) != NULL
+      && watcher->blocked > 0)
+    watcher->blocked--;
+}
@@ -0,0 +1,59 @@
+/*
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along with
+ * this program; if not, write to the Free Software Foundation, Inc., 59 Temple
+ * Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef __MOUSEPAD_WATCH_H__
+#define __MOUSEPAD_WATCH_H__
+
+G_BEGIN_DECLS
+
+/* the attributes queried for a watched file before notifying its watchers */
+#define MOUSEPAD_WATCH_ATTRIBUTES G_FILE_ATTRIBUTE_STANDARD_SIZE "," \
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED "," \
+                                  G_FILE_ATTRIBUTE_TIME_MODIFIED_USEC "," \
+                                  G_FILE_ATTRIBUTE_ACCESS_CAN_WRITE
+
+typedef enum
+{
+  MOUSEPAD_WATCH_EVENT_CHANGED      = 1 << 0, /* the contents are being changed */
+  MOUSEPAD_WATCH_EVENT_CHANGES_DONE = 1 << 1, /* the contents were changed or replaced */
+  MOUSEPAD_WATCH_EVENT_ATTRIBUTES   = 1 << 2, /* the attributes were changed */
+}
+MousepadWatchEvents;
+
+/* called once for all the events received for a file during the coalescing delay,
+ * @fileinfo holds MOUSEPAD_WATCH_ATTRIBUTES, or is NULL if the file could not be queried */
+typedef void (*MousepadWatchFunc) (GFile               *location,
+                                   MousepadWatchEvents  events,
+                                   GFileInfo           *fileinfo,
+                                   gpointer             user_data);
+
+void  mousepad_watch_init     (void);
+
+void  mousepad_watch_finalize (void);
+
+guint mousepad_watch_add      (GFile             *location,
+                               MousepadWatchFunc  func,
+                               gpointer           user_data);
+
+void  mousepad_watch_remove   (guint              watch_id);
+
+void  mousepad_watch_block    (guint              watch_id);
+
+void  mousepad_watch_unblock  (guint              watch_id);
+
+G_END_DECLS
+
+#endif /* !__MOUSEPAD_WATCH_H__ */
@@ -19,9 +19,11 @@
 #include <mousepad/mousepad-application.h>
 #include <mousepad/mousepad-marshal.h>
 #include <mousepad/mousepad-document.h>
+#include <mousepad/mousepad-close-button.h>
 #include <mousepad/mousepad-dialogs.h>
 #include <mousepad/mousepad-replace-dialog.h>
 #include <mousepad/mousepad-encoding-dialog.h>
+#include <mousepad/mousepad-journal.h>
 #include <mousepad/mousepad-search-bar.h>
 #include <mousepad/mousepad-statusbar.h>
 #include <mousepad/mousepad-print.h>
@@ -34,6 +36,7 @@
 #define PASTE_HISTORY_MENU_LENGTH 30
 #define MIN_FONT_SIZE             6
 #define MAX_FONT_SIZE             72
+#define MAX_PARALLEL_SAVES        4
 
 #define MENUBAR        MOUSEPAD_SETTING_MENUBAR_VISIBLE
 #define STATUSBAR      MOUSEPAD_SETTING_STATUSBAR_VISIBLE
@@ -63,6 +66,15 @@ enum
   YES
 };
 
+/* the function called at the end of a file operation on a document, whatever its result,
+ * which is that of mousepad_file_open() or mousepad_file_save(): @error is only valid
+ * during the call */
+typedef void (*MousepadWindowFileFunc) (MousepadWindow   *window,
+                                        MousepadDocument *document,
+                                        gint              result,
+                                        GError           *error,
+                                        gpointer          data);
+
 
 
 /* overridden parent classes methods */
@@ -102,20 +114,66 @@ static gboolean          mousepad_window_tool_item_leave_event        (GtkWidget
                                                                        MousepadWindow         *window);
 
 /* window functions */
-static gboolean          mousepad_window_open_file                    (MousepadWindow         *window,
+static void              mousepad_window_file_open                    (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       gboolean                reload,
+                                                                       gboolean                must_exist,
+                                                                       gboolean                make_valid,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static void              mousepad_window_file_save                    (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       gboolean                forced,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static void              mousepad_window_save_document                (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static void              mousepad_window_save_as_document             (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static gboolean          mousepad_window_switch_to_file               (MousepadWindow         *window,
+                                                                       GFile                  *file);
+static void              mousepad_window_load_document                (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       MousepadEncoding        encoding,
+                                                                       gboolean                must_exist,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static void              mousepad_window_open_file                    (MousepadWindow         *window,
                                                                        GFile                  *file,
                                                                        MousepadEncoding        encoding,
-                                                                       gboolean                must_exist);
-static gboolean          mousepad_window_close_document               (MousepadWindow         *window,
-                                                                       MousepadDocument       *document);
+                                                                       gboolean                must_exist,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
+static void              mousepad_window_close_document               (MousepadWindow         *window,
+                                                                       MousepadDocument       *document,
+                                                                       MousepadWindowFileFunc  func,
+                                                                       gpointer                data);
 static void              mousepad_window_button_close_tab             (MousepadDocument       *document,
                                                                        MousepadWindow         *window);
 static void              mousepad_window_set_title                    (MousepadWindow         *window);
+static gboolean          mousepad_window_is_savable                   (MousepadWindow         *window);
+static void              mousepad_window_update_actions               (MousepadWindow         *window);
 static gboolean          mousepad_window_get_in_fullscreen            (MousepadWindow         *window);
 static void              mousepad_window_update_bar_visibility        (MousepadWindow         *window,
                                                                        const gchar            *key);
 
+/* lazy tabs */
+static GtkWidget        *mousepad_window_placeholder_add              (MousepadWindow         *window,
+                                                                       GFile                  *file,
+                                                                       MousepadEncoding        encoding,
+                                                                       gboolean                must_exist,
+                                                                       gint                    position);
+static void              mousepad_window_placeholder_load             (MousepadWindow         *window,
+                                                                       GtkWidget              *placeholder);
+static gboolean          mousepad_window_switch_to_placeholder        (MousepadWindow         *window,
+                                                                       GFile                  *file);
+
 /* notebook signals */
+static gboolean          mousepad_window_lazy_load_idle               (gpointer                data);
 static void              mousepad_window_notebook_switch_page         (GtkNotebook            *notebook,
                                                                        GtkWidget              *page,
                                                                        guint                   page_num,
@@ -168,6 +226,9 @@ static void              mousepad_window_language_changed             (MousepadD
 static void              mousepad_window_overwrite_changed            (MousepadDocument       *document,
                                                                        gboolean                overwrite,
                                                                        MousepadWindow         *window);
+static void              mousepad_window_reduced_changed              (MousepadDocument       *document,
+                                                                       gboolean                reduced,
+                                                                       MousepadWindow         *window);
 static void              mousepad_window_can_undo                     (GtkSourceBuffer        *buffer,
                                                                        GParamSpec             *unused,
                                                                        MousepadWindow         *window);
@@ -205,6 +266,8 @@ static void              mousepad_window_recent_menu                  (GSimpleAc
                                                                        GVariant               *value,
                                                                        gpointer                data);
 static const gchar      *mousepad_window_recent_get_charset           (GtkRecentInfo          *info);
+static MousepadEncoding  mousepad_window_recent_get_encoding          (MousepadWindow         *window,
+                                                                       GFile                  *file);
 static void              mousepad_window_recent_clear                 (MousepadWindow         *window);
 
 /* dnd */
@@ -405,6 +468,9 @@ static void              mousepad_window_action_write_bom             (GSimpleAc
 static void              mousepad_window_action_viewer_mode           (GSimpleAction          *action,
                                                                        GVariant               *value,
                                                                        gpointer                data);
+static void              mousepad_window_action_follow                (GSimpleAction          *action,
+                                                                       GVariant               *value,
+                                                                       gpointer                data);
 static void              mousepad_window_action_prev_tab              (GSimpleAction          *action,
                                                                        GVariant               *value,
                                                                        gpointer                data);
@@ -436,6 +502,9 @@ struct _MousepadWindow
   MousepadDocument    *active;
   MousepadDocument    *previous;
 
+  /* the lazy tab to replace with its document once idle, to show it */
+  GtkWidget           *placeholder;
+
   /* main window widgets */
   GtkWidget           *box;
   GtkWidget           *menubar_box;
@@ -564,6 +633,7 @@ static const GActionEntry action_entries[] =
 
   { "document.write-unicode-bom", mousepad_window_action_write_bom, NULL, "false", NULL },
   { "document.viewer-mode", mousepad_window_action_viewer_mode, NULL, "false", NULL },
+  { "document.follow", mousepad_window_action_follow, NULL, "false", NULL },
 
   { "document.previous-tab", mousepad_window_action_prev_tab, NULL, NULL, NULL },
   { "document.next-tab", mousepad_window_action_next_tab, NULL, NULL, NULL },
@@ -1166,6 +1236,18 @@ mousepad_window_action_statusbar_overwrite (MousepadWindow *window,
 
 
 
+static void
+mousepad_window_action_statusbar_features (MousepadWindow *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
+
+  /* enable the features disabled for a large document */
+  mousepad_document_set_reduced (window->active, FALSE);
+}
+
+
+
 static void
 mousepad_window_create_statusbar (MousepadWindow *window)
 {
@@ -1194,6 +1276,10 @@ mousepad_window_create_statusbar (MousepadWindow *window)
   g_signal_connect_swapped (window->statusbar, "enable-overwrite",
                             G_CALLBACK (mousepad_window_action_statusbar_overwrite), window);
 
+  /* large document override signal */
+  g_signal_connect_swapped (window->statusbar, "enable-features",
+                            G_CALLBACK (mousepad_window_action_statusbar_features), window);
+
   /* update the statusbar items */
   if (MOUSEPAD_IS_DOCUMENT (window->active))
     mousepad_document_send_signals (window->active);
@@ -1886,374 +1972,1889 @@ mousepad_window_menu_set_tooltips (MousepadWindow *window,
 /**
  * Mousepad Window Functions
  **/
-static gboolean
-mousepad_window_open_file (MousepadWindow   *window,
-                           GFile            *file,
-                           MousepadEncoding  encoding,
-                           gboolean          must_exist)
+/* an asynchronous file operation on a document of the window */
+typedef struct
 {
-  MousepadDocument *document;
-  GtkRecentInfo    *info;
-  GError           *error = NULL;
-  GFile            *opened_file;
-  const gchar      *charset;
-  gchar            *uri;
-  gint              npages, result, i;
-  gboolean          make_valid = FALSE, encoding_from_recent = FALSE;
+  MousepadWindow         *window;
+  MousepadDocument       *document;
+  gboolean                destroyed;
+  GCancellable           *cancellable;
+  MousepadStatusbar      *statusbar;
 
-  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
-  g_return_val_if_fail (file != NULL, FALSE);
+  /* the function to call at the end of the operation */
+  MousepadWindowFileFunc  func;
+  gpointer                data;
+}
+MousepadWindowFileOperation;
 
-  /* check if the file is already openend */
-  npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
-  for (i = 0; i < npages; i++)
-    {
-      document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i));
-      if (G_LIKELY (document))
-        {
-          /* get the file location */
-          opened_file = mousepad_file_get_location (MOUSEPAD_DOCUMENT (document)->file);
+/* the function to call at the end of a sequence of operations on a document */
+typedef struct
+{
+  MousepadWindowFileFunc  func;
+  gpointer                data;
+}
+MousepadWindowFileCallback;
 
-          /* see if the file is already opened */
-          if (opened_file != NULL && g_file_equal (file, opened_file))
-            {
-              /* switch to the tab */
-              gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), i);
 
-              /* and we're done */
-              return TRUE;
-            }
-        }
-    }
 
-  /* new document */
-  document = mousepad_document_new ();
+static void
+mousepad_window_set_destroyed (gboolean *destroyed)
+{
+  *destroyed = TRUE;
+}
 
-  /* make sure it's not a floating object */
-  g_object_ref_sink (document);
 
-  /* set the file location */
-  mousepad_file_set_location (document->file, file, TRUE);
 
-  /* the user chose to open the file in the encoding dialog */
-  if (encoding == MOUSEPAD_ENCODING_NONE)
-    {
-      /* run the encoding dialog */
-      if (mousepad_encoding_dialog (GTK_WINDOW (window), document->file, FALSE, &encoding)
-          != MOUSEPAD_RESPONSE_OK)
-        {
-          /* release the document */
-          g_object_unref (document);
+/* keep the window alive during an operation, it may be closed meanwhile */
+static void
+mousepad_window_hold (MousepadWindow *window,
+                      gboolean       *destroyed)
+{
+  *destroyed = FALSE;
+  g_object_ref (window);
+  g_signal_connect_swapped (window, "destroy", G_CALLBACK (mousepad_window_set_destroyed), destroyed);
+}
 
-          return FALSE;
-        }
-    }
 
-  /* make sure the recent manager is initialized */
-  mousepad_window_recent_manager_init (window);
 
-  retry:
+/* release the window at the end of an operation, the callers must not use it anymore */
+static void
+mousepad_window_release (MousepadWindow *window,
+                         gboolean       *destroyed)
+{
+  if (! *destroyed)
+    mousepad_disconnect_by_func (window, mousepad_window_set_destroyed, destroyed);
 
-  /* set the file encoding */
-  mousepad_file_set_encoding (document->file, encoding);
+  g_object_unref (window);
+}
 
-  /* lock the undo manager */
-  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
 
-  /* read the content into the buffer */
-  result = mousepad_file_open (document->file, must_exist, FALSE, make_valid, &error);
 
-  /* release the lock */
-  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+static void
+mousepad_window_file_operation_destroyed (MousepadWindowFileOperation *operation)
+{
+  /* stop there, the function of the operation is still called at its end */
+  operation->destroyed = TRUE;
+  g_cancellable_cancel (operation->cancellable);
+}
 
-  switch (result)
-    {
-      case 0:
-        /* make sure the window wasn't destroyed during the file opening process
-         * (e.g. by triggering "app.quit" when the dialog to confirm encoding is open) */
-        if (G_LIKELY (MOUSEPAD_IS_WINDOW (window)))
-          {
-            /* add the document to the window */
-            mousepad_window_add (window, document);
 
-            /* insert in the recent history */
-            mousepad_window_recent_add (window, document->file);
-          }
-        break;
 
-      case ERROR_CONVERTING_FAILED:
-      case ERROR_ENCODING_NOT_VALID:
-        /* clear the error */
-        g_clear_error (&error);
+/* start an operation on a document, shown in the statusbar until it ends: it is cancelled
+ * if the window or the document is closed meanwhile */
+static MousepadWindowFileOperation *
+mousepad_window_file_operation_new (MousepadWindow         *window,
+                                    MousepadDocument       *document,
+                                    const gchar            *format,
+                                    MousepadWindowFileFunc  func,
+                                    gpointer                data)
+{
+  MousepadWindowFileOperation *operation;
+  gchar                       *message;
 
-        /* try to lookup the encoding from the recent history only if the default was used */
-        if (encoding_from_recent == FALSE && encoding == mousepad_encoding_get_default ())
-          {
-            /* we only try this once */
-            encoding_from_recent = TRUE;
+  operation = g_slice_new0 (MousepadWindowFileOperation);
+  operation->window = g_object_ref (window);
+  operation->document = g_object_ref (document);
+  operation->cancellable = g_cancellable_new ();
+  operation->statusbar = MOUSEPAD_STATUSBAR (g_object_ref (window->statusbar));
+  operation->func = func;
+  operation->data = data;
 
-            /* build uri */
-            uri = g_file_get_uri (file);
+  g_signal_connect_swapped (window, "destroy",
+                            G_CALLBACK (mousepad_window_file_operation_destroyed), operation);
+  g_signal_connect_swapped (document, "destroy",
+                            G_CALLBACK (mousepad_window_file_operation_destroyed), operation);
 
-            /* try to lookup the recent item */
-            if (G_LIKELY (uri != NULL))
-              {
-                info = gtk_recent_manager_lookup_item (window->recent_manager, uri, NULL);
-
-                /* cleanup */
-                g_free (uri);
-
-                if (G_LIKELY (info != NULL))
-                  {
-                    /* try to find the encoding */
-                    charset = mousepad_window_recent_get_charset (info);
-                    encoding = mousepad_encoding_find (charset);
-                    gtk_recent_info_unref (info);
-
-                    /* try to open again with the last used encoding */
-                    if (G_LIKELY (encoding != MOUSEPAD_ENCODING_NONE))
-                      goto retry;
-                  }
-              }
-          }
+  /* show the operation in the statusbar */
+  message = g_strdup_printf (format, mousepad_document_get_basename (document));
+  mousepad_statusbar_push_progress (operation->statusbar, message, operation->cancellable);
+  g_free (message);
 
-        /* run the encoding dialog */
-        if (mousepad_encoding_dialog (GTK_WINDOW (window), document->file, FALSE, &encoding)
-            == MOUSEPAD_RESPONSE_OK)
-          {
-            make_valid = TRUE;
-            goto retry;
-          }
+  return operation;
+}
 
-        break;
 
-      default:
-        /* something went wrong */
-        if (G_LIKELY (error != NULL))
-          {
-            /* show the warning */
-            mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR);
 
-            /* cleanup */
-            g_error_free (error);
-          }
+/* end an operation, passing its result to its function: if the window or the document
+ * was closed meanwhile, it is turned into a cancellation, so that the callers stop there */
+static void
+mousepad_window_file_operation_return (MousepadWindowFileOperation *operation,
+                                       gint                         result,
+                                       gint                         failure,
+                                       GError                      *error)
+{
+  /* hide the operation */
+  mousepad_statusbar_pop_progress (operation->statusbar, operation->cancellable);
 
-        break;
+  mousepad_disconnect_by_func (operation->window, mousepad_window_file_operation_destroyed, operation);
+  mousepad_disconnect_by_func (operation->document, mousepad_window_file_operation_destroyed, operation);
+  if (operation->destroyed)
+    {
+      result = failure;
+      g_clear_error (&error);
+      g_set_error_literal (&error, G_IO_ERROR, G_IO_ERROR_CANCELLED,
+                           "The document was closed during the operation");
     }
 
-  /* decrease reference count if everything went well, else release the document */
-  g_object_unref (document);
+  if (operation->func != NULL)
+    operation->func (operation->window, operation->document, result, error, operation->data);
+
+  /* cleanup */
+  if (error != NULL)
+    g_error_free (error);
 
-  return (result == 0);
+  g_object_unref (operation->cancellable);
+  g_object_unref (operation->statusbar);
+  g_object_unref (operation->document);
+  g_object_unref (operation->window);
+  g_slice_free (MousepadWindowFileOperation, operation);
 }
 
 
 
-gint
-mousepad_window_open_files (MousepadWindow    *window,
-                            GFile            **files,
-                            gint               n_files,
-                            MousepadEncoding   encoding,
-                            gboolean           must_exist)
+static void
+mousepad_window_file_open_progress (MousepadFile *file,
+                                    gdouble       fraction,
+                                    gpointer      data)
 {
-  gint n;
+  mousepad_statusbar_set_progress (MOUSEPAD_STATUSBAR (data), fraction);
+}
 
-  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), 0);
-  g_return_val_if_fail (files != NULL, 0);
-  g_return_val_if_fail (*files != NULL, 0);
 
-  /* block menu updates */
-  lock_menu_updates++;
 
-  /* open new tabs with the files */
-  for (n = 0; n < n_files; n++)
-    mousepad_window_open_file (window, files[n], encoding, must_exist);
+static void
+mousepad_window_file_open_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
+{
+  MousepadWindowFileOperation *operation = data;
+  GError                      *error = NULL;
+  gint                         retval;
 
-  /* allow menu updates again */
-  lock_menu_updates--;
+  retval = mousepad_file_open_finish (MOUSEPAD_FILE (object), result, &error);
 
-  /* return the number of opened documents */
-  if (GTK_IS_WIDGET (window->notebook))
-    return gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook));
-  else
-    return -1;
+  /* release the lock */
+  mousepad_document_thaw (operation->document);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (operation->document->buffer));
+
+  mousepad_window_file_operation_return (operation, retval, ERROR_READING_FAILED, error);
 }
 
 
 
-void
-mousepad_window_add (MousepadWindow   *window,
-                     MousepadDocument *document)
+static void
+mousepad_window_file_reload_ready (GObject      *object,
+                                   GAsyncResult *result,
+                                   gpointer      data)
 {
-  GtkWidget        *label;
-  gint              page;
-  MousepadDocument *prev_active = window->active;
+  GError *error = NULL;
+  gint    retval;
 
-  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
-  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
-  g_return_if_fail (GTK_IS_NOTEBOOK (window->notebook));
+  retval = mousepad_file_open_finish (MOUSEPAD_FILE (object), result, &error);
+  mousepad_window_file_operation_return (data, retval, ERROR_READING_FAILED, error);
+}
 
-  /* receive the document occurrences count */
-  g_signal_connect_swapped (document, "search-completed",
-                            G_CALLBACK (mousepad_window_search_completed), window);
 
-  /* create the tab label */
-  label = mousepad_document_get_tab_label (document);
 
-  /* get active page */
-  page = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook));
+/* view a large local file page by page rather than loading it in the buffer, which is
+ * immediate, or view a file already viewed this way again: returns FALSE if the file must
+ * be loaded normally, else its result is in @retval */
+static gboolean
+mousepad_window_file_open_pager (MousepadDocument  *document,
+                                 gboolean           reload,
+                                 gint              *retval,
+                                 GError           **error)
+{
+  MousepadPager    *pager;
+  MousepadEncoding  encoding;
+  GFileInfo        *info;
+  GFile            *location;
+  goffset           size;
+  gint              threshold;
 
-  /* insert the page right of the active tab */
-  page = gtk_notebook_insert_page (GTK_NOTEBOOK (window->notebook),
-                                   GTK_WIDGET (document), label, page + 1);
+  location = mousepad_file_get_location (document->file);
+  encoding = mousepad_file_get_encoding (document->file);
 
-  /* set tab child properties */
-  gtk_container_child_set (GTK_CONTAINER (window->notebook),
-                           GTK_WIDGET (document), "tab-expand", TRUE, NULL);
-  gtk_notebook_set_tab_reorderable (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document), TRUE);
-  gtk_notebook_set_tab_detachable (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document), TRUE);
+  if (mousepad_document_get_pager (document) == NULL)
+    {
+      /* lines must be found without decoding the file, which must be mapped in memory */
+      threshold = MOUSEPAD_SETTING_GET_INT (PAGED_VIEW_THRESHOLD);
+      if (reload || threshold == 0 || ! g_file_is_native (location)
+          || ! mousepad_encoding_is_ascii_compatible (encoding))
+        return FALSE;
 
-  /* show the document */
-  gtk_widget_show (GTK_WIDGET (document));
+      /* errors are reported by the normal loading */
+      info = g_file_query_info (location, G_FILE_ATTRIBUTE_STANDARD_SIZE,
+                                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+      if (info == NULL)
+        return FALSE;
 
-  /* don't bother about this when there was no previous active page (startup) */
-  if (G_LIKELY (prev_active != NULL))
+      size = g_file_info_get_size (info);
+      g_object_unref (info);
+      if (size < (goffset) threshold * 1024 * 1024)
+        return FALSE;
+    }
+
+  pager = mousepad_pager_new (location, encoding, error);
+  if (pager == NULL)
     {
-      /* switch to the new tab */
-      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page);
+      /* the file is loaded normally if its contents don't allow to view it page by page */
+      if (mousepad_document_get_pager (document) == NULL
+          && g_error_matches (*error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED))
+        {
+          g_clear_error (error);
+          return FALSE;
+        }
 
-      /* destroy the previous tab if it was not modified, untitled and the new tab is not untitled */
-      if (gtk_text_buffer_get_modified (prev_active->buffer) == FALSE
-          && ! mousepad_file_location_is_set (prev_active->file)
-          && mousepad_file_location_is_set (document->file))
-        gtk_widget_destroy (GTK_WIDGET (prev_active));
+      *retval = ERROR_READING_FAILED;
+      return TRUE;
     }
 
-  /* make sure the textview is focused in the new document */
-  mousepad_document_focus_textview (document);
+  mousepad_document_set_pager (document, pager);
+  mousepad_pager_unref (pager);
+  *retval = 0;
+
+  return TRUE;
 }
 
 
 
-static gboolean
-mousepad_window_close_document (MousepadWindow   *window,
-                                MousepadDocument *document)
-{
-  GVariant *value;
-  gboolean  succeed = FALSE;
+/* load the document file without blocking the user interface, showing the progress
+ * in the statusbar, or reload it by applying only the changes to the buffer: @func
+ * is called with the result of mousepad_file_open() when it is done */
+static void
+mousepad_window_file_open (MousepadWindow         *window,
+                           MousepadDocument       *document,
+                           gboolean                reload,
+                           gboolean                must_exist,
+                           gboolean                make_valid,
+                           MousepadWindowFileFunc  func,
+                           gpointer                data)
+{
+  MousepadWindowFileOperation *operation;
+  GError                      *error = NULL;
+  gint                         retval;
 
-  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
-  g_return_val_if_fail (MOUSEPAD_IS_DOCUMENT (document), FALSE);
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
-  /* check if the document has been modified */
-  if (gtk_text_buffer_get_modified (document->buffer))
+  /* large files are not loaded in the buffer, which is immediate */
+  if (mousepad_window_file_open_pager (document, reload, &retval, &error))
     {
-      /* run save changes dialog */
-      switch (mousepad_dialogs_save_changes (GTK_WINDOW (window),
-                                             mousepad_file_get_read_only (document->file)))
-        {
-          case MOUSEPAD_RESPONSE_DONT_SAVE:
-            /* don't save, only destroy the document */
-            succeed = TRUE;
-            break;
+      /* the document can no longer be edited */
+      if (window->active == document)
+        mousepad_window_update_actions (window);
 
-          case MOUSEPAD_RESPONSE_CANCEL:
-            /* do nothing */
-            break;
+      if (func != NULL)
+        func (window, document, retval, error, data);
 
-          case MOUSEPAD_RESPONSE_SAVE:
-            g_action_group_activate_action (G_ACTION_GROUP (window), "file.save", NULL);
-            value = g_action_group_get_action_state (G_ACTION_GROUP (window), "file.save");
-            succeed = g_variant_get_int32 (value);
-            g_variant_unref (value);
-            break;
+      if (error != NULL)
+        g_error_free (error);
 
-          case MOUSEPAD_RESPONSE_SAVE_AS:
-            g_action_group_activate_action (G_ACTION_GROUP (window), "file.save-as", NULL);
-            value = g_action_group_get_action_state (G_ACTION_GROUP (window), "file.save-as");
-            succeed = g_variant_get_int32 (value);
-            g_variant_unref (value);
-            break;
-        }
+      return;
     }
-  /* no changes in the document, safe to destroy it */
-  else
-    succeed = TRUE;
 
-  /* destroy the document */
-  if (succeed)
-    gtk_widget_destroy (GTK_WIDGET (document));
+  operation = mousepad_window_file_operation_new (window, document, _("Loading %s..."), func, data);
+
+  /* when reloading, only the changed lines are replaced, as an undoable action */
+  if (reload)
+    mousepad_file_reload_async (document->file, operation->cancellable,
+                                mousepad_window_file_open_progress, operation->statusbar,
+                                mousepad_window_file_reload_ready, operation);
+  else
+    {
+      /* lock the undo manager and suspend the handlers we don't need while filling the buffer */
+      gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+      mousepad_document_freeze (document);
 
-  return succeed;
+      /* read the content into the buffer, keeping the user interface responsive */
+      mousepad_file_open_async (document->file, must_exist, FALSE, make_valid, operation->cancellable,
+                                mousepad_window_file_open_progress, operation->statusbar,
+                                mousepad_window_file_open_ready, operation);
+    }
 }
 
 
 
 static void
-mousepad_window_button_close_tab (MousepadDocument *document,
-                                  MousepadWindow   *window)
+mousepad_window_file_save_ready (GObject      *object,
+                                 GAsyncResult *result,
+                                 gpointer      data)
 {
-  gint page_num;
-
-  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
-  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
-
-  /* switch to the tab we're going to close */
-  page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
-  gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+  GError   *error = NULL;
+  gboolean  succeed;
 
-  /* close the document */
-  mousepad_window_close_document (window, document);
+  succeed = mousepad_file_save_finish (MOUSEPAD_FILE (object), result, &error);
+  mousepad_window_file_operation_return (data, succeed, FALSE, error);
 }
 
 
 
+/* save the document file without blocking the user interface, which means the document
+ * can be edited during the saving: @func is called with the result of mousepad_file_save()
+ * when it is done */
 static void
-mousepad_window_set_title (MousepadWindow *window)
+mousepad_window_file_save (MousepadWindow         *window,
+                           MousepadDocument       *document,
+                           gboolean                forced,
+                           MousepadWindowFileFunc  func,
+                           gpointer                data)
 {
-  gchar            *string;
-  const gchar      *title;
-  gboolean          show_full_path;
-  MousepadDocument *document = window->active;
+  MousepadWindowFileOperation *operation;
+  GError                      *error = NULL;
 
-  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
-  /* whether to show the full path */
-  show_full_path = MOUSEPAD_SETTING_GET_BOOLEAN (PATH_IN_TITLE);
-
-  /* name we display in the title */
-  if (G_UNLIKELY (show_full_path && mousepad_document_get_filename (document)))
-    title = mousepad_document_get_filename (document);
-  else
-    title = mousepad_document_get_basename (document);
+  /* only a part of the file is in the buffer, which would replace it as a whole */
+  if (mousepad_document_get_pager (document) != NULL)
+    {
+      g_set_error (&error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+                   _("A file viewed page by page can't be saved"));
+      func (window, document, FALSE, error, data);
+      g_error_free (error);
 
-  /* build the title */
-  if (G_UNLIKELY (mousepad_file_get_read_only (document->file)))
-    string = g_strdup_printf ("%s%s [%s] - %s",
-                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
-                              title, _("Read Only"), PACKAGE_NAME);
-  else if (G_UNLIKELY (! gtk_text_view_get_editable (GTK_TEXT_VIEW (document->textview))))
-    string = g_strdup_printf ("%s%s [%s] - %s",
-                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
-                              title, _("Viewer Mode"), PACKAGE_NAME);
-  else
-    string = g_strdup_printf ("%s%s - %s",
-                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
-                              title, PACKAGE_NAME);
+      return;
+    }
 
-  /* set the window title */
-  gtk_window_set_title (GTK_WINDOW (window), string);
+  operation = mousepad_window_file_operation_new (window, document, _("Saving %s..."), func, data);
 
-  /* cleanup */
-  g_free (string);
+  /* write the document in the background */
+  mousepad_file_save_async (document->file, forced, operation->cancellable,
+                            mousepad_window_file_save_ready, operation);
 }
 
 
 
-/* give the statusbar a languages menu created from the application resources */
-GtkWidget *
-mousepad_window_get_languages_menu (MousepadWindow *window)
+static void
+mousepad_window_save_document_ready (MousepadWindow   *window,
+                                     MousepadDocument *document,
+                                     gint              succeed,
+                                     GError           *error,
+                                     gpointer          data)
+{
+  MousepadWindowFileCallback *save = data;
+
+  /* file has been externally modified, ask the user what to do */
+  if (G_UNLIKELY (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)))
+    {
+      switch (mousepad_dialogs_externally_modified (GTK_WINDOW (window), TRUE, TRUE))
+        {
+          case MOUSEPAD_RESPONSE_SAVE_AS:
+            /* run save as dialog */
+            mousepad_window_save_as_document (window, document, save->func, save->data);
+            g_slice_free (MousepadWindowFileCallback, save);
+            return;
+
+          case MOUSEPAD_RESPONSE_SAVE:
+            /* force to save the document */
+            mousepad_window_file_save (window, document, TRUE,
+                                       mousepad_window_save_document_ready, save);
+            return;
+
+          default:
+            /* do nothing */
+            break;
+        }
+    }
+  /* other kind of error, unless the user cancelled the operation or it is already running */
+  else if (G_UNLIKELY (error != NULL)
+           && ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED)
+           && ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_PENDING))
+    mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to save the document"));
+
+  /* the errors have been reported, the callers only have to tell a success */
+  save->func (window, document, succeed, error, save->data);
+  g_slice_free (MousepadWindowFileCallback, save);
+}
+
+
+
+/* save a document, running the save as dialog if it has no file yet or if the user
+ * prefers it to overwriting external modifications: @func is called with the result
+ * of mousepad_file_save() when it is done */
+static void
+mousepad_window_save_document (MousepadWindow         *window,
+                               MousepadDocument       *document,
+                               MousepadWindowFileFunc  func,
+                               gpointer                data)
+{
+  MousepadWindowFileCallback *save;
+
+  /* file has no filename yet, open the save as dialog */
+  if (! mousepad_file_location_is_set (document->file))
+    {
+      mousepad_window_save_as_document (window, document, func, data);
+      return;
+    }
+
+  /* try to save the file */
+  save = g_slice_new (MousepadWindowFileCallback);
+  save->func = func;
+  save->data = data;
+  mousepad_window_file_save (window, document, FALSE, mousepad_window_save_document_ready, save);
+}
+
+
+
+/* the saving of a document to a location chosen by the user */
+typedef struct
+{
+  GFile                  *file;
+  GFile                  *current_file;
+  MousepadEncoding        current_encoding;
+
+  /* the function to call at the end of the saving */
+  MousepadWindowFileFunc  func;
+  gpointer                data;
+}
+MousepadWindowSaveAs;
+
+
+
+static void
+mousepad_window_save_as_document_ready (MousepadWindow   *window,
+                                        MousepadDocument *document,
+                                        gint              succeed,
+                                        GError           *error,
+                                        gpointer          data)
+{
+  MousepadWindowSaveAs *save_as = data;
+
+  if (G_LIKELY (succeed))
+    {
+      /* validate file location change */
+      mousepad_file_set_location (document->file, save_as->file, TRUE);
+
+      /* add to the recent history */
+      mousepad_window_recent_add (window, document->file);
+
+      /* update last save location */
+      if (last_save_location != NULL)
+        g_object_unref (last_save_location);
+      last_save_location = g_file_get_parent (save_as->file);
+    }
+  /* revert file location change */
+  else
+    {
+      mousepad_file_set_location (document->file, save_as->current_file, FALSE);
+      mousepad_file_set_encoding (document->file, save_as->current_encoding);
+    }
+
+  save_as->func (window, document, succeed, error, save_as->data);
+
+  /* cleanup */
+  g_object_unref (save_as->file);
+  if (save_as->current_file != NULL)
+    g_object_unref (save_as->current_file);
+
+  g_slice_free (MousepadWindowSaveAs, save_as);
+}
+
+
+
+/* run the save as dialog and save the document to the chosen location, which becomes
+ * that of the document on success: @func is called with the result of mousepad_file_save(),
+ * or %FALSE if the user cancelled the dialog */
+static void
+mousepad_window_save_as_document (MousepadWindow         *window,
+                                  MousepadDocument       *document,
+                                  MousepadWindowFileFunc  func,
+                                  gpointer                data)
+{
+  MousepadWindowSaveAs *save_as;
+  MousepadEncoding      encoding;
+  GFile                *file;
+
+  /* run the dialog */
+  if (mousepad_dialogs_save_as (GTK_WINDOW (window), document->file,
+                                last_save_location, &file, &encoding)
+      != GTK_RESPONSE_ACCEPT || G_UNLIKELY (file == NULL))
+    {
+      func (window, document, FALSE, NULL, data);
+      return;
+    }
+
+  save_as = g_slice_new0 (MousepadWindowSaveAs);
+  save_as->file = file;
+  save_as->func = func;
+  save_as->data = data;
+
+  /* keep a ref of the current file location to restore it in case of failure */
+  if (mousepad_file_location_is_set (document->file))
+    {
+      save_as->current_file = g_object_ref (mousepad_file_get_location (document->file));
+      save_as->current_encoding = mousepad_file_get_encoding (document->file);
+    }
+
+  /* virtually set the new file location */
+  mousepad_file_set_location (document->file, file, FALSE);
+  mousepad_file_set_encoding (document->file, encoding);
+
+  /* save the file, whatever the state of the save action, which may be disabled
+   * depending on the file status */
+  mousepad_window_save_document (window, document, mousepad_window_save_as_document_ready, save_as);
+}
+
+
+
+/* switch to the tab of a file if it is already opened, in this window or another one */
+static gboolean
+mousepad_window_switch_to_file (MousepadWindow *window,
+                                GFile          *file)
+{
+  MousepadDocument *document;
+  GtkWidget        *other;
+  GtkNotebook      *notebook;
+
+  document = mousepad_application_lookup_document (MOUSEPAD_APPLICATION (g_application_get_default ()),
+                                                   file);
+  if (document == NULL)
+    return mousepad_window_switch_to_placeholder (window, file);
+
+  other = gtk_widget_get_ancestor (GTK_WIDGET (document), MOUSEPAD_TYPE_WINDOW);
+  if (other == NULL)
+    return FALSE;
+
+  /* switch to the tab */
+  notebook = GTK_NOTEBOOK (MOUSEPAD_WINDOW (other)->notebook);
+  gtk_notebook_set_current_page (notebook, gtk_notebook_page_num (notebook, GTK_WIDGET (document)));
+
+  /* raise the window which contains it */
+  if (other != GTK_WIDGET (window))
+    gtk_window_present (GTK_WINDOW (other));
+
+  return TRUE;
+}
+
+
+
+/* the loading of a document, retried with other encodings as long as it can't be decoded */
+typedef struct
+{
+  MousepadEncoding        encoding;
+  gboolean                must_exist;
+  gboolean                make_valid;
+  gboolean                encoding_from_recent;
+  gboolean                encoding_detected;
+
+  /* the function to call at the end of the loading */
+  MousepadWindowFileFunc  func;
+  gpointer                data;
+}
+MousepadWindowLoad;
+
+
+
+static void mousepad_window_load_document_ready (MousepadWindow   *window,
+                                                 MousepadDocument *document,
+                                                 gint              retval,
+                                                 GError           *error,
+                                                 gpointer          data);
+
+
+
+static void
+mousepad_window_load_document_start (MousepadWindow     *window,
+                                     MousepadDocument   *document,
+                                     MousepadWindowLoad *load)
+{
+  /* set the file encoding */
+  mousepad_file_set_encoding (document->file, load->encoding);
+
+  /* read the content into the buffer */
+  mousepad_window_file_open (window, document, FALSE, load->must_exist, load->make_valid,
+                             mousepad_window_load_document_ready, load);
+}
+
+
+
+static void
+mousepad_window_load_document_ready (MousepadWindow   *window,
+                                     MousepadDocument *document,
+                                     gint              retval,
+                                     GError           *error,
+                                     gpointer          data)
+{
+  MousepadWindowLoad *load = data;
+  MousepadEncoding    encoding;
+  gdouble             confidence;
+
+  switch (retval)
+    {
+      case 0:
+        break;
+
+      case ERROR_CONVERTING_FAILED:
+      case ERROR_ENCODING_NOT_VALID:
+        /* try to lookup the encoding from the recent history only if the default was used */
+        if (! load->encoding_from_recent && load->encoding == mousepad_encoding_get_default ())
+          {
+            /* we only try this once */
+            load->encoding_from_recent = TRUE;
+
+            /* try to open again with the last used encoding */
+            encoding = mousepad_window_recent_get_encoding (window,
+                                                            mousepad_file_get_location (document->file));
+            if (G_LIKELY (encoding != MOUSEPAD_ENCODING_NONE))
+              {
+                load->encoding = encoding;
+                mousepad_window_load_document_start (window, document, load);
+
+                return;
+              }
+          }
+
+        /* then try the encoding guessed from the contents, if it is reliable enough */
+        if (load->encoding_from_recent && ! load->encoding_detected)
+          {
+            /* we only try this once */
+            load->encoding_detected = TRUE;
+
+            encoding = mousepad_file_get_detected_encoding (document->file, &confidence);
+            if (encoding != MOUSEPAD_ENCODING_NONE && encoding != mousepad_encoding_get_default ()
+                && confidence >= MOUSEPAD_ENCODING_CONFIDENCE_HIGH)
+              {
+                load->encoding = encoding;
+                mousepad_window_load_document_start (window, document, load);
+
+                return;
+              }
+          }
+
+        /* run the encoding dialog */
+        if (mousepad_encoding_dialog (GTK_WINDOW (window), document->file, FALSE, &load->encoding)
+            == MOUSEPAD_RESPONSE_OK)
+          {
+            load->make_valid = TRUE;
+            mousepad_window_load_document_start (window, document, load);
+
+            return;
+          }
+
+        break;
+
+      default:
+        /* something went wrong, unless the user cancelled the operation */
+        if (G_LIKELY (error != NULL) && ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+          mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR);
+
+        break;
+    }
+
+  /* the errors have been reported, the callers only have to tell a cancellation */
+  load->func (window, document, retval, error, load->data);
+  g_slice_free (MousepadWindowLoad, load);
+}
+
+
+
+/* load the file of a document which is not yet in the window, or whose loading was
+ * deferred, falling back on the recent history or the user for the encoding: @func is
+ * called with the result of mousepad_file_open() when it is done */
+static void
+mousepad_window_load_document (MousepadWindow         *window,
+                               MousepadDocument       *document,
+                               MousepadEncoding        encoding,
+                               gboolean                must_exist,
+                               MousepadWindowFileFunc  func,
+                               gpointer                data)
+{
+  MousepadWindowLoad *load;
+
+  /* make sure the recent manager is initialized */
+  mousepad_window_recent_manager_init (window);
+
+  load = g_slice_new0 (MousepadWindowLoad);
+  load->encoding = encoding;
+  load->must_exist = must_exist;
+  load->func = func;
+  load->data = data;
+
+  mousepad_window_load_document_start (window, document, load);
+}
+
+
+
+static void
+mousepad_window_open_file_ready (MousepadWindow   *window,
+                                 MousepadDocument *document,
+                                 gint              retval,
+                                 GError           *error,
+                                 gpointer          data)
+{
+  MousepadWindowFileCallback *open = data;
+
+  if (retval == 0)
+    {
+      /* add the document to the window */
+      mousepad_window_add (window, document);
+
+      /* insert in the recent history */
+      mousepad_window_recent_add (window, document->file);
+    }
+
+  if (open->func != NULL)
+    open->func (window, document, retval, error, open->data);
+
+  /* release the document, which is owned by the window if everything went well */
+  g_object_unref (document);
+  g_slice_free (MousepadWindowFileCallback, open);
+}
+
+
+
+/* open a file in a new tab, or switch to its tab if it is already opened: @func, which
+ * may be %NULL, is called with the result of mousepad_file_open() when it is done */
+static void
+mousepad_window_open_file (MousepadWindow         *window,
+                           GFile                  *file,
+                           MousepadEncoding        encoding,
+                           gboolean                must_exist,
+                           MousepadWindowFileFunc  func,
+                           gpointer                data)
+{
+  MousepadWindowFileCallback *open;
+  MousepadDocument           *document;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (file != NULL);
+
+  /* check if the file is already openend */
+  if (mousepad_window_switch_to_file (window, file))
+    {
+      if (func != NULL)
+        func (window, NULL, 0, NULL, data);
+
+      return;
+    }
+
+  /* new document */
+  document = mousepad_document_new ();
+
+  /* make sure it's not a floating object */
+  g_object_ref_sink (document);
+
+  /* set the file location */
+  mousepad_file_set_location (document->file, file, TRUE);
+
+  /* the user chose to open the file in the encoding dialog */
+  if (encoding == MOUSEPAD_ENCODING_NONE)
+    {
+      /* run the encoding dialog */
+      if (mousepad_encoding_dialog (GTK_WINDOW (window), document->file, FALSE, &encoding)
+          != MOUSEPAD_RESPONSE_OK)
+        {
+          if (func != NULL)
+            func (window, document, ERROR_READING_FAILED, NULL, data);
+
+          /* release the document */
+          g_object_unref (document);
+
+          return;
+        }
+    }
+
+  /* read the content into the buffer */
+  open = g_slice_new (MousepadWindowFileCallback);
+  open->func = func;
+  open->data = data;
+  mousepad_window_load_document (window, document, encoding, must_exist,
+                                 mousepad_window_open_file_ready, open);
+}
+
+
+
+/* files opened one after the other, each one possibly asking the user for its encoding */
+typedef struct
+{
+  MousepadWindow   *window;
+  gboolean          destroyed;
+  GTask            *task;
+  GPtrArray        *files;
+  guint             next;
+  MousepadEncoding  encoding;
+  gboolean          must_exist;
+}
+MousepadWindowOpenList;
+
+
+
+/* return the number of tabs in the window, or -1 if it was closed in the meantime */
+static void
+mousepad_window_open_files_return (MousepadWindow *window,
+                                   gboolean        destroyed,
+                                   GTask          *task)
+{
+  g_task_return_int (task, destroyed ? -1 : gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)));
+  g_object_unref (task);
+}
+
+
+
+static void
+mousepad_window_open_list_next (MousepadWindow   *window,
+                                MousepadDocument *document,
+                                gint              retval,
+                                GError           *error,
+                                gpointer          data)
+{
+  MousepadWindowOpenList *list = data;
+
+  /* open the next file, unless the window was closed in the meantime */
+  if (list->next < list->files->len && ! list->destroyed)
+    {
+      mousepad_window_open_file (list->window, g_ptr_array_index (list->files, list->next++),
+                                 list->encoding, list->must_exist,
+                                 mousepad_window_open_list_next, list);
+      return;
+    }
+
+  /* cleanup */
+  mousepad_window_open_files_return (list->window, list->destroyed, list->task);
+  mousepad_window_release (list->window, &list->destroyed);
+  g_ptr_array_free (list->files, TRUE);
+  g_slice_free (MousepadWindowOpenList, list);
+}
+
+
+
+/* open the files one after the other, the result of @task being set at the end */
+static void
+mousepad_window_open_list (MousepadWindow    *window,
+                           GFile            **files,
+                           gint               n_files,
+                           MousepadEncoding   encoding,
+                           gboolean           must_exist,
+                           GTask             *task)
+{
+  MousepadWindowOpenList *list;
+  gint                    n;
+
+  list = g_slice_new0 (MousepadWindowOpenList);
+  list->task = task;
+  list->encoding = encoding;
+  list->must_exist = must_exist;
+  list->files = g_ptr_array_new_full (n_files, g_object_unref);
+  for (n = 0; n < n_files; n++)
+    g_ptr_array_add (list->files, g_object_ref (files[n]));
+
+  /* keep the window alive, it may be closed while the files are opened */
+  list->window = window;
+  mousepad_window_hold (window, &list->destroyed);
+
+  mousepad_window_open_list_next (window, NULL, 0, NULL, list);
+}
+
+
+
+/* a file opened as part of a batch */
+typedef struct
+{
+  struct _MousepadWindowOpenBatch *batch;
+
+  GFile                           *file;
+  MousepadDocument                *document;
+  MousepadEncoding                 encoding;
+  gboolean                         encoding_from_recent;
+  gboolean                         encoding_detected;
+
+  /* result of the opening */
+  gboolean                         done;
+  gint                             retval;
+  GError                          *error;
+}
+MousepadWindowOpenItem;
+
+/* several files opened concurrently, and added to the window in the original order */
+typedef struct _MousepadWindowOpenBatch
+{
+  MousepadWindow    *window;
+  gboolean           destroyed;
+  GTask             *task;
+  GCancellable      *cancellable;
+  MousepadStatusbar *statusbar;
+  MousepadEncoding   encoding;
+  gboolean           must_exist;
+  gboolean           make_valid;
+
+  GPtrArray         *items;
+  guint              next_start;
+  guint              next_attach;
+  guint              n_running;
+  guint              n_done;
+  guint              max_running;
+}
+MousepadWindowOpenBatch;
+
+
+
+static void mousepad_window_open_batch_schedule (MousepadWindowOpenBatch  *batch);
+static void mousepad_window_open_batch_ready    (GObject                  *object,
+                                                 GAsyncResult             *result,
+                                                 gpointer                  data);
+static void mousepad_window_open_batch          (MousepadWindow           *window,
+                                                 GFile                   **files,
+                                                 gint                      n_files,
+                                                 MousepadEncoding          encoding,
+                                                 gboolean                  must_exist,
+                                                 gboolean                  make_valid,
+                                                 GTask                    *task);
+
+
+
+static void
+mousepad_window_open_batch_start (MousepadWindowOpenBatch *batch,
+                                  MousepadWindowOpenItem  *item)
+{
+  /* set the file encoding */
+  mousepad_file_set_encoding (item->document->file, item->encoding);
+
+  /* large files are not loaded in the buffer, which is immediate */
+  if (mousepad_window_file_open_pager (item->document, FALSE, &item->retval, &item->error))
+    {
+      item->done = TRUE;
+      batch->n_done++;
+      mousepad_statusbar_set_progress (batch->statusbar, (gdouble) batch->n_done / batch->items->len);
+      return;
+    }
+
+  /* lock the undo manager and suspend the handlers we don't need while filling the buffer */
+  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (item->document->buffer));
+  mousepad_document_freeze (item->document);
+
+  /* read and decode the file in worker threads */
+  batch->n_running++;
+  mousepad_file_open_async (item->document->file, batch->must_exist, FALSE, batch->make_valid,
+                            batch->cancellable, NULL, NULL,
+                            mousepad_window_open_batch_ready, item);
+}
+
+
+
+static void
+mousepad_window_open_batch_ready (GObject      *object,
+                                  GAsyncResult *result,
+                                  gpointer      data)
+{
+  MousepadWindowOpenItem  *item = data;
+  MousepadWindowOpenBatch *batch = item->batch;
+  MousepadEncoding         encoding;
+  gdouble                  confidence;
+
+  item->retval = mousepad_file_open_finish (MOUSEPAD_FILE (object), result, &item->error);
+  batch->n_running--;
+
+  /* release the locks */
+  mousepad_document_thaw (item->document);
+  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (item->document->buffer));
+
+  if ((item->retval == ERROR_CONVERTING_FAILED || item->retval == ERROR_ENCODING_NOT_VALID)
+      && ! g_cancellable_is_cancelled (batch->cancellable) && ! batch->destroyed)
+    {
+      /* try to lookup the encoding from the recent history only if the default was used */
+      if (! item->encoding_from_recent && item->encoding == mousepad_encoding_get_default ())
+        {
+          /* we only try this once */
+          item->encoding_from_recent = TRUE;
+
+          /* try to open again with the last used encoding, as soon as possible */
+          encoding = mousepad_window_recent_get_encoding (batch->window, item->file);
+          if (G_LIKELY (encoding != MOUSEPAD_ENCODING_NONE))
+            {
+              g_clear_error (&item->error);
+              item->encoding = encoding;
+              mousepad_window_open_batch_start (batch, item);
+
+              /* the file may now be viewed page by page, which is immediate */
+              if (item->done)
+                mousepad_window_open_batch_schedule (batch);
+
+              return;
+            }
+        }
+
+      /* then try the encoding guessed from the contents, if it is reliable enough, so that
+       * the user is only asked for the ambiguous files */
+      if (item->encoding_from_recent && ! item->encoding_detected)
+        {
+          /* we only try this once */
+          item->encoding_detected = TRUE;
+
+          encoding = mousepad_file_get_detected_encoding (item->document->file, &confidence);
+          if (encoding != MOUSEPAD_ENCODING_NONE && encoding != mousepad_encoding_get_default ()
+              && confidence >= MOUSEPAD_ENCODING_CONFIDENCE_HIGH)
+            {
+              g_clear_error (&item->error);
+              item->encoding = encoding;
+              mousepad_window_open_batch_start (batch, item);
+
+              /* the file may now be viewed page by page, which is immediate */
+              if (item->done)
+                mousepad_window_open_batch_schedule (batch);
+
+              return;
+            }
+        }
+    }
+
+  /* update the progress */
+  item->done = TRUE;
+  batch->n_done++;
+  mousepad_statusbar_set_progress (batch->statusbar, (gdouble) batch->n_done / batch->items->len);
+
+  mousepad_window_open_batch_schedule (batch);
+}
+
+
+
+static void
+mousepad_window_open_batch_item_free (gpointer data)
+{
+  MousepadWindowOpenItem *item = data;
+
+  if (item->error != NULL)
+    g_error_free (item->error);
+
+  g_object_unref (item->document);
+  g_object_unref (item->file);
+  g_slice_free (MousepadWindowOpenItem, item);
+}
+
+
+
+/* report the failures once all the documents are attached or dropped, then end the batch */
+static void
+mousepad_window_open_batch_finish (MousepadWindowOpenBatch *batch)
+{
+  MousepadWindowOpenItem *item, *first = NULL;
+  MousepadWindow         *window = batch->window;
+  MousepadEncoding        encoding;
+  GPtrArray              *failures;
+  GString                *names = NULL, *errors = NULL;
+  GTask                  *task = batch->task;
+  GError                 *error = NULL;
+  gchar                  *name;
+  gint                    n_failures = 0, n_errors = 0;
+  guint                   m;
+
+  /* hide the progress */
+  mousepad_statusbar_pop_progress (batch->statusbar, batch->cancellable);
+
+  /* gather the errors, if the window is still there, to report them at once */
+  failures = g_ptr_array_new ();
+  for (m = 0; m < batch->items->len && ! batch->destroyed; m++)
+    {
+      item = g_ptr_array_index (batch->items, m);
+      switch (item->retval)
+        {
+          case 0:
+            break;
+
+          /* the encoding failures are handled together */
+          case ERROR_CONVERTING_FAILED:
+          case ERROR_ENCODING_NOT_VALID:
+            g_ptr_array_add (failures, item->file);
+            if (first == NULL)
+              first = item;
+
+            if (n_failures++ < 10)
+              {
+                name = g_file_get_parse_name (item->file);
+                if (names == NULL)
+                  names = g_string_new (name);
+                else
+                  g_string_append_printf (names, "\n%s", name);
+
+                g_free (name);
+              }
+            else if (n_failures == 11)
+              g_string_append (names, "\n...");
+
+            break;
+
+          default:
+            /* something went wrong, unless the user cancelled the operation */
+            if (item->error == NULL || g_error_matches (item->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+              break;
+
+            if (n_errors++ == 0)
+              error = item->error;
+
+            if (n_errors <= 10)
+              {
+                name = g_file_get_parse_name (item->file);
+                if (errors == NULL)
+                  errors = g_string_new (NULL);
+                else
+                  g_string_append_c (errors, '\n');
+
+                g_string_append_printf (errors, "%s: %s", name, item->error->message);
+                g_free (name);
+              }
+            else if (n_errors == 11)
+              g_string_append (errors, "\n...");
+
+            break;
+        }
+    }
+
+  /* a single error is reported as usual */
+  if (n_errors == 1)
+    mousepad_dialogs_show_error (GTK_WINDOW (window), error, MOUSEPAD_MESSAGE_IO_ERROR);
+  else if (n_errors > 1)
+    mousepad_dialogs_show_errors (GTK_WINDOW (window), errors->str, n_errors);
+
+  /* let the user choose one encoding for all the files which could not be opened, previewed
+   * on the first of them, and open them again with it, the batch ending with the new one */
+  if (failures->len > 0)
+    {
+      if (mousepad_dialogs_encoding_failures (GTK_WINDOW (window), mousepad_encoding_get_charset (batch->encoding),
+                                              names->str, n_failures) == MOUSEPAD_RESPONSE_OK
+          && mousepad_encoding_dialog (GTK_WINDOW (window), first->document->file, FALSE, &encoding)
+             == MOUSEPAD_RESPONSE_OK)
+        {
+          mousepad_window_open_batch (window, (GFile **) failures->pdata, failures->len,
+                                      encoding, batch->must_exist, TRUE, task);
+          task = NULL;
+        }
+
+      g_string_free (names, TRUE);
+    }
+
+  if (task != NULL)
+    mousepad_window_open_files_return (window, batch->destroyed, task);
+
+  /* cleanup */
+  if (errors != NULL)
+    g_string_free (errors, TRUE);
+
+  g_ptr_array_free (failures, TRUE);
+  g_ptr_array_free (batch->items, TRUE);
+  if (! batch->destroyed)
+    mousepad_disconnect_by_func (window, g_cancellable_cancel, batch->cancellable);
+
+  g_object_unref (batch->cancellable);
+  g_object_unref (batch->statusbar);
+  mousepad_window_release (window, &batch->destroyed);
+  g_slice_free (MousepadWindowOpenBatch, batch);
+}
+
+
+
+static void
+mousepad_window_open_batch_schedule (MousepadWindowOpenBatch *batch)
+{
+  MousepadWindowOpenItem *item;
+
+  /* the documents opened or dropped when starting are attached in a new pass */
+  do
+    {
+      /* add the opened documents to the window in the original order */
+      while (batch->next_attach < batch->items->len
+             && (item = g_ptr_array_index (batch->items, batch->next_attach))->done)
+        {
+          /* make sure the window wasn't destroyed during the file opening process */
+          if (item->retval == 0 && G_LIKELY (! batch->destroyed))
+            {
+              /* add the document to the window */
+              mousepad_window_add (batch->window, item->document);
+
+              /* insert in the recent history */
+              mousepad_window_recent_add (batch->window, item->document->file);
+            }
+
+          batch->next_attach++;
+        }
+
+      /* start new openings until the limit is reached */
+      while (batch->n_running < batch->max_running && batch->next_start < batch->items->len)
+        {
+          item = g_ptr_array_index (batch->items, batch->next_start++);
+
+          /* don't start anything more if the user cancelled the operation */
+          if (g_cancellable_is_cancelled (batch->cancellable))
+            {
+              item->retval = ERROR_READING_FAILED;
+              item->done = TRUE;
+              batch->n_done++;
+              continue;
+            }
+
+          mousepad_window_open_batch_start (batch, item);
+        }
+    }
+  while (batch->next_attach < batch->items->len
+         && ((MousepadWindowOpenItem *) g_ptr_array_index (batch->items, batch->next_attach))->done);
+
+  /* we're done when all the documents are attached or dropped */
+  if (batch->n_running == 0 && batch->next_attach == batch->items->len)
+    mousepad_window_open_batch_finish (batch);
+}
+
+
+
+/* add lazy tabs for the files, right of the active tab, and show the last one */
+static void
+mousepad_window_open_lazy (MousepadWindow    *window,
+                           GFile            **files,
+                           gint               n_files,
+                           MousepadEncoding   encoding,
+                           gboolean           must_exist)
+{
+  MousepadDocument *prev_active = window->active;
+  GHashTable       *seen;
+  GtkWidget        *placeholder = NULL;
+  gint              n, position;
+
+  position = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook)) + 1;
+
+  /* skip the files which are already opened */
+  seen = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+  for (n = 0; n < n_files; n++)
+    if (! mousepad_window_switch_to_file (window, files[n]) && g_hash_table_add (seen, files[n]))
+      placeholder = mousepad_window_placeholder_add (window, files[n], encoding, must_exist, position++);
+
+  g_hash_table_destroy (seen);
+
+  if (placeholder == NULL)
+    return;
+
+  /* destroy the previous tab if it was not modified and untitled, as when adding a document */
+  if (prev_active != NULL
+      && ! gtk_text_buffer_get_modified (prev_active->buffer)
+      && ! mousepad_file_location_is_set (prev_active->file))
+    gtk_widget_destroy (GTK_WIDGET (prev_active));
+
+  /* switch to the last tab, which loads it */
+  gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook),
+                                 gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), placeholder));
+}
+
+
+
+/* open the files concurrently, the result of @task being set at the end */
+static void
+mousepad_window_open_batch (MousepadWindow    *window,
+                            GFile            **files,
+                            gint               n_files,
+                            MousepadEncoding   encoding,
+                            gboolean           must_exist,
+                            gboolean           make_valid,
+                            GTask             *task)
+{
+  MousepadWindowOpenBatch *batch;
+  MousepadWindowOpenItem  *item;
+  GHashTable              *seen;
+  gchar                   *message;
+  gint                     n;
+
+  /* only add the tabs, their file will be loaded when they are first shown */
+  if (MOUSEPAD_SETTING_GET_BOOLEAN (LAZY_LOADING) && ! make_valid)
+    {
+      mousepad_window_open_lazy (window, files, n_files, encoding, must_exist);
+      mousepad_window_open_files_return (window, FALSE, task);
+
+      return;
+    }
+
+  batch = g_slice_new0 (MousepadWindowOpenBatch);
+  batch->window = window;
+  batch->task = task;
+  batch->encoding = encoding;
+  batch->must_exist = must_exist;
+  batch->make_valid = make_valid;
+  batch->max_running = MAX (g_get_num_processors (), 1);
+  batch->items = g_ptr_array_new_with_free_func (mousepad_window_open_batch_item_free);
+
+  /* create the documents, skipping the files which are already opened */
+  seen = g_hash_table_new (g_file_hash, (GEqualFunc) g_file_equal);
+  for (n = 0; n < n_files; n++)
+    {
+      /* switch to the tab of an already opened file */
+      if (mousepad_window_switch_to_file (window, files[n]))
+        continue;
+
+      /* skip the duplicates in the list */
+      if (! g_hash_table_add (seen, files[n]))
+        continue;
+
+      item = g_slice_new0 (MousepadWindowOpenItem);
+      item->batch = batch;
+      item->file = g_object_ref (files[n]);
+      item->encoding = encoding;
+      item->document = mousepad_document_new ();
+
+      /* make sure it's not a floating object */
+      g_object_ref_sink (item->document);
+
+      /* set the file location */
+      mousepad_file_set_location (item->document->file, files[n], TRUE);
+
+      g_ptr_array_add (batch->items, item);
+    }
+
+  g_hash_table_destroy (seen);
+
+  /* nothing to open */
+  if (batch->items->len == 0)
+    {
+      mousepad_window_open_files_return (window, FALSE, task);
+      g_ptr_array_free (batch->items, TRUE);
+      g_slice_free (MousepadWindowOpenBatch, batch);
+
+      return;
+    }
+
+  /* make sure the recent manager is initialized */
+  mousepad_window_recent_manager_init (window);
+
+  /* keep the window alive, the openings are cancelled if it is closed meanwhile */
+  batch->cancellable = g_cancellable_new ();
+  mousepad_window_hold (window, &batch->destroyed);
+  g_signal_connect_swapped (window, "destroy", G_CALLBACK (g_cancellable_cancel), batch->cancellable);
+
+  /* show the progress of the operation */
+  batch->statusbar = MOUSEPAD_STATUSBAR (g_object_ref (window->statusbar));
+  message = g_strdup_printf (ngettext ("Loading %d file...", "Loading %d files...",
+                                       batch->items->len), batch->items->len);
+  mousepad_statusbar_push_progress (batch->statusbar, message, batch->cancellable);
+  g_free (message);
+
+  /* open the files concurrently */
+  mousepad_window_open_batch_schedule (batch);
+}
+
+
+
+void
+mousepad_window_open_files (MousepadWindow       *window,
+                            GFile               **files,
+                            gint                  n_files,
+                            MousepadEncoding      encoding,
+                            gboolean              must_exist,
+                            GAsyncReadyCallback   callback,
+                            gpointer              user_data)
+{
+  GTask *task;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (files != NULL);
+  g_return_if_fail (*files != NULL);
+
+  task = g_task_new (window, NULL, callback, user_data);
+  g_task_set_source_tag (task, mousepad_window_open_files);
+
+  /* block menu updates */
+  lock_menu_updates++;
+
+  /* open several files concurrently, unless the user has to choose an encoding for each */
+  if (n_files > 1 && encoding != MOUSEPAD_ENCODING_NONE)
+    mousepad_window_open_batch (window, files, n_files, encoding, must_exist, FALSE, task);
+  /* open new tabs with the files */
+  else
+    mousepad_window_open_list (window, files, n_files, encoding, must_exist, task);
+
+  /* allow menu updates again */
+  lock_menu_updates--;
+}
+
+
+
+/* returns the number of tabs in the window at the end of the opening, or -1 if it was
+ * closed in the meantime */
+gint
+mousepad_window_open_files_finish (MousepadWindow *window,
+                                   GAsyncResult   *result)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), -1);
+  g_return_val_if_fail (g_task_is_valid (result, window), -1);
+
+  return g_task_propagate_int (G_TASK (result), NULL);
+}
+
+
+
+/* the recovery of documents from their journals, one after the other */
+typedef struct
+{
+  MousepadWindow *window;
+  gboolean        destroyed;
+  gchar         **journals;
+  guint           next;
+
+  /* the origin of the journal being recovered */
+  GFile          *location;
+  GFile          *base_location;
+  guint64         base_digest;
+  goffset         base_size;
+}
+MousepadWindowRecover;
+
+
+
+static void mousepad_window_recover_next (MousepadWindowRecover *recover);
+
+
+
+/* replay the journal on the document, which contains its base if any */
+static void
+mousepad_window_recover_replay (MousepadWindow   *window,
+                                MousepadDocument *document,
+                                gint              retval,
+                                GError           *unused,
+                                gpointer          data)
+{
+  MousepadWindowRecover *recover = data;
+  const gchar           *journal = recover->journals[recover->next];
+  GError                *error = NULL;
+  guint64                digest;
+  goffset                size;
+
+  /* the journal is kept if its base can't be loaded, e.g. on an unmounted volume, the
+   * error having been reported */
+  if (retval != 0 || recover->destroyed)
+    goto next;
+
+  /* the changes can only be applied to the contents they were made on */
+  if (recover->base_location != NULL
+      && (! mousepad_file_get_digest (document->file, &digest, &size)
+          || digest != recover->base_digest || size != recover->base_size))
+    g_set_error (&error, G_IO_ERROR, G_IO_ERROR_FAILED,
+                 _("The file has been modified since the unsaved changes were made"));
+
+  /* replay the changes, they are not undoable */
+  if (error == NULL)
+    {
+      gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+      mousepad_journal_replay (journal, document->buffer, &error);
+      gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+    }
+
+  if (error == NULL)
+    {
+      /* the document is to be saved where it was */
+      if (recover->location != NULL
+          && (recover->base_location == NULL || ! g_file_equal (recover->location, recover->base_location)))
+        mousepad_file_set_location (document->file, recover->location, TRUE);
+
+      gtk_text_buffer_set_modified (document->buffer, TRUE);
+      mousepad_window_add (window, document);
+
+      /* the document records its own journal from now on */
+      mousepad_journal_discard (journal);
+    }
+  else
+    {
+      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to recover the document"));
+      g_error_free (error);
+    }
+
+  next:
+
+  /* cleanup */
+  g_object_unref (document);
+  g_clear_object (&recover->location);
+  g_clear_object (&recover->base_location);
+
+  recover->next++;
+  mousepad_window_recover_next (recover);
+}
+
+
+
+static void
+mousepad_window_recover_next (MousepadWindowRecover *recover)
+{
+  MousepadDocument *document;
+  MousepadEncoding  base_encoding;
+  GError           *error = NULL;
+
+  for (; recover->journals[recover->next] != NULL && ! recover->destroyed; recover->next++)
+    {
+      /* the journals are only discarded once replayed, they are kept on any failure
+       * so that the changes are not lost, until the user clears them */
+      if (! mousepad_journal_get_origin (recover->journals[recover->next], &recover->location,
+                                         &recover->base_location, &base_encoding,
+                                         &recover->base_digest, &recover->base_size, &error))
+        {
+          mousepad_dialogs_show_error (GTK_WINDOW (recover->window), error,
+                                       _("Failed to recover the document"));
+          g_clear_error (&error);
+          continue;
+        }
+
+      /* new document */
+      document = mousepad_document_new ();
+      g_object_ref_sink (document);
+
+      /* load the file the changes apply to, unless they start from a snapshot */
+      if (recover->base_location != NULL)
+        {
+          if (base_encoding == MOUSEPAD_ENCODING_NONE)
+            base_encoding = mousepad_encoding_get_default ();
+
+          mousepad_file_set_location (document->file, recover->base_location, TRUE);
+          mousepad_window_load_document (recover->window, document, base_encoding, TRUE,
+                                         mousepad_window_recover_replay, recover);
+        }
+      else
+        mousepad_window_recover_replay (recover->window, document, 0, NULL, recover);
+
+      /* the next journal is recovered once this one is */
+      return;
+    }
+
+  /* cleanup */
+  mousepad_window_release (recover->window, &recover->destroyed);
+  g_strfreev (recover->journals);
+  g_slice_free (MousepadWindowRecover, recover);
+}
+
+
+
+/* recover the documents whose unsaved changes were recorded in the given journals */
+void
+mousepad_window_recover (MousepadWindow  *window,
+                         gchar          **journals)
+{
+  MousepadWindowRecover *recover;
+  gint                   response;
+  guint                  n;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (journals != NULL);
+
+  /* ask the user, the journals are kept for the next time if they cancel */
+  response = mousepad_dialogs_recover (GTK_WINDOW (window), g_strv_length (journals));
+  if (response == MOUSEPAD_RESPONSE_CLEAR)
+    {
+      for (n = 0; journals[n] != NULL; n++)
+        mousepad_journal_discard (journals[n]);
+
+      return;
+    }
+  else if (response != MOUSEPAD_RESPONSE_RECOVER)
+    return;
+
+  /* keep the window alive, it may be closed while the documents are recovered */
+  recover = g_slice_new0 (MousepadWindowRecover);
+  recover->window = window;
+  recover->journals = g_strdupv (journals);
+  mousepad_window_hold (window, &recover->destroyed);
+
+  mousepad_window_recover_next (recover);
+}
+
+
+
+/* insert the document tab at @position, returning its page number */
+static gint
+mousepad_window_insert_document (MousepadWindow   *window,
+                                 MousepadDocument *document,
+                                 gint              position)
+{
+  GtkWidget *label;
+  gint       page;
+
+  /* receive the document occurrences count */
+  g_signal_connect_swapped (document, "search-completed",
+                            G_CALLBACK (mousepad_window_search_completed), window);
+
+  /* create the tab label */
+  label = mousepad_document_get_tab_label (document);
+
+  /* insert the page */
+  page = gtk_notebook_insert_page (GTK_NOTEBOOK (window->notebook),
+                                   GTK_WIDGET (document), label, position);
+
+  /* set tab child properties */
+  gtk_container_child_set (GTK_CONTAINER (window->notebook),
+                           GTK_WIDGET (document), "tab-expand", TRUE, NULL);
+  gtk_notebook_set_tab_reorderable (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document), TRUE);
+  gtk_notebook_set_tab_detachable (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document), TRUE);
+
+  /* show the document */
+  gtk_widget_show (GTK_WIDGET (document));
+
+  return page;
+}
+
+
+
+void
+mousepad_window_add (MousepadWindow   *window,
+                     MousepadDocument *document)
+{
+  gint              page;
+  MousepadDocument *prev_active = window->active;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (GTK_IS_NOTEBOOK (window->notebook));
+
+  /* insert the page right of the active tab */
+  page = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook));
+  page = mousepad_window_insert_document (window, document, page + 1);
+
+  /* don't bother about this when there was no previous active page (startup) */
+  if (G_LIKELY (prev_active != NULL))
+    {
+      /* switch to the new tab */
+      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page);
+
+      /* destroy the previous tab if it was not modified, untitled and the new tab is not untitled */
+      if (gtk_text_buffer_get_modified (prev_active->buffer) == FALSE
+          && ! mousepad_file_location_is_set (prev_active->file)
+          && mousepad_file_location_is_set (document->file))
+        gtk_widget_destroy (GTK_WIDGET (prev_active));
+    }
+
+  /* make sure the textview is focused in the new document */
+  mousepad_document_focus_textview (document);
+}
+
+
+
+static void
+mousepad_window_close_document_ready (MousepadWindow   *window,
+                                      MousepadDocument *document,
+                                      gint              succeed,
+                                      GError           *error,
+                                      gpointer          data)
+{
+  MousepadWindowFileCallback *close = data;
+
+  /* destroy the document once saved */
+  if (succeed)
+    gtk_widget_destroy (GTK_WIDGET (document));
+
+  if (close->func != NULL)
+    close->func (window, document, succeed, error, close->data);
+
+  g_slice_free (MousepadWindowFileCallback, close);
+}
+
+
+
+/* close a document, asking the user whether to save it first if it is modified: @func,
+ * which may be %NULL, is called with %TRUE if the document was closed */
+static void
+mousepad_window_close_document (MousepadWindow         *window,
+                                MousepadDocument       *document,
+                                MousepadWindowFileFunc  func,
+                                gpointer                data)
+{
+  MousepadWindowFileCallback *close;
+  gint                        response = MOUSEPAD_RESPONSE_DONT_SAVE;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* check if the document has been modified, and run save changes dialog */
+  if (gtk_text_buffer_get_modified (document->buffer))
+    response = mousepad_dialogs_save_changes (GTK_WINDOW (window),
+                                              mousepad_file_get_read_only (document->file));
+
+  close = g_slice_new (MousepadWindowFileCallback);
+  close->func = func;
+  close->data = data;
+
+  /* keep the document alive until the end, it is destroyed on success */
+  g_object_ref (document);
+
+  switch (response)
+    {
+      case MOUSEPAD_RESPONSE_DONT_SAVE:
+        /* don't save, only destroy the document */
+        mousepad_window_close_document_ready (window, document, TRUE, NULL, close);
+        break;
+
+      case MOUSEPAD_RESPONSE_SAVE:
+        mousepad_window_save_document (window, document, mousepad_window_close_document_ready, close);
+        break;
+
+      case MOUSEPAD_RESPONSE_SAVE_AS:
+        mousepad_window_save_as_document (window, document, mousepad_window_close_document_ready, close);
+        break;
+
+      default:
+        /* do nothing */
+        mousepad_window_close_document_ready (window, document, FALSE, NULL, close);
+        break;
+    }
+
+  g_object_unref (document);
+}
+
+
+
+/* the closing of the documents of a window, from the last one */
+typedef struct
+{
+  gboolean  destroyed;
+  GTask    *task;
+}
+MousepadWindowClose;
+
+
+
+static void
+mousepad_window_close_next (MousepadWindow   *window,
+                            MousepadDocument *document,
+                            gint              succeed,
+                            GError           *error,
+                            gpointer          data)
+{
+  MousepadWindowClose *close = data;
+  GtkWidget           *page;
+  GAction             *action;
+  gint                 page_num;
+
+  /* the lazy tabs have nothing to save, drop them */
+  while (! close->destroyed && succeed
+         && (page_num = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)) - 1) >= 0
+         && ! MOUSEPAD_IS_DOCUMENT (page = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), page_num)))
+    gtk_widget_destroy (page);
+
+  /* the window is destroyed with its last document */
+  if (close->destroyed)
+    succeed = TRUE;
+  /* ask what to do with the next modified document, stop if the user wants to keep it */
+  else if (succeed && (page_num = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)) - 1) >= 0)
+    {
+      /* focus the tab we're going to close */
+      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+      /* close the document, the next one being closed once it is */
+      document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), page_num));
+      mousepad_window_close_document (window, document, mousepad_window_close_next, close);
+
+      return;
+    }
+
+  /* store the close result as the action state */
+  if (! close->destroyed)
+    {
+      action = g_action_map_lookup_action (G_ACTION_MAP (window), "file.close-window");
+      g_action_change_state (action, g_variant_new_int32 (succeed));
+    }
+
+  /* cleanup */
+  g_task_return_boolean (close->task, succeed);
+  g_object_unref (close->task);
+  mousepad_window_release (window, &close->destroyed);
+  g_slice_free (MousepadWindowClose, close);
+}
+
+
+
+/* close the documents of the window, asking the user what to do with the modified ones,
+ * the window being destroyed with the last of them */
+void
+mousepad_window_close (MousepadWindow      *window,
+                       GAsyncReadyCallback  callback,
+                       gpointer             user_data)
+{
+  MousepadWindowClose *close;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  close = g_slice_new (MousepadWindowClose);
+  close->task = g_task_new (window, NULL, callback, user_data);
+  g_task_set_source_tag (close->task, mousepad_window_close);
+
+  /* keep the window alive, it is destroyed with its last document */
+  mousepad_window_hold (window, &close->destroyed);
+
+  /* the window may be hidden without any document, e.g. when running the encoding
+   * dialog at startup */
+  if (gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)) == 0)
+    gtk_widget_destroy (GTK_WIDGET (window));
+
+  mousepad_window_close_next (window, NULL, TRUE, NULL, close);
+}
+
+
+
+/* returns whether all the documents were closed, or %FALSE if the user kept one */
+gboolean
+mousepad_window_close_finish (MousepadWindow *window,
+                              GAsyncResult   *result)
+{
+  g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, window), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), NULL);
+}
+
+
+
+static void
+mousepad_window_button_close_tab (MousepadDocument *document,
+                                  MousepadWindow   *window)
+{
+  gint page_num;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* switch to the tab we're going to close */
+  page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
+  gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+  /* close the document */
+  mousepad_window_close_document (window, document, NULL, NULL);
+}
+
+
+
+static void
+mousepad_window_set_title (MousepadWindow *window)
+{
+  gchar            *string;
+  const gchar      *title;
+  gboolean          show_full_path;
+  MousepadDocument *document = window->active;
+
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+
+  /* whether to show the full path */
+  show_full_path = MOUSEPAD_SETTING_GET_BOOLEAN (PATH_IN_TITLE);
+
+  /* name we display in the title */
+  if (G_UNLIKELY (show_full_path && mousepad_document_get_filename (document)))
+    title = mousepad_document_get_filename (document);
+  else
+    title = mousepad_document_get_basename (document);
+
+  /* build the title */
+  if (G_UNLIKELY (mousepad_file_get_read_only (document->file)))
+    string = g_strdup_printf ("%s%s [%s] - %s",
+                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
+                              title, _("Read Only"), PACKAGE_NAME);
+  else if (G_UNLIKELY (! gtk_text_view_get_editable (GTK_TEXT_VIEW (document->textview))))
+    string = g_strdup_printf ("%s%s [%s] - %s",
+                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
+                              title, _("Viewer Mode"), PACKAGE_NAME);
+  else
+    string = g_strdup_printf ("%s%s - %s",
+                              gtk_text_buffer_get_modified (document->buffer) ? "*" : "",
+                              title, PACKAGE_NAME);
+
+  /* set the window title */
+  gtk_window_set_title (GTK_WINDOW (window), string);
+
+  /* cleanup */
+  g_free (string);
+}
+
+
+
+/* give the statusbar a languages menu created from the application resources */
+GtkWidget *
+mousepad_window_get_languages_menu (MousepadWindow *window)
 {
   g_return_val_if_fail (MOUSEPAD_IS_WINDOW (window), NULL);
 
@@ -2423,6 +4024,16 @@ mousepad_window_update_bar_visibility (MousepadWindow *window,
 /**
  * Notebook Signal Functions
  **/
+static gboolean
+mousepad_window_is_savable (MousepadWindow *window)
+{
+  /* a file viewed page by page is only partly in the buffer */
+  return mousepad_document_get_pager (window->active) == NULL
+         && mousepad_file_is_savable (window->active->file);
+}
+
+
+
 static void
 mousepad_window_update_actions (MousepadWindow *window)
 {
@@ -2433,7 +4044,17 @@ mousepad_window_update_actions (MousepadWindow *window)
   MousepadLineEnding  line_ending;
   gboolean            cycle_tabs, value;
   gint                n_pages, page_num;
+  guint               n;
   const gchar        *language_id;
+  const gchar        *edit_actions[] =
+  {
+    "file.save-as", "document.viewer-mode", "document.follow",
+    "edit.paste-special.paste-from-history", "edit.paste-special.paste-as-column",
+    "edit.delete-line", "edit.duplicate-line-selection",
+    "edit.convert.tabs-to-spaces", "edit.convert.spaces-to-tabs",
+    "edit.convert.strip-trailing-spaces", "edit.convert.transpose",
+    "edit.increase-indent", "edit.decrease-indent", "search.find-and-replace"
+  };
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
 
@@ -2464,8 +4085,7 @@ mousepad_window_update_actions (MousepadWindow *window)
 
       /* set the reload, detach and save sensitivity */
       action = g_action_map_lookup_action (G_ACTION_MAP (window), "file.save");
-      g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                   mousepad_file_is_savable (document->file));
+      g_simple_action_set_enabled (G_SIMPLE_ACTION (action), mousepad_window_is_savable (window));
 
       action = g_action_map_lookup_action (G_ACTION_MAP (window), "file.detach-tab");
       g_simple_action_set_enabled (G_SIMPLE_ACTION (action), n_pages > 1);
@@ -2493,6 +4113,22 @@ mousepad_window_update_actions (MousepadWindow *window)
       g_action_group_change_action_state (G_ACTION_GROUP (window), "document.viewer-mode",
                                           g_variant_new_boolean (value));
 
+      /* follow mode */
+      value = mousepad_file_get_follow (document->file);
+      g_action_group_change_action_state (G_ACTION_GROUP (window), "document.follow",
+                                          g_variant_new_boolean (value));
+
+      /* a file viewed page by page is only partly in the buffer, which can't be edited */
+      value = (mousepad_document_get_pager (document) == NULL);
+      for (n = 0; n < G_N_ELEMENTS (edit_actions); n++)
+        {
+          action = g_action_map_lookup_action (G_ACTION_MAP (window), edit_actions[n]);
+          g_simple_action_set_enabled (G_SIMPLE_ACTION (action), value);
+        }
+
+      /* and those depending on the focus and the selection */
+      mousepad_window_enable_edit_actions (G_OBJECT (document->buffer), NULL, window);
+
       /* update the currently active language */
       language = gtk_source_buffer_get_language (GTK_SOURCE_BUFFER (document->buffer));
       language_id = language ? gtk_source_language_get_id (language) : "plain-text";
@@ -2509,6 +4145,210 @@ mousepad_window_update_actions (MousepadWindow *window)
 
 
 
+static void
+mousepad_window_lazy_load_ready (MousepadWindow   *window,
+                                 MousepadDocument *document,
+                                 gint              retval,
+                                 GError           *error,
+                                 gpointer          data)
+{
+  /* drop the tab of a file that could not be opened, unless it was closed meanwhile */
+  if (retval != 0)
+    {
+      if (gtk_widget_get_parent (GTK_WIDGET (document)) != NULL)
+        gtk_widget_destroy (GTK_WIDGET (document));
+
+      return;
+    }
+
+  /* insert in the recent history */
+  mousepad_window_recent_add (window, document->file);
+
+  gtk_widget_set_sensitive (GTK_WIDGET (document->textview), TRUE);
+  mousepad_document_focus_textview (document);
+}
+
+
+
+/* a lazy tab, which only holds the file to open until it is shown: it is then replaced
+ * with the document of the file, so that only the visited tabs take memory */
+static GtkWidget *
+mousepad_window_placeholder_new (GFile            *file,
+                                 MousepadEncoding  encoding,
+                                 gboolean          must_exist)
+{
+  GtkWidget *placeholder;
+  gchar     *basename;
+
+  placeholder = gtk_box_new (GTK_ORIENTATION_VERTICAL, 0);
+  g_object_ref_sink (placeholder);
+
+  /* what to open once shown */
+  mousepad_object_set_data_full (placeholder, "placeholder-file", g_object_ref (file), g_object_unref);
+  mousepad_object_set_data (placeholder, "placeholder-encoding", GINT_TO_POINTER (encoding));
+  mousepad_object_set_data (placeholder, "lazy-load", GINT_TO_POINTER (must_exist ? 2 : 1));
+
+  /* the names shown in the tab label and the menus */
+  basename = g_file_get_basename (file);
+  mousepad_object_set_data_full (placeholder, "placeholder-basename",
+                                 g_filename_display_name (basename), g_free);
+  mousepad_object_set_data_full (placeholder, "placeholder-filename",
+                                 g_file_get_parse_name (file), g_free);
+  g_free (basename);
+
+  return placeholder;
+}
+
+
+
+/* a tab label similar to the one of the documents */
+static GtkWidget *
+mousepad_window_placeholder_get_tab_label (GtkWidget *placeholder)
+{
+  GtkWidget *hbox, *ebox, *label, *button;
+
+  hbox = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, 0);
+  gtk_widget_show (hbox);
+
+  ebox = g_object_new (GTK_TYPE_EVENT_BOX, "border-width", 2, "visible-window", FALSE, NULL);
+  gtk_box_pack_start (GTK_BOX (hbox), ebox, TRUE, TRUE, 0);
+  gtk_widget_set_tooltip_text (ebox, mousepad_object_get_data (placeholder, "placeholder-filename"));
+  gtk_widget_show (ebox);
+
+  label = gtk_label_new (mousepad_object_get_data (placeholder, "placeholder-basename"));
+  gtk_label_set_ellipsize (GTK_LABEL (label), PANGO_ELLIPSIZE_MIDDLE);
+  gtk_container_add (GTK_CONTAINER (ebox), label);
+  gtk_widget_show (label);
+
+  /* there is nothing to save, the tab is simply dropped */
+  button = mousepad_close_button_new ();
+  gtk_widget_set_tooltip_text (button, _("Close this tab"));
+  gtk_box_pack_start (GTK_BOX (hbox), button, FALSE, FALSE, 0);
+  g_signal_connect_swapped (button, "clicked", G_CALLBACK (gtk_widget_destroy), placeholder);
+  gtk_widget_show (button);
+
+  return hbox;
+}
+
+
+
+/* add a lazy tab for @file at @position */
+static GtkWidget *
+mousepad_window_placeholder_add (MousepadWindow   *window,
+                                 GFile            *file,
+                                 MousepadEncoding  encoding,
+                                 gboolean          must_exist,
+                                 gint              position)
+{
+  GtkWidget *placeholder;
+
+  placeholder = mousepad_window_placeholder_new (file, encoding, must_exist);
+  gtk_notebook_insert_page (GTK_NOTEBOOK (window->notebook), placeholder,
+                            mousepad_window_placeholder_get_tab_label (placeholder), position);
+
+  /* it can't be moved to another window, not being a document */
+  gtk_container_child_set (GTK_CONTAINER (window->notebook), placeholder, "tab-expand", TRUE, NULL);
+  gtk_notebook_set_tab_reorderable (GTK_NOTEBOOK (window->notebook), placeholder, TRUE);
+  gtk_widget_show (placeholder);
+
+  g_object_unref (placeholder);
+
+  return placeholder;
+}
+
+
+
+/* replace a lazy tab with its document, shown in its place, and start loading the file */
+static void
+mousepad_window_placeholder_load (MousepadWindow *window,
+                                  GtkWidget      *placeholder)
+{
+  MousepadDocument *document;
+  gint              page_num, lazy_load;
+
+  page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), placeholder);
+  if (page_num == -1)
+    return;
+
+  /* new document */
+  document = mousepad_document_new ();
+  g_object_ref_sink (document);
+  mousepad_file_set_location (document->file, mousepad_object_get_data (placeholder, "placeholder-file"), TRUE);
+  mousepad_file_set_encoding (document->file,
+                              GPOINTER_TO_INT (mousepad_object_get_data (placeholder, "placeholder-encoding")));
+  lazy_load = GPOINTER_TO_INT (mousepad_object_get_data (placeholder, "lazy-load"));
+
+  /* take the place of the tab and show it */
+  if (window->placeholder == placeholder)
+    window->placeholder = NULL;
+
+  mousepad_window_insert_document (window, document, page_num);
+  gtk_widget_destroy (placeholder);
+  gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+  /* prevent editing until the contents are there */
+  gtk_widget_set_sensitive (GTK_WIDGET (document->textview), FALSE);
+
+  mousepad_window_load_document (window, document, mousepad_file_get_encoding (document->file),
+                                 lazy_load == 2, mousepad_window_lazy_load_ready, NULL);
+
+  /* the notebook holds the document */
+  g_object_unref (document);
+}
+
+
+
+/* switch to the lazy tab of @file if there is one, in this window or another one */
+static gboolean
+mousepad_window_switch_to_placeholder (MousepadWindow *window,
+                                       GFile          *file)
+{
+  GtkNotebook *notebook;
+  GtkWidget   *page;
+  GList       *li;
+  gint         n;
+
+  for (li = gtk_application_get_windows (GTK_APPLICATION (g_application_get_default ()));
+       li != NULL; li = li->next)
+    {
+      if (! MOUSEPAD_IS_WINDOW (li->data))
+        continue;
+
+      notebook = GTK_NOTEBOOK (MOUSEPAD_WINDOW (li->data)->notebook);
+      for (n = 0; (page = gtk_notebook_get_nth_page (notebook, n)) != NULL; n++)
+        if (! MOUSEPAD_IS_DOCUMENT (page)
+            && g_file_equal (file, mousepad_object_get_data (page, "placeholder-file")))
+          {
+            /* switch to the tab, which loads it */
+            gtk_notebook_set_current_page (notebook, n);
+
+            /* raise the window which contains it */
+            if (li->data != window)
+              gtk_window_present (GTK_WINDOW (li->data));
+
+            return TRUE;
+          }
+    }
+
+  return FALSE;
+}
+
+
+
+static gboolean
+mousepad_window_lazy_load_idle (gpointer data)
+{
+  MousepadWindow *window = data;
+
+  /* the tab may have been closed in the meantime */
+  if (window->placeholder != NULL)
+    mousepad_window_placeholder_load (window, window->placeholder);
+
+  return FALSE;
+}
+
+
+
 static void
 mousepad_window_notebook_switch_page (GtkNotebook    *notebook,
                                       GtkWidget      *page,
@@ -2520,8 +4360,22 @@ mousepad_window_notebook_switch_page (GtkNotebook    *notebook,
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (GTK_IS_NOTEBOOK (notebook));
 
+  /* a lazy tab is not shown, but replaced with its document once idle, which is then
+   * switched to */
+  if (! MOUSEPAD_IS_DOCUMENT (page))
+    {
+      g_signal_stop_emission_by_name (notebook, "switch-page");
+      if (window->placeholder == NULL)
+        g_idle_add_full (G_PRIORITY_HIGH, mousepad_window_lazy_load_idle,
+                         g_object_ref (window), g_object_unref);
+
+      window->placeholder = page;
+
+      return;
+    }
+
   /* get the new active document */
-  document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (notebook, page_num));
+  document = MOUSEPAD_DOCUMENT (page);
 
   /* only update when really changed */
   if (G_LIKELY (window->active != document))
@@ -2549,10 +4403,18 @@ mousepad_window_notebook_added (GtkNotebook     *notebook,
                                 guint            page_num,
                                 MousepadWindow  *window)
 {
-  MousepadDocument *document = MOUSEPAD_DOCUMENT (page);
+  MousepadDocument *document;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
-  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* a lazy tab has nothing to connect to */
+  if (! MOUSEPAD_IS_DOCUMENT (page))
+    {
+      mousepad_window_update_tabs (window, NULL, NULL);
+      return;
+    }
+
+  document = MOUSEPAD_DOCUMENT (page);
 
   /* connect signals to the document for this window */
   g_signal_connect (page, "close-tab",
@@ -2565,6 +4427,8 @@ mousepad_window_notebook_added (GtkNotebook     *notebook,
                     G_CALLBACK (mousepad_window_language_changed), window);
   g_signal_connect (page, "overwrite-changed",
                     G_CALLBACK (mousepad_window_overwrite_changed), window);
+  g_signal_connect (page, "reduced-changed",
+                    G_CALLBACK (mousepad_window_reduced_changed), window);
   g_signal_connect (page, "drag-data-received",
                     G_CALLBACK (mousepad_window_drag_data_received), window);
   g_signal_connect (document->buffer, "notify::has-selection",
@@ -2586,6 +4450,9 @@ mousepad_window_notebook_added (GtkNotebook     *notebook,
   g_signal_connect (document->textview, "notify::has-focus",
                     G_CALLBACK (mousepad_window_enable_edit_actions), window);
 
+  /* make the document findable from all the windows */
+  mousepad_application_add_document (MOUSEPAD_APPLICATION (g_application_get_default ()), document);
+
   /* change the visibility of the tabs accordingly */
   mousepad_window_update_tabs (window, NULL, NULL);
 }
@@ -2598,18 +4465,29 @@ mousepad_window_notebook_removed (GtkNotebook     *notebook,
                                   guint            page_num,
                                   MousepadWindow  *window)
 {
-  MousepadDocument *document = MOUSEPAD_DOCUMENT (page);
+  MousepadDocument *document;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
-  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
   g_return_if_fail (GTK_IS_NOTEBOOK (notebook));
 
+  /* a lazy tab has nothing to disconnect */
+  if (! MOUSEPAD_IS_DOCUMENT (page))
+    {
+      if (window->placeholder == page)
+        window->placeholder = NULL;
+
+      goto update;
+    }
+
+  document = MOUSEPAD_DOCUMENT (page);
+
   /* disconnect the old document signals */
   mousepad_disconnect_by_func (page, mousepad_window_button_close_tab, window);
   mousepad_disconnect_by_func (page, mousepad_window_cursor_changed, window);
   mousepad_disconnect_by_func (page, mousepad_window_encoding_changed, window);
   mousepad_disconnect_by_func (page, mousepad_window_language_changed, window);
   mousepad_disconnect_by_func (page, mousepad_window_overwrite_changed, window);
+  mousepad_disconnect_by_func (page, mousepad_window_reduced_changed, window);
   mousepad_disconnect_by_func (page, mousepad_window_drag_data_received, window);
   mousepad_disconnect_by_func (document->buffer, mousepad_window_enable_edit_actions, window);
   mousepad_disconnect_by_func (document->buffer, mousepad_window_can_undo, window);
@@ -2621,10 +4499,19 @@ mousepad_window_notebook_removed (GtkNotebook     *notebook,
   mousepad_disconnect_by_func (document->textview, mousepad_window_menu_textview_popup, window);
   mousepad_disconnect_by_func (document->textview, mousepad_window_enable_edit_actions, window);
 
-  /* reset the reference to NULL to avoid illegal memory access */
+  /* the document may be moved to another window, which will index it again */
+  mousepad_application_remove_document (MOUSEPAD_APPLICATION (g_application_get_default ()), document);
+
+  /* reset the references to NULL to avoid illegal memory access, the next active
+   * document may only be set once idle, if the next tab is a lazy one */
   if (window->previous == document)
     window->previous = NULL;
 
+  if (window->active == document)
+    window->active = NULL;
+
+  update:
+
   /* window contains no tabs: save geometry and destroy it */
   if (gtk_notebook_get_n_pages (notebook) == 0)
     {
@@ -2727,6 +4614,19 @@ mousepad_window_notebook_button_press_event (GtkNotebook    *notebook,
           /* check if the cursor is inside this label */
           if (event->x_root >= x_root && event->x_root <= (x_root + alloc.width))
             {
+              /* a lazy tab is simply dropped, or replaced with its document right away,
+               * for the menu to apply to it */
+              if (! MOUSEPAD_IS_DOCUMENT (page))
+                {
+                  if (event->button == 2)
+                    {
+                      gtk_widget_destroy (page);
+                      return TRUE;
+                    }
+
+                  mousepad_window_placeholder_load (window, page);
+                }
+
               /* switch to this tab */
               gtk_notebook_set_current_page (notebook, page_num);
 
@@ -2865,7 +4765,7 @@ mousepad_window_pending_tab (GtkNotebook  *notebook,
                              guint         page_num,
                              MousepadFile *file)
 {
-  if (MOUSEPAD_DOCUMENT (page)->file == file)
+  if (MOUSEPAD_IS_DOCUMENT (page) && MOUSEPAD_DOCUMENT (page)->file == file)
     {
       /* disconnect this handler */
       mousepad_disconnect_by_func (notebook, mousepad_window_pending_tab, file);
@@ -2957,7 +4857,7 @@ mousepad_window_readonly_changed (MousepadFile   *file,
 
       /* set the save action sensitivity */
       action = g_action_map_lookup_action (G_ACTION_MAP (window), "file.save");
-      g_simple_action_set_enabled (G_SIMPLE_ACTION (action), mousepad_file_is_savable (file));
+      g_simple_action_set_enabled (G_SIMPLE_ACTION (action), mousepad_window_is_savable (window));
     }
 }
 
@@ -2978,8 +4878,7 @@ mousepad_window_modified_changed (GtkTextBuffer  *buffer,
 
       /* set the save action sensitivity */
       action = g_action_map_lookup_action (G_ACTION_MAP (window), "file.save");
-      g_simple_action_set_enabled (G_SIMPLE_ACTION (action),
-                                   mousepad_file_is_savable (window->active->file));
+      g_simple_action_set_enabled (G_SIMPLE_ACTION (action), mousepad_window_is_savable (window));
 
       /* update document dependent menu items */
       mousepad_window_update_document_menu_items (window);
@@ -2997,11 +4896,11 @@ mousepad_window_enable_edit_actions (GObject        *object,
   GList            *items;
   GAction          *action;
   guint             n;
-  gboolean          enabled;
-  const gchar      *focus_actions[] = { "edit.paste", "edit.delete-selection", "edit.select-all" };
+  gboolean          enabled, editable;
+  const gchar      *focus_actions[] = { "edit.select-all", "edit.paste", "edit.delete-selection" };
   const gchar      *select_actions[] =
   {
-    "edit.cut", "edit.copy",
+    "edit.copy", "edit.cut",
     "edit.convert.to-lowercase", "edit.convert.to-uppercase",
     "edit.convert.to-title-case", "edit.convert.to-opposite-case",
     "edit.move-selection.line-up", "edit.move-selection.line-down"
@@ -3009,6 +4908,10 @@ mousepad_window_enable_edit_actions (GObject        *object,
 
   if (GTK_IS_TEXT_VIEW (object) || document->buffer == GTK_TEXT_BUFFER (object))
     {
+      /* the actions after the first one of each list modify the buffer, which a file
+       * viewed page by page only partly holds */
+      editable = (mousepad_document_get_pager (document) == NULL);
+
       /* actions enabled only in a focused text view or in the text view menu,
        * to prevent conflicts with GtkEntry keybindings */
       items = gtk_container_get_children (GTK_CONTAINER (window->textview_menu));
@@ -3017,7 +4920,7 @@ mousepad_window_enable_edit_actions (GObject        *object,
       for (n = 0; n < G_N_ELEMENTS (focus_actions); n++)
         {
           action = g_action_map_lookup_action (G_ACTION_MAP (window), focus_actions[n]);
-          g_simple_action_set_enabled (G_SIMPLE_ACTION (action), enabled);
+          g_simple_action_set_enabled (G_SIMPLE_ACTION (action), enabled && (n == 0 || editable));
         }
 
       /* actions enabled only for selections, in addition to the above conditions */
@@ -3025,7 +4928,7 @@ mousepad_window_enable_edit_actions (GObject        *object,
       for (n = 0; n < G_N_ELEMENTS (select_actions); n++)
         {
           action = g_action_map_lookup_action (G_ACTION_MAP (window), select_actions[n]);
-          g_simple_action_set_enabled (G_SIMPLE_ACTION (action), enabled);
+          g_simple_action_set_enabled (G_SIMPLE_ACTION (action), enabled && (n == 0 || editable));
         }
     }
 }
@@ -3095,6 +4998,21 @@ mousepad_window_overwrite_changed (MousepadDocument *document,
 
 
 
+static void
+mousepad_window_reduced_changed (MousepadDocument *document,
+                                 gboolean          reduced,
+                                 MousepadWindow   *window)
+{
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
+
+  /* show or hide the large document indicator in the statusbar */
+  if (window->statusbar && window->active == document)
+    mousepad_statusbar_set_reduced (MOUSEPAD_STATUSBAR (window->statusbar), reduced);
+}
+
+
+
 static void
 mousepad_window_can_undo (GtkSourceBuffer *buffer,
                           GParamSpec      *unused,
@@ -3554,7 +5472,7 @@ mousepad_window_update_gomenu (GSimpleAction *action,
                                gpointer       data)
 {
   MousepadWindow   *window = MOUSEPAD_WINDOW (data);
-  MousepadDocument *document;
+  GtkWidget        *page;
   GtkApplication   *application;
   GMenu            *menu;
   GMenuItem        *item;
@@ -3586,13 +5504,22 @@ mousepad_window_update_gomenu (GSimpleAction *action,
 
       for (n = 0; n < n_pages; ++n)
         {
-          document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), n));
+          page = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), n);
 
           /* add the item to the "Go to Tab" submenu */
-          label = mousepad_document_get_basename (document);
+          if (MOUSEPAD_IS_DOCUMENT (page))
+            {
+              label = mousepad_document_get_basename (MOUSEPAD_DOCUMENT (page));
+              tooltip = mousepad_document_get_filename (MOUSEPAD_DOCUMENT (page));
+            }
+          else
+            {
+              label = mousepad_object_get_data (page, "placeholder-basename");
+              tooltip = mousepad_object_get_data (page, "placeholder-filename");
+            }
+
           action_name = g_strdup_printf ("win.document.go-to-tab(%d)", n);
           item = g_menu_item_new (label, action_name);
-          tooltip = mousepad_document_get_filename (document);
           if (tooltip)
             g_menu_item_set_attribute_value (item, "tooltip", g_variant_new_string (tooltip));
           g_free (action_name);
@@ -3841,15 +5768,53 @@ mousepad_window_recent_get_charset (GtkRecentInfo *info)
   description = gtk_recent_info_get_description (info);
   if (G_LIKELY (description))
     {
-      /* get the offset length: 'Encoding: ' */
-      offset = strlen (_("Charset")) + 2;
+      /* get the offset length: 'Encoding: ' */
+      offset = strlen (_("Charset")) + 2;
+
+      /* check if the encoding string looks valid, if so, set it */
+      if (G_LIKELY (strlen (description) > offset))
+        charset = description + offset;
+    }
+
+  return charset;
+}
+
+
+
+/* the encoding the file was last opened with, according to the recent history */
+static MousepadEncoding
+mousepad_window_recent_get_encoding (MousepadWindow *window,
+                                     GFile          *file)
+{
+  MousepadEncoding  encoding = MOUSEPAD_ENCODING_NONE;
+  GtkRecentInfo    *info;
+  const gchar      *charset;
+  gchar            *uri;
+
+  /* make sure the recent manager is initialized */
+  mousepad_window_recent_manager_init (window);
+
+  /* build uri */
+  uri = g_file_get_uri (file);
+
+  /* try to lookup the recent item */
+  if (G_LIKELY (uri != NULL))
+    {
+      info = gtk_recent_manager_lookup_item (window->recent_manager, uri, NULL);
 
-      /* check if the encoding string looks valid, if so, set it */
-      if (G_LIKELY (strlen (description) > offset))
-        charset = description + offset;
+      /* cleanup */
+      g_free (uri);
+
+      if (G_LIKELY (info != NULL))
+        {
+          /* try to find the encoding */
+          charset = mousepad_window_recent_get_charset (info);
+          encoding = mousepad_encoding_find (charset);
+          gtk_recent_info_unref (info);
+        }
     }
 
-  return charset;
+  return encoding;
 }
 
 
@@ -3936,7 +5901,7 @@ mousepad_window_drag_data_received (GtkWidget        *widget,
       /* open the files */
       data = g_ptr_array_free (files, FALSE);
       mousepad_window_open_files (window, (GFile **) data, n_pages,
-                                  mousepad_encoding_get_default (), TRUE);
+                                  mousepad_encoding_get_default (), TRUE, NULL, NULL);
 
       /* cleanup */
       g_strfreev (uris);
@@ -4015,9 +5980,10 @@ mousepad_window_search (MousepadWindow      *window,
   if (flags & MOUSEPAD_SEARCH_FLAGS_AREA_ALL_DOCUMENTS)
     for (n = 0; n < gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)); n++)
       {
-        /* search in the nth document */
+        /* search in the nth document, the lazy tabs are not loaded for that */
         document = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), n);
-        mousepad_document_search (MOUSEPAD_DOCUMENT (document), string, replacement, flags);
+        if (MOUSEPAD_IS_DOCUMENT (document))
+          mousepad_document_search (MOUSEPAD_DOCUMENT (document), string, replacement, flags);
       }
   /* search in the active document */
   else
@@ -4056,6 +6022,8 @@ mousepad_window_search_completed (MousepadWindow      *window,
   static GList *documents = NULL, *n_matches_docs = NULL;
   static gchar *multi_string = NULL;
   static gint   n_matches = 0, n_documents = 0;
+  GtkWidget    *page;
+  gint          n, n_pages = 0;
   GList        *up_doc, *up_match;
   gint          index;
 
@@ -4139,8 +6107,12 @@ mousepad_window_search_completed (MousepadWindow      *window,
           n_documents++;
         }
 
-      /* exit if all documents have not yet send their result */
-      if (n_documents < gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)))
+      /* exit if all documents have not yet send their result, the lazy tabs don't search */
+      for (n = 0; (page = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), n)) != NULL; n++)
+        if (MOUSEPAD_IS_DOCUMENT (page))
+          n_pages++;
+
+      if (n_documents < n_pages)
         return;
 
       /* send the final result, only relevant for the replace dialog */
@@ -4511,6 +6483,7 @@ mousepad_window_action_open (GSimpleAction *action,
 {
   MousepadWindow   *window = MOUSEPAD_WINDOW (data);
   MousepadEncoding  encoding;
+  GPtrArray        *array;
   GSList           *files, *file;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
@@ -4520,25 +6493,43 @@ mousepad_window_action_open (GSimpleAction *action,
   if (G_LIKELY (mousepad_dialogs_open (GTK_WINDOW (window),
                                        mousepad_file_get_location (window->active->file),
                                        &files, &encoding)
-                == GTK_RESPONSE_ACCEPT))
+                == GTK_RESPONSE_ACCEPT) && files != NULL)
     {
-      /* lock menu updates */
-      lock_menu_updates++;
-
       /* open all the selected locations in new tabs */
+      array = g_ptr_array_new ();
       for (file = files; file != NULL; file = file->next)
-        mousepad_window_open_file (window, file->data, encoding, TRUE);
+        g_ptr_array_add (array, file->data);
+
+      mousepad_window_open_files (window, (GFile **) array->pdata, array->len, encoding, TRUE, NULL, NULL);
 
       /* cleanup */
+      g_ptr_array_free (array, TRUE);
       g_slist_free_full (files, g_object_unref);
-
-      /* allow menu updates again */
-      lock_menu_updates--;
     }
 }
 
 
 
+static void
+mousepad_window_open_recent_ready (MousepadWindow   *window,
+                                   MousepadDocument *document,
+                                   gint              retval,
+                                   GError           *error,
+                                   gpointer          data)
+{
+  gchar *uri = data;
+
+  /* update the document history, don't both the user if this fails */
+  if (G_LIKELY (retval == 0))
+    gtk_recent_manager_add_item (window->recent_manager, uri);
+  else if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    gtk_recent_manager_remove_item (window->recent_manager, uri, NULL);
+
+  g_free (uri);
+}
+
+
+
 static void
 mousepad_window_action_open_recent (GSimpleAction *action,
                                     GVariant      *value,
@@ -4549,7 +6540,6 @@ mousepad_window_action_open_recent (GSimpleAction *action,
   GtkRecentInfo    *info;
   GFile            *file;
   const gchar      *uri, *charset;
-  gboolean          succeed = FALSE;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
 
@@ -4569,16 +6559,11 @@ mousepad_window_action_open_recent (GSimpleAction *action,
           /* lookup the encoding */
           encoding = mousepad_encoding_find (charset);
 
-          /* try to open the file */
+          /* try to open the file, the history is updated at the end */
           file = g_file_new_for_uri (uri);
-          succeed = mousepad_window_open_file (window, file, encoding, TRUE);
+          mousepad_window_open_file (window, file, encoding, TRUE,
+                                     mousepad_window_open_recent_ready, g_strdup (uri));
           g_object_unref (file);
-
-          /* update the document history, don't both the user if this fails */
-          if (G_LIKELY (succeed))
-            gtk_recent_manager_add_item (window->recent_manager, uri);
-          else
-            gtk_recent_manager_remove_item (window->recent_manager, uri, NULL);
         }
     }
 }
@@ -4610,6 +6595,20 @@ mousepad_window_action_clear_recent (GSimpleAction *action,
 
 
 
+static void
+mousepad_window_action_save_ready (MousepadWindow   *window,
+                                   MousepadDocument *document,
+                                   gint              succeed,
+                                   GError           *error,
+                                   gpointer          data)
+{
+  /* store the save result as the action state, unless the window was closed meanwhile */
+  if (! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    g_action_change_state (G_ACTION (data), g_variant_new_int32 (succeed));
+}
+
+
+
 static void
 mousepad_window_action_save (GSimpleAction *action,
                              GVariant      *value,
@@ -4617,65 +6616,12 @@ mousepad_window_action_save (GSimpleAction *action,
 {
   MousepadWindow   *window = MOUSEPAD_WINDOW (data);
   MousepadDocument *document = window->active;
-  GError           *error = NULL;
-  GVariant         *v_succeed;
-  gboolean          succeed = FALSE;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
-  if (! mousepad_file_location_is_set (document->file))
-    {
-      /* file has no filename yet, open the save as dialog */
-      g_action_group_activate_action (G_ACTION_GROUP (window), "file.save-as", NULL);
-      v_succeed = g_action_group_get_action_state (G_ACTION_GROUP (window), "file.save-as");
-      succeed = g_variant_get_int32 (v_succeed);
-      g_variant_unref (v_succeed);
-    }
-  else
-    {
-      /* try to save the file */
-      succeed = mousepad_file_save (document->file, FALSE, &error);
-
-      /* file has been externally modified */
-      if (G_UNLIKELY (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)))
-        {
-          /* cleanup */
-          g_clear_error (&error);
-
-          /* ask the user what to do */
-          switch (mousepad_dialogs_externally_modified (GTK_WINDOW (window), TRUE, TRUE))
-            {
-              case MOUSEPAD_RESPONSE_CANCEL:
-                /* do nothing */
-                succeed = FALSE;
-                break;
-
-              case MOUSEPAD_RESPONSE_SAVE_AS:
-                /* run save as dialog */
-                g_action_group_activate_action (G_ACTION_GROUP (window), "file.save-as", NULL);
-                v_succeed = g_action_group_get_action_state (G_ACTION_GROUP (window), "file.save-as");
-                succeed = g_variant_get_int32 (v_succeed);
-                g_variant_unref (v_succeed);
-                break;
-
-              case MOUSEPAD_RESPONSE_SAVE:
-                /* force to save the document */
-                succeed = mousepad_file_save (document->file, TRUE, &error);
-                break;
-            }
-        }
-
-      /* other kind of error */
-      if (G_UNLIKELY (error != NULL))
-        {
-          mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to save the document"));
-          g_error_free (error);
-        }
-    }
-
-  /* store the save result as the action state */
-  g_action_change_state (G_ACTION (action), g_variant_new_int32 (succeed));
+  /* the result is stored as the action state once the document is saved */
+  mousepad_window_save_document (window, document, mousepad_window_action_save_ready, action);
 }
 
 
@@ -4687,67 +6633,229 @@ mousepad_window_action_save_as (GSimpleAction *action,
 {
   MousepadWindow   *window = MOUSEPAD_WINDOW (data);
   MousepadDocument *document = window->active;
-  MousepadEncoding  encoding, current_encoding = MOUSEPAD_ENCODING_NONE;
-  GAction          *action_save;
-  GVariant         *v_succeed;
-  GFile            *file, *current_file = NULL;
-  gboolean          succeed = FALSE;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
 
-  /* run the dialog */
-  if (mousepad_dialogs_save_as (GTK_WINDOW (window), document->file,
-                                last_save_location, &file, &encoding)
-      == GTK_RESPONSE_ACCEPT && G_LIKELY (file != NULL))
+  /* the result is stored as the action state once the document is saved */
+  mousepad_window_save_as_document (window, document, mousepad_window_action_save_ready, action);
+}
+
+
+
+/* the state of a save-all operation, documents are saved concurrently */
+typedef struct
+{
+  MousepadWindow    *window;
+  gboolean           destroyed;
+  GCancellable      *cancellable;
+  MousepadStatusbar *statusbar;
+  gint               current;
+
+  /* documents waiting to be saved and number of savings in progress */
+  GQueue            *pending;
+  guint              n_running;
+  guint              n_done;
+  guint              n_total;
+
+  /* documents to bother the user with later, and the first error met */
+  GSList            *documents;
+  MousepadDocument  *failed;
+  GError            *error;
+}
+MousepadWindowSaveAll;
+
+typedef struct
+{
+  MousepadWindowSaveAll *save_all;
+  MousepadDocument      *document;
+}
+MousepadWindowSaveAllItem;
+
+
+
+/* the documents of a save-all operation which need the user, saved one after the other */
+typedef struct
+{
+  GSList *documents;
+  gint    current;
+}
+MousepadWindowSaveQueue;
+
+
+
+static void
+mousepad_window_save_queue_next (MousepadWindow   *window,
+                                 MousepadDocument *document,
+                                 gint              succeed,
+                                 GError           *error,
+                                 gpointer          data)
+{
+  MousepadWindowSaveQueue *queue = data;
+  gint                     page_num;
+
+  /* break on problems */
+  while (succeed && queue->documents != NULL)
     {
-      /* keep a ref of the current file location to restore it in case of failure */
-      if (mousepad_file_location_is_set (document->file))
+      document = queue->documents->data;
+      queue->documents = g_slist_delete_link (queue->documents, queue->documents);
+
+      /* make sure the document is still there */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (document));
+      if (G_LIKELY (page_num > -1))
         {
-          current_file = g_object_ref (mousepad_file_get_location (document->file));
-          current_encoding = mousepad_file_get_encoding (document->file);
+          /* focus the tab we're going to save */
+          gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+          /* run the save as dialog, or save the externally modified document, the next
+           * one being saved once it is */
+          if (! mousepad_file_location_is_set (document->file)
+              || mousepad_file_get_read_only (document->file))
+            mousepad_window_save_as_document (window, document, mousepad_window_save_queue_next, queue);
+          else
+            mousepad_window_save_document (window, document, mousepad_window_save_queue_next, queue);
+
+          g_object_unref (document);
+          return;
         }
 
-      /* virtually set the new file location */
-      mousepad_file_set_location (document->file, file, FALSE);
-      mousepad_file_set_encoding (document->file, encoding);
+      g_object_unref (document);
+    }
 
-      /* save the file by an internal call (the save action may be disabled, depending
-       * on the file status) */
-      action_save = g_action_map_lookup_action (G_ACTION_MAP (window), "file.save");
-      mousepad_window_action_save (G_SIMPLE_ACTION (action_save), NULL, window);
-      v_succeed = g_action_group_get_action_state (G_ACTION_GROUP (window), "file.save");
-      succeed = g_variant_get_int32 (v_succeed);
-      g_variant_unref (v_succeed);
+  /* focus the original doc if everything went fine */
+  if (G_LIKELY (succeed))
+    gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), queue->current);
+
+  /* cleanup */
+  g_slist_free_full (queue->documents, g_object_unref);
+  g_slice_free (MousepadWindowSaveQueue, queue);
+}
+
+
+
+/* report the first problem met, or save the documents which need the user */
+static void
+mousepad_window_save_all_finish (MousepadWindowSaveAll *save_all)
+{
+  MousepadWindowSaveQueue *queue;
+  MousepadWindow          *window = save_all->window;
+  gint                     page_num;
+
+  /* hide the operation */
+  if (save_all->statusbar != NULL)
+    {
+      mousepad_statusbar_pop_progress (save_all->statusbar, save_all->cancellable);
+      g_object_unref (save_all->statusbar);
+    }
+
+  /* the window may have been destroyed during the saving */
+  if (G_UNLIKELY (save_all->error != NULL && ! save_all->destroyed))
+    {
+      /* focus the tab that triggered the problem */
+      page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), GTK_WIDGET (save_all->failed));
+      if (G_LIKELY (page_num > -1))
+        gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
+
+      /* show the error, unless the user cancelled the operation */
+      if (! g_error_matches (save_all->error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+        mousepad_dialogs_show_error (GTK_WINDOW (window), save_all->error,
+                                     _("Failed to save the document"));
+    }
+  else if (save_all->documents != NULL && ! save_all->destroyed)
+    {
+      /* open a dialog for each pending file */
+      queue = g_slice_new (MousepadWindowSaveQueue);
+      queue->documents = save_all->documents;
+      queue->current = save_all->current;
+      save_all->documents = NULL;
+      mousepad_window_save_queue_next (window, NULL, TRUE, NULL, queue);
+    }
+
+  /* cleanup */
+  if (save_all->error != NULL)
+    g_error_free (save_all->error);
+
+  if (save_all->failed != NULL)
+    g_object_unref (save_all->failed);
+
+  if (! save_all->destroyed)
+    mousepad_disconnect_by_func (window, g_cancellable_cancel, save_all->cancellable);
+
+  g_slist_free_full (save_all->documents, g_object_unref);
+  g_queue_free_full (save_all->pending, g_object_unref);
+  g_object_unref (save_all->cancellable);
+  mousepad_window_release (window, &save_all->destroyed);
+  g_slice_free (MousepadWindowSaveAll, save_all);
+}
+
+
+
+static void mousepad_window_save_all_next (MousepadWindowSaveAll *save_all);
 
-      if (G_LIKELY (succeed))
-        {
-          /* validate file location change */
-          mousepad_file_set_location (document->file, file, TRUE);
 
-          /* add to the recent history */
-          mousepad_window_recent_add (window, document->file);
 
-          /* update last save location */
-          if (last_save_location != NULL)
-            g_object_unref (last_save_location);
-          last_save_location = g_file_get_parent (file);
+static void
+mousepad_window_save_all_ready (GObject      *object,
+                                GAsyncResult *result,
+                                gpointer      data)
+{
+  MousepadWindowSaveAllItem *item = data;
+  MousepadWindowSaveAll     *save_all = item->save_all;
+  GError                    *error = NULL;
+
+  if (! mousepad_file_save_finish (MOUSEPAD_FILE (object), result, &error))
+    {
+      /* file has been externally modified: add it to the queue */
+      if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG))
+        {
+          g_error_free (error);
+          save_all->documents = g_slist_prepend (save_all->documents, g_object_ref (item->document));
         }
-      /* revert file location change */
-      else
+      /* keep the first other problem, and stop there */
+      else if (save_all->error == NULL)
         {
-          mousepad_file_set_location (document->file, current_file, FALSE);
-          mousepad_file_set_encoding (document->file, current_encoding);
+          save_all->error = error;
+          save_all->failed = g_object_ref (item->document);
         }
+      else
+        g_error_free (error);
+    }
 
-      /* cleanup */
-      g_object_unref (file);
-      if (G_IS_FILE (current_file))
-        g_object_unref (current_file);
+  /* update the progress */
+  save_all->n_running--;
+  save_all->n_done++;
+  mousepad_statusbar_set_progress (save_all->statusbar, (gdouble) save_all->n_done / save_all->n_total);
+
+  /* cleanup */
+  g_object_unref (item->document);
+  g_slice_free (MousepadWindowSaveAllItem, item);
+
+  mousepad_window_save_all_next (save_all);
+}
+
+
+
+static void
+mousepad_window_save_all_next (MousepadWindowSaveAll *save_all)
+{
+  MousepadWindowSaveAllItem *item;
+
+  /* start savings until the limit is reached, unless there was a problem */
+  while (save_all->error == NULL && save_all->n_running < MAX_PARALLEL_SAVES
+         && ! g_queue_is_empty (save_all->pending))
+    {
+      item = g_slice_new (MousepadWindowSaveAllItem);
+      item->save_all = save_all;
+      item->document = g_queue_pop_head (save_all->pending);
+      save_all->n_running++;
+
+      mousepad_file_save_async (item->document->file, FALSE, save_all->cancellable,
+                                mousepad_window_save_all_ready, item);
     }
 
-  /* store the save result as the action state */
-  g_action_change_state (G_ACTION (action), g_variant_new_int32 (succeed));
+  /* we're done when the last saving is completed */
+  if (save_all->n_running == 0)
+    mousepad_window_save_all_finish (save_all);
 }
 
 
@@ -4757,103 +6865,82 @@ mousepad_window_action_save_all (GSimpleAction *action,
                                  GVariant      *value,
                                  gpointer       data)
 {
-  MousepadWindow   *window = MOUSEPAD_WINDOW (data);
-  MousepadDocument *document;
-  GVariant         *v_succeed;
-  GSList           *li, *documents = NULL;
-  GError           *error = NULL;
-  const gchar      *action_name;
-  gboolean          succeed = TRUE;
-  gint              i, current, page_num;
+  MousepadWindow        *window = MOUSEPAD_WINDOW (data);
+  MousepadWindowSaveAll *save_all;
+  MousepadDocument      *document;
+  GtkWidget             *page;
+  gchar                 *message;
+  gint                   i;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
 
+  save_all = g_slice_new0 (MousepadWindowSaveAll);
+  save_all->window = window;
+
   /* get the current active tab */
-  current = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook));
+  save_all->current = gtk_notebook_get_current_page (GTK_NOTEBOOK (window->notebook));
 
   /* walk though all the document in the window */
+  save_all->pending = g_queue_new ();
   for (i = 0; i < gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook)); i++)
     {
-      /* get the document */
-      document = MOUSEPAD_DOCUMENT (gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i));
+      /* get the document, the lazy tabs have nothing to save */
+      page = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i);
+      if (! MOUSEPAD_IS_DOCUMENT (page))
+        continue;
 
       /* continue if the document is not modified */
+      document = MOUSEPAD_DOCUMENT (page);
       if (! gtk_text_buffer_get_modified (document->buffer))
         continue;
 
       /* we try to quickly save files, without bothering the user */
       if (mousepad_file_location_is_set (document->file)
           && ! mousepad_file_get_read_only (document->file))
-        {
-          /* try to save the file */
-          succeed = mousepad_file_save (document->file, FALSE, &error);
-
-          /* file has been externally modified: add it to a queue */
-          if (G_UNLIKELY (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_WRONG_ETAG)))
-            {
-              g_clear_error (&error);
-              documents = g_slist_prepend (documents, document);
-            }
-          /* break on other problems */
-          else if (G_UNLIKELY (! succeed))
-            break;
-        }
+        g_queue_push_tail (save_all->pending, g_object_ref (document));
       /* add the document to a queue to bother the user later */
       else
-        documents = g_slist_prepend (documents, document);
+        save_all->documents = g_slist_prepend (save_all->documents, g_object_ref (document));
     }
 
-  if (G_UNLIKELY (error != NULL))
+  /* keep the window alive, the savings are cancelled if it is closed meanwhile */
+  save_all->cancellable = g_cancellable_new ();
+  mousepad_window_hold (window, &save_all->destroyed);
+  g_signal_connect_swapped (window, "destroy", G_CALLBACK (g_cancellable_cancel), save_all->cancellable);
+
+  /* show the operation in the statusbar */
+  save_all->n_total = g_queue_get_length (save_all->pending);
+  if (save_all->n_total > 0)
     {
-      /* focus the tab that triggered the problem */
-      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), i);
+      save_all->statusbar = MOUSEPAD_STATUSBAR (g_object_ref (window->statusbar));
+      message = g_strdup_printf (ngettext ("Saving %d document...", "Saving %d documents...",
+                                           save_all->n_total), save_all->n_total);
+      mousepad_statusbar_push_progress (save_all->statusbar, message, save_all->cancellable);
+      g_free (message);
+    }
 
-      /* show the error */
-      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to save the document"));
+  /* save the documents concurrently, each one from a snapshot taken when it is its turn */
+  mousepad_window_save_all_next (save_all);
+}
 
-      /* free error */
-      g_error_free (error);
-    }
-  else
-    {
-      /* open a dialog for each pending file */
-      for (li = documents; li != NULL; li = li->next)
-        {
-          /* make sure the document is still there */
-          page_num = gtk_notebook_page_num (GTK_NOTEBOOK (window->notebook), li->data);
-          if (G_LIKELY (page_num > -1))
-            {
-              /* focus the tab we're going to save */
-              gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), page_num);
-
-              /* trigger the save as function */
-              document = MOUSEPAD_DOCUMENT (li->data);
-              if (! mousepad_file_location_is_set (document->file)
-                  || mousepad_file_get_read_only (document->file))
-                action_name = "file.save-as";
-              /* trigger the save function (externally modified document) */
-              else
-                action_name = "file.save";
-
-              g_action_group_activate_action (G_ACTION_GROUP (window), action_name, NULL);
-              v_succeed = g_action_group_get_action_state (G_ACTION_GROUP (window), action_name);
-              succeed = g_variant_get_int32 (v_succeed);
-              g_variant_unref (v_succeed);
-            }
 
-          /* break on problems */
-          if (G_UNLIKELY (! succeed))
-            break;
-        }
 
-      /* focus the origional doc if everything went fine */
-      if (G_LIKELY (li == NULL))
-        gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), current);
-    }
+static void
+mousepad_window_reload_ready (MousepadWindow   *window,
+                              MousepadDocument *document,
+                              gint              retval,
+                              GError           *error,
+                              gpointer          data)
+{
+  GtkWidget *textview = data;
 
-  /* cleanup */
-  g_slist_free (documents);
+  gtk_widget_set_sensitive (textview, TRUE);
+  g_object_unref (textview);
+
+  /* show the error, unless the user cancelled the operation */
+  if (G_UNLIKELY (retval != 0) && ! g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+    mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to reload the document"));
 }
 
 
@@ -4865,8 +6952,7 @@ mousepad_window_action_reload (GSimpleAction *action,
 {
   MousepadWindow   *window = MOUSEPAD_WINDOW (data);
   MousepadDocument *document = window->active;
-  GError           *error = NULL;
-  gint              retval;
+  GtkWidget        *textview;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
@@ -4896,21 +6982,14 @@ mousepad_window_action_reload (GSimpleAction *action,
         }
     }
 
-  /* lock the undo manager */
-  gtk_source_buffer_begin_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
+  /* prevent edition while the file is being compared with the buffer, the view being
+   * destroyed meanwhile if the document is closed */
+  textview = g_object_ref (document->textview);
+  gtk_widget_set_sensitive (textview, FALSE);
 
   /* reload the file */
-  retval = mousepad_file_open (document->file, TRUE, FALSE, FALSE, &error);
-
-  /* release the lock */
-  gtk_source_buffer_end_not_undoable_action (GTK_SOURCE_BUFFER (document->buffer));
-
-  if (G_UNLIKELY (retval != 0))
-    {
-      /* show the error */
-      mousepad_dialogs_show_error (GTK_WINDOW (window), error, _("Failed to reload the document"));
-      g_error_free (error);
-    }
+  mousepad_window_file_open (window, document, TRUE, TRUE, FALSE,
+                             mousepad_window_reload_ready, textview);
 }
 
 
@@ -4976,7 +7055,7 @@ mousepad_window_action_close (GSimpleAction *action,
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
 
   /* close active document */
-  mousepad_window_close_document (window, window->active);
+  mousepad_window_close_document (window, window->active, NULL, NULL);
 }
 
 
@@ -4987,54 +7066,11 @@ mousepad_window_action_close_window (GSimpleAction *action,
                                      gpointer       data)
 {
   MousepadWindow *window = MOUSEPAD_WINDOW (data);
-  GtkWidget      *document;
-  gint            npages, i;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
 
-  /* reset action state */
-  g_action_change_state (G_ACTION (action), g_variant_new_int32 (TRUE));
-
-  /* the window may be hidden without any document, e.g. when running the encoding
-   * dialog at startup */
-  if ((npages = gtk_notebook_get_n_pages (GTK_NOTEBOOK (window->notebook))) == 0)
-    {
-      gtk_widget_destroy (GTK_WIDGET (window));
-
-      return;
-    }
-
-  /* prevent menu updates */
-  lock_menu_updates++;
-
-  /* ask what to do with the modified document in this window */
-  for (i = npages - 1; i >= 0; --i)
-    {
-      /* get the document */
-      document = gtk_notebook_get_nth_page (GTK_NOTEBOOK (window->notebook), i);
-
-      /* check for debug builds */
-      g_return_if_fail (MOUSEPAD_IS_DOCUMENT (document));
-
-      /* focus the tab we're going to close */
-      gtk_notebook_set_current_page (GTK_NOTEBOOK (window->notebook), i);
-
-      /* close each document */
-      if (! mousepad_window_close_document (window, MOUSEPAD_DOCUMENT (document)))
-        {
-          /* closing cancelled, release menu lock */
-          lock_menu_updates--;
-
-          /* store the close result as the action state */
-          g_action_change_state (G_ACTION (action), g_variant_new_int32 (FALSE));
-
-          /* leave function */
-          return;
-        }
-    }
-
-  /* release lock */
-  lock_menu_updates--;
+  /* the close result is stored as the action state at the end */
+  mousepad_window_close (window, NULL, NULL);
 }
 
 
@@ -5699,11 +7735,28 @@ mousepad_window_action_go_to_position (GSimpleAction *action,
                                        gpointer       data)
 {
   MousepadWindow *window = MOUSEPAD_WINDOW (data);
+  MousepadPager  *pager;
+  guint64         line;
 
   g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
   g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
   g_return_if_fail (GTK_IS_TEXT_BUFFER (window->active->buffer));
 
+  /* a file viewed page by page is not entirely in the buffer, only lines can be reached */
+  pager = mousepad_document_get_pager (window->active);
+  if (pager != NULL)
+    {
+      line = mousepad_document_get_line (window->active);
+      if (mousepad_dialogs_go_to_line (GTK_WINDOW (window), &line,
+                                       mousepad_pager_get_n_lines (pager)))
+        {
+          mousepad_document_go_to_line (window->active, line);
+          mousepad_view_scroll_to_cursor (window->active->textview);
+        }
+
+      return;
+    }
+
   /* run jump dialog */
   if (mousepad_dialogs_go_to (GTK_WINDOW (window), window->active->buffer))
     {
@@ -6084,6 +8137,37 @@ mousepad_window_action_viewer_mode (GSimpleAction *action,
 
 
 
+static void
+mousepad_window_action_follow (GSimpleAction *action,
+                               GVariant      *value,
+                               gpointer       data)
+{
+  MousepadWindow *window = MOUSEPAD_WINDOW (data);
+  gboolean        state;
+
+  g_return_if_fail (MOUSEPAD_IS_WINDOW (window));
+  g_return_if_fail (MOUSEPAD_IS_DOCUMENT (window->active));
+
+  /* leave when menu updates are locked */
+  if (lock_menu_updates == 0)
+    {
+      /* avoid menu actions */
+      lock_menu_updates++;
+
+      /* set the current state */
+      state = ! g_variant_get_boolean (g_action_get_state (G_ACTION (action)));
+      g_action_change_state (G_ACTION (action), g_variant_new_boolean (state));
+
+      /* set new value */
+      mousepad_file_set_follow (window->active->file, state);
+
+      /* allow menu actions again */
+      lock_menu_updates--;
+    }
+}
+
+
+
 static void
 mousepad_window_action_prev_tab (GSimpleAction *action,
                                  GVariant      *value,
@@ -51,11 +51,26 @@ GtkWidget      *mousepad_window_new                        (MousepadApplication
 void            mousepad_window_add                        (MousepadWindow       *window,
                                                             MousepadDocument     *document);
 
-gint            mousepad_window_open_files                 (MousepadWindow       *window,
+void            mousepad_window_open_files                 (MousepadWindow       *window,
                                                             GFile               **files,
                                                             gint                  n_files,
                                                             MousepadEncoding      encoding,
-                                                            gboolean              must_exist);
+                                                            gboolean              must_exist,
+                                                            GAsyncReadyCallback   callback,
+                                                            gpointer              user_data);
+
+gint            mousepad_window_open_files_finish          (MousepadWindow       *window,
+                                                            GAsyncResult         *result);
+
+void            mousepad_window_close                      (MousepadWindow       *window,
+                                                            GAsyncReadyCallback   callback,
+                                                            gpointer              user_data);
+
+gboolean        mousepad_window_close_finish               (MousepadWindow       *window,
+                                                            GAsyncResult         *result);
+
+void            mousepad_window_recover                    (MousepadWindow       *window,
+                                                            gchar               **journals);
 
 void            mousepad_window_show_preferences           (MousepadWindow       *window);
 